@@ -102,10 +102,12 @@ SRC_COMMON= \
 	sv_main.c \
 	sv_move.c \
 	sv_phys.c \
+	sv_save.c \
 	sv_user.c \
 	svbsp.c \
 	svvm_cmds.c \
 	sys_shared.c \
+	taskqueue.c \
 	vid_shared.c \
 	view.c \
 	wad.c \
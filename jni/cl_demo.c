@@ -26,6 +26,9 @@ int old_vsync = 0;
 
 static void CL_FinishTimeDemo (void);
 
+// demos bigger than this are still read from disk with cl_demo_preload
+#define CL_DEMO_PRELOADMAX (64 << 20)
+
 /*
 ==============================================================================
 
@@ -88,6 +91,10 @@ void CL_StopPlayback (void)
 	FS_Close (cls.demofile);
 	cls.demoplayback = false;
 	cls.demofile = NULL;
+	if (cls.demodata)
+		Mem_Free(cls.demodata);
+	cls.demodata = NULL;
+	cls.demo_seeking = false;
 
 	if (cls.timedemo)
 		CL_FinishTimeDemo ();
@@ -175,6 +182,18 @@ void CL_PasteDemo (unsigned char **buf, fs_offset_t *filesize)
 	*filesize = 0;
 }
 
+/*
+====================
+CL_DemoSeekDone
+
+true once a demoseek has parsed everything before its target
+====================
+*/
+static qboolean CL_DemoSeekDone(void)
+{
+	return cls.signon == SIGNONS && cl.mtime[0] >= cls.demo_seektime;
+}
+
 /*
 ====================
 CL_ReadDemoMessage
@@ -196,12 +215,24 @@ void CL_ReadDemoMessage(void)
 
 	for (;;)
 	{
+		if (cls.demo_seeking && CL_DemoSeekDone())
+		{
+			cls.demo_seeking = false;
+			Con_DPrintf("demoseek: at %f\n", cl.mtime[0]);
+		}
+
 		// decide if it is time to grab the next message
-		// always grab until fully connected
-		if (cls.signon == SIGNONS)
+		// always grab until fully connected, and while seeking
+		if (cls.signon == SIGNONS && !cls.demo_seeking)
 		{
 			if (cls.timedemo)
 			{
+				// end of the timedemo window
+				if (cls.td_endtime > 0 && cl.mtime[0] >= cls.td_endtime)
+				{
+					CL_Disconnect();
+					return;
+				}
 				cls.td_frames++;
 				cls.td_onesecondframes++;
 				// if this is the first official frame we can now grab the real
@@ -277,7 +308,7 @@ void CL_ReadDemoMessage(void)
 			if (!cls.demoplayback)
 				return;
 
-			if (cls.timedemo)
+			if (cls.timedemo && !cls.demo_seeking)
 				return;
 		}
 		else
@@ -398,36 +429,49 @@ void CL_Record_f (void)
 	cls.demo_lastcsprogscrc = -1;
 }
 
-
 /*
 ====================
-CL_PlayDemo_f
+CL_PlayDemo
 
-play [demoname]
+opens a demo (into memory with cl_demo_preload)
 ====================
 */
-void CL_PlayDemo_f (void)
+static qboolean CL_PlayDemo (const char *demoname)
 {
 	char	name[MAX_QPATH];
 	int c;
 	qboolean neg = false;
 	qfile_t *f;
-
-	if (Cmd_Argc() != 2)
-	{
-		Con_Print("play <demoname> : plays a demo\n");
-		return;
-	}
+	unsigned char *data = NULL;
+	fs_offset_t filesize;
 
 	// open the demo file
-	strlcpy (name, Cmd_Argv(1), sizeof (name));
+	strlcpy (name, demoname, sizeof (name));
 	FS_DefaultExtension (name, ".dem", sizeof (name));
 	f = FS_OpenVirtualFile(name, false);
 	if (!f)
 	{
 		Con_Printf("ERROR: couldn't open %s.\n", name);
 		cls.demonum = -1;		// stop demo loop
-		return;
+		return false;
+	}
+
+	// one big read instead of a few small ones per message
+	filesize = FS_FileSize(f);
+	if (cl_demo_preload.integer && filesize > 0 && filesize <= CL_DEMO_PRELOADMAX)
+	{
+		data = (unsigned char *)Mem_Alloc(cls.permanentmempool, filesize);
+		if (FS_Read(f, data, filesize) == filesize)
+		{
+			FS_Close(f);
+			f = FS_FileFromData(data, filesize, false);
+		}
+		else
+		{
+			Mem_Free(data);
+			data = NULL;
+			FS_Seek(f, 0, SEEK_SET);
+		}
 	}
 
 	cls.demostarting = true;
@@ -443,6 +487,7 @@ void CL_PlayDemo_f (void)
 
 	Con_Printf("Playing demo %s.\n", name);
 	cls.demofile = f;
+	cls.demodata = data;
 	strlcpy(cls.demoname, name, sizeof(cls.demoname));
 
 	cls.demoplayback = true;
@@ -459,6 +504,74 @@ void CL_PlayDemo_f (void)
 		cls.forcetrack = -cls.forcetrack;
 
 	cls.demostarting = false;
+	return true;
+}
+
+/*
+====================
+CL_PlayDemo_f
+
+play [demoname]
+====================
+*/
+void CL_PlayDemo_f (void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Con_Print("play <demoname> : plays a demo\n");
+		return;
+	}
+
+	CL_PlayDemo(Cmd_Argv(1));
+}
+
+/*
+====================
+CL_DemoSeek_Start
+
+parse ahead without drawing until time (client state has no snapshot, so
+going back restarts the demo)
+====================
+*/
+static void CL_DemoSeek_Start (double time)
+{
+	if (cls.signon == SIGNONS && time < cl.mtime[0])
+	{
+		char name[MAX_QPATH];
+		strlcpy(name, cls.demoname, sizeof(name));
+		if (!CL_PlayDemo(name))
+			return;
+	}
+
+	cls.demo_seeking = true;
+	cls.demo_seektime = time;
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demoseek <time>
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Con_Print("demoseek <time> : jumps to a server time in the demo being played\n");
+		return;
+	}
+	if (!cls.demoplayback)
+	{
+		Con_Print("Not playing a demo.\n");
+		return;
+	}
+	if (cls.timedemo)
+	{
+		Con_Print("demoseek: use the timedemo start time instead\n");
+		return;
+	}
+	CL_DemoSeek_Start(atof(Cmd_Argv(1)));
 }
 
 typedef struct
@@ -526,7 +639,7 @@ static void CL_FinishTimeDemo (void)
 			if(atoi(com_argv[i + 1]) > benchmark_runs)
 			{
 				// restart the benchmark
-				Cbuf_AddText(va(vabuf, sizeof(vabuf), "timedemo %s\n", cls.demoname));
+				Cbuf_AddText(va(vabuf, sizeof(vabuf), "timedemo %s %f %f\n", cls.demoname, cls.td_starttime_server, cls.td_endtime));
 				// cannot execute here
 			}
 			else
@@ -587,20 +700,27 @@ static void CL_FinishTimeDemo (void)
 ====================
 CL_TimeDemo_f
 
-timedemo [demoname]
+timedemo [demoname] [starttime] [endtime]
 ====================
 */
 void CL_TimeDemo_f (void)
 {
-	if (Cmd_Argc() != 2)
+	if (Cmd_Argc() < 2 || Cmd_Argc() > 4)
 	{
-		Con_Print("timedemo <demoname> : gets demo speeds\n");
+		Con_Print("timedemo <demoname> [<starttime> [<endtime>]] : gets demo speeds, optionally only between two server times\n");
 		return;
 	}
 
 	srand(0); // predictable random sequence for benchmarking
 
-	CL_PlayDemo_f ();
+	if (!CL_PlayDemo (Cmd_Argv(1)))
+		return;
+
+	// frames are only counted once the start time is reached
+	cls.td_starttime_server = Cmd_Argc() > 2 ? atof(Cmd_Argv(2)) : 0;
+	cls.td_endtime = Cmd_Argc() > 3 ? atof(Cmd_Argv(3)) : 0;
+	if (cls.td_starttime_server > 0)
+		CL_DemoSeek_Start(cls.td_starttime_server);
 
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
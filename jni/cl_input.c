@@ -449,6 +449,9 @@ cvar_t cl_anglespeedkey = {CVAR_SAVE, "cl_anglespeedkey","1.5","how much +speed
 
 cvar_t cl_movement = {CVAR_SAVE, "cl_movement", "0", "enables clientside prediction of your player movement"};
 cvar_t cl_movement_replay = {0, "cl_movement_replay", "1", "use engine prediction"};
+cvar_t cl_movement_replay_cache = {CVAR_SAVE, "cl_movement_replay_cache", "1", "keep the predicted state after each sent move and only simulate new moves while the server agrees with the prediction (full replay on a mismatch)"};
+cvar_t cl_movement_replay_cache_origin = {0, "cl_movement_replay_cache_origin", "0.125", "how far the server origin may be from the cached prediction before the moves are replayed (network coordinate precision)"};
+cvar_t cl_movement_replay_cache_velocity = {0, "cl_movement_replay_cache_velocity", "16", "how far the server velocity may be from the cached prediction before the moves are replayed (network velocity precision)"};
 cvar_t cl_movement_nettimeout = {CVAR_SAVE, "cl_movement_nettimeout", "0.3", "stops predicting moves when server is lagging badly (avoids major performance problems), timeout in seconds"};
 cvar_t cl_movement_minping = {CVAR_SAVE, "cl_movement_minping", "0", "whether to use prediction when ping is lower than this value in milliseconds"};
 cvar_t cl_movement_track_canjump = {CVAR_SAVE, "cl_movement_track_canjump", "1", "track if the player released the jump key between two jumps to decide if he is able to jump or not; when off, this causes some \"sliding\" slightly above the floor when the jump key is held too long; if the mod allows repeated jumping by holding space all the time, this has to be set to zero too"};
@@ -1608,11 +1611,75 @@ void CL_ClientMovement_PlayerMove_Frame(cl_clientmovement_state_t *s)
 	}
 }
 
+// predicted state after each sent move, in slot sequence % CL_MAX_USERCMDS
+// (s.cmd.sequence tells which move it is, 0 for an empty slot)
+static cl_clientmovement_state_t cl_movement_cache[CL_MAX_USERCMDS];
+static unsigned int cl_movement_cache_ackedsequence;
+
+typedef struct cl_movement_cachestats_s
+{
+	int replays; // prediction updates
+	int mispredictions; // server disagreed with the cached move, full replay
+	int simulatedmoves;
+	int reusedmoves;
+	double errorsum; // origin error of the mispredictions
+	double errormax;
+}
+cl_movement_cachestats_t;
+static cl_movement_cachestats_t cl_movement_cachestats;
+
+static void CL_ClientMovement_ClearCache(void)
+{
+	memset(cl_movement_cache, 0, sizeof(cl_movement_cache));
+}
+
+static void CL_ClientMovement_Stats_f(void)
+{
+	cl_movement_cachestats_t *st = &cl_movement_cachestats;
+	Con_Printf("%i prediction updates, %i moves simulated, %i reused from the cache\n", st->replays, st->simulatedmoves, st->reusedmoves);
+	Con_Printf("%i mispredictions, origin error avg %.3f max %.3f\n", st->mispredictions, st->mispredictions ? st->errorsum / st->mispredictions : 0, st->errormax);
+	memset(st, 0, sizeof(*st));
+}
+
+/*
+==============
+CL_ClientMovement_CheckCache
+
+compares the cached prediction of the newest acknowledged move with the
+state the server sent for it, and drops the cache when they disagree
+==============
+*/
+static qboolean CL_ClientMovement_CheckCache(const cl_clientmovement_state_t *server)
+{
+	const cl_clientmovement_state_t *c;
+	double error;
+
+	// a new connection starts the sequence numbers over
+	if (cls.servermovesequence < cl_movement_cache_ackedsequence)
+		CL_ClientMovement_ClearCache();
+	cl_movement_cache_ackedsequence = cls.servermovesequence;
+
+	c = &cl_movement_cache[cls.servermovesequence % CL_MAX_USERCMDS];
+	if (c->cmd.sequence != cls.servermovesequence)
+		return false;
+	error = VectorDistance(c->origin, server->origin);
+	if (error > cl_movement_replay_cache_origin.value || VectorDistance(c->velocity, server->velocity) > cl_movement_replay_cache_velocity.value)
+	{
+		cl_movement_cachestats.mispredictions++;
+		cl_movement_cachestats.errorsum += error;
+		cl_movement_cachestats.errormax = max(cl_movement_cachestats.errormax, error);
+		CL_ClientMovement_ClearCache();
+		return false;
+	}
+	return true;
+}
+
 void CL_ClientMovement_Replay(void)
 {
 	int i;
 	double totalmovemsec;
-	cl_clientmovement_state_t s;
+	cl_clientmovement_state_t s, *c;
+	qboolean usecache;
 
 	VectorCopy(cl.mvelocity[0], cl.movement_velocity);
 
@@ -1642,6 +1709,11 @@ void CL_ClientMovement_Replay(void)
 		// replay the input queue to predict current location
 		// note: this relies on the fact there's always one queue item at the end
 
+		// the moves after the acknowledged one can be taken from the cache
+		// as long as the server ended up where we predicted it would
+		usecache = cl_movement_replay_cache.integer && CL_ClientMovement_CheckCache(&s);
+		cl_movement_cachestats.replays++;
+
 		// find how many are still valid
 		for (i = 0;i < CL_MAX_USERCMDS;i++)
 			if (cl.movecmd[i].sequence <= cls.servermovesequence)
@@ -1649,6 +1721,18 @@ void CL_ClientMovement_Replay(void)
 		// now walk them in oldest to newest order
 		for (i--;i >= 0;i--)
 		{
+			// movecmd[0] is still being built, so it is never cached
+			c = &cl_movement_cache[cl.movecmd[i].sequence % CL_MAX_USERCMDS];
+			if (usecache && i > 0 && c->cmd.sequence == cl.movecmd[i].sequence)
+			{
+				s = *c;
+				cl.movecmd[i].canjump = s.cmd.canjump;
+				cl_movement_cachestats.reusedmoves++;
+				continue;
+			}
+			// everything after a simulated move has to be simulated as well
+			usecache = false;
+
 			s.cmd = cl.movecmd[i];
 			if (i < CL_MAX_USERCMDS - 1)
 				s.cmd.canjump = cl.movecmd[i+1].canjump;
@@ -1656,6 +1740,9 @@ void CL_ClientMovement_Replay(void)
 			CL_ClientMovement_PlayerMove_Frame(&s);
 
 			cl.movecmd[i].canjump = s.cmd.canjump;
+			cl_movement_cachestats.simulatedmoves++;
+			if (i > 0 && cl_movement_replay_cache.integer)
+				*c = s;
 		}
 		//Con_Printf("\n");
 		CL_ClientMovement_UpdateStatus(&s);
@@ -1753,6 +1840,8 @@ void CL_RotateMoves(const matrix4x4_t *m)
 	vec3_t v;
 	vec3_t f, r, u;
 	int i;
+	// the cached predictions used the old angles
+	CL_ClientMovement_ClearCache();
 	for (i = 0;i < CL_MAX_USERCMDS;i++)
 	{
 		if (cl.movecmd[i].sequence > cls.servermovesequence)
@@ -2248,6 +2337,7 @@ void CL_InitInput (void)
 	Cmd_AddCommand ("cycleweapon", IN_CycleWeapon, "send an impulse number to server to select the next usable weapon out of several (example: 9 4 8) if you are holding one of these, and choose the first one if you are holding none of these");
 #endif
 	Cmd_AddCommand ("register_bestweapon", IN_BestWeapon_Register_f, "(for QC usage only) change weapon parameters to be used by bestweapon; stuffcmd this in ClientConnect");
+	Cmd_AddCommand ("movementstats", CL_ClientMovement_Stats_f, "print and reset the prediction cache statistics (cl_movement_replay_cache)");
 
 	Cvar_RegisterVariable(&cl_yawmode);
 	Cvar_RegisterVariable(&cl_pitchmode);
@@ -2260,6 +2350,9 @@ void CL_InitInput (void)
 	Cvar_RegisterVariable(&cl_movecliptokeyboard);
 	Cvar_RegisterVariable(&cl_movement);
 	Cvar_RegisterVariable(&cl_movement_replay);
+	Cvar_RegisterVariable(&cl_movement_replay_cache);
+	Cvar_RegisterVariable(&cl_movement_replay_cache_origin);
+	Cvar_RegisterVariable(&cl_movement_replay_cache_velocity);
 	Cvar_RegisterVariable(&cl_movement_nettimeout);
 	Cvar_RegisterVariable(&cl_movement_minping);
 	Cvar_RegisterVariable(&cl_movement_track_canjump);
@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "r_shadow.h"
 #include "libcurl.h"
 #include "snd_main.h"
+#include "taskqueue.h"
 
 // we need to declare some mouse variables here, because the menu system
 // references them even when on a unix system.
@@ -39,6 +40,7 @@ cvar_t csqc_usedemoprogs = {0, "csqc_usedemoprogs","1","use csprogs stored in de
 cvar_t cl_shownet = {0, "cl_shownet","0","1 = print packet size, 2 = print packet message list"};
 cvar_t cl_nolerp = {0, "cl_nolerp", "0","network update smoothing"};
 cvar_t cl_lerpexcess = {0, "cl_lerpexcess", "0","maximum allowed lerp excess (hides, not fixes, some packet loss)"};
+cvar_t cl_entities_threaded = {CVAR_SAVE, "cl_entities_threaded", "1", "interpolate network entities in parallel on the taskqueue worker threads when there are many of them (trails are still spawned in order afterwards)"};
 cvar_t cl_lerpanim_maxdelta_server = {0, "cl_lerpanim_maxdelta_server", "0.1","maximum frame delta for smoothing between server-controlled animation frames (when 0, one network frame)"};
 cvar_t cl_lerpanim_maxdelta_framegroups = {0, "cl_lerpanim_maxdelta_framegroups", "0.1","maximum frame delta for smoothing between framegroups (when 0, one network frame)"};
 
@@ -60,6 +62,7 @@ cvar_t cl_nosplashscreen = {CVAR_SAVE, "cl_nosplashscreen", "0", "prevents the c
 
 cvar_t cl_autodemo = {CVAR_SAVE, "cl_autodemo", "0", "records every game played, using the date/time and map name to name the demo file" };
 cvar_t cl_autodemo_nameformat = {CVAR_SAVE, "cl_autodemo_nameformat", "autodemos/%Y-%m-%d_%H-%M", "The format of the cl_autodemo filename, followed by the map name (the date is encoded using strftime escapes)" };
+cvar_t cl_demo_preload = {CVAR_SAVE, "cl_demo_preload", "1", "read the whole demo file into memory when playing it back instead of reading each message from disk"};
 cvar_t cl_autodemo_delete = {0, "cl_autodemo_delete", "0", "Delete demos after recording.  This is a bitmask, bit 1 gives the default, bit 0 the value for the current demo.  Thus, the values are: 0 = disabled; 1 = delete current demo only; 2 = delete all demos except the current demo; 3 = delete all demos from now on" };
 
 cvar_t r_draweffects = {0, "r_draweffects", "1","renders temporary sprite effects"};
@@ -347,6 +350,8 @@ void CL_Disconnect(void)
 	CL_VM_ShutDown();
 // stop sounds (especially looping!)
 	S_StopAllSounds ();
+	// a Host_Error can leave a precache batch unfinished
+	S_EndPrecaching ();
 
 	cl.parsingtextexpectingpingforscores = 0; // just in case no reply has come yet
 
@@ -1322,17 +1327,41 @@ static void CL_UpdateNetworkCollisionEntities(void)
 	}
 }
 
+#define CL_MAXENTITYTASKS 16
+// fewer entities than this per task are not worth the threading overhead
+#define CL_ENTITYTASK_MINENTITIES 64
+
+// active entity numbers of this frame, untagged ones first and the tagged
+// ones (which update their parents too) from the end of the array down
+static int cl_updateentitynumbers[MAX_EDICTS];
+static taskqueue_task_t cl_updateentitytasks[CL_MAXENTITYTASKS];
+
+static void CL_UpdateNetworkEntities_Task(taskqueue_task_t *task)
+{
+	size_t i;
+	// each untagged entity only writes its own render state, so the ranges
+	// do not overlap
+	for (i = task->i[0];i < task->i[1];i++)
+		CL_UpdateNetworkEntity(cl.entities + cl_updateentitynumbers[i], 32, true);
+}
+
 /*
 ===============
 CL_UpdateNetworkEntities
+
+interpolates the untagged network entities in parallel when there are many,
+then the attached ones and all the trails serially in entity number order
+so the particle spawns come out the same as a single threaded update
 ===============
 */
 static void CL_UpdateNetworkEntities(void)
 {
 	entity_t *ent;
-	int i;
+	int i, numuntagged, firsttagged, untagged, tagged, numtasks, count;
 
 	// start on the entity after the world
+	numuntagged = 0;
+	firsttagged = MAX_EDICTS;
 	for (i = 1;i < cl.num_entities;i++)
 	{
 		if (cl.entities_active[i])
@@ -1340,10 +1369,10 @@ static void CL_UpdateNetworkEntities(void)
 			ent = cl.entities + i;
 			if (ent->state_current.active)
 			{
-				CL_UpdateNetworkEntity(ent, 32, true);
-				// view models should never create light/trails
-				if (!(ent->render.flags & RENDER_VIEWMODEL))
-					CL_UpdateNetworkEntityTrail(ent);
+				if (ent->state_current.tagentity)
+					cl_updateentitynumbers[--firsttagged] = i;
+				else
+					cl_updateentitynumbers[numuntagged++] = i;
 			}
 			else
 			{
@@ -1352,6 +1381,42 @@ static void CL_UpdateNetworkEntities(void)
 			}
 		}
 	}
+
+	numtasks = 1;
+	if (cl_entities_threaded.integer && TaskQueue_NumThreads() > 1 && numuntagged >= CL_ENTITYTASK_MINENTITIES * 2)
+		numtasks = min(min(TaskQueue_NumThreads(), CL_MAXENTITYTASKS), numuntagged / CL_ENTITYTASK_MINENTITIES);
+	if (numtasks > 1)
+	{
+		count = (numuntagged + numtasks - 1) / numtasks;
+		for (i = 0;i < numtasks;i++)
+			TaskQueue_Setup(&cl_updateentitytasks[i], CL_UpdateNetworkEntities_Task, min(i * count, numuntagged), min((i + 1) * count, numuntagged), NULL, NULL);
+		TaskQueue_Enqueue(numtasks, cl_updateentitytasks);
+		for (i = 0;i < numtasks;i++)
+			TaskQueue_WaitForTaskDone(&cl_updateentitytasks[i]);
+	}
+	else
+	{
+		for (i = 0;i < numuntagged;i++)
+			CL_UpdateNetworkEntity(cl.entities + cl_updateentitynumbers[i], 32, true);
+	}
+
+	// attached entities recurse into their tag entity, which may be another
+	// attached one, so they stay on this thread (the parents are done already)
+	for (i = MAX_EDICTS - 1;i >= firsttagged;i--)
+		CL_UpdateNetworkEntity(cl.entities + cl_updateentitynumbers[i], 32, true);
+
+	// trails spawn particles and temp entities, merge both lists back into
+	// entity number order for them
+	for (untagged = 0, tagged = MAX_EDICTS - 1;untagged < numuntagged || tagged >= firsttagged;)
+	{
+		if (tagged >= firsttagged && (untagged >= numuntagged || cl_updateentitynumbers[tagged] < cl_updateentitynumbers[untagged]))
+			ent = cl.entities + cl_updateentitynumbers[tagged--];
+		else
+			ent = cl.entities + cl_updateentitynumbers[untagged++];
+		// view models should never create light/trails
+		if (!(ent->render.flags & RENDER_VIEWMODEL))
+			CL_UpdateNetworkEntityTrail(ent);
+	}
 }
 
 static void CL_UpdateViewModel(void)
@@ -1937,7 +2002,9 @@ void CL_UpdateWorld(void)
 		CL_RelinkLightFlashes();
 		CSQC_RelinkAllEntities(ENTMASK_ENGINE | ENTMASK_ENGINEVIEWMODELS);
 
-		// decals, particles, and explosions will be updated during rneder
+		// move particles once per frame, they are only culled and queued
+		// for each view during render (decals and explosions still update there)
+		CL_UpdateParticles();
 	}
 
 	r_refdef.scene.time = cl.time;
@@ -2413,6 +2480,7 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_shownet);
 	Cvar_RegisterVariable (&cl_nolerp);
 	Cvar_RegisterVariable (&cl_lerpexcess);
+	Cvar_RegisterVariable (&cl_entities_threaded);
 	Cvar_RegisterVariable (&cl_lerpanim_maxdelta_server);
 	Cvar_RegisterVariable (&cl_lerpanim_maxdelta_framegroups);
 	Cvar_RegisterVariable (&cl_deathfade);
@@ -2434,7 +2502,8 @@ void CL_Init (void)
 	Cmd_AddCommand ("record", CL_Record_f, "record a demo");
 	Cmd_AddCommand ("stop", CL_Stop_f, "stop recording or playing a demo");
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f, "watch a demo file");
-	Cmd_AddCommand ("timedemo", CL_TimeDemo_f, "play back a demo as fast as possible and save statistics to benchmark.log");
+	Cmd_AddCommand ("timedemo", CL_TimeDemo_f, "play back a demo as fast as possible and save statistics to benchmark.log (optional server start and end time to only measure part of it)");
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f, "jump to a server time in the demo being played");
 
 	// Support Client-side Model Index List
 	Cmd_AddCommand ("cl_modelindexlist", CL_ModelIndexList_f, "list information on all models in the client modelindex");
@@ -2447,6 +2516,7 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_autodemo);
 	Cvar_RegisterVariable (&cl_autodemo_nameformat);
 	Cvar_RegisterVariable (&cl_autodemo_delete);
+	Cvar_RegisterVariable (&cl_demo_preload);
 
 	Cmd_AddCommand ("fog", CL_Fog_f, "set global fog parameters (density red green blue [alpha [mindist [maxdist [top [fadedepth]]]]])");
 	Cmd_AddCommand ("fog_heighttexture", CL_Fog_HeightTexture_f, "set global fog parameters (density red green blue alpha mindist maxdist top depth textures/mapname/fogheight.tga)");
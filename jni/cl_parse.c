@@ -696,6 +696,7 @@ static void QW_CL_RequestNextDownload(void)
 		S_ClearUsed();
 
 		// precache any sounds used by the client
+		S_BeginPrecaching();
 		cl.sfx_wizhit = S_PrecacheSound(cl_sound_wizardhit.string, false, true);
 		cl.sfx_knighthit = S_PrecacheSound(cl_sound_hknighthit.string, false, true);
 		cl.sfx_tink1 = S_PrecacheSound(cl_sound_tink1.string, false, true);
@@ -707,6 +708,7 @@ static void QW_CL_RequestNextDownload(void)
 		// sounds used by the game
 		for (i = 1;i < MAX_SOUNDS && cl.sound_name[i][0];i++)
 			cl.sound_precache[i] = S_PrecacheSound(cl.sound_name[i], true, true);
+		S_EndPrecaching();
 
 		// we purge the models and sounds later in CL_SignonReply
 		//S_PurgeUnused();
@@ -1198,6 +1200,7 @@ static void CL_BeginDownloads(qboolean aborteddownload)
 				+	cl.loadsound_total * LOADPROGRESSWEIGHT_SOUND
 				)
 			);
+		S_BeginPrecaching();
 		for (;cl.loadsound_current < cl.loadsound_total;cl.loadsound_current++)
 		{
 			SCR_PushLoadingScreen(false, cl.sound_name[cl.loadsound_current], 1.0 / cl.loadsound_total);
@@ -1210,6 +1213,7 @@ static void CL_BeginDownloads(qboolean aborteddownload)
 			cl.sound_precache[cl.loadsound_current] = S_PrecacheSound(cl.sound_name[cl.loadsound_current], false, true);
 			SCR_PopLoadingScreen(false);
 		}
+		S_EndPrecaching();
 		SCR_PopLoadingScreen(false);
 		// finished loading sounds
 	}
@@ -1859,6 +1863,7 @@ static void CL_ParseServerInfo (void)
 		S_ClearUsed();
 
 		// precache any sounds used by the client
+		S_BeginPrecaching();
 		cl.sfx_wizhit = S_PrecacheSound(cl_sound_wizardhit.string, false, true);
 		cl.sfx_knighthit = S_PrecacheSound(cl_sound_hknighthit.string, false, true);
 		cl.sfx_tink1 = S_PrecacheSound(cl_sound_tink1.string, false, true);
@@ -1870,6 +1875,7 @@ static void CL_ParseServerInfo (void)
 		// sounds used by the game
 		for (i = 1;i < MAX_SOUNDS && cl.sound_name[i][0];i++)
 			cl.sound_precache[i] = S_PrecacheSound(cl.sound_name[i], true, true);
+		S_EndPrecaching();
 
 		// now we try to load everything that is new
 		cl.loadmodel_current = 1;
@@ -23,6 +23,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "cl_collision.h"
 #include "image.h"
 #include "r_shadow.h"
+#include "taskqueue.h"
+
+extern cvar_t mod_collision_bih;
 
 // must match ptype_t values
 particletype_t particletype[pt_total] =
@@ -296,6 +299,8 @@ cvar_t cl_particles_sparks = {CVAR_SAVE, "cl_particles_sparks", "1", "enables sp
 cvar_t cl_particles_bubbles = {CVAR_SAVE, "cl_particles_bubbles", "1", "enables bubbles (used by multiple effects)"};
 cvar_t cl_particles_visculling = {CVAR_SAVE, "cl_particles_visculling", "0", "perform a costly check if each particle is visible before drawing"};
 cvar_t cl_particles_collisions = {CVAR_SAVE, "cl_particles_collisions", "1", "allow costly collision detection on particles (sparks that bounce, particles not going through walls, blood hitting surfaces, etc)"};
+cvar_t cl_particles_evict = {CVAR_SAVE, "cl_particles_evict", "1", "what to replace when the particle or decal pool is full: 0 = drop the new one, 1 = the oldest, 2 = the most distant from the view, 3 = the smallest (a few candidates are compared per spawn, not the whole pool)"};
+cvar_t cl_particles_threaded = {CVAR_SAVE, "cl_particles_threaded", "1", "move particles in parallel on the taskqueue worker threads when there are many of them (not on q3bsp maps with mod_collision_bih 0)"};
 cvar_t cl_decals = {CVAR_SAVE, "cl_decals", "1", "enables decals (bullet holes, blood, etc)"};
 cvar_t cl_decals_visculling = {CVAR_SAVE, "cl_decals_visculling", "1", "perform a very cheap check if each decal is visible before drawing"};
 cvar_t cl_decals_time = {CVAR_SAVE, "cl_decals_time", "20", "how long before decals start to fade away"};
@@ -595,6 +600,8 @@ void CL_Particles_Init (void)
 	Cvar_RegisterVariable (&cl_particles_bubbles);
 	Cvar_RegisterVariable (&cl_particles_visculling);
 	Cvar_RegisterVariable (&cl_particles_collisions);
+	Cvar_RegisterVariable (&cl_particles_threaded);
+	Cvar_RegisterVariable (&cl_particles_evict);
 	Cvar_RegisterVariable (&cl_decals);
 	Cvar_RegisterVariable (&cl_decals_visculling);
 	Cvar_RegisterVariable (&cl_decals_time);
@@ -615,6 +622,56 @@ void CL_Particles_Shutdown (void)
 void CL_SpawnDecalParticleForSurface(int hitent, const vec3_t org, const vec3_t normal, int color1, int color2, int texnum, float size, float alpha);
 void CL_SpawnDecalParticleForPoint(const vec3_t org, float maxdist, float size, float alpha, int texnum, int color1, int color2);
 
+// number of pool entries compared when picking one to evict
+#define CL_EVICT_CANDIDATES 32
+
+/*
+===============
+CL_EvictParticle
+
+returns a live particle to overwrite when cl.particles is at its size limit,
+chosen by cl_particles_evict among the next few particles of the pool
+===============
+*/
+static particle_t *CL_EvictParticle(void)
+{
+	int i, j, best = -1;
+	float score, bestscore = 0;
+	float spawntime = cl.time;
+	particle_t *p;
+
+	if (cl_particles_evict.integer <= 0 || !cl.num_particles)
+		return NULL;
+	for (i = 0;i < CL_EVICT_CANDIDATES;i++)
+	{
+		j = (cl.evict_particle + i) % cl.num_particles;
+		p = cl.particles + j;
+		// the caller of CL_NewParticle may still hold particles it spawned
+		// this frame (rain spawns its splashes while setting up the drop)
+		if (p->delayedspawn == spawntime)
+			continue;
+		switch (cl_particles_evict.integer)
+		{
+		case 1:
+			score = -p->delayedspawn;
+			break;
+		case 2:
+			score = VectorDistance2(p->org, r_refdef.view.origin);
+			break;
+		default:
+			score = -p->size;
+			break;
+		}
+		if (best < 0 || bestscore < score)
+		{
+			best = j;
+			bestscore = score;
+		}
+	}
+	cl.evict_particle = (cl.evict_particle + CL_EVICT_CANDIDATES) % cl.num_particles;
+	return best >= 0 ? cl.particles + best : NULL;
+}
+
 // list of all 26 parameters:
 // ptype - any of the pt_ enum values (pt_static, pt_blood, etc), see ptype_t near the top of this file
 // pcolor1,pcolor2 - minimum and maximum ranges of color, randomly interpolated to decide particle color
@@ -643,14 +700,12 @@ particle_t *CL_NewParticle(const vec3_t sortorigin, unsigned short ptypeindex, i
 	vec3_t v;
 	if (!cl_particles.integer)
 		return NULL;
-	for (;cl.free_particle < cl.max_particles && cl.particles[cl.free_particle].typeindex;cl.free_particle++);
-	if (cl.free_particle >= cl.max_particles)
-		return NULL;
+	if (cl.num_particles < cl.max_particles)
+		part = &cl.particles[cl.num_particles++];
+	else if (cl.max_particles < MAX_PARTICLES || !(part = CL_EvictParticle()))
+		return NULL; // the pool grows at the next CL_UpdateParticles
 	if (!lifetime)
 		lifetime = palpha / min(1, palphafade);
-	part = &cl.particles[cl.free_particle++];
-	if (cl.num_particles < cl.free_particle)
-		cl.num_particles = cl.free_particle;
 	memset(part, 0, sizeof(*part));
 	VectorCopy(sortorigin, part->sortorigin);
 	part->typeindex = ptypeindex;
@@ -813,6 +868,47 @@ static void CL_ImmediateBloodStain(particle_t *part)
 	}
 }
 
+/*
+===============
+CL_EvictDecal
+
+same as CL_EvictParticle for cl.decals, the age of a decal is its sequence
+===============
+*/
+static decal_t *CL_EvictDecal(void)
+{
+	int i, j, best = -1;
+	float score, bestscore = 0;
+	decal_t *d;
+
+	if (cl_particles_evict.integer <= 0 || !cl.num_decals)
+		return NULL;
+	for (i = 0;i < CL_EVICT_CANDIDATES;i++)
+	{
+		j = (cl.evict_decal + i) % cl.num_decals;
+		d = cl.decals + j;
+		switch (cl_particles_evict.integer)
+		{
+		case 1:
+			score = cl.decalsequence - d->decalsequence;
+			break;
+		case 2:
+			score = VectorDistance2(d->org, r_refdef.view.origin);
+			break;
+		default:
+			score = -d->size;
+			break;
+		}
+		if (best < 0 || bestscore < score)
+		{
+			best = j;
+			bestscore = score;
+		}
+	}
+	cl.evict_decal = (cl.evict_decal + CL_EVICT_CANDIDATES) % cl.num_decals;
+	return cl.decals + best;
+}
+
 void CL_SpawnDecalParticleForSurface(int hitent, const vec3_t org, const vec3_t normal, int color1, int color2, int texnum, float size, float alpha)
 {
 	int l1, l2;
@@ -839,12 +935,10 @@ void CL_SpawnDecalParticleForSurface(int hitent, const vec3_t org, const vec3_t
 		return;
 	}
 
-	for (;cl.free_decal < cl.max_decals && cl.decals[cl.free_decal].typeindex;cl.free_decal++);
-	if (cl.free_decal >= cl.max_decals)
-		return;
-	decal = &cl.decals[cl.free_decal++];
-	if (cl.num_decals < cl.free_decal)
-		cl.num_decals = cl.free_decal;
+	if (cl.num_decals < cl.max_decals)
+		decal = &cl.decals[cl.num_decals++];
+	else if (cl.max_decals < MAX_DECALS || !(decal = CL_EvictDecal()))
+		return; // the pool grows at the next R_DrawDecals
 	memset(decal, 0, sizeof(*decal));
 	decal->decalsequence = cl.decalsequence++;
 	decal->typeindex = pt_decal;
@@ -1952,6 +2046,7 @@ cvar_t r_drawparticles = {0, "r_drawparticles", "1", "enables drawing of particl
 static cvar_t r_drawparticles_drawdistance = {CVAR_SAVE, "r_drawparticles_drawdistance", "2000", "particles further than drawdistance*size will not be drawn"};
 static cvar_t r_drawparticles_nearclip_min = {CVAR_SAVE, "r_drawparticles_nearclip_min", "4", "particles closer than drawnearclip_min will not be drawn"};
 static cvar_t r_drawparticles_nearclip_max = {CVAR_SAVE, "r_drawparticles_nearclip_max", "4", "particles closer than drawnearclip_min will be faded"};
+static cvar_t r_drawparticles_instanced = {CVAR_SAVE, "r_drawparticles_instanced", "1", "draw particles as instanced quads expanded in the vertex shader (one record per particle instead of four vertices, needs GLES3)"};
 cvar_t r_drawdecals = {0, "r_drawdecals", "1", "enables drawing of decals"};
 static cvar_t r_drawdecals_drawdistance = {CVAR_SAVE, "r_drawdecals_drawdistance", "500", "decals further than drawdistance*size will not be drawn"};
 
@@ -2409,6 +2504,10 @@ static void r_part_newmap(void)
 
 unsigned short particle_elements[MESHQUEUE_TRANSPARENT_BATCHSIZE*6];
 float particle_vertex3f[MESHQUEUE_TRANSPARENT_BATCHSIZE*12], particle_texcoord2f[MESHQUEUE_TRANSPARENT_BATCHSIZE*8], particle_color4f[MESHQUEUE_TRANSPARENT_BATCHSIZE*16];
+// instanced path: one shared quad (corners in -1 to 1, same order as the
+// vertices built above) and one record per particle
+static const float particle_quadvertex3f[4*3] = {-1, -1, 0, -1, 1, 0, 1, 1, 0, 1, -1, 0};
+static r_vertexinstance_t particle_instance[MESHQUEUE_TRANSPARENT_BATCHSIZE];
 
 void R_Particles_Init (void)
 {
@@ -2427,6 +2526,7 @@ void R_Particles_Init (void)
 	Cvar_RegisterVariable(&r_drawparticles_drawdistance);
 	Cvar_RegisterVariable(&r_drawparticles_nearclip_min);
 	Cvar_RegisterVariable(&r_drawparticles_nearclip_max);
+	Cvar_RegisterVariable(&r_drawparticles_instanced);
 	Cvar_RegisterVariable(&r_drawdecals);
 	Cvar_RegisterVariable(&r_drawdecals_drawdistance);
 	R_RegisterModule("R_Particles", r_part_start, r_part_shutdown, r_part_newmap, NULL, NULL);
@@ -2526,11 +2626,9 @@ void R_DrawDecals (void)
 	drawdist2 = r_drawdecals_drawdistance.value * r_refdef.view.quality;
 	drawdist2 = drawdist2*drawdist2;
 
-	for (i = 0, decal = cl.decals;i < cl.num_decals;i++, decal++)
+	for (i = 0;i < cl.num_decals;i++)
 	{
-		if (!decal->typeindex)
-			continue;
-
+		decal = cl.decals + i;
 		if (killsequence - decal->decalsequence > 0)
 			goto killdecal;
 
@@ -2562,16 +2660,14 @@ void R_DrawDecals (void)
 			R_MeshQueue_AddTransparent(TRANSPARENTSORT_DISTANCE, decal->org, R_DrawDecal_TransparentCallback, NULL, i, NULL);
 		continue;
 killdecal:
-		decal->typeindex = 0;
-		if (cl.free_decal > i)
-			cl.free_decal = i;
+		// move the last decal into the hole and look at it next, it has not
+		// been queued for drawing yet so its index can still change
+		*decal = cl.decals[--cl.num_decals];
+		i--;
 	}
 
-	// reduce cl.num_decals if possible
-	while (cl.num_decals > 0 && cl.decals[cl.num_decals - 1].typeindex == 0)
-		cl.num_decals--;
-
-	if (cl.num_decals == cl.max_decals && cl.max_decals < MAX_DECALS)
+	// grow before the pool is completely full so spawns rarely fail
+	if (cl.num_decals >= cl.max_decals - (cl.max_decals >> 2) && cl.max_decals < MAX_DECALS)
 	{
 		decal_t *olddecals = cl.decals;
 		cl.max_decals = min(cl.max_decals * 2, MAX_DECALS);
@@ -2583,150 +2679,123 @@ killdecal:
 	r_refdef.stats[r_stat_totaldecals] = cl.num_decals;
 }
 
-static void R_DrawParticle_TransparentCallback(const entity_render_t *ent, const rtlight_t *rtlight, int numsurfaces, int *surfacelist)
+/*
+===============
+R_DrawParticle_Color
+
+premultiplied, fogged (and lit) color of a particle, shared by both draw paths
+===============
+*/
+static void R_DrawParticle_Color(const particle_t *p, const vec4_t colormultiplier, qboolean dofade, float minparticledist_start, float minparticledist_end, float *c4f)
 {
-	vec3_t vecorg, vecvel, baseright, baseup;
-	int surfacelistindex;
-	int batchstart, batchcount;
-	const particle_t *p;
 	pblend_t blendmode;
-	rtexture_t *texture;
-	float *v3f, *t2f, *c4f;
-	particletexture_t *tex;
-	float up2[3], v[3], right[3], up[3], fog, ifog, size, len, lenfactor, alpha;
-//	float ambient[3], diffuse[3], diffusenormal[3];
-	float palpha, spintime, spinrad, spincos, spinsin, spinm1, spinm2, spinm3, spinm4;
-	vec4_t colormultiplier;
-	float minparticledist_start, minparticledist_end;
-	qboolean dofade;
-
-	RSurf_ActiveWorldEntity();
+	vec3_t vecorg;
+	float palpha, alpha, fog, ifog;
+
+	blendmode = (pblend_t)p->blendmode;
+	palpha = p->alpha;
+	if(dofade && p->orientation != PARTICLE_VBEAM && p->orientation != PARTICLE_HBEAM)
+		palpha *= min(1, (DotProduct(p->org, r_refdef.view.forward)  - minparticledist_start) / (minparticledist_end - minparticledist_start));
+	alpha = palpha * colormultiplier[3];
+	// ensure alpha multiplier saturates properly
+	if (alpha > 1.0f)
+		alpha = 1.0f;
+
+	switch (blendmode)
+	{
+	case PBLEND_INVALID:
+	case PBLEND_INVMOD:
+		// additive and modulate can just fade out in fog (this is correct)
+		if (r_refdef.fogenabled)
+			alpha *= RSurf_FogVertex(p->org);
+		// collapse alpha into color for these blends (so that the particlefont does not need alpha on most textures)
+		alpha *= 1.0f / 256.0f;
+		c4f[0] = p->color[0] * alpha;
+		c4f[1] = p->color[1] * alpha;
+		c4f[2] = p->color[2] * alpha;
+		c4f[3] = 0;
+		break;
+	case PBLEND_ADD:
+		// additive and modulate can just fade out in fog (this is correct)
+		if (r_refdef.fogenabled)
+			alpha *= RSurf_FogVertex(p->org);
+		// collapse alpha into color for these blends (so that the particlefont does not need alpha on most textures)
+		c4f[0] = p->color[0] * colormultiplier[0] * alpha;
+		c4f[1] = p->color[1] * colormultiplier[1] * alpha;
+		c4f[2] = p->color[2] * colormultiplier[2] * alpha;
+		c4f[3] = 0;
+		break;
+	case PBLEND_ALPHA:
+		c4f[0] = p->color[0] * colormultiplier[0];
+		c4f[1] = p->color[1] * colormultiplier[1];
+		c4f[2] = p->color[2] * colormultiplier[2];
+		c4f[3] = alpha;
+		// note: lighting is not cheap!
+		if (particletype[p->typeindex].lighting)
+		{
+			vecorg[0] = p->org[0];
+			vecorg[1] = p->org[1];
+			vecorg[2] = p->org[2];
+			R_LightPoint(c4f, vecorg, LP_LIGHTMAP | LP_RTWORLD | LP_DYNLIGHT);
+		}
+		// mix in the fog color
+		if (r_refdef.fogenabled)
+		{
+			fog = RSurf_FogVertex(p->org);
+			ifog = 1 - fog;
+			c4f[0] = c4f[0] * fog + r_refdef.fogcolor[0] * ifog;
+			c4f[1] = c4f[1] * fog + r_refdef.fogcolor[1] * ifog;
+			c4f[2] = c4f[2] * fog + r_refdef.fogcolor[2] * ifog;
+		}
+		// for premultiplied alpha we have to apply the alpha to the color (after fog of course)
+		VectorScale(c4f, alpha, c4f);
+		break;
+	}
+}
 
-	Vector4Set(colormultiplier, r_refdef.view.colorscale * (1.0 / 256.0f), r_refdef.view.colorscale * (1.0 / 256.0f), r_refdef.view.colorscale * (1.0 / 256.0f), cl_particles_alpha.value * (1.0 / 256.0f));
+/*
+===============
+R_DrawParticle_Instances
 
-	r_refdef.stats[r_stat_particles] += numsurfaces;
-//	R_Mesh_ResetTextureState();
-	GL_DepthMask(false);
-	GL_DepthRange(0, 1);
-	GL_PolygonOffset(0, 0);
-	GL_DepthTest(true);
-	GL_CullFace(GL_NONE);
+fills particle_instance with one record per particle for the MODE_PARTICLE
+vertex shader, which does the billboard and beam expansion
+===============
+*/
+static void R_DrawParticle_Instances(int numsurfaces, const int *surfacelist, const vec4_t colormultiplier, qboolean dofade, float minparticledist_start, float minparticledist_end)
+{
+	int surfacelistindex;
+	const particle_t *p;
+	particletexture_t *tex;
+	r_vertexinstance_t *inst;
+	vec3_t vecvel, baseright, baseup, dir;
+	float size, len, lenfactor, spintime, spinrad, spincos, spinsin, v0, v1;
 
 	spintime = r_refdef.scene.time;
-
-	minparticledist_start = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_min.value;
-	minparticledist_end = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_max.value;
-	dofade = (minparticledist_start < minparticledist_end);
-
-	// first generate all the vertices at once
-	for (surfacelistindex = 0, v3f = particle_vertex3f, t2f = particle_texcoord2f, c4f = particle_color4f;surfacelistindex < numsurfaces;surfacelistindex++, v3f += 3*4, t2f += 2*4, c4f += 4*4)
+	for (surfacelistindex = 0, inst = particle_instance;surfacelistindex < numsurfaces;surfacelistindex++, inst++)
 	{
 		p = cl.particles + surfacelist[surfacelistindex];
-
-		blendmode = (pblend_t)p->blendmode;
-		palpha = p->alpha;
-		if(dofade && p->orientation != PARTICLE_VBEAM && p->orientation != PARTICLE_HBEAM)
-			palpha *= min(1, (DotProduct(p->org, r_refdef.view.forward)  - minparticledist_start) / (minparticledist_end - minparticledist_start));
-		alpha = palpha * colormultiplier[3];
-		// ensure alpha multiplier saturates properly
-		if (alpha > 1.0f)
-			alpha = 1.0f;
-
-		switch (blendmode)
-		{
-		case PBLEND_INVALID:
-		case PBLEND_INVMOD:
-			// additive and modulate can just fade out in fog (this is correct)
-			if (r_refdef.fogenabled)
-				alpha *= RSurf_FogVertex(p->org);
-			// collapse alpha into color for these blends (so that the particlefont does not need alpha on most textures)
-			alpha *= 1.0f / 256.0f;
-			c4f[0] = p->color[0] * alpha;
-			c4f[1] = p->color[1] * alpha;
-			c4f[2] = p->color[2] * alpha;
-			c4f[3] = 0;
-			break;
-		case PBLEND_ADD:
-			// additive and modulate can just fade out in fog (this is correct)
-			if (r_refdef.fogenabled)
-				alpha *= RSurf_FogVertex(p->org);
-			// collapse alpha into color for these blends (so that the particlefont does not need alpha on most textures)
-			c4f[0] = p->color[0] * colormultiplier[0] * alpha;
-			c4f[1] = p->color[1] * colormultiplier[1] * alpha;
-			c4f[2] = p->color[2] * colormultiplier[2] * alpha;
-			c4f[3] = 0;
-			break;
-		case PBLEND_ALPHA:
-			c4f[0] = p->color[0] * colormultiplier[0];
-			c4f[1] = p->color[1] * colormultiplier[1];
-			c4f[2] = p->color[2] * colormultiplier[2];
-			c4f[3] = alpha;
-			// note: lighting is not cheap!
-			if (particletype[p->typeindex].lighting)
-			{
-				vecorg[0] = p->org[0];
-				vecorg[1] = p->org[1];
-				vecorg[2] = p->org[2];
-				R_LightPoint(c4f, vecorg, LP_LIGHTMAP | LP_RTWORLD | LP_DYNLIGHT);
-			}
-			// mix in the fog color
-			if (r_refdef.fogenabled)
-			{
-				fog = RSurf_FogVertex(p->org);
-				ifog = 1 - fog;
-				c4f[0] = c4f[0] * fog + r_refdef.fogcolor[0] * ifog;
-				c4f[1] = c4f[1] * fog + r_refdef.fogcolor[1] * ifog;
-				c4f[2] = c4f[2] * fog + r_refdef.fogcolor[2] * ifog;
-			}
-			// for premultiplied alpha we have to apply the alpha to the color (after fog of course)
-			VectorScale(c4f, alpha, c4f);
-			break;
-		}
-		// copy the color into the other three vertices
-		Vector4Copy(c4f, c4f + 4);
-		Vector4Copy(c4f, c4f + 8);
-		Vector4Copy(c4f, c4f + 12);
+		R_DrawParticle_Color(p, colormultiplier, dofade, minparticledist_start, minparticledist_end, inst->color4f);
 
 		size = p->size * cl_particles_size.value;
 		tex = &particletexture[p->texnum];
+		// texcoord rect, then origin and kind (see MODE_PARTICLE in shader_glsl.h)
+		Vector4Set(inst->texcoord4f[0], tex->s1, tex->t2, tex->s2, tex->t1);
+		VectorCopy(p->org, inst->texcoord4f[1]);
+		inst->texcoord4f[1][3] = 0;
 		switch(p->orientation)
 		{
 //		case PARTICLE_INVALID:
 		case PARTICLE_BILLBOARD:
+			// right and up as multiples of view left and view up
 			if (p->angle + p->spin)
 			{
 				spinrad = (p->angle + p->spin * (spintime - p->delayedspawn)) * (float)(M_PI / 180.0f);
 				spinsin = sin(spinrad) * size;
 				spincos = cos(spinrad) * size;
-				spinm1 = -p->stretch * spincos;
-				spinm2 = -spinsin;
-				spinm3 = spinsin;
-				spinm4 = -p->stretch * spincos;
-				VectorMAM(spinm1, r_refdef.view.left, spinm2, r_refdef.view.up, right);
-				VectorMAM(spinm3, r_refdef.view.left, spinm4, r_refdef.view.up, up);
+				Vector4Set(inst->texcoord4f[2], -p->stretch * spincos, -spinsin, spinsin, -p->stretch * spincos);
 			}
 			else
-			{
-				VectorScale(r_refdef.view.left, -size * p->stretch, right);
-				VectorScale(r_refdef.view.up, size, up);
-			}
-
-			v3f[ 0] = p->org[0] - right[0] - up[0];
-			v3f[ 1] = p->org[1] - right[1] - up[1];
-			v3f[ 2] = p->org[2] - right[2] - up[2];
-			v3f[ 3] = p->org[0] - right[0] + up[0];
-			v3f[ 4] = p->org[1] - right[1] + up[1];
-			v3f[ 5] = p->org[2] - right[2] + up[2];
-			v3f[ 6] = p->org[0] + right[0] + up[0];
-			v3f[ 7] = p->org[1] + right[1] + up[1];
-			v3f[ 8] = p->org[2] + right[2] + up[2];
-			v3f[ 9] = p->org[0] + right[0] - up[0];
-			v3f[10] = p->org[1] + right[1] - up[1];
-			v3f[11] = p->org[2] + right[2] - up[2];
-			t2f[0] = tex->s1;t2f[1] = tex->t2;
-			t2f[2] = tex->s1;t2f[3] = tex->t1;
-			t2f[4] = tex->s2;t2f[5] = tex->t1;
-			t2f[6] = tex->s2;t2f[7] = tex->t2;
+				Vector4Set(inst->texcoord4f[2], -size * p->stretch, 0, 0, size);
 			break;
 		case PARTICLE_ORIENTED_DOUBLESIDED:
 			vecvel[0] = p->vel[0];
@@ -2738,80 +2807,227 @@ static void R_DrawParticle_TransparentCallback(const entity_render_t *ent, const
 				spinrad = (p->angle + p->spin * (spintime - p->delayedspawn)) * (float)(M_PI / 180.0f);
 				spinsin = sin(spinrad) * size;
 				spincos = cos(spinrad) * size;
-				spinm1 = p->stretch * spincos;
-				spinm2 = -spinsin;
-				spinm3 = spinsin;
-				spinm4 = p->stretch * spincos;
-				VectorMAM(spinm1, baseright, spinm2, baseup, right);
-				VectorMAM(spinm3, baseright, spinm4, baseup, up);
+				VectorMAM(p->stretch * spincos, baseright, -spinsin, baseup, inst->texcoord4f[2]);
+				VectorMAM(spinsin, baseright, p->stretch * spincos, baseup, inst->texcoord4f[3]);
 			}
 			else
 			{
-				VectorScale(baseright, size * p->stretch, right);
-				VectorScale(baseup, size, up);
+				VectorScale(baseright, size * p->stretch, inst->texcoord4f[2]);
+				VectorScale(baseup, size, inst->texcoord4f[3]);
 			}
-			v3f[ 0] = p->org[0] - right[0] - up[0];
-			v3f[ 1] = p->org[1] - right[1] - up[1];
-			v3f[ 2] = p->org[2] - right[2] - up[2];
-			v3f[ 3] = p->org[0] - right[0] + up[0];
-			v3f[ 4] = p->org[1] - right[1] + up[1];
-			v3f[ 5] = p->org[2] - right[2] + up[2];
-			v3f[ 6] = p->org[0] + right[0] + up[0];
-			v3f[ 7] = p->org[1] + right[1] + up[1];
-			v3f[ 8] = p->org[2] + right[2] + up[2];
-			v3f[ 9] = p->org[0] + right[0] - up[0];
-			v3f[10] = p->org[1] + right[1] - up[1];
-			v3f[11] = p->org[2] + right[2] - up[2];
-			t2f[0] = tex->s1;t2f[1] = tex->t2;
-			t2f[2] = tex->s1;t2f[3] = tex->t1;
-			t2f[4] = tex->s2;t2f[5] = tex->t1;
-			t2f[6] = tex->s2;t2f[7] = tex->t2;
+			inst->texcoord4f[1][3] = 1;
 			break;
 		case PARTICLE_SPARK:
 			len = VectorLength(p->vel);
-			VectorNormalize2(p->vel, up);
+			VectorNormalize2(p->vel, dir);
 			lenfactor = p->stretch * 0.04 * len;
 			if(lenfactor < size * 0.5)
 				lenfactor = size * 0.5;
-			VectorMA(p->org, -lenfactor, up, v);
-			VectorMA(p->org,  lenfactor, up, up2);
-			R_CalcBeam_Vertex3f(v3f, v, up2, size);
-			t2f[0] = tex->s1;t2f[1] = tex->t2;
-			t2f[2] = tex->s1;t2f[3] = tex->t1;
-			t2f[4] = tex->s2;t2f[5] = tex->t1;
-			t2f[6] = tex->s2;t2f[7] = tex->t2;
+			VectorMA(p->org, -lenfactor, dir, inst->texcoord4f[1]);
+			VectorMA(p->org,  lenfactor, dir, inst->texcoord4f[2]);
+			inst->texcoord4f[1][3] = 2;
+			inst->texcoord4f[2][3] = size;
 			break;
 		case PARTICLE_VBEAM:
-			R_CalcBeam_Vertex3f(v3f, p->org, p->vel, size);
-			VectorSubtract(p->vel, p->org, up);
-			VectorNormalize(up);
-			v[0] = DotProduct(p->org, up) * (1.0f / 64.0f) * p->stretch;
-			v[1] = DotProduct(p->vel, up) * (1.0f / 64.0f) * p->stretch;
-			t2f[0] = tex->s2;t2f[1] = v[0];
-			t2f[2] = tex->s1;t2f[3] = v[0];
-			t2f[4] = tex->s1;t2f[5] = v[1];
-			t2f[6] = tex->s2;t2f[7] = v[1];
-			break;
 		case PARTICLE_HBEAM:
-			R_CalcBeam_Vertex3f(v3f, p->org, p->vel, size);
-			VectorSubtract(p->vel, p->org, up);
-			VectorNormalize(up);
-			v[0] = DotProduct(p->org, up) * (1.0f / 64.0f) * p->stretch;
-			v[1] = DotProduct(p->vel, up) * (1.0f / 64.0f) * p->stretch;
-			t2f[0] = v[0];t2f[1] = tex->t1;
-			t2f[2] = v[0];t2f[3] = tex->t2;
-			t2f[4] = v[1];t2f[5] = tex->t2;
-			t2f[6] = v[1];t2f[7] = tex->t1;
+			VectorSubtract(p->vel, p->org, dir);
+			VectorNormalize(dir);
+			v0 = DotProduct(p->org, dir) * (1.0f / 64.0f) * p->stretch;
+			v1 = DotProduct(p->vel, dir) * (1.0f / 64.0f) * p->stretch;
+			VectorCopy(p->vel, inst->texcoord4f[2]);
+			inst->texcoord4f[2][3] = size;
+			if (p->orientation == PARTICLE_VBEAM)
+			{
+				// the texture runs across the beam, kind 3 swaps the texcoord axes
+				Vector4Set(inst->texcoord4f[0], tex->s2, v0, tex->s1, v1);
+				inst->texcoord4f[1][3] = 3;
+			}
+			else
+			{
+				Vector4Set(inst->texcoord4f[0], v0, tex->t1, v1, tex->t2);
+				inst->texcoord4f[1][3] = 2;
+			}
 			break;
 		}
 	}
+}
+
+static void R_DrawParticle_TransparentCallback(const entity_render_t *ent, const rtlight_t *rtlight, int numsurfaces, int *surfacelist)
+{
+	vec3_t vecvel, baseright, baseup;
+	int surfacelistindex;
+	int batchstart, batchcount;
+	const particle_t *p;
+	rtexture_t *texture;
+	float *v3f, *t2f, *c4f;
+	particletexture_t *tex;
+	float up2[3], v[3], right[3], up[3], size, len, lenfactor;
+//	float ambient[3], diffuse[3], diffusenormal[3];
+	float spintime, spinrad, spincos, spinsin, spinm1, spinm2, spinm3, spinm4;
+	vec4_t colormultiplier;
+	float minparticledist_start, minparticledist_end;
+	qboolean dofade, instanced;
+
+	RSurf_ActiveWorldEntity();
+
+	Vector4Set(colormultiplier, r_refdef.view.colorscale * (1.0 / 256.0f), r_refdef.view.colorscale * (1.0 / 256.0f), r_refdef.view.colorscale * (1.0 / 256.0f), cl_particles_alpha.value * (1.0 / 256.0f));
+
+	r_refdef.stats[r_stat_particles] += numsurfaces;
+//	R_Mesh_ResetTextureState();
+	GL_DepthMask(false);
+	GL_DepthRange(0, 1);
+	GL_PolygonOffset(0, 0);
+	GL_DepthTest(true);
+	GL_CullFace(GL_NONE);
+
+	spintime = r_refdef.scene.time;
+
+	minparticledist_start = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_min.value;
+	minparticledist_end = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_max.value;
+	dofade = (minparticledist_start < minparticledist_end);
+
+	instanced = r_drawparticles_instanced.integer && vid.support.arb_instanced_arrays && (vid.renderpath == RENDERPATH_GL20 || vid.renderpath == RENDERPATH_GLES2);
+	if (instanced)
+		R_DrawParticle_Instances(numsurfaces, surfacelist, colormultiplier, dofade, minparticledist_start, minparticledist_end);
+	else
+	{
+		// first generate all the vertices at once
+		for (surfacelistindex = 0, v3f = particle_vertex3f, t2f = particle_texcoord2f, c4f = particle_color4f;surfacelistindex < numsurfaces;surfacelistindex++, v3f += 3*4, t2f += 2*4, c4f += 4*4)
+		{
+			p = cl.particles + surfacelist[surfacelistindex];
+
+			R_DrawParticle_Color(p, colormultiplier, dofade, minparticledist_start, minparticledist_end, c4f);
+			// copy the color into the other three vertices
+			Vector4Copy(c4f, c4f + 4);
+			Vector4Copy(c4f, c4f + 8);
+			Vector4Copy(c4f, c4f + 12);
+
+			size = p->size * cl_particles_size.value;
+			tex = &particletexture[p->texnum];
+			switch(p->orientation)
+			{
+	//		case PARTICLE_INVALID:
+			case PARTICLE_BILLBOARD:
+				if (p->angle + p->spin)
+				{
+					spinrad = (p->angle + p->spin * (spintime - p->delayedspawn)) * (float)(M_PI / 180.0f);
+					spinsin = sin(spinrad) * size;
+					spincos = cos(spinrad) * size;
+					spinm1 = -p->stretch * spincos;
+					spinm2 = -spinsin;
+					spinm3 = spinsin;
+					spinm4 = -p->stretch * spincos;
+					VectorMAM(spinm1, r_refdef.view.left, spinm2, r_refdef.view.up, right);
+					VectorMAM(spinm3, r_refdef.view.left, spinm4, r_refdef.view.up, up);
+				}
+				else
+				{
+					VectorScale(r_refdef.view.left, -size * p->stretch, right);
+					VectorScale(r_refdef.view.up, size, up);
+				}
+
+				v3f[ 0] = p->org[0] - right[0] - up[0];
+				v3f[ 1] = p->org[1] - right[1] - up[1];
+				v3f[ 2] = p->org[2] - right[2] - up[2];
+				v3f[ 3] = p->org[0] - right[0] + up[0];
+				v3f[ 4] = p->org[1] - right[1] + up[1];
+				v3f[ 5] = p->org[2] - right[2] + up[2];
+				v3f[ 6] = p->org[0] + right[0] + up[0];
+				v3f[ 7] = p->org[1] + right[1] + up[1];
+				v3f[ 8] = p->org[2] + right[2] + up[2];
+				v3f[ 9] = p->org[0] + right[0] - up[0];
+				v3f[10] = p->org[1] + right[1] - up[1];
+				v3f[11] = p->org[2] + right[2] - up[2];
+				t2f[0] = tex->s1;t2f[1] = tex->t2;
+				t2f[2] = tex->s1;t2f[3] = tex->t1;
+				t2f[4] = tex->s2;t2f[5] = tex->t1;
+				t2f[6] = tex->s2;t2f[7] = tex->t2;
+				break;
+			case PARTICLE_ORIENTED_DOUBLESIDED:
+				vecvel[0] = p->vel[0];
+				vecvel[1] = p->vel[1];
+				vecvel[2] = p->vel[2];
+				VectorVectors(vecvel, baseright, baseup);
+				if (p->angle + p->spin)
+				{
+					spinrad = (p->angle + p->spin * (spintime - p->delayedspawn)) * (float)(M_PI / 180.0f);
+					spinsin = sin(spinrad) * size;
+					spincos = cos(spinrad) * size;
+					spinm1 = p->stretch * spincos;
+					spinm2 = -spinsin;
+					spinm3 = spinsin;
+					spinm4 = p->stretch * spincos;
+					VectorMAM(spinm1, baseright, spinm2, baseup, right);
+					VectorMAM(spinm3, baseright, spinm4, baseup, up);
+				}
+				else
+				{
+					VectorScale(baseright, size * p->stretch, right);
+					VectorScale(baseup, size, up);
+				}
+				v3f[ 0] = p->org[0] - right[0] - up[0];
+				v3f[ 1] = p->org[1] - right[1] - up[1];
+				v3f[ 2] = p->org[2] - right[2] - up[2];
+				v3f[ 3] = p->org[0] - right[0] + up[0];
+				v3f[ 4] = p->org[1] - right[1] + up[1];
+				v3f[ 5] = p->org[2] - right[2] + up[2];
+				v3f[ 6] = p->org[0] + right[0] + up[0];
+				v3f[ 7] = p->org[1] + right[1] + up[1];
+				v3f[ 8] = p->org[2] + right[2] + up[2];
+				v3f[ 9] = p->org[0] + right[0] - up[0];
+				v3f[10] = p->org[1] + right[1] - up[1];
+				v3f[11] = p->org[2] + right[2] - up[2];
+				t2f[0] = tex->s1;t2f[1] = tex->t2;
+				t2f[2] = tex->s1;t2f[3] = tex->t1;
+				t2f[4] = tex->s2;t2f[5] = tex->t1;
+				t2f[6] = tex->s2;t2f[7] = tex->t2;
+				break;
+			case PARTICLE_SPARK:
+				len = VectorLength(p->vel);
+				VectorNormalize2(p->vel, up);
+				lenfactor = p->stretch * 0.04 * len;
+				if(lenfactor < size * 0.5)
+					lenfactor = size * 0.5;
+				VectorMA(p->org, -lenfactor, up, v);
+				VectorMA(p->org,  lenfactor, up, up2);
+				R_CalcBeam_Vertex3f(v3f, v, up2, size);
+				t2f[0] = tex->s1;t2f[1] = tex->t2;
+				t2f[2] = tex->s1;t2f[3] = tex->t1;
+				t2f[4] = tex->s2;t2f[5] = tex->t1;
+				t2f[6] = tex->s2;t2f[7] = tex->t2;
+				break;
+			case PARTICLE_VBEAM:
+				R_CalcBeam_Vertex3f(v3f, p->org, p->vel, size);
+				VectorSubtract(p->vel, p->org, up);
+				VectorNormalize(up);
+				v[0] = DotProduct(p->org, up) * (1.0f / 64.0f) * p->stretch;
+				v[1] = DotProduct(p->vel, up) * (1.0f / 64.0f) * p->stretch;
+				t2f[0] = tex->s2;t2f[1] = v[0];
+				t2f[2] = tex->s1;t2f[3] = v[0];
+				t2f[4] = tex->s1;t2f[5] = v[1];
+				t2f[6] = tex->s2;t2f[7] = v[1];
+				break;
+			case PARTICLE_HBEAM:
+				R_CalcBeam_Vertex3f(v3f, p->org, p->vel, size);
+				VectorSubtract(p->vel, p->org, up);
+				VectorNormalize(up);
+				v[0] = DotProduct(p->org, up) * (1.0f / 64.0f) * p->stretch;
+				v[1] = DotProduct(p->vel, up) * (1.0f / 64.0f) * p->stretch;
+				t2f[0] = v[0];t2f[1] = tex->t1;
+				t2f[2] = v[0];t2f[3] = tex->t2;
+				t2f[4] = v[1];t2f[5] = tex->t2;
+				t2f[6] = v[1];t2f[7] = tex->t1;
+				break;
+			}
+		}
+	}
 
 	// now render batches of particles based on blendmode and texture
-	blendmode = PBLEND_INVALID;
 	texture = NULL;
 	batchstart = 0;
 	batchcount = 0;
-	R_Mesh_PrepareVertices_Generic_Arrays(numsurfaces * 4, particle_vertex3f, particle_color4f, particle_texcoord2f);
+	if (!instanced)
+		R_Mesh_PrepareVertices_Generic_Arrays(numsurfaces * 4, particle_vertex3f, particle_color4f, particle_texcoord2f);
 	for (surfacelistindex = 0;surfacelistindex < numsurfaces;)
 	{
 		p = cl.particles + surfacelist[surfacelistindex];
@@ -2819,7 +3035,10 @@ static void R_DrawParticle_TransparentCallback(const entity_render_t *ent, const
 		if (texture != particletexture[p->texnum].texture)
 		{
 			texture = particletexture[p->texnum].texture;
-			R_SetupShader_Generic(texture, NULL, GL_MODULATE, 1, false, false, false);
+			if (instanced)
+				R_SetupShader_Particle(texture);
+			else
+				R_SetupShader_Generic(texture, NULL, GL_MODULATE, 1, false, false, false);
 		}
 
 		if (p->blendmode == PBLEND_INVMOD)
@@ -2851,208 +3070,399 @@ static void R_DrawParticle_TransparentCallback(const entity_render_t *ent, const
 		}
 
 		batchcount = surfacelistindex - batchstart;
-		R_Mesh_Draw(batchstart * 4, batchcount * 4, batchstart * 2, batchcount * 2, NULL, NULL, 0, particle_elements, NULL, 0);
+		if (instanced)
+		{
+			// there is no base instance in GLES3, so point the instance arrays at the batch instead
+			R_Mesh_PrepareVertices_Instanced(4, particle_quadvertex3f, batchcount, particle_instance + batchstart);
+			R_Mesh_DrawInstanced(4, 2, particle_elements, batchcount);
+		}
+		else
+			R_Mesh_Draw(batchstart * 4, batchcount * 4, batchstart * 2, batchcount * 2, NULL, NULL, 0, particle_elements, NULL, 0);
 	}
 }
 
-void R_DrawParticles (void)
+#define CL_MAXPARTICLETASKS 16
+// fewer particles than this per task are not worth the threading overhead
+#define CL_PARTICLETASK_MINPARTICLES 2048
+
+typedef enum particleeventtype_e
 {
-	int i, a;
-	int drawparticles = r_drawparticles.integer;
-	float minparticledist_start;
-	particle_t *p;
-	float gravity, frametime, f, dist, oldorg[3], decaldir[3];
-	float drawdist2;
+	PARTICLEEVENT_IMPACT, // stain and decal of a particle that hit something
+	PARTICLEEVENT_SNOWFLUTTER // new random velocity for a snow flake
+}
+particleeventtype_t;
+
+// something CL_UpdateParticles_Range found that has to be done on the main
+// thread, in particle order (R_Stain, decals and rand are not thread safe)
+typedef struct particleevent_s
+{
+	particleeventtype_t type;
+	int index;
 	int hitent;
-	trace_t trace;
-	qboolean update;
+	vec3_t normal;
+	// the particle as it was at the impact (it may be dead and reused by
+	// the time the event is applied)
+	particle_t particle;
+}
+particleevent_t;
 
-	frametime = bound(0, cl.time - cl.particles_updatetime, 1);
-	cl.particles_updatetime = bound(cl.time - 1, cl.particles_updatetime + frametime, cl.time + 1);
+typedef struct particleupdate_s
+{
+	int first, end;
+	int numevents, maxevents;
+	particleevent_t *events;
+}
+particleupdate_t;
 
-	// LordHavoc: early out conditions
-	if (!cl.num_particles)
-		return;
+static particleupdate_t cl_particleupdates[CL_MAXPARTICLETASKS];
+// TaskQueue_Enqueue takes a contiguous array of tasks
+static taskqueue_task_t cl_particleupdatetasks[CL_MAXPARTICLETASKS];
+static float cl_particleupdate_frametime, cl_particleupdate_gravity;
 
-	minparticledist_start = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_min.value;
-	gravity = frametime * cl.movevars_gravity;
-	update = frametime > 0;
-	drawdist2 = r_drawparticles_drawdistance.value * r_refdef.view.quality;
-	drawdist2 = drawdist2*drawdist2;
+static void CL_UpdateParticles_AddEvent(particleupdate_t *update, particleeventtype_t type, int index)
+{
+	particleevent_t *e;
+	if (update->numevents == update->maxevents)
+	{
+		update->maxevents = max(update->maxevents * 2, 256);
+		update->events = (particleevent_t *)Mem_Realloc(cls.permanentmempool, update->events, update->maxevents * sizeof(*update->events));
+	}
+	e = update->events + update->numevents++;
+	e->type = type;
+	e->index = index;
+	e->hitent = 0;
+	VectorClear(e->normal);
+	e->particle = cl.particles[index];
+}
 
-	for (i = 0, p = cl.particles;i < cl.num_particles;i++, p++)
+/*
+===============
+CL_UpdateParticles_Range
+
+moves particles first .. end-1 and removes the dead ones, anything that
+touches more than the particle itself is queued as an event for
+CL_UpdateParticles_ApplyEvents.  runs on the taskqueue workers, so only
+thread safe traces are used (see CL_UpdateParticles)
+===============
+*/
+static void CL_UpdateParticles_Range(particleupdate_t *update)
+{
+	int i, a;
+	particle_t *p;
+	float gravity = cl_particleupdate_gravity, frametime = cl_particleupdate_frametime, f, dist, oldorg[3];
+	int hitent;
+	trace_t trace;
+
+	update->numevents = 0;
+	for (i = update->first, p = cl.particles + i;i < update->end;i++, p++)
 	{
-		if (!p->typeindex)
-		{
-			if (cl.free_particle > i)
-				cl.free_particle = i;
+		if (p->delayedspawn > cl.time)
 			continue;
-		}
 
-		if (update)
-		{
-			if (p->delayedspawn > cl.time)
-				continue;
-
-			p->size += p->sizeincrease * frametime;
-			p->alpha -= p->alphafade * frametime;
+		p->size += p->sizeincrease * frametime;
+		p->alpha -= p->alphafade * frametime;
 
-			if (p->alpha <= 0 || p->die <= cl.time)
-				goto killparticle;
+		if (p->alpha <= 0 || p->die <= cl.time)
+			goto killparticle;
 
-			if (p->orientation != PARTICLE_VBEAM && p->orientation != PARTICLE_HBEAM && frametime > 0)
+		if (p->orientation != PARTICLE_VBEAM && p->orientation != PARTICLE_HBEAM && frametime > 0)
+		{
+			if (p->liquidfriction && cl_particles_collisions.integer && (CL_PointSuperContents(p->org) & SUPERCONTENTS_LIQUIDSMASK))
+			{
+				if (p->typeindex == pt_blood)
+					p->size += frametime * 8;
+				else
+					p->vel[2] -= p->gravity * gravity;
+				f = 1.0f - min(p->liquidfriction * frametime, 1);
+				VectorScale(p->vel, f, p->vel);
+			}
+			else
 			{
-				if (p->liquidfriction && cl_particles_collisions.integer && (CL_PointSuperContents(p->org) & SUPERCONTENTS_LIQUIDSMASK))
+				p->vel[2] -= p->gravity * gravity;
+				if (p->airfriction)
 				{
-					if (p->typeindex == pt_blood)
-						p->size += frametime * 8;
-					else
-						p->vel[2] -= p->gravity * gravity;
-					f = 1.0f - min(p->liquidfriction * frametime, 1);
+					f = 1.0f - min(p->airfriction * frametime, 1);
 					VectorScale(p->vel, f, p->vel);
 				}
-				else
+			}
+
+			VectorCopy(p->org, oldorg);
+			VectorMA(p->org, frametime, p->vel, p->org);
+//			if (p->bounce && cl.time >= p->delayedcollisions)
+			if (p->bounce && cl_particles_collisions.integer && VectorLength(p->vel))
+			{
+				trace = CL_TraceLine(oldorg, p->org, MOVE_NOMONSTERS, NULL, SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | ((p->typeindex == pt_rain || p->typeindex == pt_snow) ? SUPERCONTENTS_LIQUIDSMASK : 0), true, false, &hitent, false, false);
+				// if the trace started in or hit something of SUPERCONTENTS_NODROP
+				// or if the trace hit something flagged as NOIMPACT
+				// then remove the particle
+				if (trace.hitq3surfaceflags & Q3SURFACEFLAG_NOIMPACT || ((trace.startsupercontents | trace.hitsupercontents) & SUPERCONTENTS_NODROP) || (trace.startsupercontents & SUPERCONTENTS_SOLID))
+					goto killparticle;
+				VectorCopy(trace.endpos, p->org);
+				// react if the particle hit something
+				if (trace.fraction < 1)
 				{
-					p->vel[2] -= p->gravity * gravity;
-					if (p->airfriction)
+					VectorCopy(trace.endpos, p->org);
+
+					// blood - splash on solid (stains and decals are made by
+					// CL_UpdateParticles_ApplyEvents)
+					if (!(trace.hitq3surfaceflags & Q3SURFACEFLAG_NOMARKS) && (p->staintexnum >= 0 || (p->typeindex == pt_blood && p->staintexnum == -1)))
 					{
-						f = 1.0f - min(p->airfriction * frametime, 1);
-						VectorScale(p->vel, f, p->vel);
+						CL_UpdateParticles_AddEvent(update, PARTICLEEVENT_IMPACT, i);
+						update->events[update->numevents - 1].hitent = hitent;
+						VectorCopy(trace.plane.normal, update->events[update->numevents - 1].normal);
 					}
-				}
 
-				VectorCopy(p->org, oldorg);
-				VectorMA(p->org, frametime, p->vel, p->org);
-//				if (p->bounce && cl.time >= p->delayedcollisions)
-				if (p->bounce && cl_particles_collisions.integer && VectorLength(p->vel))
-				{
-					trace = CL_TraceLine(oldorg, p->org, MOVE_NOMONSTERS, NULL, SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | ((p->typeindex == pt_rain || p->typeindex == pt_snow) ? SUPERCONTENTS_LIQUIDSMASK : 0), true, false, &hitent, false, false);
-					// if the trace started in or hit something of SUPERCONTENTS_NODROP
-					// or if the trace hit something flagged as NOIMPACT
-					// then remove the particle
-					if (trace.hitq3surfaceflags & Q3SURFACEFLAG_NOIMPACT || ((trace.startsupercontents | trace.hitsupercontents) & SUPERCONTENTS_NODROP) || (trace.startsupercontents & SUPERCONTENTS_SOLID))
+					if (p->typeindex == pt_blood)
+					{
+						// blood - splash on solid
 						goto killparticle;
-					VectorCopy(trace.endpos, p->org);
-					// react if the particle hit something
-					if (trace.fraction < 1)
+					}
+					else if (p->bounce < 0)
 					{
-						VectorCopy(trace.endpos, p->org);
-
-						if (p->staintexnum >= 0)
-						{
-							// blood - splash on solid
-							if (!(trace.hitq3surfaceflags & Q3SURFACEFLAG_NOMARKS))
-							{
-								R_Stain(p->org, 16,
-									p->staincolor[0], p->staincolor[1], p->staincolor[2], (int)(p->stainalpha * p->stainsize * (1.0f / 160.0f)),
-									p->staincolor[0], p->staincolor[1], p->staincolor[2], (int)(p->stainalpha * p->stainsize * (1.0f / 160.0f)));
-								if (cl_decals.integer)
-								{
-									// create a decal for the blood splat
-									a = 0xFFFFFF ^ (p->staincolor[0]*65536+p->staincolor[1]*256+p->staincolor[2]);
-									if (cl_decals_newsystem_bloodsmears.integer)
-									{
-										VectorCopy(p->vel, decaldir);
-										VectorNormalize(decaldir);
-									}
-									else
-										VectorCopy(trace.plane.normal, decaldir);
-									CL_SpawnDecalParticleForSurface(hitent, p->org, decaldir, a, a, p->staintexnum, p->stainsize, p->stainalpha); // staincolor needs to be inverted for decals!
-								}
-							}
-						}
-
-						if (p->typeindex == pt_blood)
-						{
-							// blood - splash on solid
-							if (trace.hitq3surfaceflags & Q3SURFACEFLAG_NOMARKS)
-								goto killparticle;
-							if(p->staintexnum == -1) // staintex < -1 means no stains at all
-							{
-								R_Stain(p->org, 16, 64, 16, 16, (int)(p->alpha * p->size * (1.0f / 80.0f)), 64, 32, 32, (int)(p->alpha * p->size * (1.0f / 80.0f)));
-								if (cl_decals.integer)
-								{
-									// create a decal for the blood splat
-									if (cl_decals_newsystem_bloodsmears.integer)
-									{
-										VectorCopy(p->vel, decaldir);
-										VectorNormalize(decaldir);
-									}
-									else
-										VectorCopy(trace.plane.normal, decaldir);
-									CL_SpawnDecalParticleForSurface(hitent, p->org, decaldir, p->color[0] * 65536 + p->color[1] * 256 + p->color[2], p->color[0] * 65536 + p->color[1] * 256 + p->color[2], tex_blooddecal[rand()&7], p->size * lhrandom(cl_particles_blood_decal_scalemin.value, cl_particles_blood_decal_scalemax.value), cl_particles_blood_decal_alpha.value * 768);
-								}
-							}
-							goto killparticle;
-						}
-						else if (p->bounce < 0)
-						{
-							// bounce -1 means remove on impact
-							goto killparticle;
-						}
-						else
-						{
-							// anything else - bounce off solid
-							dist = DotProduct(p->vel, trace.plane.normal) * -p->bounce;
-							VectorMA(p->vel, dist, trace.plane.normal, p->vel);
-						}
+						// bounce -1 means remove on impact
+						goto killparticle;
+					}
+					else
+					{
+						// anything else - bounce off solid
+						dist = DotProduct(p->vel, trace.plane.normal) * -p->bounce;
+						VectorMA(p->vel, dist, trace.plane.normal, p->vel);
 					}
 				}
+			}
+
+			if (VectorLength2(p->vel) < 0.03)
+			{
+				if(p->orientation == PARTICLE_SPARK) // sparks are virtually invisible if very slow, so rather let them go off
+					goto killparticle;
+				VectorClear(p->vel);
+			}
+		}
+
+		if (p->typeindex != pt_static)
+		{
+			switch (p->typeindex)
+			{
+			case pt_entityparticle:
+				// particle that removes itself after one rendered frame
+				if (p->time2)
+					goto killparticle;
+				else
+					p->time2 = 1;
+				break;
+			case pt_blood:
+				a = CL_PointSuperContents(p->org);
+				if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_LAVA | SUPERCONTENTS_NODROP))
+					goto killparticle;
+				break;
+			case pt_bubble:
+				a = CL_PointSuperContents(p->org);
+				if (!(a & (SUPERCONTENTS_WATER | SUPERCONTENTS_SLIME)))
+					goto killparticle;
+				break;
+			case pt_rain:
+				a = CL_PointSuperContents(p->org);
+				if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | SUPERCONTENTS_LIQUIDSMASK))
+					goto killparticle;
+				break;
+			case pt_snow:
+				a = CL_PointSuperContents(p->org);
+				if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | SUPERCONTENTS_LIQUIDSMASK))
+					goto killparticle;
+				// snow flutter
+				if (cl.time > p->time2)
+					CL_UpdateParticles_AddEvent(update, PARTICLEEVENT_SNOWFLUTTER, i);
+				break;
+			default:
+				break;
+			}
+		}
+		continue;
+killparticle:
+		// removed from the pool by CL_UpdateParticles after all ranges ran
+		p->typeindex = 0;
+	}
+}
+
+static void CL_UpdateParticles_Task(taskqueue_task_t *task)
+{
+	CL_UpdateParticles_Range((particleupdate_t *)task->p[0]);
+}
+
+/*
+===============
+CL_UpdateParticles_ApplyEvents
+
+makes the stains and decals of the impacts and the snow flutter found by
+CL_UpdateParticles_Range, in particle order like the old single pass did
+===============
+*/
+static void CL_UpdateParticles_ApplyEvents(particleupdate_t *update)
+{
+	int i, a;
+	particleevent_t *e;
+	particle_t *p;
+	float decaldir[3];
+
+	for (i = 0, e = update->events;i < update->numevents;i++, e++)
+	{
+		if (e->type == PARTICLEEVENT_SNOWFLUTTER)
+		{
+			p = cl.particles + e->index;
+			p->time2 = cl.time + (rand() & 3) * 0.1;
+			p->vel[0] = p->vel[0] * 0.9f + lhrandom(-32, 32);
+			p->vel[1] = p->vel[0] * 0.9f + lhrandom(-32, 32);
+			continue;
+		}
 
-				if (VectorLength2(p->vel) < 0.03)
+		p = &e->particle;
+		if (p->staintexnum >= 0)
+		{
+			// blood - splash on solid
+			R_Stain(p->org, 16,
+				p->staincolor[0], p->staincolor[1], p->staincolor[2], (int)(p->stainalpha * p->stainsize * (1.0f / 160.0f)),
+				p->staincolor[0], p->staincolor[1], p->staincolor[2], (int)(p->stainalpha * p->stainsize * (1.0f / 160.0f)));
+			if (cl_decals.integer)
+			{
+				// create a decal for the blood splat
+				a = 0xFFFFFF ^ (p->staincolor[0]*65536+p->staincolor[1]*256+p->staincolor[2]);
+				if (cl_decals_newsystem_bloodsmears.integer)
 				{
-					if(p->orientation == PARTICLE_SPARK) // sparks are virtually invisible if very slow, so rather let them go off
-						goto killparticle;
-					VectorClear(p->vel);
+					VectorCopy(p->vel, decaldir);
+					VectorNormalize(decaldir);
 				}
+				else
+					VectorCopy(e->normal, decaldir);
+				CL_SpawnDecalParticleForSurface(e->hitent, p->org, decaldir, a, a, p->staintexnum, p->stainsize, p->stainalpha); // staincolor needs to be inverted for decals!
 			}
+		}
 
-			if (p->typeindex != pt_static)
+		if (p->typeindex == pt_blood && p->staintexnum == -1) // staintex < -1 means no stains at all
+		{
+			R_Stain(p->org, 16, 64, 16, 16, (int)(p->alpha * p->size * (1.0f / 80.0f)), 64, 32, 32, (int)(p->alpha * p->size * (1.0f / 80.0f)));
+			if (cl_decals.integer)
 			{
-				switch (p->typeindex)
+				// create a decal for the blood splat
+				if (cl_decals_newsystem_bloodsmears.integer)
 				{
-				case pt_entityparticle:
-					// particle that removes itself after one rendered frame
-					if (p->time2)
-						goto killparticle;
-					else
-						p->time2 = 1;
-					break;
-				case pt_blood:
-					a = CL_PointSuperContents(p->org);
-					if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_LAVA | SUPERCONTENTS_NODROP))
-						goto killparticle;
-					break;
-				case pt_bubble:
-					a = CL_PointSuperContents(p->org);
-					if (!(a & (SUPERCONTENTS_WATER | SUPERCONTENTS_SLIME)))
-						goto killparticle;
-					break;
-				case pt_rain:
-					a = CL_PointSuperContents(p->org);
-					if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | SUPERCONTENTS_LIQUIDSMASK))
-						goto killparticle;
-					break;
-				case pt_snow:
-					if (cl.time > p->time2)
-					{
-						// snow flutter
-						p->time2 = cl.time + (rand() & 3) * 0.1;
-						p->vel[0] = p->vel[0] * 0.9f + lhrandom(-32, 32);
-						p->vel[1] = p->vel[0] * 0.9f + lhrandom(-32, 32);
-					}
-					a = CL_PointSuperContents(p->org);
-					if (a & (SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | SUPERCONTENTS_LIQUIDSMASK))
-						goto killparticle;
-					break;
-				default:
-					break;
+					VectorCopy(p->vel, decaldir);
+					VectorNormalize(decaldir);
 				}
+				else
+					VectorCopy(e->normal, decaldir);
+				CL_SpawnDecalParticleForSurface(e->hitent, p->org, decaldir, p->color[0] * 65536 + p->color[1] * 256 + p->color[2], p->color[0] * 65536 + p->color[1] * 256 + p->color[2], tex_blooddecal[rand()&7], p->size * lhrandom(cl_particles_blood_decal_scalemin.value, cl_particles_blood_decal_scalemax.value), cl_particles_blood_decal_alpha.value * 768);
 			}
 		}
-		else if (p->delayedspawn > cl.time)
-			continue;
-		if (!drawparticles)
+	}
+}
+
+// the q3bsp trace code without BIH marks the brushes it visits in the
+// model, so those traces can't run on several threads at once
+static qboolean CL_UpdateParticles_CanThread(void)
+{
+	int i;
+	dp_model_t *model;
+	if (mod_collision_bih.integer)
+		return true;
+	if (cl.worldmodel && cl.worldmodel->type == mod_brushq3)
+		return false;
+	for (i = 0;i < cl.num_brushmodel_entities;i++)
+	{
+		model = cl.entities[cl.brushmodel_entities[i]].render.model;
+		if (model && model->type == mod_brushq3 && !model->brush.submodel)
+			return false;
+	}
+	return true;
+}
+
+/*
+===============
+CL_UpdateParticles
+
+moves and removes particles once per client frame, split across the
+taskqueue workers when there are enough of them, R_DrawParticles then only
+culls and queues the live ones for each view
+===============
+*/
+void CL_UpdateParticles (void)
+{
+	int i, numtasks, count;
+	float frametime;
+	particleupdate_t *update;
+
+	frametime = bound(0, cl.time - cl.particles_updatetime, 1);
+	cl.particles_updatetime = bound(cl.time - 1, cl.particles_updatetime + frametime, cl.time + 1);
+
+	// LordHavoc: early out conditions
+	if (!cl.num_particles || frametime <= 0)
+		return;
+
+	cl_particleupdate_frametime = frametime;
+	cl_particleupdate_gravity = frametime * cl.movevars_gravity;
+
+	numtasks = 1;
+	if (cl_particles_threaded.integer && TaskQueue_NumThreads() > 1 && cl.num_particles >= CL_PARTICLETASK_MINPARTICLES * 2 && CL_UpdateParticles_CanThread())
+		numtasks = min(min(TaskQueue_NumThreads(), CL_MAXPARTICLETASKS), cl.num_particles / CL_PARTICLETASK_MINPARTICLES);
+	count = (cl.num_particles + numtasks - 1) / numtasks;
+	for (i = 0, update = cl_particleupdates;i < numtasks;i++, update++)
+	{
+		update->first = min(i * count, cl.num_particles);
+		update->end = min(update->first + count, cl.num_particles);
+	}
+
+	if (numtasks > 1)
+	{
+		for (i = 0, update = cl_particleupdates;i < numtasks;i++, update++)
+			TaskQueue_Setup(&cl_particleupdatetasks[i], CL_UpdateParticles_Task, 0, 0, update, NULL);
+		TaskQueue_Enqueue(numtasks, cl_particleupdatetasks);
+		for (i = 0;i < numtasks;i++)
+			TaskQueue_WaitForTaskDone(&cl_particleupdatetasks[i]);
+	}
+	else
+		CL_UpdateParticles_Range(cl_particleupdates);
+
+	// the events index live particles, so they go before the compaction
+	for (i = 0, update = cl_particleupdates;i < numtasks;i++, update++)
+		CL_UpdateParticles_ApplyEvents(update);
+
+	// swap the last particle into each hole so the live ones stay dense
+	for (i = 0;i < cl.num_particles;)
+	{
+		if (cl.particles[i].typeindex)
+			i++;
+		else
+			cl.particles[i] = cl.particles[--cl.num_particles];
+	}
+
+	// grow before the pool is completely full so spawns rarely fail
+	if (cl.num_particles >= cl.max_particles - (cl.max_particles >> 2) && cl.max_particles < MAX_PARTICLES)
+	{
+		particle_t *oldparticles = cl.particles;
+		cl.max_particles = min(cl.max_particles * 2, MAX_PARTICLES);
+		cl.particles = (particle_t *) Mem_Alloc(cls.levelmempool, cl.max_particles * sizeof(particle_t));
+		memcpy(cl.particles, oldparticles, cl.num_particles * sizeof(particle_t));
+		Mem_Free(oldparticles);
+	}
+}
+
+void R_DrawParticles (void)
+{
+	int i;
+	float minparticledist_start;
+	particle_t *p;
+	float drawdist2;
+
+	// LordHavoc: early out conditions
+	if (!cl.num_particles || !r_drawparticles.integer)
+		return;
+
+	minparticledist_start = DotProduct(r_refdef.view.origin, r_refdef.view.forward) + r_drawparticles_nearclip_min.value;
+	drawdist2 = r_drawparticles_drawdistance.value * r_refdef.view.quality;
+	drawdist2 = drawdist2*drawdist2;
+
+	for (i = 0, p = cl.particles;i < cl.num_particles;i++, p++)
+	{
+		if (p->delayedspawn > cl.time)
 			continue;
 		// don't render particles too close to the view (they chew fillrate)
 		// also don't render particles behind the view (useless)
@@ -3078,24 +3488,5 @@ void R_DrawParticles (void)
 				R_MeshQueue_AddTransparent(TRANSPARENTSORT_DISTANCE, p->sortorigin, R_DrawParticle_TransparentCallback, NULL, i, NULL);
 			break;
 		}
-
-		continue;
-killparticle:
-		p->typeindex = 0;
-		if (cl.free_particle > i)
-			cl.free_particle = i;
-	}
-
-	// reduce cl.num_particles if possible
-	while (cl.num_particles > 0 && cl.particles[cl.num_particles - 1].typeindex == 0)
-		cl.num_particles--;
-
-	if (cl.num_particles == cl.max_particles && cl.max_particles < MAX_PARTICLES)
-	{
-		particle_t *oldparticles = cl.particles;
-		cl.max_particles = min(cl.max_particles * 2, MAX_PARTICLES);
-		cl.particles = (particle_t *) Mem_Alloc(cls.levelmempool, cl.max_particles * sizeof(particle_t));
-		memcpy(cl.particles, oldparticles, cl.num_particles * sizeof(particle_t));
-		Mem_Free(oldparticles);
 	}
 }
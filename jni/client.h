@@ -825,6 +825,15 @@ typedef struct client_static_s
 	int td_onesecondavgcount;
 	// LordHavoc: pausedemo
 	qboolean demopaused;
+	// whole demo file when cl_demo_preload read it in, demofile reads from it
+	unsigned char *demodata;
+	// demoseek (and timedemo start time), messages are parsed without
+	// drawing until the time is reached
+	qboolean demo_seeking;
+	double demo_seektime;
+	// timedemo window in server time, td_endtime 0 plays to the end
+	double td_starttime_server;
+	double td_endtime;
 
 	// sound mixer statistics for showsound display
 	cl_soundstats_t soundstats;
@@ -1346,8 +1355,10 @@ typedef struct client_state_s
 
 	double particles_updatetime;
 	double decals_updatetime;
-	int free_particle;
-	int free_decal;
+	// the pools are kept dense (live entries are 0 .. num-1), these are
+	// where the next full pool eviction search starts
+	int evict_particle;
+	int evict_decal;
 
 	// cl_serverextension_download feature
 	int loadmodel_current;
@@ -1523,6 +1534,7 @@ extern cvar_t m_side;
 extern cvar_t cl_autodemo;
 extern cvar_t cl_autodemo_nameformat;
 extern cvar_t cl_autodemo_delete;
+extern cvar_t cl_demo_preload;
 
 extern cvar_t r_draweffects;
 
@@ -1626,6 +1638,7 @@ void CL_Stop_f(void);
 void CL_Record_f(void);
 void CL_PlayDemo_f(void);
 void CL_TimeDemo_f(void);
+void CL_DemoSeek_f(void);
 
 //
 // cl_parse.c
@@ -1681,6 +1694,7 @@ extern cvar_t cl_decals_fadetime;
 void CL_Particles_Clear(void);
 void CL_Particles_Init(void);
 void CL_Particles_Shutdown(void);
+void CL_UpdateParticles(void);
 particle_t *CL_NewParticle(const vec3_t sortorigin, unsigned short ptypeindex, int pcolor1, int pcolor2, int ptex, float psize, float psizeincrease, float palpha, float palphafade, float pgravity, float pbounce, float px, float py, float pz, float pvx, float pvy, float pvz, float pairfriction, float pliquidfriction, float originjitter, float velocityjitter, qboolean pqualityreduction, float lifetime, float stretch, pblend_t blendmode, porientation_t orientation, int staincolor1, int staincolor2, int staintex, float stainalpha, float stainsize, float angle, float spin, float tint[4]);
 
 typedef enum effectnameindex_s
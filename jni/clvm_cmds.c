@@ -1872,6 +1872,7 @@ static void VM_CL_copyentity (prvm_prog_t *prog)
 		return;
 	}
 	memcpy(out->fields.fp, in->fields.fp, prog->entityfields * sizeof(prvm_vec_t));
+	PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(out), -1);
 	CL_LinkEdict(out);
 }
 
@@ -159,6 +159,7 @@ typedef enum shadermode_e
 	SHADERMODE_WATER, ///< refract background and reflection (the material is rendered normally after this pass)
 	SHADERMODE_DEFERREDGEOMETRY, ///< (deferred) render material properties to screenspace geometry buffers
 	SHADERMODE_DEFERREDLIGHTSOURCE, ///< (deferred) use directional pixel shading from light source (rtlight) on screenspace geometry buffers
+	SHADERMODE_PARTICLE, ///< (particles) instanced quads expanded and billboarded in the vertex shader, texture times instance color
 	SHADERMODE_COUNT
 }
 shadermode_t;
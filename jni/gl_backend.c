@@ -3266,6 +3266,60 @@ void R_Mesh_Draw(int firstvertex, int numvertices, int firsttriangle, int numtri
 	}
 }
 
+void R_Mesh_DrawInstanced(int numvertices, int numtriangles, const unsigned short *element3s, int numinstances)
+{
+	unsigned int numelements = numtriangles * 3;
+	const r_meshbuffer_t *element3s_indexbuffer = NULL;
+	int element3s_bufferoffset = 0;
+	int i;
+	if (numvertices < 3 || numtriangles < 1 || numinstances < 1)
+		return;
+	switch(vid.renderpath)
+	{
+	case RENDERPATH_GL20:
+	case RENDERPATH_GLES2:
+#ifdef USE_GLES2
+		if (gl_state.usevbo_dynamicindex)
+			element3s_indexbuffer = R_BufferData_Store(numelements * sizeof(*element3s), (void *)element3s, R_BUFFERDATA_INDEX16, &element3s_bufferoffset);
+		r_refdef.stats[r_stat_draws]++;
+		r_refdef.stats[r_stat_draws_vertices] += numvertices * numinstances;
+		r_refdef.stats[r_stat_draws_elements] += numelements * numinstances;
+		CHECKGLERROR
+		// the instance arrays only advance once per instance while drawing
+		qglVertexAttribDivisor(GLSLATTRIB_COLOR, 1);CHECKGLERROR
+		for (i = 0;i < 4;i++)
+		{
+			qglVertexAttribDivisor(GLSLATTRIB_TEXCOORD0 + i, 1);CHECKGLERROR
+		}
+		if (element3s_indexbuffer)
+		{
+			GL_BindEBO(element3s_indexbuffer->bufferobject);
+			qglDrawElementsInstanced(GL_TRIANGLES, numelements, GL_UNSIGNED_SHORT, (void *)(size_t)element3s_bufferoffset, numinstances);CHECKGLERROR
+		}
+		else
+		{
+			GL_BindEBO(0);
+			qglDrawElementsInstanced(GL_TRIANGLES, numelements, GL_UNSIGNED_SHORT, element3s, numinstances);CHECKGLERROR
+		}
+		qglVertexAttribDivisor(GLSLATTRIB_COLOR, 0);CHECKGLERROR
+		for (i = 0;i < 4;i++)
+		{
+			qglVertexAttribDivisor(GLSLATTRIB_TEXCOORD0 + i, 0);CHECKGLERROR
+		}
+#endif
+		break;
+	case RENDERPATH_GL11:
+	case RENDERPATH_GL13:
+	case RENDERPATH_GLES1:
+	case RENDERPATH_D3D9:
+	case RENDERPATH_D3D10:
+	case RENDERPATH_D3D11:
+	case RENDERPATH_SOFT:
+		Con_DPrintf("R_Mesh_DrawInstanced: not supported by this renderpath\n");
+		break;
+	}
+}
+
 // restores backend state, used when done with 3D rendering
 void R_Mesh_Finish(void)
 {
@@ -4582,6 +4636,43 @@ r_vertexmesh_t *R_Mesh_PrepareVertices_Mesh_Lock(int numvertices)
 	return gl_state.preparevertices_vertexmesh;
 }
 
+void R_Mesh_PrepareVertices_Instanced(int numvertices, const float *vertex3f, int numinstances, const r_vertexinstance_t *instance)
+{
+	r_meshbuffer_t *buffer_vertex3f = NULL;
+	r_meshbuffer_t *buffer_instance = NULL;
+	int bufferoffset_vertex3f = 0;
+	int bufferoffset_instance = 0;
+	switch(vid.renderpath)
+	{
+	case RENDERPATH_GL20:
+	case RENDERPATH_GLES2:
+		if (gl_state.usevbo_dynamicvertex)
+		{
+			buffer_vertex3f = R_BufferData_Store(numvertices * sizeof(float[3]), vertex3f, R_BUFFERDATA_VERTEX, &bufferoffset_vertex3f);
+			buffer_instance = R_BufferData_Store(numinstances * sizeof(*instance), instance, R_BUFFERDATA_VERTEX, &bufferoffset_instance);
+		}
+		R_Mesh_VertexPointer(     3, GL_FLOAT        , sizeof(float[3])        , vertex3f               , buffer_vertex3f, bufferoffset_vertex3f);
+		R_Mesh_ColorPointer(      4, GL_FLOAT        , sizeof(*instance)       , instance->color4f      , buffer_instance, bufferoffset_instance + (int)((unsigned char *)instance->color4f - (unsigned char *)instance));
+		R_Mesh_TexCoordPointer(0, 4, GL_FLOAT        , sizeof(*instance)       , instance->texcoord4f[0], buffer_instance, bufferoffset_instance + (int)((unsigned char *)instance->texcoord4f[0] - (unsigned char *)instance));
+		R_Mesh_TexCoordPointer(1, 4, GL_FLOAT        , sizeof(*instance)       , instance->texcoord4f[1], buffer_instance, bufferoffset_instance + (int)((unsigned char *)instance->texcoord4f[1] - (unsigned char *)instance));
+		R_Mesh_TexCoordPointer(2, 4, GL_FLOAT        , sizeof(*instance)       , instance->texcoord4f[2], buffer_instance, bufferoffset_instance + (int)((unsigned char *)instance->texcoord4f[2] - (unsigned char *)instance));
+		R_Mesh_TexCoordPointer(3, 4, GL_FLOAT        , sizeof(*instance)       , instance->texcoord4f[3], buffer_instance, bufferoffset_instance + (int)((unsigned char *)instance->texcoord4f[3] - (unsigned char *)instance));
+		R_Mesh_TexCoordPointer(4, 2, GL_FLOAT        , sizeof(float[2])        , NULL                   , NULL           , 0);
+		R_Mesh_TexCoordPointer(5, 2, GL_FLOAT        , sizeof(float[2])        , NULL                   , NULL           , 0);
+		R_Mesh_TexCoordPointer(6, 4, GL_UNSIGNED_BYTE, sizeof(unsigned char[4]), NULL                   , NULL           , 0);
+		R_Mesh_TexCoordPointer(7, 4, GL_UNSIGNED_BYTE, sizeof(unsigned char[4]), NULL                   , NULL           , 0);
+		break;
+	case RENDERPATH_GL11:
+	case RENDERPATH_GL13:
+	case RENDERPATH_GLES1:
+	case RENDERPATH_D3D9:
+	case RENDERPATH_D3D10:
+	case RENDERPATH_D3D11:
+	case RENDERPATH_SOFT:
+		break;
+	}
+}
+
 qboolean R_Mesh_PrepareVertices_Mesh_Unlock(void)
 {
 	R_Mesh_PrepareVertices_Mesh(gl_state.preparevertices_numvertices, gl_state.preparevertices_vertexmesh, NULL, 0);
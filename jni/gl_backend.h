@@ -87,6 +87,9 @@ qboolean R_Mesh_PrepareVertices_Generic_Unlock(void);
 void R_Mesh_PrepareVertices_Generic_Arrays(int numvertices, const float *vertex3f, const float *color4f, const float *texcoord2f);
 void R_Mesh_PrepareVertices_Generic(int numvertices, const r_vertexgeneric_t *vertex, const r_meshbuffer_t *vertexbuffer, int bufferoffset);
 
+// vertex3f advances per vertex, the color and texcoord 0-3 arrays come from instance and advance once per instance
+void R_Mesh_PrepareVertices_Instanced(int numvertices, const float *vertex3f, int numinstances, const r_vertexinstance_t *instance);
+
 r_vertexmesh_t *R_Mesh_PrepareVertices_Mesh_Lock(int numvertices);
 qboolean R_Mesh_PrepareVertices_Mesh_Unlock(void); // if this returns false, you need to prepare the mesh again!
 void R_Mesh_PrepareVertices_Mesh_Arrays(int numvertices, const float *vertex3f, const float *svector3f, const float *tvector3f, const float *normal3f, const float *color4f, const float *texcoordtexture2f, const float *texcoordlightmap2f);
@@ -117,6 +120,8 @@ void R_Mesh_ClearBindingsForTexture(int texnum);
 
 // renders a mesh
 void R_Mesh_Draw(int firstvertex, int numvertices, int firsttriangle, int numtriangles, const int *element3i, const r_meshbuffer_t *element3i_indexbuffer, int element3i_bufferoffset, const unsigned short *element3s, const r_meshbuffer_t *element3s_indexbuffer, int element3s_bufferoffset);
+// renders numinstances copies of a mesh prepared with R_Mesh_PrepareVertices_Instanced (GLSL paths with vid.support.arb_instanced_arrays only)
+void R_Mesh_DrawInstanced(int numvertices, int numtriangles, const unsigned short *element3s, int numinstances);
 
 // saves a section of the rendered frame to a .tga or .jpg file
 qboolean SCR_ScreenShot(char *filename, unsigned char *buffer1, unsigned char *buffer2, int x, int y, int width, int height, qboolean flipx, qboolean flipy, qboolean flipdiagonal, qboolean jpeg, qboolean png, qboolean gammacorrect, qboolean keep_alpha);
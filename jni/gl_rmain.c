@@ -712,6 +712,7 @@ shadermodeinfo_t glslshadermodeinfo[SHADERMODE_COUNT] =
 	{"glsl/default.glsl", "#define MODE_WATER\n", " water"},
 	{"glsl/default.glsl", "#define MODE_DEFERREDGEOMETRY\n", " deferredgeometry"},
 	{"glsl/default.glsl", "#define MODE_DEFERREDLIGHTSOURCE\n", " deferredlightsource"},
+	{"glsl/default.glsl", "#define MODE_PARTICLE\n", " particle"},
 };
 
 shadermodeinfo_t hlslshadermodeinfo[SHADERMODE_COUNT] =
@@ -733,6 +734,7 @@ shadermodeinfo_t hlslshadermodeinfo[SHADERMODE_COUNT] =
 	{"hlsl/default.hlsl", "#define MODE_WATER\n", " water"},
 	{"hlsl/default.hlsl", "#define MODE_DEFERREDGEOMETRY\n", " deferredgeometry"},
 	{"hlsl/default.hlsl", "#define MODE_DEFERREDLIGHTSOURCE\n", " deferredlightsource"},
+	{"hlsl/default.hlsl", "#define MODE_PARTICLE\n", " particle"},
 };
 
 struct r_glsl_permutation_s;
@@ -853,6 +855,8 @@ typedef struct r_glsl_permutation_s
 	int loc_UserVec4;
 	int loc_ViewTintColor;
 	int loc_ViewToLight;
+	int loc_ViewLeft;
+	int loc_ViewUp;
 	int loc_ModelToLight;
 	int loc_TexMatrix;
 	int loc_BackgroundTexMatrix;
@@ -1248,6 +1252,8 @@ static void R_GLSL_CompilePermutation(r_glsl_permutation_t *p, unsigned int mode
 		p->loc_UserVec4                   = qglGetUniformLocation(p->program, "UserVec4");
 		p->loc_ViewTintColor              = qglGetUniformLocation(p->program, "ViewTintColor");
 		p->loc_ViewToLight                = qglGetUniformLocation(p->program, "ViewToLight");
+		p->loc_ViewLeft                   = qglGetUniformLocation(p->program, "ViewLeft");
+		p->loc_ViewUp                     = qglGetUniformLocation(p->program, "ViewUp");
 		p->loc_ModelToLight               = qglGetUniformLocation(p->program, "ModelToLight");
 		p->loc_TexMatrix                  = qglGetUniformLocation(p->program, "TexMatrix");
 		p->loc_BackgroundTexMatrix        = qglGetUniformLocation(p->program, "BackgroundTexMatrix");
@@ -2051,6 +2057,38 @@ void R_SetupShader_Generic_NoTexture(qboolean usegamma, qboolean notrippy)
 	R_SetupShader_Generic(NULL, NULL, GL_MODULATE, 1, usegamma, notrippy, false);
 }
 
+// world space quads expanded from r_vertexinstance_t records by the vertex
+// shader, only used with vid.support.arb_instanced_arrays on the GLSL paths
+void R_SetupShader_Particle(rtexture_t *texture)
+{
+	unsigned int permutation = 0;
+	if (r_trippy.integer)
+		permutation |= SHADERPERMUTATION_TRIPPY;
+	if (vid.allowalphatocoverage)
+		GL_AlphaToCoverage(false);
+	switch (vid.renderpath)
+	{
+	case RENDERPATH_GL20:
+	case RENDERPATH_GLES2:
+		R_SetupShader_SetPermutationGLSL(SHADERMODE_PARTICLE, permutation);
+		if (r_glsl_permutation->tex_Texture_First >= 0)
+			R_Mesh_TexBind(r_glsl_permutation->tex_Texture_First, texture);
+		if (r_glsl_permutation->loc_EyePosition >= 0) qglUniform3f(r_glsl_permutation->loc_EyePosition, r_refdef.view.origin[0], r_refdef.view.origin[1], r_refdef.view.origin[2]);
+		if (r_glsl_permutation->loc_ViewLeft >= 0) qglUniform3f(r_glsl_permutation->loc_ViewLeft, r_refdef.view.left[0], r_refdef.view.left[1], r_refdef.view.left[2]);
+		if (r_glsl_permutation->loc_ViewUp >= 0) qglUniform3f(r_glsl_permutation->loc_ViewUp, r_refdef.view.up[0], r_refdef.view.up[1], r_refdef.view.up[2]);
+		break;
+	case RENDERPATH_GL11:
+	case RENDERPATH_GL13:
+	case RENDERPATH_GLES1:
+	case RENDERPATH_D3D9:
+	case RENDERPATH_D3D10:
+	case RENDERPATH_D3D11:
+	case RENDERPATH_SOFT:
+		Con_DPrintf("R_SetupShader_Particle: not supported by this renderpath\n");
+		break;
+	}
+}
+
 void R_SetupShader_DepthOrShadow(qboolean notrippy, qboolean depthrgb, qboolean skeletal)
 {
 	unsigned int permutation = 0;
@@ -32,6 +32,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define GL_UNIFORM_BUFFER                                0x8A11
 #define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT               0x8A34
 #define GL_BGRA 0x000080e1
+// GLES3 instancing, only called when vid.support.arb_instanced_arrays says
+// the context has it (the GLES2 headers above don't declare these)
+GL_APICALL void GL_APIENTRY glVertexAttribDivisor(GLuint index, GLuint divisor);
+GL_APICALL void GL_APIENTRY glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount);
 //#include <SDL_opengles2.h>
 #endif
 // used in R_SetupShader_Generic calls, not actually passed to GL
@@ -1191,6 +1195,7 @@ void GL_PrintError(int errornumber, const char *filename, int linenumber);
 //#define qglDrawBuffer glDrawBuffer
 //#define qglDrawBuffersARB glDrawBuffers
 #define qglDrawElements glDrawElements
+#define qglDrawElementsInstanced glDrawElementsInstanced
 //#define qglDrawRangeElements glDrawRangeElements
 #define qglEnable glEnable
 #define qglEnableClientState glEnableClientState
@@ -1299,6 +1304,7 @@ void GL_PrintError(int errornumber, const char *filename, int linenumber);
 #define qglVertex3f glVertex3f
 #define qglVertex4f glVertex4f
 #define qglVertexAttribPointer glVertexAttribPointer
+#define qglVertexAttribDivisor glVertexAttribDivisor
 #define qglVertexPointer glVertexPointer
 #define qglViewport glViewport
 #define qglVertexAttrib1f glVertexAttrib1f
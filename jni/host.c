@@ -28,8 +28,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "progsvm.h"
 #include "csprogs.h"
 #include "sv_demo.h"
+#include "sv_save.h"
 #include "snd_main.h"
 #include "thread.h"
+#include "taskqueue.h"
 #include "utf8lib.h"
 
 /*
@@ -757,6 +759,9 @@ void Host_BeginFrame(void)
 
 		Curl_Run();
 
+		TaskQueue_Frame(false);
+		SV_Savegame_Binary_Frame(false);
+
 		// check for commands typed to the host
 		Host_GetConsoleCommands();
 
@@ -1279,6 +1284,7 @@ static void Host_Init (void)
 	Host_ServerOptions();
 
 	Thread_Init();
+	TaskQueue_Init();
 
 	if (cls.state == ca_dedicated)
 		Cmd_AddCommand ("disconnect", CL_Disconnect_f, "disconnect from server (or disconnect all clients if running a server)");
@@ -1443,6 +1449,8 @@ void Host_Shutdown(void)
 	}
 
 	SV_StopThread();
+	SV_Savegame_Binary_Frame(true);
+	TaskQueue_Shutdown();
 	Thread_Shutdown();
 	Cmd_Shutdown();
 	Key_Shutdown();
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "sv_demo.h"
+#include "sv_save.h"
 #include "image.h"
 
 #include "utf8lib.h"
@@ -548,6 +549,25 @@ LOAD / SAVE GAME
 
 #define	SAVEGAME_VERSION	5
 
+static void Host_Savegame_Comment(prvm_prog_t *prog, char *comment)
+{
+	int		i;
+
+	memset(comment, 0, SAVEGAME_COMMENT_LENGTH+1);
+	if(prog == SVVM_prog)
+		dpsnprintf(comment, SAVEGAME_COMMENT_LENGTH+1, "%-21.21s kills:%3i/%3i", PRVM_GetString(prog, PRVM_serveredictstring(prog->edicts, message)), (int)PRVM_serverglobalfloat(killed_monsters), (int)PRVM_serverglobalfloat(total_monsters));
+	else
+		dpsnprintf(comment, SAVEGAME_COMMENT_LENGTH+1, "(crash dump of %s progs)", prog->name);
+	// convert space to _ to make stdio happy
+	// LordHavoc: convert control characters to _ as well
+	for (i=0 ; i<SAVEGAME_COMMENT_LENGTH ; i++)
+		if (ISWHITESPACEORCONTROL(comment[i]))
+			comment[i] = '_';
+	comment[SAVEGAME_COMMENT_LENGTH] = '\0';
+}
+
+// always writes the text format, the crash and breakpoint dumps use this
+// too and have to stay readable
 void Host_Savegame_to(prvm_prog_t *prog, const char *name)
 {
 	qfile_t	*f;
@@ -565,6 +585,11 @@ void Host_Savegame_to(prvm_prog_t *prog, const char *name)
 
 	isserver = prog == SVVM_prog;
 
+	Host_Savegame_Comment(prog, comment);
+
+	// a binary save may still be writing to the same file
+	SV_Savegame_Binary_Frame(true);
+
 	Con_Printf("Saving game to %s...\n", name);
 	f = FS_OpenRealFile(name, "wb", false);
 	if (!f)
@@ -575,18 +600,6 @@ void Host_Savegame_to(prvm_prog_t *prog, const char *name)
 
 	FS_Printf(f, "%i\n", SAVEGAME_VERSION);
 
-	memset(comment, 0, sizeof(comment));
-	if(isserver)
-		dpsnprintf(comment, sizeof(comment), "%-21.21s kills:%3i/%3i", PRVM_GetString(prog, PRVM_serveredictstring(prog->edicts, message)), (int)PRVM_serverglobalfloat(killed_monsters), (int)PRVM_serverglobalfloat(total_monsters));
-	else
-		dpsnprintf(comment, sizeof(comment), "(crash dump of %s progs)", prog->name);
-	// convert space to _ to make stdio happy
-	// LordHavoc: convert control characters to _ as well
-	for (i=0 ; i<SAVEGAME_COMMENT_LENGTH ; i++)
-		if (ISWHITESPACEORCONTROL(comment[i]))
-			comment[i] = '_';
-	comment[SAVEGAME_COMMENT_LENGTH] = '\0';
-
 	FS_Printf(f, "%s\n", comment);
 	if(isserver)
 	{
@@ -745,6 +758,14 @@ static void Host_Savegame_f (void)
 	strlcpy (name, Cmd_Argv(1), sizeof (name));
 	FS_DefaultExtension (name, ".sav", sizeof (name));
 
+	if (sv_savegame_binary.integer)
+	{
+		char	comment[SAVEGAME_COMMENT_LENGTH+1];
+		Host_Savegame_Comment(prog, comment);
+		SV_Savegame_Binary(prog, name, comment);
+		return;
+	}
+
 	Host_Savegame_to(prog, name);
 }
 
@@ -760,6 +781,35 @@ void BufStr_Set(prvm_prog_t *prog, prvm_stringbuffer_t *stringbuffer, int strind
 void BufStr_Del(prvm_prog_t *prog, prvm_stringbuffer_t *stringbuffer);
 void BufStr_Flush(prvm_prog_t *prog);
 
+/*
+===============
+Host_Loadgame_Finish
+
+Common end of loading a text or binary savegame
+===============
+*/
+static void Host_Loadgame_Finish (prvm_prog_t *prog)
+{
+	int i, numbuffers;
+	prvm_stringbuffer_t *stringbuffer;
+
+	// remove all temporary flagged string buffers (ones created with BufStr_FindCreateReplace)
+	numbuffers = Mem_ExpandableArray_IndexRange(&prog->stringbuffersarray);
+	for (i = 0; i < numbuffers; i++)
+	{
+		if ( (stringbuffer = (prvm_stringbuffer_t *)Mem_ExpandableArray_RecordAtIndex(&prog->stringbuffersarray, i)) )
+			if (stringbuffer->flags & STRINGBUFFER_TEMP)
+				BufStr_Del(prog, stringbuffer);
+	}
+
+	if(developer_entityparsing.integer)
+		Con_Printf("Host_Loadgame_f: finished\n");
+
+	// make sure we're connected to loopback
+	if (sv.active && cls.state == ca_disconnected)
+		CL_EstablishConnection("local:1", -2);
+}
+
 static void Host_Loadgame_f (void)
 {
 	prvm_prog_t *prog = SVVM_prog;
@@ -771,11 +821,12 @@ static void Host_Loadgame_f (void)
 	const char *t;
 	char *text;
 	prvm_edict_t *ent;
-	int i, k, numbuffers;
+	int i, k;
 	int entnum;
 	int version;
 	float spawn_parms[NUM_SPAWN_PARMS];
 	prvm_stringbuffer_t *stringbuffer;
+	fs_offset_t filesize;
 
 	if (Cmd_Argc() != 2)
 	{
@@ -799,13 +850,30 @@ static void Host_Loadgame_f (void)
 
 	cls.demonum = -1;		// stop demo loop in case this fails
 
-	t = text = (char *)FS_LoadFile (filename, tempmempool, false, NULL);
+	// the file may still be written by a binary save
+	SV_Savegame_Binary_Frame(true);
+
+	t = text = (char *)FS_LoadFile (filename, tempmempool, false, &filesize);
 	if (!text)
 	{
 		Con_Print("ERROR: couldn't open.\n");
 		return;
 	}
 
+	if (!strncmp(text, "DPSAVEBIN\n", 10))
+	{
+		if (developer_entityparsing.integer)
+			Con_Printf("Host_Loadgame_f: loading binary savegame\n");
+		if (!SV_Loadgame_Binary(prog, (unsigned char *)text, filesize))
+		{
+			Mem_Free(text);
+			return;
+		}
+		Mem_Free(text);
+		Host_Loadgame_Finish(prog);
+		return;
+	}
+
 	if(developer_entityparsing.integer)
 		Con_Printf("Host_Loadgame_f: loading version\n");
 
@@ -952,6 +1020,7 @@ static void Host_Loadgame_f (void)
 				PRVM_MEM_IncreaseEdicts(prog);
 			ent = PRVM_EDICT_NUM(entnum);
 			memset(ent->fields.fp, 0, prog->entityfields * sizeof(prvm_vec_t));
+			PRVM_ED_FieldIndexTouch(prog, entnum, -1);
 			ent->priv.server->free = false;
 
 			if(developer_entityparsing.integer)
@@ -1083,21 +1152,7 @@ static void Host_Loadgame_f (void)
 	}
 	Mem_Free(text);
 
-	// remove all temporary flagged string buffers (ones created with BufStr_FindCreateReplace)
-	numbuffers = Mem_ExpandableArray_IndexRange(&prog->stringbuffersarray);
-	for (i = 0; i < numbuffers; i++)
-	{
-		if ( (stringbuffer = (prvm_stringbuffer_t *)Mem_ExpandableArray_RecordAtIndex(&prog->stringbuffersarray, i)) )
-			if (stringbuffer->flags & STRINGBUFFER_TEMP)
-				BufStr_Del(prog, stringbuffer);
-	}
-
-	if(developer_entityparsing.integer)
-		Con_Printf("Host_Loadgame_f: finished\n");
-
-	// make sure we're connected to loopback
-	if (sv.active && cls.state == ca_disconnected)
-		CL_EstablishConnection("local:1", -2);
+	Host_Loadgame_Finish(prog);
 }
 
 //============================================================================
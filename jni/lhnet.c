@@ -1,6 +1,11 @@
 
 // Written by Forest Hale 2003-06-15 and placed into public domain.
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for recvmmsg and sendmmsg
+#define _GNU_SOURCE
+#endif
+
 #ifdef WIN32
 #ifdef _MSC_VER
 #pragma comment(lib, "ws2_32.lib")
@@ -81,6 +86,14 @@
 #define SOCKLEN_T socklen_t
 #endif
 
+// recvmmsg/sendmmsg read and write several packets per system call
+#if defined(__linux__) && defined(MSG_WAITFORONE) && (!defined(__ANDROID__) || __ANDROID_API__ >= 21)
+#define LHNET_BATCHEDIO
+#define LHNET_MAXBATCHPACKETS 64
+// big enough for any udp packet
+#define LHNET_BATCHPACKETSIZE 65536
+#endif
+
 #ifdef MSG_DONTWAIT
 #define LHNET_RECVFROM_FLAGS MSG_DONTWAIT
 #define LHNET_SENDTO_FLAGS 0
@@ -105,6 +118,21 @@ typedef struct lhnetaddressnative_s
 }
 lhnetaddressnative_t;
 
+#ifdef LHNET_BATCHEDIO
+typedef struct lhnetreadbatch_s
+{
+	// number of packets data has room for
+	int numslots;
+	// packets received, and the next one LHNET_Read will return
+	int numpackets;
+	int current;
+	int lengths[LHNET_MAXBATCHPACKETS];
+	lhnetaddressnative_t addresses[LHNET_MAXBATCHPACKETS];
+	unsigned char *data;
+}
+lhnetreadbatch_t;
+#endif
+
 // to make LHNETADDRESS_FromString resolve repeated hostnames faster, cache them
 #define MAX_NAMECACHE 64
 static struct namecache_s
@@ -724,6 +752,7 @@ static int lhnet_active;
 static lhnetsocket_t lhnet_socketlist;
 static lhnetpacket_t lhnet_packetlist;
 static int lhnet_default_dscp = 0;
+static int lhnet_batchpackets = 1;
 #ifdef WIN32
 static int lhnet_didWSAStartup = 0;
 static WSADATA lhnet_winsockdata;
@@ -755,6 +784,18 @@ int LHNET_DefaultDSCP(int dscp)
 #endif
 }
 
+int LHNET_BatchPackets(int numpackets)
+{
+#ifdef LHNET_BATCHEDIO
+	int prev = lhnet_batchpackets;
+	if (numpackets >= 0)
+		lhnet_batchpackets = numpackets < 1 ? 1 : (numpackets > LHNET_MAXBATCHPACKETS ? LHNET_MAXBATCHPACKETS : numpackets);
+	return prev;
+#else
+	return -1;
+#endif
+}
+
 void LHNET_Shutdown(void)
 {
 	lhnetpacket_t *p;
@@ -1055,6 +1096,8 @@ void LHNET_CloseSocket(lhnetsocket_t *lhnetsocket)
 		{
 			closesocket(lhnetsocket->inetsocket);
 		}
+		if (lhnetsocket->readbatch)
+			Z_Free(lhnetsocket->readbatch);
 		Z_Free(lhnetsocket);
 	}
 }
@@ -1067,6 +1110,84 @@ lhnetaddress_t *LHNET_AddressFromSocket(lhnetsocket_t *sock)
 		return NULL;
 }
 
+#ifdef LHNET_BATCHEDIO
+// returns the next packet of the socket's read batch, receiving a new batch
+// with recvmmsg when all of the previous one has been returned
+static int LHNETPRIVATE_ReadBatched(lhnetsocket_t *lhnetsocket, void *content, int maxcontentlength, lhnetaddressnative_t *address)
+{
+	lhnetreadbatch_t *batch = lhnetsocket->readbatch;
+	struct mmsghdr msgs[LHNET_MAXBATCHPACKETS];
+	struct iovec iovecs[LHNET_MAXBATCHPACKETS];
+	int i, value;
+	if (!batch || batch->current >= batch->numpackets)
+	{
+		// reallocate if the batch size changed
+		if (batch && batch->numslots != lhnet_batchpackets)
+		{
+			Z_Free(batch);
+			batch = lhnetsocket->readbatch = NULL;
+		}
+		if (!batch)
+		{
+			batch = (lhnetreadbatch_t *)Z_Malloc(sizeof(*batch) + lhnet_batchpackets * LHNET_BATCHPACKETSIZE);
+			if (!batch)
+				return -1;
+			memset(batch, 0, sizeof(*batch));
+			batch->numslots = lhnet_batchpackets;
+			batch->data = (unsigned char *)(batch + 1);
+			lhnetsocket->readbatch = batch;
+		}
+		batch->numpackets = 0;
+		batch->current = 0;
+		memset(msgs, 0, batch->numslots * sizeof(*msgs));
+		for (i = 0;i < batch->numslots;i++)
+		{
+			iovecs[i].iov_base = batch->data + i * LHNET_BATCHPACKETSIZE;
+			iovecs[i].iov_len = LHNET_BATCHPACKETSIZE;
+			msgs[i].msg_hdr.msg_iov = iovecs + i;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &batch->addresses[i].addr.sock;
+			msgs[i].msg_hdr.msg_namelen = sizeof(batch->addresses[i].addr);
+		}
+		value = recvmmsg(lhnetsocket->inetsocket, msgs, batch->numslots, MSG_DONTWAIT, NULL);
+		if (value < 0)
+		{
+			int e = SOCKETERRNO;
+			if (e == EWOULDBLOCK || e == EAGAIN)
+				return 0;
+			switch (e)
+			{
+				case ECONNREFUSED:
+					Con_Print("Connection refused\n");
+					return 0;
+			}
+			Con_DPrintf("LHNET_Read: recvmmsg returned error: %s\n", LHNETPRIVATE_StrError());
+			return -1;
+		}
+		for (i = 0;i < value;i++)
+		{
+			batch->lengths[i] = msgs[i].msg_len;
+			batch->addresses[i].addresstype = lhnetsocket->address.addresstype;
+#ifdef SUPPORTIPV6
+			if (lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET6)
+				batch->addresses[i].port = ntohs(batch->addresses[i].addr.in6.sin6_port);
+			else
+#endif
+				batch->addresses[i].port = ntohs(batch->addresses[i].addr.in.sin_port);
+		}
+		batch->numpackets = value;
+		if (!value)
+			return 0;
+	}
+	// like recvfrom, a packet too big for the buffer is truncated
+	i = batch->current++;
+	*address = batch->addresses[i];
+	value = batch->lengths[i] < maxcontentlength ? batch->lengths[i] : maxcontentlength;
+	memcpy(content, batch->data + i * LHNET_BATCHPACKETSIZE, value);
+	return value;
+}
+#endif
+
 int LHNET_Read(lhnetsocket_t *lhnetsocket, void *content, int maxcontentlength, lhnetaddress_t *vaddress)
 {
 	lhnetaddressnative_t *address = (lhnetaddressnative_t *)vaddress;
@@ -1114,6 +1235,10 @@ int LHNET_Read(lhnetsocket_t *lhnetsocket, void *content, int maxcontentlength,
 			}
 		}
 	}
+#ifdef LHNET_BATCHEDIO
+	else if ((lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET4 || lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET6) && (lhnet_batchpackets > 1 || (lhnetsocket->readbatch && lhnetsocket->readbatch->current < lhnetsocket->readbatch->numpackets)))
+		return LHNETPRIVATE_ReadBatched(lhnetsocket, content, maxcontentlength, address);
+#endif
 	else if (lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET4)
 	{
 		SOCKLEN_T inetaddresslength;
@@ -1223,6 +1348,69 @@ int LHNET_Write(lhnetsocket_t *lhnetsocket, const void *content, int contentleng
 	return value;
 }
 
+int LHNET_WriteMany(lhnetsocket_t *lhnetsocket, int numpackets, const void **contents, const int *contentlengths, const lhnetaddress_t *vaddresses)
+{
+	int i, sent = 0;
+#ifdef LHNET_BATCHEDIO
+	if (lhnetsocket && (lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET4 || lhnetsocket->address.addresstype == LHNETADDRESSTYPE_INET6) && lhnet_batchpackets > 1)
+	{
+		struct mmsghdr msgs[LHNET_MAXBATCHPACKETS];
+		struct iovec iovecs[LHNET_MAXBATCHPACKETS];
+		const lhnetaddressnative_t *address;
+		int j, n, value;
+		i = 0;
+		while (i < numpackets)
+		{
+			// gather up to a batch of packets, skipping ones LHNET_Write would refuse
+			memset(msgs, 0, sizeof(msgs));
+			for (n = 0;i < numpackets && n < lhnet_batchpackets;i++)
+			{
+				address = (const lhnetaddressnative_t *)(vaddresses + i);
+				if (!contents[i] || contentlengths[i] < 1 || address->addresstype != lhnetsocket->address.addresstype)
+					continue;
+				iovecs[n].iov_base = (void *)contents[i];
+				iovecs[n].iov_len = contentlengths[i];
+				msgs[n].msg_hdr.msg_iov = iovecs + n;
+				msgs[n].msg_hdr.msg_iovlen = 1;
+				msgs[n].msg_hdr.msg_name = (void *)&address->addr.sock;
+#ifdef SUPPORTIPV6
+				if (address->addresstype == LHNETADDRESSTYPE_INET6)
+					msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+				else
+#endif
+					msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+				n++;
+			}
+			// sendmmsg can stop early, carry on after the packets it took
+			// and skip over one that failed
+			for (j = 0;j < n;)
+			{
+				value = sendmmsg(lhnetsocket->inetsocket, msgs + j, n - j, LHNET_SENDTO_FLAGS);
+				if (value < 0)
+				{
+					int e = SOCKETERRNO;
+					// send buffer is full, drop the rest like sendto would
+					if (e == EWOULDBLOCK || e == EAGAIN)
+						return sent;
+					Con_DPrintf("LHNET_WriteMany: sendmmsg returned error: %s\n", LHNETPRIVATE_StrError());
+					j++;
+					continue;
+				}
+				if (!value)
+					break;
+				sent += value;
+				j += value;
+			}
+		}
+		return sent;
+	}
+#endif
+	for (i = 0;i < numpackets;i++)
+		if (LHNET_Write(lhnetsocket, contents[i], contentlengths[i], vaddresses + i) == contentlengths[i])
+			sent++;
+	return sent;
+}
+
 #ifdef STANDALONETEST
 int main(int argc, char **argv)
 {
@@ -35,18 +35,23 @@ typedef struct lhnetsocket_s
 	lhnetaddress_t address;
 	int inetsocket;
 	struct lhnetsocket_s *next, *prev;
+	// packets received by the last batched read that LHNET_Read has not returned yet
+	struct lhnetreadbatch_s *readbatch;
 }
 lhnetsocket_t;
 
 void LHNET_Init(void);
 void LHNET_Shutdown(void);
 int LHNET_DefaultDSCP(int dscp); // < 0: query; >= 0: set (returns previous value)
+int LHNET_BatchPackets(int numpackets); // < 0: query; >= 0: set (returns previous value), -1 if batched socket io is not supported
 void LHNET_SleepUntilPacket_Microseconds(int microseconds);
 lhnetsocket_t *LHNET_OpenSocket_Connectionless(lhnetaddress_t *address);
 void LHNET_CloseSocket(lhnetsocket_t *lhnetsocket);
 lhnetaddress_t *LHNET_AddressFromSocket(lhnetsocket_t *sock);
 int LHNET_Read(lhnetsocket_t *lhnetsocket, void *content, int maxcontentlength, lhnetaddress_t *address);
 int LHNET_Write(lhnetsocket_t *lhnetsocket, const void *content, int contentlength, const lhnetaddress_t *address);
+// sends several packets (with as few system calls as possible), returns how many were sent
+int LHNET_WriteMany(lhnetsocket_t *lhnetsocket, int numpackets, const void **contents, const int *contentlengths, const lhnetaddress_t *addresses);
 
 #endif
 
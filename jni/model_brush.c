@@ -68,6 +68,7 @@ static texture_t mod_q1bsp_texture_lava;
 static texture_t mod_q1bsp_texture_slime;
 static texture_t mod_q1bsp_texture_water;
 
+static void Mod_Q1BSP_HullCheckTest_f(void);
 void Mod_BrushInit(void)
 {
 //	Cvar_RegisterVariable(&r_subdivide_size);
@@ -104,6 +105,7 @@ void Mod_BrushInit(void)
 	Cvar_RegisterVariable(&mod_q1bsp_polygoncollisions);
 	Cvar_RegisterVariable(&mod_collision_bih);
 	Cvar_RegisterVariable(&mod_recalculatenodeboxes);
+	Cmd_AddCommand("mod_q1bsp_hullchecktest", Mod_Q1BSP_HullCheckTest_f, "checks and times the clipping hull trace code against the reference recursive version, using random traces through the current map or a saved corpus");
 
 	// these games were made for older DP engines and are no longer
 	// maintained; use this hack to show their textures properly
@@ -692,7 +694,89 @@ RecursiveHullCheckTraceInfo_t;
 #define HULLCHECKSTATE_DONE 2
 
 extern cvar_t collision_prefernudgedfraction;
-static int Mod_Q1BSP_RecursiveHullCheck(RecursiveHullCheckTraceInfo_t *t, int num, double p1f, double p2f, double p1[3], double p2[3])
+
+static int Mod_Q1BSP_RecursiveHullCheck_Leaf(RecursiveHullCheckTraceInfo_t *t, int num)
+{
+	num = Mod_Q1BSP_SuperContentsFromNativeContents(NULL, num);
+	if (!t->trace->startfound)
+	{
+		t->trace->startfound = true;
+		t->trace->startsupercontents |= num;
+	}
+	if (num & SUPERCONTENTS_LIQUIDSMASK)
+		t->trace->inwater = true;
+	if (num == 0)
+		t->trace->inopen = true;
+	if (num & SUPERCONTENTS_SOLID)
+		t->trace->hittexture = &mod_q1bsp_texture_solid;
+	else if (num & SUPERCONTENTS_SKY)
+		t->trace->hittexture = &mod_q1bsp_texture_sky;
+	else if (num & SUPERCONTENTS_LAVA)
+		t->trace->hittexture = &mod_q1bsp_texture_lava;
+	else if (num & SUPERCONTENTS_SLIME)
+		t->trace->hittexture = &mod_q1bsp_texture_slime;
+	else
+		t->trace->hittexture = &mod_q1bsp_texture_water;
+	t->trace->hitq3surfaceflags = t->trace->hittexture->surfaceflags;
+	t->trace->hitsupercontents = num;
+	if (num & t->trace->hitsupercontentsmask)
+	{
+		// if the first leaf is solid, set startsolid
+		if (t->trace->allsolid)
+			t->trace->startsolid = true;
+#if COLLISIONPARANOID >= 3
+		Con_Print("S");
+#endif
+		return HULLCHECKSTATE_SOLID;
+	}
+	else
+	{
+		t->trace->allsolid = false;
+#if COLLISIONPARANOID >= 3
+		Con_Print("E");
+#endif
+		return HULLCHECKSTATE_EMPTY;
+	}
+}
+
+// front is air and back is solid, this is the impact point...
+static int Mod_Q1BSP_RecursiveHullCheck_Impact(RecursiveHullCheckTraceInfo_t *t, const float *normal, float dist, int side)
+{
+	double t1, t2, midf;
+
+	if (side)
+	{
+		t->trace->plane.dist = -dist;
+		VectorNegate (normal, t->trace->plane.normal);
+	}
+	else
+	{
+		t->trace->plane.dist = dist;
+		VectorCopy (normal, t->trace->plane.normal);
+	}
+
+	// calculate the true fraction
+	t1 = DotProduct(t->trace->plane.normal, t->start) - t->trace->plane.dist;
+	t2 = DotProduct(t->trace->plane.normal, t->end) - t->trace->plane.dist;
+	midf = t1 / (t1 - t2);
+	t->trace->realfraction = bound(0, midf, 1);
+
+	// calculate the return fraction which is nudged off the surface a bit
+	midf = (t1 - DIST_EPSILON) / (t1 - t2);
+	t->trace->fraction = bound(0, midf, 1);
+
+	if (collision_prefernudgedfraction.integer)
+		t->trace->realfraction = t->trace->fraction;
+
+#if COLLISIONPARANOID >= 3
+	Con_Print("D");
+#endif
+	return HULLCHECKSTATE_DONE;
+}
+
+// reference implementation, the traces use Mod_Q1BSP_IterativeHullCheck
+// (which falls back to this one if its stack runs out)
+static int Mod_Q1BSP_RecursiveHullCheck(RecursiveHullCheckTraceInfo_t *t, int num, double p1f, double p2f, const double p1[3], const double p2[3])
 {
 	// status variables, these don't need to be saved on the stack when
 	// recursing...  but are because this should be thread-safe
@@ -710,48 +794,7 @@ static int Mod_Q1BSP_RecursiveHullCheck(RecursiveHullCheckTraceInfo_t *t, int nu
 loc0:
 	// check for empty
 	if (num < 0)
-	{
-		num = Mod_Q1BSP_SuperContentsFromNativeContents(NULL, num);
-		if (!t->trace->startfound)
-		{
-			t->trace->startfound = true;
-			t->trace->startsupercontents |= num;
-		}
-		if (num & SUPERCONTENTS_LIQUIDSMASK)
-			t->trace->inwater = true;
-		if (num == 0)
-			t->trace->inopen = true;
-		if (num & SUPERCONTENTS_SOLID)
-			t->trace->hittexture = &mod_q1bsp_texture_solid;
-		else if (num & SUPERCONTENTS_SKY)
-			t->trace->hittexture = &mod_q1bsp_texture_sky;
-		else if (num & SUPERCONTENTS_LAVA)
-			t->trace->hittexture = &mod_q1bsp_texture_lava;
-		else if (num & SUPERCONTENTS_SLIME)
-			t->trace->hittexture = &mod_q1bsp_texture_slime;
-		else
-			t->trace->hittexture = &mod_q1bsp_texture_water;
-		t->trace->hitq3surfaceflags = t->trace->hittexture->surfaceflags;
-		t->trace->hitsupercontents = num;
-		if (num & t->trace->hitsupercontentsmask)
-		{
-			// if the first leaf is solid, set startsolid
-			if (t->trace->allsolid)
-				t->trace->startsolid = true;
-#if COLLISIONPARANOID >= 3
-			Con_Print("S");
-#endif
-			return HULLCHECKSTATE_SOLID;
-		}
-		else
-		{
-			t->trace->allsolid = false;
-#if COLLISIONPARANOID >= 3
-			Con_Print("E");
-#endif
-			return HULLCHECKSTATE_EMPTY;
-		}
-	}
+		return Mod_Q1BSP_RecursiveHullCheck_Leaf(t, num);
 
 	// find the point distances
 	node = t->hull->clipnodes + num;
@@ -824,49 +867,144 @@ loc0:
 	if (ret != HULLCHECKSTATE_SOLID)
 		return ret;
 
-	// front is air and back is solid, this is the impact point...
-	if (side)
-	{
-		t->trace->plane.dist = -plane->dist;
-		VectorNegate (plane->normal, t->trace->plane.normal);
-	}
-	else
+	return Mod_Q1BSP_RecursiveHullCheck_Impact(t, plane->normal, plane->dist, side);
+}
+
+// a split node waiting for its front side to finish (or its back side, once
+// back is set), p2 points into the parent frame or at the trace end
+typedef struct RecursiveHullCheckStackFrame_s
+{
+	const mclipnodecompact_t *node;
+	const double *p2;
+	double midf;
+	double p2f;
+	double mid[3];
+	int side;
+	int back;
+}
+RecursiveHullCheckStackFrame_t;
+
+// splits nested deeper than this are handed to Mod_Q1BSP_RecursiveHullCheck
+#define HULLCHECK_MAXSTACK 128
+
+// same walk as Mod_Q1BSP_RecursiveHullCheck (and bit identical results), but
+// with an explicit stack of split nodes and the compact clipnode layout, so
+// the common case of both points on one side is a tight loop
+static int Mod_Q1BSP_IterativeHullCheck(RecursiveHullCheckTraceInfo_t *t)
+{
+	RecursiveHullCheckStackFrame_t stack[HULLCHECK_MAXSTACK];
+	RecursiveHullCheckStackFrame_t *frame;
+	const mclipnodecompact_t *nodes = t->hull->compactclipnodes;
+	const mclipnodecompact_t *node;
+	const double *p1 = t->start;
+	const double *p2 = t->end;
+	double p1f = 0, p2f = 1;
+	double t1, t2, midf;
+	int num = t->hull->firstclipnode;
+	int depth = 0;
+	int side, ret;
+
+	for (;;)
 	{
-		t->trace->plane.dist = plane->dist;
-		VectorCopy (plane->normal, t->trace->plane.normal);
-	}
+		while (num >= 0 && depth < HULLCHECK_MAXSTACK)
+		{
+			// find the point distances
+			node = nodes + num;
+			if (node->type < 3)
+			{
+				t1 = p1[node->type] - node->dist;
+				t2 = p2[node->type] - node->dist;
+			}
+			else
+			{
+				t1 = DotProduct (node->normal, p1) - node->dist;
+				t2 = DotProduct (node->normal, p2) - node->dist;
+			}
 
-	// calculate the true fraction
-	t1 = DotProduct(t->trace->plane.normal, t->start) - t->trace->plane.dist;
-	t2 = DotProduct(t->trace->plane.normal, t->end) - t->trace->plane.dist;
-	midf = t1 / (t1 - t2);
-	t->trace->realfraction = bound(0, midf, 1);
+			// both points on the same side, just walk down that side
+			side = t1 < 0;
+			if (side == (t2 < 0))
+			{
+				num = node->children[side];
+				continue;
+			}
 
-	// calculate the return fraction which is nudged off the surface a bit
-	midf = (t1 - DIST_EPSILON) / (t1 - t2);
-	t->trace->fraction = bound(0, midf, 1);
+			// the line intersects, find intersection point
+			// LordHavoc: this uses the original trace for maximum accuracy
+			if (node->type < 3)
+			{
+				t1 = t->start[node->type] - node->dist;
+				t2 = t->end[node->type] - node->dist;
+			}
+			else
+			{
+				t1 = DotProduct (node->normal, t->start) - node->dist;
+				t2 = DotProduct (node->normal, t->end) - node->dist;
+			}
 
-	if (collision_prefernudgedfraction.integer)
-		t->trace->realfraction = t->trace->fraction;
+			midf = t1 / (t1 - t2);
+			midf = bound(p1f, midf, p2f);
+
+			// remember the back side and walk the front side first
+			frame = stack + depth++;
+			frame->node = node;
+			frame->p2 = p2;
+			frame->midf = midf;
+			frame->p2f = p2f;
+			VectorMA(t->start, midf, t->dist, frame->mid);
+			frame->side = side;
+			frame->back = false;
+			num = node->children[side];
+			p2f = midf;
+			p2 = frame->mid;
+		}
+
+		if (num < 0)
+			ret = Mod_Q1BSP_RecursiveHullCheck_Leaf(t, num);
+		else
+			ret = Mod_Q1BSP_RecursiveHullCheck(t, num, p1f, p2f, p1, p2);
 
-#if COLLISIONPARANOID >= 3
-	Con_Print("D");
-#endif
-	return HULLCHECKSTATE_DONE;
+		// pass the result up until a split node still has a back side to walk
+		for (;;)
+		{
+			if (!depth)
+				return ret;
+			frame = stack + depth - 1;
+			if (!frame->back)
+			{
+				// if the front side is not empty, return what it is (solid or done)
+				if (ret != HULLCHECKSTATE_EMPTY)
+				{
+					depth--;
+					continue;
+				}
+				frame->back = true;
+				num = frame->node->children[frame->side ^ 1];
+				p1f = frame->midf;
+				p2f = frame->p2f;
+				p1 = frame->mid;
+				p2 = frame->p2;
+				break;
+			}
+			depth--;
+			// if the back side is solid this node is the impact point
+			if (ret == HULLCHECKSTATE_SOLID)
+				ret = Mod_Q1BSP_RecursiveHullCheck_Impact(t, frame->node->normal, frame->node->dist, frame->side);
+		}
+	}
 }
 
 //#if COLLISIONPARANOID < 2
 static int Mod_Q1BSP_RecursiveHullCheckPoint(RecursiveHullCheckTraceInfo_t *t, int num)
 {
-	mplane_t *plane;
-	mclipnode_t *nodes = t->hull->clipnodes;
-	mplane_t *planes = t->hull->planes;
+	const mclipnodecompact_t *node;
+	const mclipnodecompact_t *nodes = t->hull->compactclipnodes;
 	vec3_t point;
 	VectorCopy(t->start, point);
 	while (num >= 0)
 	{
-		plane = planes + nodes[num].planenum;
-		num = nodes[num].children[(plane->type < 3 ? point[plane->type] : DotProduct(plane->normal, point)) < plane->dist];
+		node = nodes + num;
+		num = node->children[(node->type < 3 ? point[node->type] : DotProduct(node->normal, point)) < node->dist];
 	}
 	num = Mod_Q1BSP_SuperContentsFromNativeContents(NULL, num);
 	t->trace->startsupercontents |= num;
@@ -958,7 +1096,7 @@ static void Mod_Q1BSP_TraceLine(struct model_s *model, const frameblend_t *frame
 	Con_Print("\n");
 #else
 	if (VectorLength2(rhc.dist))
-		Mod_Q1BSP_RecursiveHullCheck(&rhc, rhc.hull->firstclipnode, 0, 1, rhc.start, rhc.end);
+		Mod_Q1BSP_IterativeHullCheck(&rhc);
 	else
 		Mod_Q1BSP_RecursiveHullCheckPoint(&rhc, rhc.hull->firstclipnode);
 #endif
@@ -1040,7 +1178,7 @@ static void Mod_Q1BSP_TraceBox(struct model_s *model, const frameblend_t *frameb
 	Con_Print("\n");
 #else
 	if (VectorLength2(rhc.dist))
-		Mod_Q1BSP_RecursiveHullCheck(&rhc, rhc.hull->firstclipnode, 0, 1, rhc.start, rhc.end);
+		Mod_Q1BSP_IterativeHullCheck(&rhc);
 	else
 		Mod_Q1BSP_RecursiveHullCheckPoint(&rhc, rhc.hull->firstclipnode);
 #endif
@@ -1049,17 +1187,154 @@ static void Mod_Q1BSP_TraceBox(struct model_s *model, const frameblend_t *frameb
 static int Mod_Q1BSP_PointSuperContents(struct model_s *model, int frame, const vec3_t point)
 {
 	int num = model->brushq1.hulls[0].firstclipnode;
-	mplane_t *plane;
-	mclipnode_t *nodes = model->brushq1.hulls[0].clipnodes;
-	mplane_t *planes = model->brushq1.hulls[0].planes;
+	const mclipnodecompact_t *node;
+	const mclipnodecompact_t *nodes = model->brushq1.hulls[0].compactclipnodes;
 	while (num >= 0)
 	{
-		plane = planes + nodes[num].planenum;
-		num = nodes[num].children[(plane->type < 3 ? point[plane->type] : DotProduct(plane->normal, point)) < plane->dist];
+		node = nodes + num;
+		num = node->children[(node->type < 3 ? point[node->type] : DotProduct(node->normal, point)) < node->dist];
 	}
 	return Mod_Q1BSP_SuperContentsFromNativeContents(NULL, num);
 }
 
+static void Mod_Q1BSP_HullCheckTest_Trace(dp_model_t *model, int hullindex, const float *start, const float *end, trace_t *trace, qboolean iterative)
+{
+	RecursiveHullCheckTraceInfo_t rhc;
+
+	memset(&rhc, 0, sizeof(rhc));
+	memset(trace, 0, sizeof(trace_t));
+	rhc.trace = trace;
+	rhc.trace->hitsupercontentsmask = SUPERCONTENTS_SOLID | SUPERCONTENTS_BODY | SUPERCONTENTS_PLAYERCLIP;
+	rhc.trace->fraction = 1;
+	rhc.trace->realfraction = 1;
+	rhc.trace->allsolid = true;
+	rhc.hull = &model->brushq1.hulls[hullindex];
+	VectorCopy(start, rhc.start);
+	VectorCopy(end, rhc.end);
+	VectorSubtract(rhc.end, rhc.start, rhc.dist);
+	if (iterative)
+		Mod_Q1BSP_IterativeHullCheck(&rhc);
+	else
+		Mod_Q1BSP_RecursiveHullCheck(&rhc, rhc.hull->firstclipnode, 0, 1, rhc.start, rhc.end);
+}
+
+// deterministic generator so a corpus can be rebuilt on any platform
+static unsigned int Mod_Q1BSP_HullCheckTest_Random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 8) & 0xFFFF;
+}
+
+#define HULLCHECKTEST_RECORDSIZE 28
+
+static void Mod_Q1BSP_HullCheckTest_f(void)
+{
+	dp_model_t *model = sv.active ? sv.worldmodel : cl.worldmodel;
+	const char *filename = Cmd_Argc() >= 3 ? Cmd_Argv(2) : NULL;
+	unsigned char *corpus = NULL, *record;
+	fs_offset_t filesize = 0;
+	int i, j, numtraces, numhulls, numhits = 0, mismatches = 0;
+	unsigned int seed = 1;
+	float start[3], end[3];
+	union {float f;unsigned int i;} bits;
+	trace_t tracerecursive, traceiterative;
+	double t0, t1, t2;
+
+	if (Cmd_Argc() < 2 || Cmd_Argc() > 3)
+	{
+		Con_Print("usage: mod_q1bsp_hullchecktest <numtraces> [corpusfile]\n(replays corpusfile if it exists, otherwise generates numtraces random traces and saves them to corpusfile)\n");
+		return;
+	}
+	if (!model || !model->brushq1.numclipnodes)
+	{
+		Con_Print("no q1bsp worldmodel loaded\n");
+		return;
+	}
+
+	numhulls = model->brush.ishlbsp ? 4 : 3;
+	numtraces = bound(1, atoi(Cmd_Argv(1)), 1000000);
+	if (filename && (corpus = FS_LoadFile(filename, tempmempool, true, &filesize)))
+	{
+		numtraces = (int)(filesize / HULLCHECKTEST_RECORDSIZE);
+		Con_Printf("loaded %i traces from %s\n", numtraces, filename);
+	}
+	else
+	{
+		// random short traces through the map bounds, spread over all hulls
+		corpus = (unsigned char *)Mem_Alloc(tempmempool, numtraces * HULLCHECKTEST_RECORDSIZE);
+		for (i = 0, record = corpus;i < numtraces;i++, record += HULLCHECKTEST_RECORDSIZE)
+		{
+			for (j = 0;j < 3;j++)
+			{
+				start[j] = model->normalmins[j] + (model->normalmaxs[j] - model->normalmins[j]) * Mod_Q1BSP_HullCheckTest_Random(&seed) * (1.0f / 65536.0f);
+				end[j] = start[j] + (Mod_Q1BSP_HullCheckTest_Random(&seed) - 32768) * (1.0f / 128.0f);
+			}
+			StoreLittleLong(record, i % numhulls);
+			for (j = 0;j < 3;j++)
+			{
+				bits.f = start[j];
+				StoreLittleLong(record + 4 + j * 4, bits.i);
+				bits.f = end[j];
+				StoreLittleLong(record + 16 + j * 4, bits.i);
+			}
+		}
+		if (filename && FS_WriteFile(filename, corpus, numtraces * HULLCHECKTEST_RECORDSIZE))
+			Con_Printf("saved %i traces to %s\n", numtraces, filename);
+	}
+
+	// compare every trace result bit for bit
+	for (i = 0, record = corpus;i < numtraces;i++, record += HULLCHECKTEST_RECORDSIZE)
+	{
+		for (j = 0;j < 3;j++)
+		{
+			start[j] = BuffLittleFloat(record + 4 + j * 4);
+			end[j] = BuffLittleFloat(record + 16 + j * 4);
+		}
+		j = BuffLittleLong(record);
+		if (j < 0 || j >= numhulls)
+			continue;
+		Mod_Q1BSP_HullCheckTest_Trace(model, j, start, end, &tracerecursive, false);
+		Mod_Q1BSP_HullCheckTest_Trace(model, j, start, end, &traceiterative, true);
+		if (tracerecursive.fraction < 1)
+			numhits++;
+		if (memcmp(&tracerecursive, &traceiterative, sizeof(trace_t)))
+		{
+			if (mismatches++ < 10)
+				Con_Printf("mismatch on trace %i (hull %i): recursive %f iterative %f\n", i, j, tracerecursive.fraction, traceiterative.fraction);
+		}
+	}
+
+	// then time both over the whole corpus
+	t0 = Sys_DirtyTime();
+	for (i = 0, record = corpus;i < numtraces;i++, record += HULLCHECKTEST_RECORDSIZE)
+	{
+		for (j = 0;j < 3;j++)
+		{
+			start[j] = BuffLittleFloat(record + 4 + j * 4);
+			end[j] = BuffLittleFloat(record + 16 + j * 4);
+		}
+		j = BuffLittleLong(record);
+		if (j >= 0 && j < numhulls)
+			Mod_Q1BSP_HullCheckTest_Trace(model, j, start, end, &tracerecursive, false);
+	}
+	t1 = Sys_DirtyTime();
+	for (i = 0, record = corpus;i < numtraces;i++, record += HULLCHECKTEST_RECORDSIZE)
+	{
+		for (j = 0;j < 3;j++)
+		{
+			start[j] = BuffLittleFloat(record + 4 + j * 4);
+			end[j] = BuffLittleFloat(record + 16 + j * 4);
+		}
+		j = BuffLittleLong(record);
+		if (j >= 0 && j < numhulls)
+			Mod_Q1BSP_HullCheckTest_Trace(model, j, start, end, &traceiterative, true);
+	}
+	t2 = Sys_DirtyTime();
+
+	Con_Printf("%i traces (%i hit something), %i mismatches\nrecursive: %.1f ns/trace\niterative: %.1f ns/trace\n", numtraces, numhits, mismatches, (t1 - t0) * 1e9 / numtraces, (t2 - t1) * 1e9 / numtraces);
+	Mem_Free(corpus);
+}
+
 void Collision_ClipTrace_Box(trace_t *trace, const vec3_t cmins, const vec3_t cmaxs, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int hitsupercontentsmask, int boxsupercontents, int boxq3surfaceflags, const texture_t *boxtexture)
 {
 #if 1
@@ -2984,9 +3259,30 @@ static qboolean Mod_Q1BSP_CheckWaterAlphaSupport(void)
 	return false;
 }
 
+// folds the planes into a collision-only copy of the clipnodes
+static mclipnodecompact_t *Mod_Q1BSP_MakeCompactClipnodes(const mclipnode_t *in, int count)
+{
+	int i;
+	const mplane_t *plane;
+	mclipnodecompact_t *out, *compact;
+
+	compact = out = (mclipnodecompact_t *)Mem_Alloc(loadmodel->mempool, count * sizeof(*out));
+	for (i = 0;i < count;i++, in++, out++)
+	{
+		plane = loadmodel->brush.data_planes + in->planenum;
+		VectorCopy(plane->normal, out->normal);
+		out->dist = plane->dist;
+		out->type = plane->type;
+		out->children[0] = in->children[0];
+		out->children[1] = in->children[1];
+	}
+	return compact;
+}
+
 static void Mod_Q1BSP_LoadClipnodes(sizebuf_t *sb, hullinfo_t *hullinfo)
 {
 	mclipnode_t *out;
+	mclipnodecompact_t *compact;
 	int			i, count;
 	hull_t		*hull;
 	size_t structsize = loadmodel->brush.isbsp2 ? 12 : 8;
@@ -3040,6 +3336,10 @@ static void Mod_Q1BSP_LoadClipnodes(sizebuf_t *sb, hullinfo_t *hullinfo)
 				out->children[1] -= 65536;
 		}
 	}
+
+	compact = Mod_Q1BSP_MakeCompactClipnodes(loadmodel->brushq1.clipnodes, count);
+	for (i = 1; i < MAX_MAP_HULLS; i++)
+		loadmodel->brushq1.hulls[i].compactclipnodes = compact;
 }
 
 //Duplicate the drawing hull structure as a clipping hull
@@ -3066,6 +3366,8 @@ static void Mod_Q1BSP_MakeHull0(void)
 		out->children[0] = in->children[0]->plane ? in->children[0] - loadmodel->brush.data_nodes : ((mleaf_t *)in->children[0])->contents;
 		out->children[1] = in->children[1]->plane ? in->children[1] - loadmodel->brush.data_nodes : ((mleaf_t *)in->children[1])->contents;
 	}
+
+	hull->compactclipnodes = Mod_Q1BSP_MakeCompactClipnodes(hull->clipnodes, loadmodel->brush.num_nodes);
 }
 
 static void Mod_Q1BSP_LoadLeaffaces(sizebuf_t *sb)
@@ -189,9 +189,21 @@ typedef struct mclipnode_s
 	int			children[2];	// negative numbers are contents
 } mclipnode_t;
 
+// collision-only copy of a clipnode with its plane folded in, so a hull walk
+// touches one 32 byte record per node instead of a clipnode and a plane
+typedef struct mclipnodecompact_s
+{
+	float		normal[3];
+	float		dist;
+	int			type;			// plane type (0-2 = axial)
+	int			children[2];	// negative numbers are contents
+	int			padding;
+} mclipnodecompact_t;
+
 typedef struct hull_s
 {
 	mclipnode_t *clipnodes;
+	mclipnodecompact_t *compactclipnodes;
 	mplane_t *planes;
 	int firstclipnode;
 	int lastclipnode;
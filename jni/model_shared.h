@@ -125,6 +125,14 @@ typedef struct r_vertexmesh_s
 }
 r_vertexmesh_t;
 
+typedef struct r_vertexinstance_s
+{
+	// 80 bytes, one per instance of R_Mesh_DrawInstanced
+	float color4f[4];
+	float texcoord4f[4][4];
+}
+r_vertexinstance_t;
+
 typedef struct r_meshbuffer_s
 {
 	int bufferobject; // OpenGL
@@ -741,6 +741,7 @@ static void VM_M_copyentity (prvm_prog_t *prog)
 	in = PRVM_G_EDICT(OFS_PARM0);
 	out = PRVM_G_EDICT(OFS_PARM1);
 	memcpy(out->fields.fp, in->fields.fp, prog->entityfields * sizeof(prvm_vec_t));
+	PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(out), -1);
 }
 
 //#66 vector() getmousepos (EXT_CSQC)
@@ -97,6 +97,8 @@ static cvar_t net_slist_timeout = {0, "net_slist_timeout", "4", "how long to lis
 static cvar_t net_slist_pause = {0, "net_slist_pause", "0", "when set to 1, the server list won't update until it is set back to 0"};
 static cvar_t net_slist_maxtries = {0, "net_slist_maxtries", "3", "how many times to ask the same server for information (more times gives better ping reports but takes longer)"};
 static cvar_t net_slist_favorites = {CVAR_SAVE | CVAR_NQUSERINFOHACK, "net_slist_favorites", "", "contains a list of IP addresses and ports to always query explicitly"};
+cvar_t net_fastloopback = {0, "net_fastloopback", "1", "pass messages between the client and a local server directly instead of through the loopback socket (takes effect on the next connect, cl_netlocalping disables it)"};
+static cvar_t net_batchpackets = {CVAR_SAVE, "net_batchpackets", "8", "how many packets to read or write per system call (recvmmsg/sendmmsg), 1 reads and writes one packet at a time"};
 static cvar_t net_tos_dscp = {CVAR_SAVE, "net_tos_dscp", "32", "DiffServ Codepoint for network sockets (may need game restart to apply)"};
 static cvar_t gameversion = {0, "gameversion", "0", "version of game data (mod-specific) to be sent to querying clients"};
 static cvar_t gameversion_min = {0, "gameversion_min", "-1", "minimum version of game data (mod-specific), when client and server gameversion mismatch in the server browser the server is shown as incompatible; if -1, gameversion is used alone"};
@@ -128,6 +130,47 @@ static lhnetsocket_t *cl_sockets[16];
 static int sv_numsockets;
 static lhnetsocket_t *sv_sockets[16];
 
+// packets written to the server sockets between NetConn_BeginBatchedWrites
+// and NetConn_EndBatchedWrites, sent together with LHNET_WriteMany
+#define NETCONN_MAXQUEUEDPACKETS 256
+#define NETCONN_WRITEQUEUESIZE 131072
+typedef struct netconn_writequeue_s
+{
+	qboolean active;
+	int numpackets;
+	int numbytes;
+	lhnetsocket_t *sockets[NETCONN_MAXQUEUEDPACKETS];
+	const void *contents[NETCONN_MAXQUEUEDPACKETS];
+	int lengths[NETCONN_MAXQUEUEDPACKETS];
+	lhnetaddress_t addresses[NETCONN_MAXQUEUEDPACKETS];
+	unsigned char data[NETCONN_WRITEQUEUESIZE];
+}
+netconn_writequeue_t;
+static netconn_writequeue_t netconn_writequeue;
+
+// messages between the client and a local server (net_fastloopback), these
+// skip the loopback socket, fragmenting, acks and the crypto layer, the
+// buffers are kept around for reuse
+#define NETCONN_LOOPBACKMESSAGES 64
+typedef struct netconn_loopbackmessage_s
+{
+	qboolean reliable;
+	int length;
+	int maxlength;
+	unsigned char *data;
+}
+netconn_loopbackmessage_t;
+typedef struct netconn_loopbackqueue_s
+{
+	int start;
+	int count;
+	netconn_loopbackmessage_t messages[NETCONN_LOOPBACKMESSAGES];
+}
+netconn_loopbackqueue_t;
+#define NETCONN_LOOPBACK_TOSERVER 0
+#define NETCONN_LOOPBACK_TOCLIENT 1
+static netconn_loopbackqueue_t netconn_loopback[2];
+
 netconn_t *netconn_list = NULL;
 mempool_t *netconn_mempool = NULL;
 void *netconn_mutex = NULL;
@@ -622,6 +665,141 @@ int NetConn_Read(lhnetsocket_t *mysocket, void *data, int maxlength, lhnetaddres
 	return length;
 }
 
+void NetConn_FlushBatchedWrites(void)
+{
+	netconn_writequeue_t *q = &netconn_writequeue;
+	int i, j;
+	// one LHNET_WriteMany per run of packets for the same socket
+	for (i = 0;i < q->numpackets;i = j)
+	{
+		for (j = i + 1;j < q->numpackets && q->sockets[j] == q->sockets[i];j++)
+			;
+		LHNET_WriteMany(q->sockets[i], j - i, q->contents + i, q->lengths + i, q->addresses + i);
+	}
+	q->numpackets = 0;
+	q->numbytes = 0;
+}
+
+void NetConn_BeginBatchedWrites(void)
+{
+	netconn_writequeue.active = LHNET_BatchPackets(-1) > 1;
+}
+
+void NetConn_EndBatchedWrites(void)
+{
+	NetConn_FlushBatchedWrites();
+	netconn_writequeue.active = false;
+}
+
+// queues the packet if it goes out on a server socket during batched writes
+static qboolean NetConn_QueueWrite(lhnetsocket_t *mysocket, const void *data, int length, const lhnetaddress_t *peeraddress)
+{
+	netconn_writequeue_t *q = &netconn_writequeue;
+	int i;
+	if (!q->active || length < 1 || length > NETCONN_WRITEQUEUESIZE || mysocket->address.addresstype == LHNETADDRESSTYPE_LOOP)
+		return false;
+	for (i = 0;i < sv_numsockets;i++)
+		if (sv_sockets[i] == mysocket)
+			break;
+	if (i == sv_numsockets)
+		return false;
+	if (q->numpackets >= NETCONN_MAXQUEUEDPACKETS || q->numbytes + length > NETCONN_WRITEQUEUESIZE)
+		NetConn_FlushBatchedWrites();
+	memcpy(q->data + q->numbytes, data, length);
+	q->sockets[q->numpackets] = mysocket;
+	q->contents[q->numpackets] = q->data + q->numbytes;
+	q->lengths[q->numpackets] = length;
+	q->addresses[q->numpackets] = *peeraddress;
+	q->numpackets++;
+	q->numbytes += length;
+	return true;
+}
+
+// returns false if the queue is full
+static qboolean NetConn_FastLoopback_Write(int to, qboolean reliable, const unsigned char *data, int length)
+{
+	netconn_loopbackqueue_t *q = netconn_loopback + to;
+	netconn_loopbackmessage_t *m;
+	qboolean ret = false;
+	if (netconn_mutex)
+		Thread_LockMutex(netconn_mutex);
+	if (q->count < NETCONN_LOOPBACKMESSAGES)
+	{
+		m = q->messages + (q->start + q->count) % NETCONN_LOOPBACKMESSAGES;
+		if (m->maxlength < length)
+		{
+			if (m->data)
+				Mem_Free(m->data);
+			m->maxlength = max(length, 1024);
+			m->data = (unsigned char *)Mem_Alloc(netconn_mempool, m->maxlength);
+		}
+		memcpy(m->data, data, length);
+		m->length = length;
+		m->reliable = reliable;
+		q->count++;
+		ret = true;
+	}
+	if (netconn_mutex)
+		Thread_UnlockMutex(netconn_mutex);
+	return ret;
+}
+
+// copies the oldest queued message into the buffer, returns -1 if there is none
+static int NetConn_FastLoopback_Read(int to, sizebuf_t *buf, qboolean *reliable)
+{
+	netconn_loopbackqueue_t *q = netconn_loopback + to;
+	netconn_loopbackmessage_t *m;
+	int length = -1;
+	if (netconn_mutex)
+		Thread_LockMutex(netconn_mutex);
+	if (q->count)
+	{
+		m = q->messages + q->start;
+		q->start = (q->start + 1) % NETCONN_LOOPBACKMESSAGES;
+		q->count--;
+		length = min(m->length, buf->maxsize);
+		SZ_Clear(buf);
+		SZ_Write(buf, m->data, length);
+		MSG_BeginReading(buf);
+		*reliable = m->reliable;
+	}
+	if (netconn_mutex)
+		Thread_UnlockMutex(netconn_mutex);
+	return length;
+}
+
+static void NetConn_FastLoopback_Clear(int to)
+{
+	if (netconn_mutex)
+		Thread_LockMutex(netconn_mutex);
+	netconn_loopback[to].start = 0;
+	netconn_loopback[to].count = 0;
+	if (netconn_mutex)
+		Thread_UnlockMutex(netconn_mutex);
+}
+
+// bookkeeping NetConn_ReceivedMessage would do for a message
+static void NetConn_FastLoopback_Received(netconn_t *conn, int length, qboolean reliable, double newtimeout)
+{
+	conn->packetsReceived++;
+	conn->lastMessageTime = realtime;
+	conn->timeout = realtime + newtimeout;
+	if (reliable)
+	{
+		conn->incoming_netgraph[conn->incoming_packetcounter].reliablebytes += length + NET_HEADERSIZE + 28;
+		conn->reliableMessagesReceived++;
+	}
+	else
+	{
+		conn->incoming_packetcounter = (conn->incoming_packetcounter + 1) % NETGRAPH_PACKETS;
+		conn->incoming_netgraph[conn->incoming_packetcounter].time            = realtime;
+		conn->incoming_netgraph[conn->incoming_packetcounter].unreliablebytes = length + NET_HEADERSIZE + 28;
+		conn->incoming_netgraph[conn->incoming_packetcounter].reliablebytes   = NETGRAPH_NOPACKET;
+		conn->incoming_netgraph[conn->incoming_packetcounter].ackbytes        = NETGRAPH_NOPACKET;
+		conn->unreliableMessagesReceived++;
+	}
+}
+
 int NetConn_Write(lhnetsocket_t *mysocket, const void *data, int length, const lhnetaddress_t *peeraddress)
 {
 	int ret;
@@ -630,11 +808,16 @@ int NetConn_Write(lhnetsocket_t *mysocket, const void *data, int length, const l
 		for (i = 0;i < cl_numsockets;i++)
 			if (cl_sockets[i] == mysocket && (rand() % 100) < cl_netpacketloss_send.integer)
 				return length;
-	if (mysocket->address.addresstype == LHNETADDRESSTYPE_LOOP && netconn_mutex)
-		Thread_LockMutex(netconn_mutex);
-	ret = LHNET_Write(mysocket, data, length, peeraddress);
-	if (mysocket->address.addresstype == LHNETADDRESSTYPE_LOOP && netconn_mutex)
-		Thread_UnlockMutex(netconn_mutex);
+	if (NetConn_QueueWrite(mysocket, data, length, peeraddress))
+		ret = length;
+	else
+	{
+		if (mysocket->address.addresstype == LHNETADDRESSTYPE_LOOP && netconn_mutex)
+			Thread_LockMutex(netconn_mutex);
+		ret = LHNET_Write(mysocket, data, length, peeraddress);
+		if (mysocket->address.addresstype == LHNETADDRESSTYPE_LOOP && netconn_mutex)
+			Thread_UnlockMutex(netconn_mutex);
+	}
 	if (developer_networking.integer)
 	{
 		char addressstring[128], addressstring2[128];
@@ -747,6 +930,41 @@ int NetConn_SendUnreliableMessage(netconn_t *conn, sizebuf_t *data, protocolvers
 
 		totallen += packetLen + 28;
 	}
+	else if (conn->fastloopback)
+	{
+		int to = conn == cls.netcon ? NETCONN_LOOPBACK_TOSERVER : NETCONN_LOOPBACK_TOCLIENT;
+
+		// the whole reliable message goes at once, if the queue is full it
+		// stays in conn->message until the next call
+		if (conn->message.cursize && !quakesignon_suppressreliables)
+		{
+			if (developer_networking.integer && conn == cls.netcon)
+			{
+				Con_Print("client sending reliable message to server:\n");
+				SZ_HexDumpToConsole(&conn->message);
+			}
+			if (NetConn_FastLoopback_Write(to, true, conn->message.data, conn->message.cursize))
+			{
+				conn->outgoing_netgraph[conn->outgoing_packetcounter].reliablebytes += conn->message.cursize + NET_HEADERSIZE + 28;
+				totallen += conn->message.cursize + NET_HEADERSIZE + 28;
+				conn->lastSendTime = realtime;
+				conn->packetsSent++;
+				conn->reliableMessagesSent++;
+				SZ_Clear(&conn->message);
+			}
+		}
+
+		// an unreliable message that does not fit is dropped, just like a lost packet
+		if (data->cursize)
+		{
+			if (NetConn_FastLoopback_Write(to, false, data->data, data->cursize))
+				conn->outgoing_unreliable_sequence++;
+			conn->outgoing_netgraph[conn->outgoing_packetcounter].unreliablebytes += data->cursize + NET_HEADERSIZE + 28;
+			totallen += data->cursize + NET_HEADERSIZE + 28;
+			conn->packetsSent++;
+			conn->unreliableMessagesSent++;
+		}
+	}
 	else
 	{
 		unsigned int packetLen;
@@ -950,6 +1168,7 @@ void NetConn_OpenClientPorts(void)
 
 void NetConn_CloseServerPorts(void)
 {
+	NetConn_FlushBatchedWrites();
 	for (;sv_numsockets > 0;sv_numsockets--)
 		if (sv_sockets[sv_numsockets - 1])
 			LHNET_CloseSocket(sv_sockets[sv_numsockets - 1]);
@@ -1057,6 +1276,8 @@ netconn_t *NetConn_Open(lhnetsocket_t *mysocket, lhnetaddress_t *peeraddress)
 	// LordHavoc: (inspired by ProQuake) use a short connect timeout to
 	// reduce effectiveness of connection request floods
 	conn->timeout = realtime + net_connecttimeout.value;
+	// both ends of a local connection decide this the same way when they open
+	conn->fastloopback = LHNETADDRESS_GetAddressType(peeraddress) == LHNETADDRESSTYPE_LOOP && net_fastloopback.integer && !cl_netlocalping.value;
 	LHNETADDRESS_ToString(&conn->peeraddress, conn->address, sizeof(conn->address), true);
 	conn->next = netconn_list;
 	netconn_list = conn;
@@ -1072,6 +1293,11 @@ void NetConn_Close(netconn_t *conn)
 	// allow the client to reconnect immediately
 	NetConn_ClearFlood(&(conn->peeraddress), sv.connectfloodaddresses, sizeof(sv.connectfloodaddresses) / sizeof(sv.connectfloodaddresses[0]));
 
+	// nobody is going to read what was waiting for this end anymore (what
+	// it sent, like a disconnect message, is still delivered)
+	if (conn->fastloopback)
+		NetConn_FastLoopback_Clear(conn == cls.netcon ? NETCONN_LOOPBACK_TOCLIENT : NETCONN_LOOPBACK_TOSERVER);
+
 	if (conn == netconn_list)
 		netconn_list = conn->next;
 	else
@@ -1101,6 +1327,7 @@ void NetConn_UpdateSockets(void)
 
 	// TODO add logic to automatically close sockets if needed
 	LHNET_DefaultDSCP(net_tos_dscp.integer);
+	LHNET_BatchPackets(net_batchpackets.integer);
 
 	if (cls.state != ca_dedicated)
 	{
@@ -2266,7 +2493,8 @@ void NetConn_QueryQueueFrame(void)
 
 void NetConn_ClientFrame(void)
 {
-	int i, length;
+	int i, length, dropped, droppedreliable;
+	qboolean reliable;
 	lhnetaddress_t peeraddress;
 	unsigned char readbuffer[NET_HEADERSIZE+NET_MAXMESSAGE];
 	NetConn_UpdateSockets();
@@ -2313,6 +2541,25 @@ void NetConn_ClientFrame(void)
 //			R_TimeReport("clientparsepacket");
 		}
 	}
+	// messages from a local server (read after the sockets so the accept
+	// reply opening cls.netcon comes first)
+	dropped = droppedreliable = 0;
+	while ((length = NetConn_FastLoopback_Read(NETCONN_LOOPBACK_TOCLIENT, &cl_message, &reliable)) >= 0)
+	{
+		if (length == 0)
+			continue;
+		if (!cls.netcon || !cls.netcon->fastloopback)
+		{
+			dropped++;
+			if (reliable)
+				droppedreliable++;
+			continue;
+		}
+		NetConn_FastLoopback_Received(cls.netcon, length, reliable, net_messagetimeout.value);
+		CL_ParseServerMessage();
+	}
+	if (dropped)
+		Con_DPrintf("NetConn_ClientFrame: dropped %i messages (%i reliable) from the local server, no fast loopback connection to deliver them to\n", dropped, droppedreliable);
 	NetConn_QueryQueueFrame();
 	if (cls.netcon && realtime > cls.netcon->timeout && !sv.active)
 	{
@@ -3418,8 +3665,24 @@ static int NetConn_ServerParsePacket(lhnetsocket_t *mysocket, unsigned char *dat
 void NetConn_ServerFrame(void)
 {
 	int i, length;
+	qboolean reliable;
 	lhnetaddress_t peeraddress;
 	unsigned char readbuffer[NET_HEADERSIZE+NET_MAXMESSAGE];
+	// messages from the local client go first: they were sent before any
+	// connect request waiting in the sockets (a reconnect queues its
+	// disconnect here and then sends the request over the loopback socket)
+	while ((length = NetConn_FastLoopback_Read(NETCONN_LOOPBACK_TOSERVER, &sv_message, &reliable)) >= 0)
+	{
+		if (!sv.active || length == 0)
+			continue;
+		for (i = 0, host_client = svs.clients;i < svs.maxclients;i++, host_client++)
+			if (host_client->netconnection && host_client->netconnection->fastloopback)
+				break;
+		if (i == svs.maxclients)
+			continue;
+		NetConn_FastLoopback_Received(host_client->netconnection, length, reliable, host_client->begun ? net_messagetimeout.value : net_connecttimeout.value);
+		SV_ReadClientMessage();
+	}
 	for (i = 0;i < sv_numsockets;i++)
 		while (sv_sockets[i] && (length = NetConn_Read(sv_sockets[i], readbuffer, sizeof(readbuffer), &peeraddress)) > 0)
 			NetConn_ServerParsePacket(sv_sockets[i], readbuffer, length, &peeraddress);
@@ -3696,12 +3959,15 @@ void NetConn_Init(void)
 	Cvar_RegisterVariable(&net_slist_pause);
 	if(LHNET_DefaultDSCP(-1) >= 0) // register cvar only if supported
 		Cvar_RegisterVariable(&net_tos_dscp);
+	if(LHNET_BatchPackets(-1) >= 0) // register cvar only if supported
+		Cvar_RegisterVariable(&net_batchpackets);
 	Cvar_RegisterVariable(&net_messagetimeout);
 	Cvar_RegisterVariable(&net_connecttimeout);
 	Cvar_RegisterVariable(&net_connectfloodblockingtimeout);
 	Cvar_RegisterVariable(&net_challengefloodblockingtimeout);
 	Cvar_RegisterVariable(&net_getstatusfloodblockingtimeout);
 	Cvar_RegisterVariable(&cl_netlocalping);
+	Cvar_RegisterVariable(&net_fastloopback);
 	Cvar_RegisterVariable(&cl_netpacketloss_send);
 	Cvar_RegisterVariable(&cl_netpacketloss_receive);
 	Cvar_RegisterVariable(&hostname);
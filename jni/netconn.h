@@ -154,6 +154,10 @@ typedef struct netconn_s
 	unsigned char messagedata[NET_MAXMESSAGE];
 	/// @}
 
+	/// local connection that hands whole messages to the other side through
+	/// the fast loopback queues instead of the loopback socket (net_fastloopback)
+	qboolean fastloopback;
+
 	/// reliable message that is currently sending
 	/// (for building fragments)
 	int sendMessageLength;
@@ -433,6 +437,10 @@ void NetConn_Listen(qboolean state);
 int NetConn_Read(lhnetsocket_t *mysocket, void *data, int maxlength, lhnetaddress_t *peeraddress);
 int NetConn_Write(lhnetsocket_t *mysocket, const void *data, int length, const lhnetaddress_t *peeraddress);
 int NetConn_WriteString(lhnetsocket_t *mysocket, const char *string, const lhnetaddress_t *peeraddress);
+/// packets written to server sockets between these are sent together at the end (or when the queue fills up)
+void NetConn_BeginBatchedWrites(void);
+void NetConn_EndBatchedWrites(void);
+void NetConn_FlushBatchedWrites(void);
 int NetConn_IsLocalGame(void);
 void NetConn_ClientFrame(void);
 void NetConn_ServerFrame(void);
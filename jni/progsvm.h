@@ -44,8 +44,23 @@ typedef struct prvm_stack_s
 	double			tprofile_acc;
 	double			profile_acc;
 	double			builtinsprofile_acc;
+	int				callnode; // call tree node of the calling function
 } prvm_stack_t;
 
+#define PRVM_MAX_CALLNODES 65536
+
+/// call tree node for prvm_stackprofile (filled by the prvm_timeprofiling interpreter)
+typedef struct prvm_callnode_s
+{
+	int function; // index into functions, -1 for the engine
+	int parent;
+	int firstchild;
+	int nextsibling;
+	double calls;
+	double time; // time spent in the function itself (for builtins without the QC they call)
+}
+prvm_callnode_t;
+
 
 typedef union prvm_eval_s
 {
@@ -58,6 +73,113 @@ typedef union prvm_eval_s
 	prvm_int_t		edict;
 } prvm_eval_t;
 
+/// mstatement_t with the operands resolved to pointers into the globals (NULL
+/// if unused) when the progs are loaded, executed by prvm_execthreaded.h
+typedef struct mstatementdecoded_s
+{
+	prvm_eval_t *operand[3];
+	int op; // unknown opcodes are changed to OP_DECODED_BAD, pairs may be fused
+	int jumpabsolute;
+}
+mstatementdecoded_t;
+
+/// engine-only opcodes of mstatementdecoded_t, the OP_FUSED ones execute the
+/// statement they are on and the following one (which is left unchanged so
+/// jumps to it still work)
+typedef enum opcodedecoded_e
+{
+	OP_DECODED_BAD = OP_BITOR + 1,
+	// comparison whose result is only tested by the following IFNOT
+	OP_FUSED_EQ_F_IFNOT,
+	OP_FUSED_NE_F_IFNOT,
+	OP_FUSED_LE_IFNOT,
+	OP_FUSED_GE_IFNOT,
+	OP_FUSED_LT_IFNOT,
+	OP_FUSED_GT_IFNOT,
+	// ADDRESS feeding the following STOREP (self.field = value)
+	OP_FUSED_ADDRESS_STOREP,
+	OP_FUSED_ADDRESS_STOREP_V,
+	// field load followed by arithmetic
+	OP_FUSED_LOAD_F_ADD_F,
+	OP_FUSED_LOAD_F_SUB_F,
+	OP_FUSED_LOAD_F_MUL_F,
+	OP_FUSED_LOAD_V_ADD_V,
+	OP_FUSED_LOAD_V_SUB_V,
+	// two stores in a row (usually setting up call parameters)
+	OP_FUSED_STORE_STORE,
+	OP_FUSED_STORE_V_STORE_V,
+	OP_DECODED_MAX
+}
+opcodedecoded_t;
+
+/// chained hash of the names in fielddefs, globaldefs or functions for the
+/// PRVM_ED_Find* functions, chains are in ascending index order so the first
+/// definition of a name is found like with a linear search
+typedef struct prvm_namehash_s
+{
+	int mask; // number of buckets - 1
+	int *first; // first index in each bucket, -1 if empty
+	int *next; // next index in the same bucket, -1 at the end
+}
+prvm_namehash_t;
+
+#define PRVM_MAX_FIELDINDEXES 8
+
+/// index of the edicts by the value of one string or float field, used by the
+/// find builtins for the fields listed in prvm_findindexfields
+typedef struct prvm_fieldindex_s
+{
+	int ofs;
+	etype_t type; // ev_string, ev_float or ev_entity
+	qboolean built;
+	int maxedicts; // size of the per edict arrays, rebuilt when prog->max_edicts changes
+	int numcovered; // edicts below this are either hashed or unhashed
+	unsigned int freedstrings; // knownstrings_stats.freed when built (freed slots get reused for other text)
+	int mask; // number of buckets - 1
+	int *first; // first edict in each bucket, -1 if empty, chains are in ascending edict order
+	int *next;
+	int *prev;
+	int *bucket; // bucket of each edict, -1 if not hashed
+	// edicts that are not hashed because they were written to by the
+	// currently running QC call, or hold text that can change without a
+	// field write (tempstrings, engine strings), these are checked on every search
+	int *unhashed;
+	int numunhashed;
+	unsigned char *isunhashed;
+	int touchserial; // prog->toplevelcalls when an edict was last touched
+}
+prvm_fieldindex_t;
+
+/// known string counters for prvm_stringstats
+typedef struct prvm_knownstringstats_s
+{
+	int active; // slots in use
+	unsigned int registered; // new engine strings
+	unsigned int interned; // engine strings matched by content (prvm_stringinterning)
+	unsigned int allocated; // QC strings (strzone and such)
+	unsigned int freed;
+	unsigned int grown; // reallocations of the known string arrays
+}
+prvm_knownstringstats_t;
+
+/// tempstring buffer counters for prvm_stringstats
+typedef struct prvm_tempstringstats_s
+{
+	int highwater; // most bytes of tempstrings in use at once
+	unsigned int strings; // tempstrings created
+	unsigned int resets; // calls from the engine that left tempstrings to delete
+	unsigned int grown; // reallocations of the buffer
+}
+prvm_tempstringstats_t;
+
+/// a freed edict waiting in the PRVM_ED_Alloc queues
+typedef struct prvm_freeedict_s
+{
+	int num;
+	float freetime; // entries whose edict was freed again since are stale
+}
+prvm_freeedict_t;
+
 typedef struct prvm_required_field_s
 {
 	int type;
@@ -539,6 +661,8 @@ typedef struct prvm_prog_s
 	ddef_t				*fielddefs;
 	ddef_t				*globaldefs;
 	mstatement_t		*statements;
+	mstatementdecoded_t	*decodedstatements;
+	int					numfusedstatements; // superinstructions in decodedstatements
 	int					entityfields;			// number of vec_t fields in progs (some variables are 3)
 	int					entityfieldsarea;		// LordHavoc: equal to max_edicts * entityfields (for bounds checking)
 
@@ -558,6 +682,10 @@ typedef struct prvm_prog_s
 	int					numglobaldefs;
 	int					numfielddefs;
 	int					numfunctions;
+	// name lookups, built once the engine fields and globals are appended
+	prvm_namehash_t		fielddefs_hash;
+	prvm_namehash_t		globaldefs_hash;
+	prvm_namehash_t		functions_hash;
 	int					numstrings;
 	int					numglobals;
 
@@ -574,12 +702,19 @@ typedef struct prvm_prog_s
 
 	int					maxknownstrings;
 	int					numknownstrings;
-	// this is updated whenever a string is removed or added
-	// (simple optimization of the free string search)
-	int					firstfreeknownstring;
+	// freed slots below numknownstrings, linked through knownstrings_hashnext (-1 ends)
+	int					knownstrings_freelist;
 	const char			**knownstrings;
 	unsigned char		*knownstrings_freeable;
 	const char          **knownstrings_origin;
+	// hash chains of known strings by pointer, and of engine strings by
+	// content for prvm_stringinterning (key -1 if not in the content hash)
+	int					*knownstrings_hashfirst;
+	int					*knownstrings_hashnext;
+	int					*knownstrings_contentfirst;
+	int					*knownstrings_contentnext;
+	int					*knownstrings_contentkey;
+	prvm_knownstringstats_t	knownstrings_stats;
 	const char			***stringshash;
 
 	memexpandablearray_t	stringbuffersarray;
@@ -627,6 +762,7 @@ typedef struct prvm_prog_s
 
 	// buffer for storing all tempstrings created during one invocation of ExecuteProgram
 	sizebuf_t			tempstringsbuf;
+	prvm_tempstringstats_t	tempstrings_stats;
 
 	// LordHavoc: moved this here to clean up things that relied on prvm_prog_list too much
 	// FIXME: make VM_CL_R_Polygon functions use Debug_Polygon functions?
@@ -646,6 +782,34 @@ typedef struct prvm_prog_s
 	prvm_vec_t		*edictsfields;
 	void				*edictprivate;
 
+	// find builtin indexes (prvm_findindexfields), fieldindexflags has an
+	// entry per field offset that is nonzero when writes there (including
+	// vector writes covering it) must call PRVM_ED_FieldIndexTouch
+	unsigned char		*fieldindexflags;
+	prvm_fieldindex_t	fieldindexes[PRVM_MAX_FIELDINDEXES];
+	int					numfieldindexes;
+	char				fieldindexconfig[256]; // prvm_findindexfields the indexes were set up for
+	// incremented each time the engine calls into QC
+	int					toplevelcalls;
+
+	// call tree for prvm_stackprofile, node 0 is the engine
+	prvm_callnode_t		*callnodes;
+	int					numcallnodes;
+	int					maxcallnodes;
+	int					callnode; // node of the running function or builtin
+	double				nestedtime; // time spent in QC called from builtins
+
+	// freed edicts for PRVM_ED_Alloc: the queue is in freetime order and holds
+	// edicts still blocked by the reuse delay, the heap holds the reusable ones
+	// ordered by edict number so the lowest free edict is still picked first
+	prvm_freeedict_t	*freeedicts_queue; // circular
+	int					freeedicts_queuehead;
+	int					freeedicts_queuecount;
+	int					freeedicts_queuesize;
+	prvm_freeedict_t	*freeedicts_heap;
+	int					freeedicts_heapcount;
+	int					freeedicts_heapsize;
+
 	// size of the engine private struct
 	int					edictprivate_size; // [INIT]
 
@@ -773,6 +937,9 @@ void PRVM_Profile (prvm_prog_t *prog, int maxfunctions, double mintime, int sort
 void PRVM_Profile_f (void);
 void PRVM_ChildProfile_f (void);
 void PRVM_CallProfile_f (void);
+void PRVM_Benchmark_f (void);
+void PRVM_StringStats_f(void);
+void PRVM_StackProfile_f (void);
 void PRVM_PrintFunction_f (void);
 
 void PRVM_PrintState(prvm_prog_t *prog, int stack_index);
@@ -797,6 +964,12 @@ prvm_edict_t *PRVM_ED_Alloc(prvm_prog_t *prog);
 void PRVM_ED_Free(prvm_prog_t *prog, prvm_edict_t *ed);
 void PRVM_ED_ClearEdict(prvm_prog_t *prog, prvm_edict_t *e);
 
+// find builtin acceleration, the Find functions return false if the field is
+// not indexed, otherwise *result is the first matching edict after start (0 if none)
+void PRVM_ED_FieldIndexTouch(prvm_prog_t *prog, int edictnum, int ofs); // ofs -1 for all fields
+qboolean PRVM_ED_FieldIndexFindString(prvm_prog_t *prog, int ofs, const char *s, int start, int *result);
+qboolean PRVM_ED_FieldIndexFindFloat(prvm_prog_t *prog, int ofs, prvm_vec_t s, int start, int *result);
+
 void PRVM_PrintFunctionStatements(prvm_prog_t *prog, const char *name);
 void PRVM_ED_Print(prvm_prog_t *prog, prvm_edict_t *ed, const char *wildcard_fieldname);
 void PRVM_ED_Write(prvm_prog_t *prog, qfile_t *f, prvm_edict_t *ed);
@@ -848,8 +1021,11 @@ void PRVM_ED_PrintNum (prvm_prog_t *prog, int ent, const char *wildcard_fieldnam
 
 const char *PRVM_GetString(prvm_prog_t *prog, int num);
 int PRVM_SetEngineString(prvm_prog_t *prog, const char *s);
+int PRVM_SetChangeableEngineString(prvm_prog_t *prog, const char *s);
 const char *PRVM_ChangeEngineString(prvm_prog_t *prog, int i, const char *s);
 int PRVM_SetTempString(prvm_prog_t *prog, const char *s);
+char *PRVM_TempString_Reserve(prvm_prog_t *prog, size_t size);
+int PRVM_TempString_Commit(prvm_prog_t *prog, size_t length);
 int PRVM_AllocString(prvm_prog_t *prog, size_t bufferlength, char **pointer);
 void PRVM_FreeString(prvm_prog_t *prog, int num);
 
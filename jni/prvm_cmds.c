@@ -17,6 +17,7 @@
 #include "mdfour.h"
 
 extern cvar_t prvm_backtraceforwarnings;
+extern cvar_t prvm_findindex;
 extern dllhandle_t ode_dll;
 
 // LordHavoc: changed this to NOT use a return statement, so that it can be used in functions that must return a value
@@ -778,17 +779,18 @@ string	ftos(float)
 void VM_ftos(prvm_prog_t *prog)
 {
 	prvm_vec_t v;
-	char s[128];
+	char *s;
 
 	VM_SAFEPARMCOUNT(1, VM_ftos);
 
 	v = PRVM_G_FLOAT(OFS_PARM0);
 
+	s = PRVM_TempString_Reserve(prog, 128);
 	if ((prvm_vec_t)((prvm_int_t)v) == v)
-		dpsnprintf(s, sizeof(s), "%.0f", v);
+		dpsnprintf(s, 128, "%.0f", v);
 	else
-		dpsnprintf(s, sizeof(s), "%f", v);
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, s);
+		dpsnprintf(s, 128, "%f", v);
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, strlen(s));
 }
 
 /*
@@ -819,12 +821,13 @@ string	vtos(vector)
 
 void VM_vtos(prvm_prog_t *prog)
 {
-	char s[512];
+	char *s;
 
 	VM_SAFEPARMCOUNT(1,VM_vtos);
 
-	dpsnprintf (s, sizeof(s), "'%5.1f %5.1f %5.1f'", PRVM_G_VECTOR(OFS_PARM0)[0], PRVM_G_VECTOR(OFS_PARM0)[1], PRVM_G_VECTOR(OFS_PARM0)[2]);
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, s);
+	s = PRVM_TempString_Reserve(prog, 512);
+	dpsnprintf (s, 512, "'%5.1f %5.1f %5.1f'", PRVM_G_VECTOR(OFS_PARM0)[0], PRVM_G_VECTOR(OFS_PARM0)[1], PRVM_G_VECTOR(OFS_PARM0)[2]);
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, strlen(s));
 }
 
 /*
@@ -837,12 +840,13 @@ string	etos(entity)
 
 void VM_etos(prvm_prog_t *prog)
 {
-	char s[128];
+	char *s;
 
 	VM_SAFEPARMCOUNT(1, VM_etos);
 
-	dpsnprintf (s, sizeof(s), "entity %i", PRVM_G_EDICTNUM(OFS_PARM0));
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, s);
+	s = PRVM_TempString_Reserve(prog, 128);
+	dpsnprintf (s, 128, "entity %i", PRVM_G_EDICTNUM(OFS_PARM0));
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, strlen(s));
 }
 
 /*
@@ -1000,30 +1004,30 @@ void VM_remove(prvm_prog_t *prog)
 
 /*
 =========
-VM_find
+VM_FindStringNext
 
-entity	find(entity start, .string field, string match)
+returns the first edict after start whose field matches, or 0
 =========
 */
-
-void VM_find(prvm_prog_t *prog)
+static int VM_FindStringNext(prvm_prog_t *prog, int start, int f, const char *s)
 {
-	int		e;
-	int		f;
-	const char	*s, *t;
+	int		e, indexed;
+	const char	*t;
 	prvm_edict_t	*ed;
 
-	VM_SAFEPARMCOUNT(3,VM_find);
-
-	e = PRVM_G_EDICTNUM(OFS_PARM0);
-	f = PRVM_G_INT(OFS_PARM1);
-	s = PRVM_G_STRING(OFS_PARM2);
+	if (prvm_findindex.integer && PRVM_ED_FieldIndexFindString(prog, f, s, start, &indexed))
+	{
+		if (prvm_findindex.integer < 2)
+			return indexed;
+	}
+	else
+		indexed = -1;
 
 	// LordHavoc: apparently BloodMage does a find(world, weaponmodel, "") and
 	// expects it to find all the monsters, so we must be careful to support
 	// searching for ""
 
-	for (e++ ; e < prog->num_edicts ; e++)
+	for (e = start + 1;e < prog->num_edicts;e++)
 	{
 		prog->xfunction->builtinsprofile++;
 		ed = PRVM_EDICT_NUM(e);
@@ -1033,13 +1037,74 @@ void VM_find(prvm_prog_t *prog)
 		if (!t)
 			t = "";
 		if (!strcmp(t,s))
-		{
-			VM_RETURN_EDICT(ed);
-			return;
-		}
+			break;
 	}
+	if (e >= prog->num_edicts)
+		e = 0;
+	if (indexed >= 0 && indexed != e)
+		VM_Warning(prog, "prvm_findindex: %s index search for \"%s\" after %i returned %i instead of %i\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, f)->s_name), s, start, indexed, e);
+	return e;
+}
 
-	VM_RETURN_EDICT(prog->edicts);
+/*
+=========
+VM_FindFloatNext
+
+returns the first edict after start whose field equals s, or 0
+=========
+*/
+static int VM_FindFloatNext(prvm_prog_t *prog, int start, int f, prvm_vec_t s)
+{
+	int		e, indexed;
+	prvm_edict_t	*ed;
+
+	if (prvm_findindex.integer && PRVM_ED_FieldIndexFindFloat(prog, f, s, start, &indexed))
+	{
+		if (prvm_findindex.integer < 2)
+			return indexed;
+	}
+	else
+		indexed = -1;
+
+	for (e = start + 1;e < prog->num_edicts;e++)
+	{
+		prog->xfunction->builtinsprofile++;
+		ed = PRVM_EDICT_NUM(e);
+		if (ed->priv.required->free)
+			continue;
+		if (PRVM_E_FLOAT(ed,f) == s)
+			break;
+	}
+	if (e >= prog->num_edicts)
+		e = 0;
+	if (indexed >= 0 && indexed != e)
+		VM_Warning(prog, "prvm_findindex: %s index search for %g after %i returned %i instead of %i\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, f)->s_name), s, start, indexed, e);
+	return e;
+}
+
+/*
+=========
+VM_find
+
+entity	find(entity start, .string field, string match)
+=========
+*/
+
+void VM_find(prvm_prog_t *prog)
+{
+	int		e;
+	int		f;
+	const char	*s;
+
+	VM_SAFEPARMCOUNT(3,VM_find);
+
+	e = PRVM_G_EDICTNUM(OFS_PARM0);
+	f = PRVM_G_INT(OFS_PARM1);
+	s = PRVM_G_STRING(OFS_PARM2);
+
+	e = VM_FindStringNext(prog, e, f, s);
+
+	VM_RETURN_EDICT(PRVM_EDICT_NUM(e));
 }
 
 /*
@@ -1056,7 +1121,6 @@ void VM_findfloat(prvm_prog_t *prog)
 	int		e;
 	int		f;
 	float	s;
-	prvm_edict_t	*ed;
 
 	VM_SAFEPARMCOUNT(3,VM_findfloat);
 
@@ -1064,20 +1128,9 @@ void VM_findfloat(prvm_prog_t *prog)
 	f = PRVM_G_INT(OFS_PARM1);
 	s = PRVM_G_FLOAT(OFS_PARM2);
 
-	for (e++ ; e < prog->num_edicts ; e++)
-	{
-		prog->xfunction->builtinsprofile++;
-		ed = PRVM_EDICT_NUM(e);
-		if (ed->priv.required->free)
-			continue;
-		if (PRVM_E_FLOAT(ed,f) == s)
-		{
-			VM_RETURN_EDICT(ed);
-			return;
-		}
-	}
+	e = VM_FindFloatNext(prog, e, f, s);
 
-	VM_RETURN_EDICT(prog->edicts);
+	VM_RETURN_EDICT(PRVM_EDICT_NUM(e));
 }
 
 /*
@@ -1093,7 +1146,7 @@ void VM_findchain(prvm_prog_t *prog)
 {
 	int		i;
 	int		f;
-	const char	*s, *t;
+	const char	*s;
 	prvm_edict_t	*ent, *chain;
 	int chainfield;
 
@@ -1111,23 +1164,11 @@ void VM_findchain(prvm_prog_t *prog)
 	f = PRVM_G_INT(OFS_PARM0);
 	s = PRVM_G_STRING(OFS_PARM1);
 
-	// LordHavoc: apparently BloodMage does a find(world, weaponmodel, "") and
-	// expects it to find all the monsters, so we must be careful to support
-	// searching for ""
-
-	ent = PRVM_NEXT_EDICT(prog->edicts);
-	for (i = 1;i < prog->num_edicts;i++, ent = PRVM_NEXT_EDICT(ent))
+	for (i = 0;(i = VM_FindStringNext(prog, i, f, s));)
 	{
-		prog->xfunction->builtinsprofile++;
-		if (ent->priv.required->free)
-			continue;
-		t = PRVM_E_STRING(ent,f);
-		if (!t)
-			t = "";
-		if (strcmp(t,s))
-			continue;
-
+		ent = PRVM_EDICT_NUM(i);
 		PRVM_EDICTFIELDEDICT(ent,chainfield) = PRVM_NUM_FOR_EDICT(chain);
+		PRVM_ED_FieldIndexTouch(prog, i, chainfield);
 		chain = ent;
 	}
 
@@ -1166,16 +1207,11 @@ void VM_findchainfloat(prvm_prog_t *prog)
 	f = PRVM_G_INT(OFS_PARM0);
 	s = PRVM_G_FLOAT(OFS_PARM1);
 
-	ent = PRVM_NEXT_EDICT(prog->edicts);
-	for (i = 1;i < prog->num_edicts;i++, ent = PRVM_NEXT_EDICT(ent))
+	for (i = 0;(i = VM_FindFloatNext(prog, i, f, s));)
 	{
-		prog->xfunction->builtinsprofile++;
-		if (ent->priv.required->free)
-			continue;
-		if (PRVM_E_FLOAT(ent,f) != s)
-			continue;
-
+		ent = PRVM_EDICT_NUM(i);
 		PRVM_EDICTFIELDEDICT(ent,chainfield) = PRVM_EDICT_TO_PROG(chain);
+		PRVM_ED_FieldIndexTouch(prog, i, chainfield);
 		chain = ent;
 	}
 
@@ -2179,14 +2215,18 @@ string	strdecolorize(string s)
 // string (string s) strdecolorize = #472; // returns the passed in string with color codes stripped
 void VM_strdecolorize(prvm_prog_t *prog)
 {
-	char szNewString[VM_STRINGTEMP_LENGTH];
+	char *szNewString;
 	const char *szString;
+	size_t length;
 
 	// Prepare Strings
 	VM_SAFEPARMCOUNT(1,VM_strdecolorize);
+	// escaping carets at most doubles the length
+	length = min(strlen(PRVM_G_STRING(OFS_PARM0)) * 2 + 1, VM_STRINGTEMP_LENGTH);
+	szNewString = PRVM_TempString_Reserve(prog, length);
 	szString = PRVM_G_STRING(OFS_PARM0);
-	COM_StringDecolorize(szString, 0, szNewString, sizeof(szNewString), TRUE);
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, szNewString);
+	COM_StringDecolorize(szString, 0, szNewString, length, TRUE);
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, strlen(szNewString));
 }
 
 // DRESK - String Length (not counting color codes)
@@ -2271,11 +2311,28 @@ string strcat(string,string,...[string])
 // and returns as a tempstring
 void VM_strcat(prvm_prog_t *prog)
 {
-	char s[VM_STRINGTEMP_LENGTH];
+	int i;
+	size_t length, used, n;
+	const char *s;
+	char *out;
 	VM_SAFEPARMCOUNTRANGE(1, 8, VM_strcat);
 
-	VM_VarString(prog, 0, s, sizeof(s));
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, s);
+	// measure the parts first so the result is written once, in place
+	// (strcat chains otherwise copy the growing string over and over)
+	length = 0;
+	for (i = 0;i < prog->argc;i++)
+		length += strlen(PRVM_G_STRING(OFS_PARM0+i*3));
+	length = min(length, VM_STRINGTEMP_LENGTH - 1);
+
+	out = PRVM_TempString_Reserve(prog, length + 1);
+	for (i = 0, used = 0;i < prog->argc && used < length;i++)
+	{
+		s = PRVM_G_STRING(OFS_PARM0+i*3);
+		n = min(strlen(s), length - used);
+		memcpy(out + used, s, n);
+		used += n;
+	}
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, length);
 }
 
 /*
@@ -2293,7 +2350,7 @@ void VM_substring(prvm_prog_t *prog)
 	int u_slength = 0, u_start;
 	size_t u_length;
 	const char *s;
-	char string[VM_STRINGTEMP_LENGTH];
+	char *string;
 
 	VM_SAFEPARMCOUNT(3,VM_substring);
 
@@ -2343,12 +2400,13 @@ void VM_substring(prvm_prog_t *prog)
 		return;
 	}
 	u_length = u8_bytelen(s + u_start, length);
-	if (u_length >= sizeof(string)-1)
-		u_length = sizeof(string)-1;
+	if (u_length >= VM_STRINGTEMP_LENGTH-1)
+		u_length = VM_STRINGTEMP_LENGTH-1;
 	
+	string = PRVM_TempString_Reserve(prog, u_length + 1);
+	s = PRVM_G_STRING(OFS_PARM0); // reserving may have moved it
 	memcpy(string, s + u_start, u_length);
-	string[u_length] = 0;
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, string);
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, u_length);
 }
 
 /*
@@ -6495,8 +6553,8 @@ string sprintf(string format, ...)
 void VM_sprintf(prvm_prog_t *prog)
 {
 	const char *s, *s0;
-	char outbuf[MAX_INPUTLINE];
-	char *o = outbuf, *end = outbuf + sizeof(outbuf), *err;
+	char *outbuf;
+	char *o, *end, *err;
 	const char *p;
 	int argpos = 1;
 	int width, precision, thisarg, flags;
@@ -6515,6 +6573,12 @@ void VM_sprintf(prvm_prog_t *prog)
 
 	formatbuf[0] = '%';
 
+	// format straight into the tempstring buffer, reserving first as that
+	// can move the buffer and with it any tempstring parms
+	outbuf = PRVM_TempString_Reserve(prog, MAX_INPUTLINE);
+	o = outbuf;
+	end = outbuf + MAX_INPUTLINE;
+
 	s = PRVM_G_STRING(OFS_PARM0);
 
 #define GETARG_FLOAT(a) (((a)>=1 && (a)<prog->argc) ? (PRVM_G_FLOAT(OFS_PARM0 + 3 * (a))) : 0)
@@ -6811,7 +6875,7 @@ verbatim:
 	}
 finished:
 	*o = 0;
-	PRVM_G_INT(OFS_RETURN) = PRVM_SetTempString(prog, outbuf);
+	PRVM_G_INT(OFS_RETURN) = PRVM_TempString_Commit(prog, strlen(outbuf));
 }
 
 
@@ -35,8 +35,13 @@ cvar_t prvm_traceqc = {0, "prvm_traceqc", "0", "prints every QuakeC statement as
 // LordHavoc: counts usage of each QuakeC statement
 cvar_t prvm_statementprofiling = {0, "prvm_statementprofiling", "0", "counts how many times each QuakeC statement has been executed, these counts are displayed in prvm_printfunction output (if enabled)"};
 cvar_t prvm_timeprofiling = {0, "prvm_timeprofiling", "0", "counts how long each function has been executed, these counts are displayed in prvm_profile output (if enabled)"};
+cvar_t prvm_threadedinterpreter = {0, "prvm_threadedinterpreter", "1", "executes QuakeC from statements decoded at load time using threaded dispatch (faster), 0 uses the plain switch interpreter"};
+cvar_t prvm_superinstructions = {0, "prvm_superinstructions", "1", "fuse common QuakeC statement pairs into single instructions for prvm_threadedinterpreter when progs are loaded"};
 cvar_t prvm_backtraceforwarnings = {0, "prvm_backtraceforwarnings", "0", "print a backtrace for warnings too"};
 cvar_t prvm_leaktest = {0, "prvm_leaktest", "0", "try to detect memory leaks in strings or entities"};
+cvar_t prvm_stringinterning = {0, "prvm_stringinterning", "0", "reuse the string index of an engine string with the same text when a new engine string is passed to QC (fewer known strings, but only safe if engine strings are never modified in place)"};
+cvar_t prvm_findindex = {0, "prvm_findindex", "1", "use indexes of the prvm_findindexfields values for find, findfloat, findchain and findchainfloat (2 also compares every result with a full search and warns on a difference)"};
+cvar_t prvm_findindexfields = {0, "prvm_findindexfields", "classname targetname", "string, float or entity fields indexed for prvm_findindex; the engine only tracks writes by QC and entity parsing, so fields it writes to directly (origin, flags, model and such) must not be listed"};
 cvar_t prvm_leaktest_ignore_classnames = {0, "prvm_leaktest_ignore_classnames", "", "classnames of entities to NOT leak check because they are found by find(world, classname, ...) but are actually spawned by QC code (NOT map entities)"};
 cvar_t prvm_errordump = {0, "prvm_errordump", "0", "write a savegame on crash to crash-server.dmp"};
 cvar_t prvm_breakpointdump = {0, "prvm_breakpointdump", "0", "write a savegame on breakpoint to breakpoint-server.dmp"};
@@ -192,6 +197,7 @@ Sets everything to NULL
 void PRVM_ED_ClearEdict(prvm_prog_t *prog, prvm_edict_t *e)
 {
 	memset(e->fields.fp, 0, prog->entityfields * sizeof(prvm_vec_t));
+	PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(e), -1);
 	e->priv.required->free = false;
 
 	// AK: Let the init_edict function determine if something needs to be initialized
@@ -232,6 +238,218 @@ qboolean PRVM_ED_CanAlloc(prvm_prog_t *prog, prvm_edict_t *e)
 	return false; // entity slot still blocked because the entity was freed less than one second ago
 }
 
+/*
+=================
+PRVM_ED_FreeEdicts_Rebuild
+
+Refills the free edict queue from the edicts, used when it gets too long
+with stale entries or a reuse cvar changed
+=================
+*/
+static int PRVM_ED_FreeEdicts_Compare(const void *a, const void *b)
+{
+	const prvm_freeedict_t *fa = (const prvm_freeedict_t *)a;
+	const prvm_freeedict_t *fb = (const prvm_freeedict_t *)b;
+	if (fa->freetime != fb->freetime)
+		return fa->freetime < fb->freetime ? -1 : 1;
+	return fa->num - fb->num;
+}
+
+static void PRVM_ED_FreeEdicts_Rebuild(prvm_prog_t *prog)
+{
+	int i, size;
+	prvm_edict_t *e;
+
+	size = max(64, prog->max_edicts * 2);
+	if (prog->freeedicts_queuesize < size)
+	{
+		if (prog->freeedicts_queue)
+			Mem_Free(prog->freeedicts_queue);
+		prog->freeedicts_queue = (prvm_freeedict_t *)Mem_Alloc(prog->progs_mempool, size * sizeof(prvm_freeedict_t));
+		prog->freeedicts_queuesize = size;
+	}
+	prog->freeedicts_queuehead = 0;
+	prog->freeedicts_queuecount = 0;
+	prog->freeedicts_heapcount = 0;
+	for (i = prog->reserved_edicts + 1;i < prog->num_edicts;i++)
+	{
+		e = PRVM_EDICT_NUM(i);
+		if (!e->priv.required->free)
+			continue;
+		prog->freeedicts_queue[prog->freeedicts_queuecount].num = i;
+		prog->freeedicts_queue[prog->freeedicts_queuecount].freetime = e->priv.required->freetime;
+		prog->freeedicts_queuecount++;
+	}
+	qsort(prog->freeedicts_queue, prog->freeedicts_queuecount, sizeof(prvm_freeedict_t), PRVM_ED_FreeEdicts_Compare);
+}
+
+/*
+=================
+PRVM_ED_FreeEdicts_Push
+
+Queues an edict that has just been marked free
+=================
+*/
+static void PRVM_ED_FreeEdicts_Push(prvm_prog_t *prog, prvm_edict_t *e)
+{
+	int i, j, size;
+	prvm_freeedict_t *queue;
+	float freetime = e->priv.required->freetime;
+
+	if (prog->freeedicts_queuecount == prog->freeedicts_queuesize)
+	{
+		// more than two entries per edict means most of them are stale
+		if (prog->freeedicts_queuesize >= prog->max_edicts * 2)
+		{
+			PRVM_ED_FreeEdicts_Rebuild(prog);
+			return;
+		}
+		size = max(64, prog->freeedicts_queuesize * 2);
+		queue = (prvm_freeedict_t *)Mem_Alloc(prog->progs_mempool, size * sizeof(prvm_freeedict_t));
+		for (i = 0;i < prog->freeedicts_queuecount;i++)
+			queue[i] = prog->freeedicts_queue[(prog->freeedicts_queuehead + i) % prog->freeedicts_queuesize];
+		if (prog->freeedicts_queue)
+			Mem_Free(prog->freeedicts_queue);
+		prog->freeedicts_queue = queue;
+		prog->freeedicts_queuesize = size;
+		prog->freeedicts_queuehead = 0;
+	}
+
+	// edicts are normally freed in time order so this just appends, but an
+	// entity parsed and then discarded by PRVM_ED_ParseEdict keeps its old freetime
+	queue = prog->freeedicts_queue;
+	size = prog->freeedicts_queuesize;
+	for (i = prog->freeedicts_queuecount;i > 0;i--)
+	{
+		j = (prog->freeedicts_queuehead + i - 1) % size;
+		if (queue[j].freetime <= freetime)
+			break;
+		queue[(j + 1) % size] = queue[j];
+	}
+	i = (prog->freeedicts_queuehead + i) % size;
+	queue[i].num = PRVM_NUM_FOR_EDICT(e);
+	queue[i].freetime = freetime;
+	prog->freeedicts_queuecount++;
+}
+
+static qboolean PRVM_ED_FreeEdicts_IsStale(prvm_prog_t *prog, prvm_freeedict_t *f)
+{
+	prvm_edict_t *e;
+	if (f->num <= prog->reserved_edicts || f->num >= prog->num_edicts)
+		return true;
+	e = PRVM_EDICT_NUM(f->num);
+	return !e->priv.required->free || e->priv.required->freetime != f->freetime;
+}
+
+static void PRVM_ED_FreeEdicts_HeapPush(prvm_prog_t *prog, prvm_freeedict_t *f)
+{
+	int i, parent, size, count;
+	prvm_freeedict_t *heap, entry;
+
+	if (prog->freeedicts_heapcount == prog->freeedicts_heapsize && prog->freeedicts_heapsize >= prog->max_edicts * 2)
+	{
+		// edicts freed again while in the heap leave stale entries behind,
+		// drop them (each entry is read before it can be overwritten)
+		count = prog->freeedicts_heapcount;
+		prog->freeedicts_heapcount = 0;
+		for (i = 0;i < count;i++)
+		{
+			entry = prog->freeedicts_heap[i];
+			if (!PRVM_ED_FreeEdicts_IsStale(prog, &entry))
+				PRVM_ED_FreeEdicts_HeapPush(prog, &entry);
+		}
+	}
+	if (prog->freeedicts_heapcount == prog->freeedicts_heapsize)
+	{
+		size = max(64, prog->freeedicts_heapsize * 2);
+		heap = (prvm_freeedict_t *)Mem_Alloc(prog->progs_mempool, size * sizeof(prvm_freeedict_t));
+		if (prog->freeedicts_heap)
+		{
+			memcpy(heap, prog->freeedicts_heap, prog->freeedicts_heapcount * sizeof(prvm_freeedict_t));
+			Mem_Free(prog->freeedicts_heap);
+		}
+		prog->freeedicts_heap = heap;
+		prog->freeedicts_heapsize = size;
+	}
+	heap = prog->freeedicts_heap;
+	for (i = prog->freeedicts_heapcount++;i > 0;i = parent)
+	{
+		parent = (i - 1) / 2;
+		if (heap[parent].num <= f->num)
+			break;
+		heap[i] = heap[parent];
+	}
+	heap[i] = *f;
+}
+
+static void PRVM_ED_FreeEdicts_HeapPop(prvm_prog_t *prog)
+{
+	int i, child, count;
+	prvm_freeedict_t *heap = prog->freeedicts_heap, last;
+
+	count = --prog->freeedicts_heapcount;
+	last = heap[count];
+	for (i = 0;(child = i * 2 + 1) < count;i = child)
+	{
+		if (child + 1 < count && heap[child + 1].num < heap[child].num)
+			child++;
+		if (last.num <= heap[child].num)
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = last;
+}
+
+/*
+=================
+PRVM_ED_FreeEdicts_Next
+
+Returns the lowest numbered edict PRVM_ED_CanAlloc allows, or NULL.
+Whether an edict may be reused only depends on its freetime and older edicts
+are released first, so the queue head is moved to the heap until it is
+blocked.
+=================
+*/
+static prvm_edict_t *PRVM_ED_FreeEdicts_Next(prvm_prog_t *prog)
+{
+	prvm_freeedict_t *f;
+	prvm_edict_t *e;
+
+	for (;;)
+	{
+		while (prog->freeedicts_queuecount)
+		{
+			f = prog->freeedicts_queue + prog->freeedicts_queuehead;
+			if (!PRVM_ED_FreeEdicts_IsStale(prog, f))
+			{
+				if (!PRVM_ED_CanAlloc(prog, PRVM_EDICT_NUM(f->num)))
+					break;
+				PRVM_ED_FreeEdicts_HeapPush(prog, f);
+			}
+			prog->freeedicts_queuehead = (prog->freeedicts_queuehead + 1) % prog->freeedicts_queuesize;
+			prog->freeedicts_queuecount--;
+		}
+		while (prog->freeedicts_heapcount)
+		{
+			f = prog->freeedicts_heap;
+			if (PRVM_ED_FreeEdicts_IsStale(prog, f))
+			{
+				PRVM_ED_FreeEdicts_HeapPop(prog);
+				continue;
+			}
+			e = PRVM_EDICT_NUM(f->num);
+			// blocked again, prvm_reuseedicts_* must have changed
+			if (!PRVM_ED_CanAlloc(prog, e))
+				break;
+			PRVM_ED_FreeEdicts_HeapPop(prog);
+			return e;
+		}
+		if (!prog->freeedicts_heapcount)
+			return NULL;
+		PRVM_ED_FreeEdicts_Rebuild(prog);
+	}
+}
+
 /*
 =================
 PRVM_ED_Alloc
@@ -253,16 +471,27 @@ prvm_edict_t *PRVM_ED_Alloc(prvm_prog_t *prog)
 	// AK:	changed i=svs.maxclients+1
 	// AK:	changed so the edict 0 wont spawn -> used as reserved/world entity
 	//		although the menu/client has no world
-	for (i = prog->reserved_edicts + 1;i < prog->num_edicts;i++)
+	if (prvm_reuseedicts_always_allow == realtime)
 	{
-		e = PRVM_EDICT_NUM(i);
-		if(PRVM_ED_CanAlloc(prog, e))
+		// any free edict will do while loading entities
+		for (i = prog->reserved_edicts + 1;i < prog->num_edicts;i++)
 		{
-			PRVM_ED_ClearEdict (prog, e);
-			e->priv.required->allocation_origin = PRVM_AllocationOrigin(prog);
-			return e;
+			e = PRVM_EDICT_NUM(i);
+			if(PRVM_ED_CanAlloc(prog, e))
+			{
+				PRVM_ED_ClearEdict (prog, e);
+				e->priv.required->allocation_origin = PRVM_AllocationOrigin(prog);
+				return e;
+			}
 		}
 	}
+	else if ((e = PRVM_ED_FreeEdicts_Next(prog)))
+	{
+		PRVM_ED_ClearEdict (prog, e);
+		e->priv.required->allocation_origin = PRVM_AllocationOrigin(prog);
+		return e;
+	}
+	i = prog->num_edicts;
 
 	if (i == prog->limit_edicts)
 		prog->error_cmd("%s: PRVM_ED_Alloc: no free edicts", prog->name);
@@ -302,6 +531,7 @@ void PRVM_ED_Free(prvm_prog_t *prog, prvm_edict_t *ed)
 		Mem_Free((char *)ed->priv.required->allocation_origin);
 		ed->priv.required->allocation_origin = NULL;
 	}
+	PRVM_ED_FreeEdicts_Push(prog, ed);
 }
 
 //===========================================================================
@@ -344,6 +574,56 @@ ddef_t *PRVM_ED_FieldAtOfs (prvm_prog_t *prog, int ofs)
 	return NULL;
 }
 
+/*
+============
+PRVM_NameHash_Key
+============
+*/
+static unsigned int PRVM_NameHash_Key(const char *name)
+{
+	return CRC_Block((const unsigned char *)name, strlen(name));
+}
+
+/*
+============
+PRVM_NameHash_Build
+
+hashes count names, getname returns the name of an index
+============
+*/
+static void PRVM_NameHash_Build(prvm_prog_t *prog, prvm_namehash_t *hash, int count, const char *(*getname)(prvm_prog_t *prog, int index))
+{
+	int i, size, bucket;
+	for (size = 16;size < count && size < 65536;size <<= 1)
+		;
+	hash->mask = size - 1;
+	hash->first = (int *)Mem_Alloc(prog->progs_mempool, size * sizeof(int));
+	hash->next = (int *)Mem_Alloc(prog->progs_mempool, max(count, 1) * sizeof(int));
+	memset(hash->first, -1, size * sizeof(int));
+	// insert backwards so each chain ends up in ascending order
+	for (i = count - 1;i >= 0;i--)
+	{
+		bucket = PRVM_NameHash_Key(getname(prog, i)) & hash->mask;
+		hash->next[i] = hash->first[bucket];
+		hash->first[bucket] = i;
+	}
+}
+
+static const char *PRVM_FieldDefName(prvm_prog_t *prog, int index)
+{
+	return PRVM_GetString(prog, prog->fielddefs[index].s_name);
+}
+
+static const char *PRVM_GlobalDefName(prvm_prog_t *prog, int index)
+{
+	return PRVM_GetString(prog, prog->globaldefs[index].s_name);
+}
+
+static const char *PRVM_FunctionName(prvm_prog_t *prog, int index)
+{
+	return PRVM_GetString(prog, prog->functions[index].s_name);
+}
+
 /*
 ============
 PRVM_ED_FindField
@@ -354,6 +634,14 @@ ddef_t *PRVM_ED_FindField (prvm_prog_t *prog, const char *name)
 	ddef_t *def;
 	int i;
 
+	if (prog->fielddefs_hash.first)
+	{
+		for (i = prog->fielddefs_hash.first[PRVM_NameHash_Key(name) & prog->fielddefs_hash.mask];i >= 0;i = prog->fielddefs_hash.next[i])
+			if (!strcmp(PRVM_GetString(prog, prog->fielddefs[i].s_name), name))
+				return &prog->fielddefs[i];
+		return NULL;
+	}
+
 	for (i = 0;i < prog->numfielddefs;i++)
 	{
 		def = &prog->fielddefs[i];
@@ -373,6 +661,14 @@ ddef_t *PRVM_ED_FindGlobal (prvm_prog_t *prog, const char *name)
 	ddef_t *def;
 	int i;
 
+	if (prog->globaldefs_hash.first)
+	{
+		for (i = prog->globaldefs_hash.first[PRVM_NameHash_Key(name) & prog->globaldefs_hash.mask];i >= 0;i = prog->globaldefs_hash.next[i])
+			if (!strcmp(PRVM_GetString(prog, prog->globaldefs[i].s_name), name))
+				return &prog->globaldefs[i];
+		return NULL;
+	}
+
 	for (i = 0;i < prog->numglobaldefs;i++)
 	{
 		def = &prog->globaldefs[i];
@@ -393,6 +689,14 @@ mfunction_t *PRVM_ED_FindFunction (prvm_prog_t *prog, const char *name)
 	mfunction_t		*func;
 	int				i;
 
+	if (prog->functions_hash.first)
+	{
+		for (i = prog->functions_hash.first[PRVM_NameHash_Key(name) & prog->functions_hash.mask];i >= 0;i = prog->functions_hash.next[i])
+			if (!strcmp(PRVM_GetString(prog, prog->functions[i].s_name), name))
+				return &prog->functions[i];
+		return NULL;
+	}
+
 	for (i = 0;i < prog->numfunctions;i++)
 	{
 		func = &prog->functions[i];
@@ -947,7 +1251,10 @@ qboolean PRVM_ED_ParseEpair(prvm_prog_t *prog, prvm_edict_t *ent, ddef_t *key, c
 	mfunction_t *func;
 
 	if (ent)
+	{
 		val = (prvm_eval_t *)(ent->fields.fp + key->ofs);
+		PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(ent), key->ofs);
+	}
 	else
 		val = (prvm_eval_t *)(prog->globals.fp + key->ofs);
 	switch (key->type & ~DEF_SAVEGLOBAL)
@@ -1315,7 +1622,10 @@ const char *PRVM_ED_ParseEdict (prvm_prog_t *prog, const char *data, prvm_edict_
 	}
 
 	if (!init)
+	{
 		ent->priv.required->free = true;
+		PRVM_ED_FreeEdicts_Push(prog, ent);
+	}
 
 	return data;
 }
@@ -1371,7 +1681,10 @@ void PRVM_ED_LoadFromFile (prvm_prog_t *prog, const char *data)
 
 		// clear it
 		if (ent != prog->edicts)	// hack
+		{
 			memset (ent->fields.fp, 0, prog->entityfields * sizeof(prvm_vec_t));
+			PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(ent), -1);
+		}
 
 		data = PRVM_ED_ParseEdict (prog, data, ent);
 		parsed++;
@@ -1877,6 +2190,141 @@ static void PRVM_LoadLNO( prvm_prog_t *prog, const char *progname ) {
 	Mem_Free( lno );
 }
 
+/*
+===============
+PRVM_FuseStatementPair
+
+returns the superinstruction executing decoded statements a and b (which
+follows a), or 0 if they can not be fused
+===============
+*/
+static int PRVM_FuseStatementPair(const mstatementdecoded_t *a, const mstatementdecoded_t *b)
+{
+	switch (a->op)
+	{
+	case OP_EQ_F:
+	case OP_NE_F:
+	case OP_LE:
+	case OP_GE:
+	case OP_LT:
+	case OP_GT:
+		if (b->op != OP_IFNOT || b->operand[0] != a->operand[2])
+			return 0;
+		switch (a->op)
+		{
+		case OP_EQ_F: return OP_FUSED_EQ_F_IFNOT;
+		case OP_NE_F: return OP_FUSED_NE_F_IFNOT;
+		case OP_LE: return OP_FUSED_LE_IFNOT;
+		case OP_GE: return OP_FUSED_GE_IFNOT;
+		case OP_LT: return OP_FUSED_LT_IFNOT;
+		default: return OP_FUSED_GT_IFNOT;
+		}
+	case OP_ADDRESS:
+		if (b->operand[1] != a->operand[2])
+			return 0;
+		switch (b->op)
+		{
+		case OP_STOREP_F:
+		case OP_STOREP_ENT:
+		case OP_STOREP_FLD:
+		case OP_STOREP_S:
+		case OP_STOREP_FNC:
+			return OP_FUSED_ADDRESS_STOREP;
+		case OP_STOREP_V:
+			return OP_FUSED_ADDRESS_STOREP_V;
+		}
+		return 0;
+	case OP_LOAD_F:
+		switch (b->op)
+		{
+		case OP_ADD_F: return OP_FUSED_LOAD_F_ADD_F;
+		case OP_SUB_F: return OP_FUSED_LOAD_F_SUB_F;
+		case OP_MUL_F: return OP_FUSED_LOAD_F_MUL_F;
+		}
+		return 0;
+	case OP_LOAD_V:
+		switch (b->op)
+		{
+		case OP_ADD_V: return OP_FUSED_LOAD_V_ADD_V;
+		case OP_SUB_V: return OP_FUSED_LOAD_V_SUB_V;
+		}
+		return 0;
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		switch (b->op)
+		{
+		case OP_STORE_F:
+		case OP_STORE_ENT:
+		case OP_STORE_FLD:
+		case OP_STORE_S:
+		case OP_STORE_FNC:
+			return OP_FUSED_STORE_STORE;
+		}
+		return 0;
+	case OP_STORE_V:
+		return b->op == OP_STORE_V ? OP_FUSED_STORE_V_STORE_V : 0;
+	}
+	return 0;
+}
+
+/*
+===============
+PRVM_DecodeStatements
+
+builds prog->decodedstatements for the threaded interpreter: operands are
+resolved to pointers into the globals, and common statement pairs are fused
+into superinstructions.  The second statement of a pair is kept as it is, so
+jumps into the middle of a pair and returns from calls behave as before, and
+the fused opcodes step over both statements so the profile counters (which
+count statements between jumps) are unchanged.
+===============
+*/
+static void PRVM_DecodeStatements(prvm_prog_t *prog)
+{
+	int i, j, op;
+	int numfused[4];
+	mstatement_t *st;
+	mstatementdecoded_t *dst;
+
+	prog->decodedstatements = (mstatementdecoded_t *)Mem_Alloc(prog->progs_mempool, prog->progs_numstatements * sizeof(mstatementdecoded_t));
+	for (i = 0, st = prog->statements, dst = prog->decodedstatements;i < prog->progs_numstatements;i++, st++, dst++)
+	{
+		for (j = 0;j < 3;j++)
+			dst->operand[j] = st->operand[j] >= 0 ? (prvm_eval_t *)(prog->globals.fp + st->operand[j]) : NULL;
+		dst->op = (unsigned int)st->op <= OP_BITOR ? st->op : OP_DECODED_BAD;
+		dst->jumpabsolute = st->jumpabsolute;
+	}
+
+	prog->numfusedstatements = 0;
+	if (!prvm_superinstructions.integer)
+		return;
+
+	memset(numfused, 0, sizeof(numfused));
+	for (i = 0, dst = prog->decodedstatements;i < prog->progs_numstatements - 1;i++, dst++)
+	{
+		op = PRVM_FuseStatementPair(dst, dst + 1);
+		if (!op)
+			continue;
+		dst->op = op;
+		if (op <= OP_FUSED_GT_IFNOT)
+			numfused[0]++;
+		else if (op <= OP_FUSED_ADDRESS_STOREP_V)
+			numfused[1]++;
+		else if (op <= OP_FUSED_LOAD_V_SUB_V)
+			numfused[2]++;
+		else
+			numfused[3]++;
+		prog->numfusedstatements++;
+		// don't start another pair on the second statement
+		i++;
+		dst++;
+	}
+	Con_DPrintf("%s: fused %i of %i statements into superinstructions (%i compare+branch, %i address+store, %i load+arithmetic, %i store+store)\n", prog->name, prog->numfusedstatements * 2, prog->progs_numstatements, numfused[0], numfused[1], numfused[2], numfused[3]);
+}
+
 /*
 ===============
 PRVM_LoadProgs
@@ -1928,6 +2376,16 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 	prog->profiletime = Sys_DirtyTime();
 	prog->starttime = realtime;
 
+	// root of the prvm_stackprofile call tree
+	prog->maxcallnodes = 256;
+	prog->callnodes = (prvm_callnode_t *)Mem_Alloc(prog->progs_mempool, prog->maxcallnodes * sizeof(prvm_callnode_t));
+	prog->numcallnodes = 1;
+	prog->callnodes[0].function = -1;
+	prog->callnodes[0].parent = -1;
+	prog->callnodes[0].firstchild = -1;
+	prog->callnodes[0].nextsibling = -1;
+	prog->callnode = 0;
+
 	Con_DPrintf("%s programs occupy %iK.\n", prog->name, (int)(filesize/1024));
 
 	requiredglobalspace = 0;
@@ -1973,6 +2431,9 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 	prog->maxknownstrings = 0;
 	prog->knownstrings = NULL;
 	prog->knownstrings_freeable = NULL;
+	prog->knownstrings_freelist = -1;
+	memset(&prog->knownstrings_stats, 0, sizeof(prog->knownstrings_stats));
+	memset(&prog->tempstrings_stats, 0, sizeof(prog->tempstrings_stats));
 
 	Mem_ExpandableArray_NewArray(&prog->stringbuffersarray, prog->progs_mempool, sizeof(prvm_stringbuffer_t), 64);
 
@@ -2050,6 +2511,16 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 		prog->numfielddefs++;
 	}
 
+	// the names don't change from here on, hash them for the PRVM_ED_Find* functions
+	PRVM_NameHash_Build(prog, &prog->fielddefs_hash, prog->numfielddefs, PRVM_FieldDefName);
+	PRVM_NameHash_Build(prog, &prog->globaldefs_hash, prog->numglobaldefs, PRVM_GlobalDefName);
+	PRVM_NameHash_Build(prog, &prog->functions_hash, prog->numfunctions, PRVM_FunctionName);
+
+	// find builtin indexes are set up on first use, only writes to indexed fields are tracked
+	prog->fieldindexflags = (unsigned char *)Mem_Alloc(prog->progs_mempool, prog->entityfields * sizeof(unsigned char));
+	prog->fieldindexconfig[0] = 0;
+	prog->numfieldindexes = 0;
+
 	// LordHavoc: TODO: reorder globals to match engine struct
 	// LordHavoc: TODO: reorder fields to match engine struct
 #define remapglobal(index) (index)
@@ -2226,6 +2697,9 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 			break;
 	}
 
+	// the globals are never reallocated after this point
+	PRVM_DecodeStatements(prog);
+
 	// we're done with the file now
 	if(!data)
 		Mem_Free(dprograms);
@@ -2352,7 +2826,7 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 				cvar = Cvar_Get(name + 9, value, 0, NULL);
 				if((prog->globaldefs[i].type & ~DEF_SAVEGLOBAL) == ev_string)
 				{
-					val->string = PRVM_SetEngineString(prog, cvar->string);
+					val->string = PRVM_SetChangeableEngineString(prog, cvar->string);
 					cvar->globaldefindex_stringno[prog - prvm_prog_list] = val->string;
 				}
 				if(!cvar)
@@ -2387,7 +2861,7 @@ void PRVM_Prog_Load(prvm_prog_t *prog, const char * filename, unsigned char * da
 						}
 						break;
 					case ev_string:
-						val->string = PRVM_SetEngineString(prog, cvar->string);
+						val->string = PRVM_SetChangeableEngineString(prog, cvar->string);
 						cvar->globaldefindex_stringno[prog - prvm_prog_list] = val->string;
 						break;
 					default:
@@ -2854,6 +3328,8 @@ void PRVM_Init (void)
 	Cmd_AddCommand ("prvm_profile", PRVM_Profile_f, "prints execution statistics about the most used QuakeC functions in the selected VM (server, client, menu)");
 	Cmd_AddCommand ("prvm_childprofile", PRVM_ChildProfile_f, "prints execution statistics about the most used QuakeC functions in the selected VM (server, client, menu), sorted by time taken in function with child calls");
 	Cmd_AddCommand ("prvm_callprofile", PRVM_CallProfile_f, "prints execution statistics about the most time consuming QuakeC calls from the engine in the selected VM (server, client, menu)");
+	Cmd_AddCommand ("prvm_stackprofile", PRVM_StackProfile_f, "prints the QuakeC functions and builtins that took the most time in the selected VM (server, client, menu) and optionally writes their call stacks to a file in the folded format of flame graph tools; needs prvm_timeprofiling 1; usage: prvm_stackprofile <program name> [count] [filename]");
+	Cmd_AddCommand ("prvm_stringstats", PRVM_StringStats_f, "prints how many strings the selected VM (server, client, menu) knows of and how many were registered, allocated and freed since it was loaded, and how much of the tempstring buffer is used");
 	Cmd_AddCommand ("prvm_fields", PRVM_Fields_f, "prints usage statistics on properties (how many entities have non-zero values) in the selected VM (server, client, menu)");
 	Cmd_AddCommand ("prvm_globals", PRVM_Globals_f, "prints all global variables in the selected VM (server, client, menu)");
 	Cmd_AddCommand ("prvm_global", PRVM_Global_f, "prints value of a specified global variable in the selected VM (server, client, menu)");
@@ -2862,6 +3338,7 @@ void PRVM_Init (void)
 	Cmd_AddCommand ("prvm_edictget", PRVM_ED_EdictGet_f, "retrieves the value of a specified property of a specified entity in the selected VM (server, client menu) into a cvar or to the console");
 	Cmd_AddCommand ("prvm_globalget", PRVM_ED_GlobalGet_f, "retrieves the value of a specified global variable in the selected VM (server, client menu) into a cvar or to the console");
 	Cmd_AddCommand ("prvm_printfunction", PRVM_PrintFunction_f, "prints a disassembly (QuakeC instructions) of the specified function in the selected VM (server, client, menu)");
+	Cmd_AddCommand ("prvm_benchmark", PRVM_Benchmark_f, "runs a QuakeC function repeatedly with both interpreters and prints the time per call; usage: prvm_benchmark <program name> <function name> [count] (note: side effects on entities are not undone)");
 	Cmd_AddCommand ("cl_cmd", PRVM_GameCommand_Client_f, "calls the client QC function GameCommand with the supplied string as argument");
 	Cmd_AddCommand ("menu_cmd", PRVM_GameCommand_Menu_f, "calls the menu QC function GameCommand with the supplied string as argument");
 	Cmd_AddCommand ("sv_cmd", PRVM_GameCommand_Server_f, "calls the server QC function GameCommand with the supplied string as argument");
@@ -2874,8 +3351,13 @@ void PRVM_Init (void)
 	Cvar_RegisterVariable (&prvm_traceqc);
 	Cvar_RegisterVariable (&prvm_statementprofiling);
 	Cvar_RegisterVariable (&prvm_timeprofiling);
+	Cvar_RegisterVariable (&prvm_threadedinterpreter);
+	Cvar_RegisterVariable (&prvm_superinstructions);
 	Cvar_RegisterVariable (&prvm_backtraceforwarnings);
 	Cvar_RegisterVariable (&prvm_leaktest);
+	Cvar_RegisterVariable (&prvm_stringinterning);
+	Cvar_RegisterVariable (&prvm_findindex);
+	Cvar_RegisterVariable (&prvm_findindexfields);
 	Cvar_RegisterVariable (&prvm_leaktest_ignore_classnames);
 	Cvar_RegisterVariable (&prvm_errordump);
 	Cvar_RegisterVariable (&prvm_breakpointdump);
@@ -2960,6 +3442,164 @@ const char *PRVM_GetString(prvm_prog_t *prog, int num)
 	}
 }
 
+/*
+===============
+PRVM_KnownStrings_PointerBucket
+
+the known strings are indexed by pointer (all of them) and optionally by
+content (engine owned ones), both hashes have maxknownstrings buckets
+===============
+*/
+static int PRVM_KnownStrings_PointerBucket(prvm_prog_t *prog, const char *s)
+{
+	size_t h = (size_t)s >> 4;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return (int)(h & (prog->maxknownstrings - 1));
+}
+
+static void PRVM_KnownStrings_Link(prvm_prog_t *prog, int i)
+{
+	int bucket = PRVM_KnownStrings_PointerBucket(prog, prog->knownstrings[i]);
+	prog->knownstrings_hashnext[i] = prog->knownstrings_hashfirst[bucket];
+	prog->knownstrings_hashfirst[bucket] = i;
+	if (prog->knownstrings_contentkey[i] >= 0)
+	{
+		bucket = prog->knownstrings_contentkey[i] & (prog->maxknownstrings - 1);
+		prog->knownstrings_contentnext[i] = prog->knownstrings_contentfirst[bucket];
+		prog->knownstrings_contentfirst[bucket] = i;
+	}
+}
+
+static void PRVM_KnownStrings_Unlink(prvm_prog_t *prog, int i)
+{
+	int *link;
+	for (link = &prog->knownstrings_hashfirst[PRVM_KnownStrings_PointerBucket(prog, prog->knownstrings[i])];*link >= 0;link = &prog->knownstrings_hashnext[*link])
+	{
+		if (*link == i)
+		{
+			*link = prog->knownstrings_hashnext[i];
+			break;
+		}
+	}
+	if (prog->knownstrings_contentkey[i] >= 0)
+	{
+		for (link = &prog->knownstrings_contentfirst[prog->knownstrings_contentkey[i] & (prog->maxknownstrings - 1)];*link >= 0;link = &prog->knownstrings_contentnext[*link])
+		{
+			if (*link == i)
+			{
+				*link = prog->knownstrings_contentnext[i];
+				break;
+			}
+		}
+		prog->knownstrings_contentkey[i] = -1;
+	}
+}
+
+/*
+===============
+PRVM_KnownStrings_NewSlot
+
+returns a free known string index, growing the arrays (and rebuilding the
+hashes) by doubling when there are no free slots left
+===============
+*/
+static int PRVM_KnownStrings_NewSlot(prvm_prog_t *prog)
+{
+	int i;
+	if (prog->knownstrings_freelist >= 0)
+	{
+		// freed slots are linked through knownstrings_hashnext
+		i = prog->knownstrings_freelist;
+		prog->knownstrings_freelist = prog->knownstrings_hashnext[i];
+		prog->knownstrings_stats.active++;
+		return i;
+	}
+	if (prog->numknownstrings >= prog->maxknownstrings)
+	{
+		const char **oldstrings = prog->knownstrings;
+		const unsigned char *oldstrings_freeable = prog->knownstrings_freeable;
+		const char **oldstrings_origin = prog->knownstrings_origin;
+		int *oldhashnext = prog->knownstrings_hashnext;
+		int *oldcontentkey = prog->knownstrings_contentkey;
+		prog->maxknownstrings = max(prog->maxknownstrings * 2, 128);
+		prog->knownstrings = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
+		prog->knownstrings_freeable = (unsigned char *)PRVM_Alloc(prog->maxknownstrings * sizeof(unsigned char));
+		if(prog->leaktest_active)
+			prog->knownstrings_origin = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
+		prog->knownstrings_hashnext = (int *)PRVM_Alloc(prog->maxknownstrings * sizeof(int));
+		prog->knownstrings_contentkey = (int *)PRVM_Alloc(prog->maxknownstrings * sizeof(int));
+		if (prog->numknownstrings)
+		{
+			memcpy((char **)prog->knownstrings, oldstrings, prog->numknownstrings * sizeof(char *));
+			memcpy((char **)prog->knownstrings_freeable, oldstrings_freeable, prog->numknownstrings * sizeof(unsigned char));
+			if(prog->leaktest_active)
+				memcpy((char **)prog->knownstrings_origin, oldstrings_origin, prog->numknownstrings * sizeof(char *));
+			memcpy(prog->knownstrings_contentkey, oldcontentkey, prog->numknownstrings * sizeof(int));
+		}
+		if (oldstrings)
+			Mem_Free((char **)oldstrings);
+		if (oldstrings_freeable)
+			Mem_Free((unsigned char *)oldstrings_freeable);
+		if (oldstrings_origin)
+			Mem_Free((char **)oldstrings_origin);
+		if (oldhashnext)
+			Mem_Free(oldhashnext);
+		if (oldcontentkey)
+			Mem_Free(oldcontentkey);
+		if (prog->knownstrings_hashfirst)
+			Mem_Free(prog->knownstrings_hashfirst);
+		if (prog->knownstrings_contentfirst)
+			Mem_Free(prog->knownstrings_contentfirst);
+		if (prog->knownstrings_contentnext)
+			Mem_Free(prog->knownstrings_contentnext);
+		prog->knownstrings_hashfirst = (int *)PRVM_Alloc(prog->maxknownstrings * sizeof(int));
+		prog->knownstrings_contentfirst = (int *)PRVM_Alloc(prog->maxknownstrings * sizeof(int));
+		prog->knownstrings_contentnext = (int *)PRVM_Alloc(prog->maxknownstrings * sizeof(int));
+		memset(prog->knownstrings_hashfirst, -1, prog->maxknownstrings * sizeof(int));
+		memset(prog->knownstrings_contentfirst, -1, prog->maxknownstrings * sizeof(int));
+		// the bucket count changed, rehash everything and rebuild the free list
+		prog->knownstrings_freelist = -1;
+		for (i = prog->numknownstrings - 1;i >= 0;i--)
+		{
+			if (prog->knownstrings[i])
+				PRVM_KnownStrings_Link(prog, i);
+			else
+			{
+				prog->knownstrings_hashnext[i] = prog->knownstrings_freelist;
+				prog->knownstrings_freelist = i;
+			}
+		}
+		prog->knownstrings_stats.grown++;
+	}
+	prog->knownstrings_stats.active++;
+	return prog->numknownstrings++;
+}
+
+/*
+===============
+PRVM_KnownStrings_Set
+
+stores s in a slot returned by PRVM_KnownStrings_NewSlot, internable slots
+go in the content hash too
+===============
+*/
+static void PRVM_KnownStrings_Set(prvm_prog_t *prog, int i, const char *s, qboolean freeable, qboolean internable)
+{
+	prog->knownstrings[i] = s;
+	prog->knownstrings_freeable[i] = freeable;
+	prog->knownstrings_contentkey[i] = (internable && prvm_stringinterning.integer) ? CRC_Block((const unsigned char *)s, strlen(s)) : -1;
+	PRVM_KnownStrings_Link(prog, i);
+}
+
+/*
+===============
+PRVM_ChangeEngineString
+
+points a slot from PRVM_SetChangeableEngineString at new text
+===============
+*/
 const char *PRVM_ChangeEngineString(prvm_prog_t *prog, int i, const char *s)
 {
 	const char *old;
@@ -2967,13 +3607,50 @@ const char *PRVM_ChangeEngineString(prvm_prog_t *prog, int i, const char *s)
 	if(i < 0 || i >= prog->numknownstrings)
 		prog->error_cmd("PRVM_ChangeEngineString: s is not an engine string");
 	old = prog->knownstrings[i];
+	if (old)
+		PRVM_KnownStrings_Unlink(prog, i);
+	// whatever the old text was, the slot must not be found by content
+	prog->knownstrings_contentkey[i] = -1;
 	prog->knownstrings[i] = s;
+	if (s)
+		PRVM_KnownStrings_Link(prog, i);
 	return old;
 }
 
-int PRVM_SetEngineString(prvm_prog_t *prog, const char *s)
+/*
+===============
+PRVM_SetChangeableEngineString
+
+like PRVM_SetEngineString, but the slot is never shared by content (it is
+changed later with PRVM_ChangeEngineString, like the autocvar strings), so
+it gets a slot of its own unless s is already known by pointer in one that
+is not interned
+===============
+*/
+int PRVM_SetChangeableEngineString(prvm_prog_t *prog, const char *s)
 {
 	int i;
+	if (!s)
+		return 0;
+	if (s >= prog->strings && s <= prog->strings + prog->stringssize)
+		prog->error_cmd("PRVM_SetChangeableEngineString: s in prog->strings area");
+	if (s >= (char *)prog->tempstringsbuf.data && s < (char *)prog->tempstringsbuf.data + prog->tempstringsbuf.maxsize)
+		prog->error_cmd("PRVM_SetChangeableEngineString: s in the tempstrings area");
+	if (prog->maxknownstrings)
+		for (i = prog->knownstrings_hashfirst[PRVM_KnownStrings_PointerBucket(prog, s)];i >= 0;i = prog->knownstrings_hashnext[i])
+			if (prog->knownstrings[i] == s && !prog->knownstrings_freeable[i] && prog->knownstrings_contentkey[i] < 0)
+				return PRVM_KNOWNSTRINGBASE + i;
+	i = PRVM_KnownStrings_NewSlot(prog);
+	PRVM_KnownStrings_Set(prog, i, s, false, false);
+	if(prog->leaktest_active)
+		prog->knownstrings_origin[i] = NULL;
+	prog->knownstrings_stats.registered++;
+	return PRVM_KNOWNSTRINGBASE + i;
+}
+
+int PRVM_SetEngineString(prvm_prog_t *prog, const char *s)
+{
+	int i, key;
 	if (!s)
 		return 0;
 	if (s >= prog->strings && s <= prog->strings + prog->stringssize)
@@ -2983,42 +3660,34 @@ int PRVM_SetEngineString(prvm_prog_t *prog, const char *s)
 	if (s >= (char *)prog->tempstringsbuf.data && s < (char *)prog->tempstringsbuf.data + prog->tempstringsbuf.maxsize)
 		return prog->stringssize + (s - (char *)prog->tempstringsbuf.data);
 	// see if it's a known string address
-	for (i = 0;i < prog->numknownstrings;i++)
-		if (prog->knownstrings[i] == s)
-			return PRVM_KNOWNSTRINGBASE + i;
-	// new unknown engine string
-	if (developer_insane.integer)
-		Con_DPrintf("new engine string %p = \"%s\"\n", s, s);
-	for (i = prog->firstfreeknownstring;i < prog->numknownstrings;i++)
-		if (!prog->knownstrings[i])
-			break;
-	if (i >= prog->numknownstrings)
+	if (prog->maxknownstrings)
 	{
-		if (i >= prog->maxknownstrings)
+		for (i = prog->knownstrings_hashfirst[PRVM_KnownStrings_PointerBucket(prog, s)];i >= 0;i = prog->knownstrings_hashnext[i])
+			if (prog->knownstrings[i] == s)
+				return PRVM_KNOWNSTRINGBASE + i;
+		// or an engine string with the same text
+		if (prvm_stringinterning.integer)
 		{
-			const char **oldstrings = prog->knownstrings;
-			const unsigned char *oldstrings_freeable = prog->knownstrings_freeable;
-			const char **oldstrings_origin = prog->knownstrings_origin;
-			prog->maxknownstrings += 128;
-			prog->knownstrings = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
-			prog->knownstrings_freeable = (unsigned char *)PRVM_Alloc(prog->maxknownstrings * sizeof(unsigned char));
-			if(prog->leaktest_active)
-				prog->knownstrings_origin = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
-			if (prog->numknownstrings)
+			key = CRC_Block((const unsigned char *)s, strlen(s));
+			for (i = prog->knownstrings_contentfirst[key & (prog->maxknownstrings - 1)];i >= 0;i = prog->knownstrings_contentnext[i])
 			{
-				memcpy((char **)prog->knownstrings, oldstrings, prog->numknownstrings * sizeof(char *));
-				memcpy((char **)prog->knownstrings_freeable, oldstrings_freeable, prog->numknownstrings * sizeof(unsigned char));
-				if(prog->leaktest_active)
-					memcpy((char **)prog->knownstrings_origin, oldstrings_origin, prog->numknownstrings * sizeof(char *));
+				if (prog->knownstrings_contentkey[i] == key && !strcmp(prog->knownstrings[i], s))
+				{
+					prog->knownstrings_stats.interned++;
+					return PRVM_KNOWNSTRINGBASE + i;
+				}
 			}
 		}
-		prog->numknownstrings++;
 	}
-	prog->firstfreeknownstring = i + 1;
-	prog->knownstrings[i] = s;
-	prog->knownstrings_freeable[i] = false;
+	// new unknown engine string
+	if (developer_insane.integer)
+		Con_DPrintf("new engine string %p = \"%s\"\n", s, s);
+	i = PRVM_KnownStrings_NewSlot(prog);
+	// only engine strings are interned, QC owned ones can be modified or freed
+	PRVM_KnownStrings_Set(prog, i, s, false, true);
 	if(prog->leaktest_active)
 		prog->knownstrings_origin[i] = NULL;
+	prog->knownstrings_stats.registered++;
 	return PRVM_KNOWNSTRINGBASE + i;
 }
 
@@ -3033,35 +3702,71 @@ int PRVM_SetEngineString(prvm_prog_t *prog, const char *s)
 
 int PRVM_SetTempString(prvm_prog_t *prog, const char *s)
 {
-	int size;
-	char *t;
+	size_t length;
 	if (!s)
 		return 0;
-	size = (int)strlen(s) + 1;
+	length = strlen(s);
+	memcpy(PRVM_TempString_Reserve(prog, length + 1), s, length);
+	return PRVM_TempString_Commit(prog, length);
+}
+
+/*
+===============
+PRVM_TempString_Reserve
+
+makes room for size bytes (including the terminating 0) at the end of the
+tempstrings buffer and returns where to write them, so builtins can format
+their result in place instead of copying it in with PRVM_SetTempString.
+the text is not a string until PRVM_TempString_Commit is called.
+
+growing the buffer moves it, so fetch string parms (which may be
+tempstrings) after reserving, not before
+===============
+*/
+char *PRVM_TempString_Reserve(prvm_prog_t *prog, size_t size)
+{
 	if (developer_insane.integer)
-		Con_DPrintf("PRVM_SetTempString: cursize %i, size %i\n", prog->tempstringsbuf.cursize, size);
-	if (prog->tempstringsbuf.maxsize < prog->tempstringsbuf.cursize + size)
+		Con_DPrintf("PRVM_TempString_Reserve: cursize %i, size %i\n", prog->tempstringsbuf.cursize, (int)size);
+	if ((size_t)(prog->tempstringsbuf.maxsize - prog->tempstringsbuf.cursize) < size)
 	{
 		sizebuf_t old = prog->tempstringsbuf;
-		if (prog->tempstringsbuf.cursize + size >= 1<<28)
-			prog->error_cmd("PRVM_SetTempString: ran out of tempstring memory!  (refusing to grow tempstring buffer over 256MB, cursize %i, size %i)\n", prog->tempstringsbuf.cursize, size);
+		if (size >= (size_t)((1<<28) - prog->tempstringsbuf.cursize))
+			prog->error_cmd("PRVM_TempString_Reserve: ran out of tempstring memory!  (refusing to grow tempstring buffer over 256MB, cursize %i, size %i)\n", prog->tempstringsbuf.cursize, (int)size);
 		prog->tempstringsbuf.maxsize = max(prog->tempstringsbuf.maxsize, 65536);
-		while (prog->tempstringsbuf.maxsize < prog->tempstringsbuf.cursize + size)
+		while ((size_t)(prog->tempstringsbuf.maxsize - prog->tempstringsbuf.cursize) < size)
 			prog->tempstringsbuf.maxsize *= 2;
 		if (prog->tempstringsbuf.maxsize != old.maxsize || prog->tempstringsbuf.data == NULL)
 		{
-			Con_DPrintf("PRVM_SetTempString: enlarging tempstrings buffer (%iKB -> %iKB)\n", old.maxsize/1024, prog->tempstringsbuf.maxsize/1024);
+			Con_DPrintf("PRVM_TempString_Reserve: enlarging tempstrings buffer (%iKB -> %iKB)\n", old.maxsize/1024, prog->tempstringsbuf.maxsize/1024);
 			prog->tempstringsbuf.data = (unsigned char *) Mem_Alloc(prog->progs_mempool, prog->tempstringsbuf.maxsize);
 			if (old.cursize)
 				memcpy(prog->tempstringsbuf.data, old.data, old.cursize);
 			if (old.data)
 				Mem_Free(old.data);
+			prog->tempstrings_stats.grown++;
 		}
 	}
-	t = (char *)prog->tempstringsbuf.data + prog->tempstringsbuf.cursize;
-	memcpy(t, s, size);
-	prog->tempstringsbuf.cursize += size;
-	return PRVM_SetEngineString(prog, t);
+	return (char *)prog->tempstringsbuf.data + prog->tempstringsbuf.cursize;
+}
+
+/*
+===============
+PRVM_TempString_Commit
+
+terminates the length bytes written at the last PRVM_TempString_Reserve
+(which must have been for at least length + 1 bytes) and returns them as a
+tempstring
+===============
+*/
+int PRVM_TempString_Commit(prvm_prog_t *prog, size_t length)
+{
+	int offset = prog->tempstringsbuf.cursize;
+	prog->tempstringsbuf.data[offset + length] = 0;
+	prog->tempstringsbuf.cursize += (int)length + 1;
+	prog->tempstrings_stats.strings++;
+	if (prog->tempstrings_stats.highwater < prog->tempstringsbuf.cursize)
+		prog->tempstrings_stats.highwater = prog->tempstringsbuf.cursize;
+	return prog->stringssize + offset;
 }
 
 int PRVM_AllocString(prvm_prog_t *prog, size_t bufferlength, char **pointer)
@@ -3069,44 +3774,13 @@ int PRVM_AllocString(prvm_prog_t *prog, size_t bufferlength, char **pointer)
 	int i;
 	if (!bufferlength)
 		return 0;
-	for (i = prog->firstfreeknownstring;i < prog->numknownstrings;i++)
-		if (!prog->knownstrings[i])
-			break;
-	if (i >= prog->numknownstrings)
-	{
-		if (i >= prog->maxknownstrings)
-		{
-			const char **oldstrings = prog->knownstrings;
-			const unsigned char *oldstrings_freeable = prog->knownstrings_freeable;
-			const char **oldstrings_origin = prog->knownstrings_origin;
-			prog->maxknownstrings += 128;
-			prog->knownstrings = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
-			prog->knownstrings_freeable = (unsigned char *)PRVM_Alloc(prog->maxknownstrings * sizeof(unsigned char));
-			if(prog->leaktest_active)
-				prog->knownstrings_origin = (const char **)PRVM_Alloc(prog->maxknownstrings * sizeof(char *));
-			if (prog->numknownstrings)
-			{
-				memcpy((char **)prog->knownstrings, oldstrings, prog->numknownstrings * sizeof(char *));
-				memcpy((char **)prog->knownstrings_freeable, oldstrings_freeable, prog->numknownstrings * sizeof(unsigned char));
-				if(prog->leaktest_active)
-					memcpy((char **)prog->knownstrings_origin, oldstrings_origin, prog->numknownstrings * sizeof(char *));
-			}
-			if (oldstrings)
-				Mem_Free((char **)oldstrings);
-			if (oldstrings_freeable)
-				Mem_Free((unsigned char *)oldstrings_freeable);
-			if (oldstrings_origin)
-				Mem_Free((char **)oldstrings_origin);
-		}
-		prog->numknownstrings++;
-	}
-	prog->firstfreeknownstring = i + 1;
-	prog->knownstrings[i] = (char *)PRVM_Alloc(bufferlength);
-	prog->knownstrings_freeable[i] = true;
+	i = PRVM_KnownStrings_NewSlot(prog);
+	PRVM_KnownStrings_Set(prog, i, (char *)PRVM_Alloc(bufferlength), true, false);
 	if(prog->leaktest_active)
 		prog->knownstrings_origin[i] = PRVM_AllocationOrigin(prog);
 	if (pointer)
 		*pointer = (char *)(prog->knownstrings[i]);
+	prog->knownstrings_stats.allocated++;
 	return PRVM_KNOWNSTRINGBASE + i;
 }
 
@@ -3123,18 +3797,405 @@ void PRVM_FreeString(prvm_prog_t *prog, int num)
 			prog->error_cmd("PRVM_FreeString: attempt to free a non-existent or already freed string");
 		if (!prog->knownstrings_freeable[num])
 			prog->error_cmd("PRVM_FreeString: attempt to free a string owned by the engine");
+		PRVM_KnownStrings_Unlink(prog, num);
 		PRVM_Free((char *)prog->knownstrings[num]);
 		if(prog->leaktest_active)
 			if(prog->knownstrings_origin[num])
 				PRVM_Free((char *)prog->knownstrings_origin[num]);
 		prog->knownstrings[num] = NULL;
 		prog->knownstrings_freeable[num] = false;
-		prog->firstfreeknownstring = min(prog->firstfreeknownstring, num);
+		prog->knownstrings_hashnext[num] = prog->knownstrings_freelist;
+		prog->knownstrings_freelist = num;
+		prog->knownstrings_stats.active--;
+		prog->knownstrings_stats.freed++;
 	}
 	else
 		prog->error_cmd("PRVM_FreeString: invalid string offset %i", num);
 }
 
+/*
+===============
+PRVM_StringStats_f
+
+prints how many known strings there are and how much they have changed
+===============
+*/
+void PRVM_StringStats_f(void)
+{
+	prvm_prog_t *prog;
+	prvm_knownstringstats_t *stats;
+	prvm_tempstringstats_t *tempstats;
+	int i, numengine = 0, numfreeable = 0;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Print("prvm_stringstats <program name>\n");
+		return;
+	}
+
+	if (!(prog = PRVM_FriendlyProgFromString(Cmd_Argv(1))))
+		return;
+
+	for (i = 0;i < prog->numknownstrings;i++)
+	{
+		if (!prog->knownstrings[i])
+			continue;
+		if (prog->knownstrings_freeable[i])
+			numfreeable++;
+		else
+			numengine++;
+	}
+	stats = &prog->knownstrings_stats;
+	Con_Printf("%s: %i known strings in use (%i engine, %i allocated by QC), %i slots, %i allocated\n", prog->name, stats->active, numengine, numfreeable, prog->numknownstrings, prog->maxknownstrings);
+	Con_Printf("since load: %u engine strings registered, %u reused by content, %u QC strings allocated, %u freed, arrays grown %u times\n", stats->registered, stats->interned, stats->allocated, stats->freed, stats->grown);
+	tempstats = &prog->tempstrings_stats;
+	Con_Printf("tempstrings: %i bytes in use, %i bytes at most, %i byte buffer grown %u times, %u created, %u calls cleaned up after\n", prog->tempstringsbuf.cursize, tempstats->highwater, prog->tempstringsbuf.maxsize, tempstats->grown, tempstats->strings, tempstats->resets);
+}
+
+/*
+===============
+PRVM_FieldIndex_Key
+
+hash key of a field value, values that compare equal get the same key
+===============
+*/
+static unsigned int PRVM_FieldIndex_StringKey(const char *s)
+{
+	return CRC_Block((const unsigned char *)s, strlen(s));
+}
+
+static unsigned int PRVM_FieldIndex_FloatKey(prvm_vec_t v)
+{
+	prvm_eval_t u;
+	unsigned int h;
+	// 0 and -0 (and denormals with flush to zero) compare equal
+	if (v == 0)
+		return 0;
+	u._float = v;
+	h = (unsigned int)u._int;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return h;
+}
+
+/*
+===============
+PRVM_FieldIndex_StableKey
+
+returns false if the value of the field can change without a write to it
+(tempstrings and engine strings), otherwise gets its hash key
+===============
+*/
+static qboolean PRVM_FieldIndex_StableKey(prvm_prog_t *prog, prvm_fieldindex_t *index, prvm_edict_t *ed, unsigned int *key)
+{
+	int num;
+	if (index->type != ev_string)
+	{
+		*key = PRVM_FieldIndex_FloatKey(PRVM_E_FLOAT(ed, index->ofs));
+		return true;
+	}
+	num = PRVM_E_INT(ed, index->ofs);
+	if (num >= 0 && num < prog->stringssize)
+	{
+		*key = PRVM_FieldIndex_StringKey(prog->strings + num);
+		return true;
+	}
+	if (num & PRVM_KNOWNSTRINGBASE)
+	{
+		num -= PRVM_KNOWNSTRINGBASE;
+		if (num >= 0 && num < prog->numknownstrings && prog->knownstrings[num] && prog->knownstrings_freeable[num])
+		{
+			*key = PRVM_FieldIndex_StringKey(prog->knownstrings[num]);
+			return true;
+		}
+	}
+	return false;
+}
+
+static qboolean PRVM_FieldIndex_Matches(prvm_prog_t *prog, prvm_fieldindex_t *index, int e, const char *s, prvm_vec_t f)
+{
+	prvm_edict_t *ed = PRVM_EDICT_NUM(e);
+	const char *t;
+	if (ed->priv.required->free)
+		return false;
+	if (index->type != ev_string)
+		return PRVM_E_FLOAT(ed, index->ofs) == f;
+	t = PRVM_E_STRING(ed, index->ofs);
+	if (!t)
+		t = "";
+	return !strcmp(t, s);
+}
+
+static void PRVM_FieldIndex_AddUnhashed(prvm_fieldindex_t *index, int e)
+{
+	if (index->isunhashed[e])
+		return;
+	index->isunhashed[e] = true;
+	index->unhashed[index->numunhashed++] = e;
+}
+
+static void PRVM_FieldIndex_Unlink(prvm_fieldindex_t *index, int e)
+{
+	if (index->bucket[e] < 0)
+		return;
+	if (index->prev[e] >= 0)
+		index->next[index->prev[e]] = index->next[e];
+	else
+		index->first[index->bucket[e]] = index->next[e];
+	if (index->next[e] >= 0)
+		index->prev[index->next[e]] = index->prev[e];
+	index->bucket[e] = -1;
+}
+
+// keeps the chain in ascending edict order
+static void PRVM_FieldIndex_Link(prvm_fieldindex_t *index, int e, unsigned int key)
+{
+	int b = key & index->mask;
+	int p = -1, n = index->first[b];
+	while (n >= 0 && n < e)
+	{
+		p = n;
+		n = index->next[n];
+	}
+	index->bucket[e] = b;
+	index->prev[e] = p;
+	index->next[e] = n;
+	if (p >= 0)
+		index->next[p] = e;
+	else
+		index->first[b] = e;
+	if (n >= 0)
+		index->prev[n] = e;
+}
+
+static void PRVM_FieldIndex_Build(prvm_prog_t *prog, prvm_fieldindex_t *index)
+{
+	int e, size;
+	unsigned int key;
+	if (index->maxedicts != prog->max_edicts)
+	{
+		if (index->first)
+		{
+			Mem_Free(index->first);
+			Mem_Free(index->next);
+			Mem_Free(index->prev);
+			Mem_Free(index->bucket);
+			Mem_Free(index->unhashed);
+			Mem_Free(index->isunhashed);
+		}
+		index->maxedicts = prog->max_edicts;
+		for (size = 64;size < index->maxedicts;size <<= 1)
+			;
+		index->mask = size - 1;
+		index->first = (int *)PRVM_Alloc(size * sizeof(int));
+		index->next = (int *)PRVM_Alloc(index->maxedicts * sizeof(int));
+		index->prev = (int *)PRVM_Alloc(index->maxedicts * sizeof(int));
+		index->bucket = (int *)PRVM_Alloc(index->maxedicts * sizeof(int));
+		index->unhashed = (int *)PRVM_Alloc(index->maxedicts * sizeof(int));
+		index->isunhashed = (unsigned char *)PRVM_Alloc(index->maxedicts * sizeof(unsigned char));
+	}
+	memset(index->first, -1, (index->mask + 1) * sizeof(int));
+	memset(index->bucket, -1, index->maxedicts * sizeof(int));
+	memset(index->isunhashed, 0, index->maxedicts * sizeof(unsigned char));
+	index->numunhashed = 0;
+	// going backwards and linking at the head keeps the chains in ascending order
+	// (world is never returned by the find builtins so it is left out)
+	for (e = min(prog->num_edicts, index->maxedicts) - 1;e > 0;e--)
+	{
+		if (PRVM_FieldIndex_StableKey(prog, index, PRVM_EDICT_NUM(e), &key))
+		{
+			int b = key & index->mask;
+			index->bucket[e] = b;
+			index->prev[e] = -1;
+			index->next[e] = index->first[b];
+			if (index->first[b] >= 0)
+				index->prev[index->first[b]] = e;
+			index->first[b] = e;
+		}
+		else
+			PRVM_FieldIndex_AddUnhashed(index, e);
+	}
+	index->numcovered = min(prog->num_edicts, index->maxedicts);
+	index->freedstrings = prog->knownstrings_stats.freed;
+	index->touchserial = prog->toplevelcalls - 1;
+	index->built = true;
+}
+
+/*
+===============
+PRVM_FieldIndex_Setup
+
+(re)creates the indexes when prvm_findindexfields has changed
+===============
+*/
+static void PRVM_FieldIndex_Setup(prvm_prog_t *prog)
+{
+	int i;
+	const char *p;
+	char name[MAX_INPUTLINE];
+	ddef_t *def;
+	prvm_fieldindex_t *index;
+
+	for (i = 0;i < prog->numfieldindexes;i++)
+	{
+		index = prog->fieldindexes + i;
+		if (index->first)
+		{
+			Mem_Free(index->first);
+			Mem_Free(index->next);
+			Mem_Free(index->prev);
+			Mem_Free(index->bucket);
+			Mem_Free(index->unhashed);
+			Mem_Free(index->isunhashed);
+		}
+	}
+	memset(prog->fieldindexes, 0, sizeof(prog->fieldindexes));
+	memset(prog->fieldindexflags, 0, prog->entityfields * sizeof(unsigned char));
+	prog->numfieldindexes = 0;
+	strlcpy(prog->fieldindexconfig, prvm_findindexfields.string, sizeof(prog->fieldindexconfig));
+
+	for (p = prog->fieldindexconfig;COM_ParseToken_Console(&p);)
+	{
+		strlcpy(name, com_token, sizeof(name));
+		if (!(def = PRVM_ED_FindField(prog, name)))
+			continue;
+		switch (def->type & ~DEF_SAVEGLOBAL)
+		{
+		case ev_string:
+		case ev_float:
+		case ev_entity:
+			break;
+		default:
+			Con_DPrintf("%s: prvm_findindexfields: %s is not a string, float or entity field\n", prog->name, name);
+			continue;
+		}
+		if (prog->numfieldindexes >= PRVM_MAX_FIELDINDEXES)
+			break;
+		index = prog->fieldindexes + prog->numfieldindexes++;
+		index->ofs = def->ofs;
+		index->type = (etype_t)(def->type & ~DEF_SAVEGLOBAL);
+		// vector writes starting up to 2 fields earlier also change it
+		for (i = max(def->ofs - 2, 0);i <= def->ofs;i++)
+			prog->fieldindexflags[i] = true;
+	}
+}
+
+static prvm_fieldindex_t *PRVM_FieldIndex_Get(prvm_prog_t *prog, int ofs, qboolean isstring)
+{
+	int i, e;
+	unsigned int key;
+	prvm_fieldindex_t *index;
+
+	if (!prvm_findindex.integer || !prog->fieldindexflags)
+		return NULL;
+	if (strcmp(prog->fieldindexconfig, prvm_findindexfields.string))
+		PRVM_FieldIndex_Setup(prog);
+	for (i = 0, index = prog->fieldindexes;i < prog->numfieldindexes;i++, index++)
+		if (index->ofs == ofs)
+			break;
+	if (i == prog->numfieldindexes || (index->type == ev_string) != isstring)
+		return NULL;
+
+	// rebuild if the edicts were reallocated, the edict count went down
+	// (new map), or zone strings were freed (their slots may now hold other text)
+	if (!index->built || index->maxedicts != prog->max_edicts || prog->num_edicts < index->numcovered || (isstring && index->freedstrings != prog->knownstrings_stats.freed))
+		PRVM_FieldIndex_Build(prog, index);
+	for (e = index->numcovered;e < prog->num_edicts;e++)
+		PRVM_FieldIndex_AddUnhashed(index, e);
+	index->numcovered = prog->num_edicts;
+
+	// a QC call that wrote to the field may still hold a pointer to it, so
+	// edicts written to only get hashed again once that call has returned
+	if (index->touchserial != prog->toplevelcalls)
+	{
+		for (i = 0;i < index->numunhashed;)
+		{
+			e = index->unhashed[i];
+			if (e < prog->num_edicts && PRVM_FieldIndex_StableKey(prog, index, PRVM_EDICT_NUM(e), &key))
+			{
+				PRVM_FieldIndex_Link(index, e, key);
+				index->isunhashed[e] = false;
+				index->unhashed[i] = index->unhashed[--index->numunhashed];
+			}
+			else
+				i++;
+		}
+		index->touchserial = prog->toplevelcalls;
+	}
+	return index;
+}
+
+/*
+===============
+PRVM_ED_FieldIndexTouch
+
+must be called when the engine or QC writes to a field that may be indexed
+===============
+*/
+void PRVM_ED_FieldIndexTouch(prvm_prog_t *prog, int edictnum, int ofs)
+{
+	int i;
+	prvm_fieldindex_t *index;
+	for (i = 0, index = prog->fieldindexes;i < prog->numfieldindexes;i++, index++)
+	{
+		if (!index->built || edictnum < 0 || edictnum >= index->maxedicts)
+			continue;
+		if (ofs >= 0 && (index->ofs < ofs || index->ofs > ofs + 2))
+			continue;
+		PRVM_FieldIndex_Unlink(index, edictnum);
+		PRVM_FieldIndex_AddUnhashed(index, edictnum);
+		index->touchserial = prog->toplevelcalls;
+	}
+}
+
+static int PRVM_FieldIndex_Find(prvm_prog_t *prog, prvm_fieldindex_t *index, unsigned int key, const char *s, prvm_vec_t f, int start)
+{
+	int i, e, b, best;
+	b = key & index->mask;
+	// continuing a find loop, start is usually in the same chain
+	if (start > 0 && start < index->maxedicts && index->bucket[start] == b)
+		e = index->next[start];
+	else
+		e = index->first[b];
+	best = prog->num_edicts;
+	for (;e >= 0 && e < prog->num_edicts;e = index->next[e])
+	{
+		prog->xfunction->builtinsprofile++;
+		if (e > start && PRVM_FieldIndex_Matches(prog, index, e, s, f))
+		{
+			best = e;
+			break;
+		}
+	}
+	for (i = 0;i < index->numunhashed;i++)
+	{
+		e = index->unhashed[i];
+		prog->xfunction->builtinsprofile++;
+		if (e > start && e < best && PRVM_FieldIndex_Matches(prog, index, e, s, f))
+			best = e;
+	}
+	return best < prog->num_edicts ? best : 0;
+}
+
+qboolean PRVM_ED_FieldIndexFindString(prvm_prog_t *prog, int ofs, const char *s, int start, int *result)
+{
+	prvm_fieldindex_t *index = PRVM_FieldIndex_Get(prog, ofs, true);
+	if (!index)
+		return false;
+	*result = PRVM_FieldIndex_Find(prog, index, PRVM_FieldIndex_StringKey(s), s, 0, start);
+	return true;
+}
+
+qboolean PRVM_ED_FieldIndexFindFloat(prvm_prog_t *prog, int ofs, prvm_vec_t f, int start, int *result)
+{
+	prvm_fieldindex_t *index = PRVM_FieldIndex_Get(prog, ofs, false);
+	if (!index)
+		return false;
+	*result = PRVM_FieldIndex_Find(prog, index, PRVM_FieldIndex_FloatKey(f), NULL, f, start);
+	return true;
+}
+
 static qboolean PRVM_IsStringReferenced(prvm_prog_t *prog, string_t string)
 {
 	int i, j;
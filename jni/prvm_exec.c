@@ -121,6 +121,7 @@ PRVM_PrintStatement
 */
 extern cvar_t prvm_statementprofiling;
 extern cvar_t prvm_timeprofiling;
+extern cvar_t prvm_threadedinterpreter;
 static void PRVM_PrintStatement(prvm_prog_t *prog, mstatement_t *s)
 {
 	size_t i;
@@ -480,6 +481,185 @@ void PRVM_ChildProfile_f (void)
 	PRVM_Profile(prog, howmany, 0, 1);
 }
 
+/*
+============
+PRVM_Benchmark_f
+
+runs a QuakeC function with the plain and the threaded interpreter and
+prints the time per call, the globals are restored before each run but
+changes to entities are not undone
+============
+*/
+void PRVM_Benchmark_f (void)
+{
+	prvm_prog_t *prog;
+	func_t fnum;
+	int i, pass, count, oldthreaded;
+	size_t globalssize;
+	prvm_vec_t *savedglobals;
+	double t, times[2];
+
+	if (Cmd_Argc() != 3 && Cmd_Argc() != 4)
+	{
+		Con_Print("prvm_benchmark <program name> <function name> [count]\n");
+		return;
+	}
+
+	if (!(prog = PRVM_FriendlyProgFromString(Cmd_Argv(1))))
+		return;
+
+	if (prog->depth > 0)
+	{
+		Con_Printf("prvm_benchmark: %s is already executing QuakeC\n", prog->name);
+		return;
+	}
+
+	fnum = PRVM_ED_FindFunctionOffset(prog, Cmd_Argv(2));
+	if (!fnum)
+	{
+		Con_Printf("prvm_benchmark: function %s not found in %s\n", Cmd_Argv(2), prog->name);
+		return;
+	}
+
+	count = Cmd_Argc() == 4 ? atoi(Cmd_Argv(3)) : 1000;
+	count = max(count, 1);
+
+	globalssize = prog->numglobals * sizeof(prvm_vec_t);
+	savedglobals = (prvm_vec_t *)Mem_Alloc(tempmempool, globalssize);
+	memcpy(savedglobals, prog->globals.fp, globalssize);
+	oldthreaded = prvm_threadedinterpreter.integer;
+
+	for (pass = 0;pass < 2;pass++)
+	{
+		Cvar_SetValueQuick(&prvm_threadedinterpreter, pass);
+		t = Sys_DirtyTime();
+		for (i = 0;i < count;i++)
+		{
+			memcpy(prog->globals.fp, savedglobals, globalssize);
+			prog->ExecuteProgram(prog, fnum, "prvm_benchmark: function is missing");
+		}
+		times[pass] = Sys_DirtyTime() - t;
+	}
+
+	Cvar_SetValueQuick(&prvm_threadedinterpreter, oldthreaded);
+	memcpy(prog->globals.fp, savedglobals, globalssize);
+	Mem_Free(savedglobals);
+
+	Con_Printf("%s %s x%i: switch %.3fus/call, threaded %.3fus/call (%.2fx, %i superinstructions)\n", prog->name, Cmd_Argv(2), count, times[0] * 1000000.0 / count, times[1] * 1000000.0 / count, times[1] > 0 ? times[0] / times[1] : 0, prog->numfusedstatements);
+}
+
+/*
+============
+PRVM_StackProfile_f
+
+prints the QC functions and builtins that took the most time according to
+the call tree of the prvm_timeprofiling interpreter and optionally writes
+the call stacks in the folded format flame graph tools read, then resets it
+============
+*/
+void PRVM_StackProfile_f (void)
+{
+	prvm_prog_t *prog;
+	int i, j, n, howmany, best, numpaths;
+	double *total, *fself, *ftotal, *fcalls, max;
+	prvm_callnode_t *node;
+	qfile_t *file = NULL;
+	const char *names[PRVM_MAX_STACK_DEPTH];
+
+	if (Cmd_Argc() < 2 || Cmd_Argc() > 4)
+	{
+		Con_Print("prvm_stackprofile <program name> [count] [filename]\n");
+		return;
+	}
+
+	if (!(prog = PRVM_FriendlyProgFromString(Cmd_Argv(1))))
+		return;
+
+	if (!prvm_timeprofiling.integer)
+		Con_Printf("prvm_timeprofiling is 0, call stacks are only collected while it is 1\n");
+
+	howmany = Cmd_Argc() >= 3 ? atoi(Cmd_Argv(2)) : 20;
+	if (Cmd_Argc() == 4)
+	{
+		if (!(file = FS_OpenRealFile(Cmd_Argv(3), "w", false)))
+		{
+			Con_Printf("prvm_stackprofile: could not open %s for writing\n", Cmd_Argv(3));
+			return;
+		}
+	}
+
+	total = (double *)Mem_Alloc(tempmempool, prog->numcallnodes * sizeof(double));
+	fself = (double *)Mem_Alloc(tempmempool, prog->numfunctions * 3 * sizeof(double));
+	ftotal = fself + prog->numfunctions;
+	fcalls = ftotal + prog->numfunctions;
+
+	// children always come after their parent
+	for (i = prog->numcallnodes - 1;i > 0;i--)
+	{
+		node = prog->callnodes + i;
+		total[i] += node->time;
+		total[node->parent] += total[i];
+	}
+
+	numpaths = 0;
+	for (i = 1;i < prog->numcallnodes;i++)
+	{
+		node = prog->callnodes + i;
+		fself[node->function] += node->time;
+		fcalls[node->function] += node->calls;
+		// recursive calls are already in the total of the outermost one
+		for (j = node->parent;j > 0 && prog->callnodes[j].function != node->function;j = prog->callnodes[j].parent)
+			;
+		if (!j)
+			ftotal[node->function] += total[i];
+		if (node->time <= 0)
+			continue;
+		numpaths++;
+		if (file)
+		{
+			for (n = 0, j = i;j > 0 && n < PRVM_MAX_STACK_DEPTH;j = prog->callnodes[j].parent)
+				names[n++] = PRVM_GetString(prog, prog->functions[prog->callnodes[j].function].s_name);
+			while (n-- > 1)
+				FS_Printf(file, "%s;", names[n]);
+			FS_Printf(file, "%s %.0f\n", names[0], node->time * 1000000.0);
+		}
+	}
+
+	Con_Printf("%s Stack Profile (%i call paths, %i nodes):\n     [Self]     [Total]     [Calls]\n", prog->name, numpaths, prog->numcallnodes - 1);
+	for (n = 0;n < howmany;n++)
+	{
+		max = 0;
+		best = -1;
+		for (i = 0;i < prog->numfunctions;i++)
+		{
+			if (max < fself[i])
+			{
+				max = fself[i];
+				best = i;
+			}
+		}
+		if (best < 0)
+			break;
+		Con_Printf("%11.6f %11.6f %11.0f %s%s\n", fself[best], ftotal[best], fcalls[best], PRVM_GetString(prog, prog->functions[best].s_name), prog->functions[best].first_statement < 0 ? " (builtin)" : "");
+		fself[best] = 0;
+	}
+
+	if (file)
+	{
+		FS_Close(file);
+		Con_Printf("wrote %s\n", Cmd_Argv(3));
+	}
+
+	Mem_Free(fself);
+	Mem_Free(total);
+
+	for (i = 0;i < prog->numcallnodes;i++)
+	{
+		prog->callnodes[i].calls = 0;
+		prog->callnodes[i].time = 0;
+	}
+}
+
 void PRVM_PrintState(prvm_prog_t *prog, int stack_index)
 {
 	int i;
@@ -545,6 +725,47 @@ The interpretation main loop
 ============================================================================
 */
 
+/*
+====================
+PRVM_CallNode_Child
+
+Returns the call tree node for calling function fnum from node parent, when
+the tree is full the call is counted in the caller
+====================
+*/
+static int PRVM_CallNode_Child (prvm_prog_t *prog, int parent, int fnum)
+{
+	int i;
+	prvm_callnode_t *nodes;
+
+	for (i = prog->callnodes[parent].firstchild;i >= 0;i = prog->callnodes[i].nextsibling)
+		if (prog->callnodes[i].function == fnum)
+			break;
+	if (i < 0)
+	{
+		if (prog->numcallnodes >= PRVM_MAX_CALLNODES)
+			return parent;
+		if (prog->numcallnodes >= prog->maxcallnodes)
+		{
+			prog->maxcallnodes = min(prog->maxcallnodes * 2, PRVM_MAX_CALLNODES);
+			nodes = (prvm_callnode_t *)Mem_Alloc(prog->progs_mempool, prog->maxcallnodes * sizeof(prvm_callnode_t));
+			memcpy(nodes, prog->callnodes, prog->numcallnodes * sizeof(prvm_callnode_t));
+			Mem_Free(prog->callnodes);
+			prog->callnodes = nodes;
+		}
+		i = prog->numcallnodes++;
+		prog->callnodes[i].function = fnum;
+		prog->callnodes[i].parent = parent;
+		prog->callnodes[i].firstchild = -1;
+		prog->callnodes[i].nextsibling = prog->callnodes[parent].firstchild;
+		prog->callnodes[i].calls = 0;
+		prog->callnodes[i].time = 0;
+		prog->callnodes[parent].firstchild = i;
+	}
+	prog->callnodes[i].calls++;
+	return i;
+}
+
 /*
 ====================
 PRVM_EnterFunction
@@ -564,6 +785,9 @@ static int PRVM_EnterFunction (prvm_prog_t *prog, mfunction_t *f)
 	prog->stack[prog->depth].profile_acc = -f->profile;
 	prog->stack[prog->depth].tprofile_acc = -f->tprofile + -f->tbprofile;
 	prog->stack[prog->depth].builtinsprofile_acc = -f->builtinsprofile;
+	prog->stack[prog->depth].callnode = prog->callnode;
+	if (prvm_timeprofiling.integer)
+		prog->callnode = PRVM_CallNode_Child(prog, prog->callnode, f - prog->functions);
 	prog->depth++;
 	if (prog->depth >=PRVM_MAX_STACK_DEPTH)
 		prog->error_cmd("stack overflow");
@@ -621,6 +845,7 @@ static int PRVM_LeaveFunction (prvm_prog_t *prog)
 	prog->depth--;
 	f = prog->xfunction;
 	--f->recursion;
+	prog->callnode = prog->stack[prog->depth].callnode;
 	prog->xfunction = prog->stack[prog->depth].f;
 	prog->stack[prog->depth].profile_acc += f->profile;
 	prog->stack[prog->depth].tprofile_acc += f->tprofile + f->tbprofile;
@@ -657,6 +882,9 @@ void PRVM_Init_Exec(prvm_prog_t *prog)
 #define OPA ((prvm_eval_t *)&prog->globals.fp[st->operand[0]])
 #define OPB ((prvm_eval_t *)&prog->globals.fp[st->operand[1]])
 #define OPC ((prvm_eval_t *)&prog->globals.fp[st->operand[2]])
+#define DOPA (dst->operand[0])
+#define DOPB (dst->operand[1])
+#define DOPC (dst->operand[2])
 extern cvar_t prvm_traceqc;
 extern cvar_t prvm_statementprofiling;
 extern qboolean prvm_runawaycheck;
@@ -676,7 +904,8 @@ void MVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessag
 	int		jumpcount, cachedpr_trace, exitdepth;
 	int		restorevm_tempstringsbuf_cursize;
 	double  calltime;
-	double tm, starttm;
+	double tm, starttm, nestedtm, callnestedtime;
+	int callnode;
 	prvm_vec_t tempfloat;
 	// these may become out of date when a builtin is called, and are updated accordingly
 	prvm_vec_t *cached_edictsfields = prog->edictsfields;
@@ -691,8 +920,10 @@ void MVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessag
 	mstatement_t *cached_statements = prog->statements;
 	qboolean cached_allowworldwrites = prog->allowworldwrites;
 	unsigned int cached_flag = prog->flag;
+	unsigned char *cached_fieldindexflags = prog->fieldindexflags;
 
 	calltime = Sys_DirtyTime();
+	callnestedtime = prog->nestedtime;
 
 	if (!fnum || fnum >= (unsigned int)prog->numfunctions)
 	{
@@ -710,6 +941,11 @@ void MVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessag
 
 	// we know we're done when pr_depth drops to this
 	exitdepth = prog->depth;
+	if (!prog->depth)
+	{
+		prog->toplevelcalls++;
+		prog->callnode = 0;
+	}
 
 // make a stack frame
 	st = &prog->statements[PRVM_EnterFunction(prog, f)];
@@ -747,6 +983,10 @@ chooseexecprogram:
 #define PRVMTIMEPROFILING 1
 #include "prvm_execprogram.h"
 #undef PRVMTIMEPROFILING
+		}
+		else if (prvm_threadedinterpreter.integer && prog->decodedstatements)
+		{
+#include "prvm_execthreaded.h"
 		}
 		else
 		{
@@ -758,10 +998,15 @@ cleanup:
 	if (developer_insane.integer && prog->tempstringsbuf.cursize > restorevm_tempstringsbuf_cursize)
 		Con_DPrintf("MVM_ExecuteProgram: %s used %i bytes of tempstrings\n", PRVM_GetString(prog, prog->functions[fnum].s_name), prog->tempstringsbuf.cursize - restorevm_tempstringsbuf_cursize);
 	// delete tempstrings created by this function
+	if (!restorevm_tempstringsbuf_cursize && prog->tempstringsbuf.cursize)
+		prog->tempstrings_stats.resets++;
 	prog->tempstringsbuf.cursize = restorevm_tempstringsbuf_cursize;
 
 	tm = Sys_DirtyTime() - calltime;if (tm < 0 || tm >= 1800) tm = 0;
 	f->totaltime += tm;
+	// QC called from a builtin, nested calls are part of tm already
+	if (exitdepth)
+		prog->nestedtime = callnestedtime + tm;
 
 	if (prog == SVVM_prog)
 		SV_FlushBroadcastMessages();
@@ -781,7 +1026,8 @@ void CLVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 	int		jumpcount, cachedpr_trace, exitdepth;
 	int		restorevm_tempstringsbuf_cursize;
 	double  calltime;
-	double tm, starttm;
+	double tm, starttm, nestedtm, callnestedtime;
+	int callnode;
 	prvm_vec_t tempfloat;
 	// these may become out of date when a builtin is called, and are updated accordingly
 	prvm_vec_t *cached_edictsfields = prog->edictsfields;
@@ -796,8 +1042,10 @@ void CLVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 	mstatement_t *cached_statements = prog->statements;
 	qboolean cached_allowworldwrites = prog->allowworldwrites;
 	unsigned int cached_flag = prog->flag;
+	unsigned char *cached_fieldindexflags = prog->fieldindexflags;
 
 	calltime = Sys_DirtyTime();
+	callnestedtime = prog->nestedtime;
 
 	if (!fnum || fnum >= (unsigned int)prog->numfunctions)
 	{
@@ -815,6 +1063,11 @@ void CLVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 
 	// we know we're done when pr_depth drops to this
 	exitdepth = prog->depth;
+	if (!prog->depth)
+	{
+		prog->toplevelcalls++;
+		prog->callnode = 0;
+	}
 
 // make a stack frame
 	st = &prog->statements[PRVM_EnterFunction(prog, f)];
@@ -852,6 +1105,10 @@ chooseexecprogram:
 #define PRVMTIMEPROFILING 1
 #include "prvm_execprogram.h"
 #undef PRVMTIMEPROFILING
+		}
+		else if (prvm_threadedinterpreter.integer && prog->decodedstatements)
+		{
+#include "prvm_execthreaded.h"
 		}
 		else
 		{
@@ -863,10 +1120,15 @@ cleanup:
 	if (developer_insane.integer && prog->tempstringsbuf.cursize > restorevm_tempstringsbuf_cursize)
 		Con_DPrintf("CLVM_ExecuteProgram: %s used %i bytes of tempstrings\n", PRVM_GetString(prog, prog->functions[fnum].s_name), prog->tempstringsbuf.cursize - restorevm_tempstringsbuf_cursize);
 	// delete tempstrings created by this function
+	if (!restorevm_tempstringsbuf_cursize && prog->tempstringsbuf.cursize)
+		prog->tempstrings_stats.resets++;
 	prog->tempstringsbuf.cursize = restorevm_tempstringsbuf_cursize;
 
 	tm = Sys_DirtyTime() - calltime;if (tm < 0 || tm >= 1800) tm = 0;
 	f->totaltime += tm;
+	// QC called from a builtin, nested calls are part of tm already
+	if (exitdepth)
+		prog->nestedtime = callnestedtime + tm;
 
 	if (prog == SVVM_prog)
 		SV_FlushBroadcastMessages();
@@ -891,7 +1153,8 @@ void PRVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 	int		jumpcount, cachedpr_trace, exitdepth;
 	int		restorevm_tempstringsbuf_cursize;
 	double  calltime;
-	double tm, starttm;
+	double tm, starttm, nestedtm, callnestedtime;
+	int callnode;
 	prvm_vec_t tempfloat;
 	// these may become out of date when a builtin is called, and are updated accordingly
 	prvm_vec_t *cached_edictsfields = prog->edictsfields;
@@ -906,8 +1169,10 @@ void PRVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 	mstatement_t *cached_statements = prog->statements;
 	qboolean cached_allowworldwrites = prog->allowworldwrites;
 	unsigned int cached_flag = prog->flag;
+	unsigned char *cached_fieldindexflags = prog->fieldindexflags;
 
 	calltime = Sys_DirtyTime();
+	callnestedtime = prog->nestedtime;
 
 	if (!fnum || fnum >= (unsigned int)prog->numfunctions)
 	{
@@ -925,6 +1190,11 @@ void PRVM_ExecuteProgram (prvm_prog_t *prog, func_t fnum, const char *errormessa
 
 	// we know we're done when pr_depth drops to this
 	exitdepth = prog->depth;
+	if (!prog->depth)
+	{
+		prog->toplevelcalls++;
+		prog->callnode = 0;
+	}
 
 // make a stack frame
 	st = &prog->statements[PRVM_EnterFunction(prog, f)];
@@ -962,6 +1232,10 @@ chooseexecprogram:
 #define PRVMTIMEPROFILING 1
 #include "prvm_execprogram.h"
 #undef PRVMTIMEPROFILING
+		}
+		else if (prvm_threadedinterpreter.integer && prog->decodedstatements)
+		{
+#include "prvm_execthreaded.h"
 		}
 		else
 		{
@@ -973,10 +1247,15 @@ cleanup:
 	if (developer_insane.integer && prog->tempstringsbuf.cursize > restorevm_tempstringsbuf_cursize)
 		Con_DPrintf("SVVM_ExecuteProgram: %s used %i bytes of tempstrings\n", PRVM_GetString(prog, prog->functions[fnum].s_name), prog->tempstringsbuf.cursize - restorevm_tempstringsbuf_cursize);
 	// delete tempstrings created by this function
+	if (!restorevm_tempstringsbuf_cursize && prog->tempstringsbuf.cursize)
+		prog->tempstrings_stats.resets++;
 	prog->tempstringsbuf.cursize = restorevm_tempstringsbuf_cursize;
 
 	tm = Sys_DirtyTime() - calltime;if (tm < 0 || tm >= 1800) tm = 0;
 	f->totaltime += tm;
+	// QC called from a builtin, nested calls are part of tm already
+	if (exitdepth)
+		prog->nestedtime = callnestedtime + tm;
 
 	if (prog == SVVM_prog)
 		SV_FlushBroadcastMessages();
@@ -3,7 +3,8 @@
 	prog->xstatement = st - cached_statements; \
 	tm = Sys_DirtyTime(); \
 	prog->xfunction->profile += (st - startst); \
-	prog->xfunction->tprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
+	prog->xfunction->tprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0; \
+	prog->callnodes[prog->callnode].time += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
 #else
 #define PreError() \
 	prog->xstatement = st - cached_statements; \
@@ -246,6 +247,8 @@
 					goto cleanup;
 				}
 #endif
+				if (cached_fieldindexflags[OPB->_int])
+					PRVM_ED_FieldIndexTouch(prog, OPA->edict, OPB->_int);
 				OPC->_int = OPA->edict * cached_entityfields + OPB->_int;
 				break;
 
@@ -355,6 +358,7 @@
 #ifdef PRVMTIMEPROFILING 
 				tm = Sys_DirtyTime();
 				prog->xfunction->tprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
+				prog->callnodes[prog->callnode].time += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
 				starttm = tm;
 #endif
 				prog->xfunction->profile += (st - startst);
@@ -381,11 +385,19 @@
 					prog->xfunction->builtinsprofile++;
 					if (builtinnumber < prog->numbuiltins && prog->builtins[builtinnumber])
 					{
+#ifdef PRVMTIMEPROFILING 
+						callnode = prog->callnode;
+						prog->callnode = PRVM_CallNode_Child(prog, callnode, newf - prog->functions);
+						nestedtm = prog->nestedtime;
+#endif
 						prog->builtins[builtinnumber](prog);
 #ifdef PRVMTIMEPROFILING 
 						tm = Sys_DirtyTime();
 						newf->tprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
 						prog->xfunction->tbprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
+						// QC called by the builtin is in its own nodes already
+						prog->callnodes[prog->callnode].time += (tm - starttm >= 0 && tm - starttm < 1800) ? max(tm - starttm - (prog->nestedtime - nestedtm), 0) : 0;
+						prog->callnode = callnode;
 						starttm = tm;
 #endif
 						// builtins may cause ED_Alloc() to be called, update cached variables
@@ -418,6 +430,7 @@
 #ifdef PRVMTIMEPROFILING 
 				tm = Sys_DirtyTime();
 				prog->xfunction->tprofile += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
+				prog->callnodes[prog->callnode].time += (tm - starttm >= 0 && tm - starttm < 1800) ? (tm - starttm) : 0;
 				starttm = tm;
 #endif
 				prog->xfunction->profile += (st - startst);
@@ -0,0 +1,724 @@
+// Fast path interpreter executing prog->decodedstatements, which have their
+// operands resolved to global pointers at load time.  With GCC style
+// compilers each opcode handler jumps directly to the next one through a
+// table of label addresses (threaded dispatch), otherwise this is a plain
+// switch loop like prvm_execprogram.h.
+// It has no tracing, profiling or watchpoint support, those always use
+// prvm_execprogram.h instead.
+
+// This code isn't #ifdef/#define protectable, don't try.
+
+#define PreError() \
+	prog->xstatement = dst - cached_decodedstatements; \
+	prog->xfunction->profile += (dst - startdst);
+
+// taken IFNOT of a fused compare+branch, dst is on the IFNOT
+#define FusedJump() \
+	prog->xfunction->profile += (dst - startdst); \
+	dst = cached_decodedstatements + dst->jumpabsolute - 1; \
+	startdst = dst; \
+	if (++jumpcount == 10000000 && prvm_runawaycheck) \
+	{ \
+		prog->xstatement = dst - cached_decodedstatements; \
+		PRVM_Profile(prog, 1<<30, 1000000, 0); \
+		prog->error_cmd("%s runaway loop counter hit limit of %d jumps\ntip: read above for list of most-executed functions", prog->name, jumpcount); \
+	}
+
+#if defined(__GNUC__)
+#define PRVMTHREADEDGOTO 1
+#define THREADED_OP(name) prvm_threaded_##name:
+#define THREADED_BADOP prvm_threaded_OP_DECODED_BAD:
+#define THREADED_NEXT goto *threaded_dispatch[(++dst)->op]
+#else
+#define THREADED_OP(name) case name:
+#define THREADED_BADOP default:
+#define THREADED_NEXT break
+#endif
+
+		{
+			mstatementdecoded_t *cached_decodedstatements = prog->decodedstatements;
+			mstatementdecoded_t *dst = cached_decodedstatements + (st - cached_statements);
+			mstatementdecoded_t *startdst = cached_decodedstatements + (startst - cached_statements);
+			prvm_int_t address;
+#ifdef PRVMTHREADEDGOTO
+			static const void *const threaded_dispatch[OP_DECODED_MAX] =
+			{
+				[OP_DONE] = &&prvm_threaded_OP_DONE,
+				[OP_MUL_F] = &&prvm_threaded_OP_MUL_F,
+				[OP_MUL_V] = &&prvm_threaded_OP_MUL_V,
+				[OP_MUL_FV] = &&prvm_threaded_OP_MUL_FV,
+				[OP_MUL_VF] = &&prvm_threaded_OP_MUL_VF,
+				[OP_DIV_F] = &&prvm_threaded_OP_DIV_F,
+				[OP_ADD_F] = &&prvm_threaded_OP_ADD_F,
+				[OP_ADD_V] = &&prvm_threaded_OP_ADD_V,
+				[OP_SUB_F] = &&prvm_threaded_OP_SUB_F,
+				[OP_SUB_V] = &&prvm_threaded_OP_SUB_V,
+				[OP_EQ_F] = &&prvm_threaded_OP_EQ_F,
+				[OP_EQ_V] = &&prvm_threaded_OP_EQ_V,
+				[OP_EQ_S] = &&prvm_threaded_OP_EQ_S,
+				[OP_EQ_E] = &&prvm_threaded_OP_EQ_E,
+				[OP_EQ_FNC] = &&prvm_threaded_OP_EQ_FNC,
+				[OP_NE_F] = &&prvm_threaded_OP_NE_F,
+				[OP_NE_V] = &&prvm_threaded_OP_NE_V,
+				[OP_NE_S] = &&prvm_threaded_OP_NE_S,
+				[OP_NE_E] = &&prvm_threaded_OP_NE_E,
+				[OP_NE_FNC] = &&prvm_threaded_OP_NE_FNC,
+				[OP_LE] = &&prvm_threaded_OP_LE,
+				[OP_GE] = &&prvm_threaded_OP_GE,
+				[OP_LT] = &&prvm_threaded_OP_LT,
+				[OP_GT] = &&prvm_threaded_OP_GT,
+				[OP_LOAD_F] = &&prvm_threaded_OP_LOAD_F,
+				[OP_LOAD_V] = &&prvm_threaded_OP_LOAD_V,
+				[OP_LOAD_S] = &&prvm_threaded_OP_LOAD_S,
+				[OP_LOAD_ENT] = &&prvm_threaded_OP_LOAD_ENT,
+				[OP_LOAD_FLD] = &&prvm_threaded_OP_LOAD_FLD,
+				[OP_LOAD_FNC] = &&prvm_threaded_OP_LOAD_FNC,
+				[OP_ADDRESS] = &&prvm_threaded_OP_ADDRESS,
+				[OP_STORE_F] = &&prvm_threaded_OP_STORE_F,
+				[OP_STORE_V] = &&prvm_threaded_OP_STORE_V,
+				[OP_STORE_S] = &&prvm_threaded_OP_STORE_S,
+				[OP_STORE_ENT] = &&prvm_threaded_OP_STORE_ENT,
+				[OP_STORE_FLD] = &&prvm_threaded_OP_STORE_FLD,
+				[OP_STORE_FNC] = &&prvm_threaded_OP_STORE_FNC,
+				[OP_STOREP_F] = &&prvm_threaded_OP_STOREP_F,
+				[OP_STOREP_V] = &&prvm_threaded_OP_STOREP_V,
+				[OP_STOREP_S] = &&prvm_threaded_OP_STOREP_S,
+				[OP_STOREP_ENT] = &&prvm_threaded_OP_STOREP_ENT,
+				[OP_STOREP_FLD] = &&prvm_threaded_OP_STOREP_FLD,
+				[OP_STOREP_FNC] = &&prvm_threaded_OP_STOREP_FNC,
+				[OP_RETURN] = &&prvm_threaded_OP_RETURN,
+				[OP_NOT_F] = &&prvm_threaded_OP_NOT_F,
+				[OP_NOT_V] = &&prvm_threaded_OP_NOT_V,
+				[OP_NOT_S] = &&prvm_threaded_OP_NOT_S,
+				[OP_NOT_ENT] = &&prvm_threaded_OP_NOT_ENT,
+				[OP_NOT_FNC] = &&prvm_threaded_OP_NOT_FNC,
+				[OP_IF] = &&prvm_threaded_OP_IF,
+				[OP_IFNOT] = &&prvm_threaded_OP_IFNOT,
+				[OP_CALL0] = &&prvm_threaded_OP_CALL0,
+				[OP_CALL1] = &&prvm_threaded_OP_CALL1,
+				[OP_CALL2] = &&prvm_threaded_OP_CALL2,
+				[OP_CALL3] = &&prvm_threaded_OP_CALL3,
+				[OP_CALL4] = &&prvm_threaded_OP_CALL4,
+				[OP_CALL5] = &&prvm_threaded_OP_CALL5,
+				[OP_CALL6] = &&prvm_threaded_OP_CALL6,
+				[OP_CALL7] = &&prvm_threaded_OP_CALL7,
+				[OP_CALL8] = &&prvm_threaded_OP_CALL8,
+				[OP_STATE] = &&prvm_threaded_OP_STATE,
+				[OP_GOTO] = &&prvm_threaded_OP_GOTO,
+				[OP_AND] = &&prvm_threaded_OP_AND,
+				[OP_OR] = &&prvm_threaded_OP_OR,
+				[OP_BITAND] = &&prvm_threaded_OP_BITAND,
+				[OP_BITOR] = &&prvm_threaded_OP_BITOR,
+				[OP_DECODED_BAD] = &&prvm_threaded_OP_DECODED_BAD,
+				[OP_FUSED_EQ_F_IFNOT] = &&prvm_threaded_OP_FUSED_EQ_F_IFNOT,
+				[OP_FUSED_NE_F_IFNOT] = &&prvm_threaded_OP_FUSED_NE_F_IFNOT,
+				[OP_FUSED_LE_IFNOT] = &&prvm_threaded_OP_FUSED_LE_IFNOT,
+				[OP_FUSED_GE_IFNOT] = &&prvm_threaded_OP_FUSED_GE_IFNOT,
+				[OP_FUSED_LT_IFNOT] = &&prvm_threaded_OP_FUSED_LT_IFNOT,
+				[OP_FUSED_GT_IFNOT] = &&prvm_threaded_OP_FUSED_GT_IFNOT,
+				[OP_FUSED_ADDRESS_STOREP] = &&prvm_threaded_OP_FUSED_ADDRESS_STOREP,
+				[OP_FUSED_ADDRESS_STOREP_V] = &&prvm_threaded_OP_FUSED_ADDRESS_STOREP_V,
+				[OP_FUSED_LOAD_F_ADD_F] = &&prvm_threaded_OP_FUSED_LOAD_F_ADD_F,
+				[OP_FUSED_LOAD_F_SUB_F] = &&prvm_threaded_OP_FUSED_LOAD_F_SUB_F,
+				[OP_FUSED_LOAD_F_MUL_F] = &&prvm_threaded_OP_FUSED_LOAD_F_MUL_F,
+				[OP_FUSED_LOAD_V_ADD_V] = &&prvm_threaded_OP_FUSED_LOAD_V_ADD_V,
+				[OP_FUSED_LOAD_V_SUB_V] = &&prvm_threaded_OP_FUSED_LOAD_V_SUB_V,
+				[OP_FUSED_STORE_STORE] = &&prvm_threaded_OP_FUSED_STORE_STORE,
+				[OP_FUSED_STORE_V_STORE_V] = &&prvm_threaded_OP_FUSED_STORE_V_STORE_V,
+			};
+
+			THREADED_NEXT;
+#else
+			while (1)
+			{
+				dst++;
+				switch (dst->op)
+				{
+#endif
+
+			THREADED_OP(OP_ADD_F)
+				DOPC->_float = DOPA->_float + DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_ADD_V)
+				DOPC->vector[0] = DOPA->vector[0] + DOPB->vector[0];
+				DOPC->vector[1] = DOPA->vector[1] + DOPB->vector[1];
+				DOPC->vector[2] = DOPA->vector[2] + DOPB->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_SUB_F)
+				DOPC->_float = DOPA->_float - DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_SUB_V)
+				DOPC->vector[0] = DOPA->vector[0] - DOPB->vector[0];
+				DOPC->vector[1] = DOPA->vector[1] - DOPB->vector[1];
+				DOPC->vector[2] = DOPA->vector[2] - DOPB->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_MUL_F)
+				DOPC->_float = DOPA->_float * DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_MUL_V)
+				DOPC->_float = DOPA->vector[0]*DOPB->vector[0] + DOPA->vector[1]*DOPB->vector[1] + DOPA->vector[2]*DOPB->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_MUL_FV)
+				tempfloat = DOPA->_float;
+				DOPC->vector[0] = tempfloat * DOPB->vector[0];
+				DOPC->vector[1] = tempfloat * DOPB->vector[1];
+				DOPC->vector[2] = tempfloat * DOPB->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_MUL_VF)
+				tempfloat = DOPB->_float;
+				DOPC->vector[0] = tempfloat * DOPA->vector[0];
+				DOPC->vector[1] = tempfloat * DOPA->vector[1];
+				DOPC->vector[2] = tempfloat * DOPA->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_DIV_F)
+				if( DOPB->_float != 0.0f )
+				{
+					DOPC->_float = DOPA->_float / DOPB->_float;
+				}
+				else
+				{
+					if (developer.integer)
+					{
+						prog->xfunction->profile += (dst - startdst);
+						startdst = dst;
+						prog->xstatement = dst - cached_decodedstatements;
+						VM_Warning(prog, "Attempted division by zero in %s\n", prog->name );
+					}
+					DOPC->_float = 0.0f;
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_BITAND)
+				DOPC->_float = (prvm_int_t)DOPA->_float & (prvm_int_t)DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_BITOR)
+				DOPC->_float = (prvm_int_t)DOPA->_float | (prvm_int_t)DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_GE)
+				DOPC->_float = DOPA->_float >= DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_LE)
+				DOPC->_float = DOPA->_float <= DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_GT)
+				DOPC->_float = DOPA->_float > DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_LT)
+				DOPC->_float = DOPA->_float < DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_AND)
+				DOPC->_float = FLOAT_IS_TRUE_FOR_INT(DOPA->_int) && FLOAT_IS_TRUE_FOR_INT(DOPB->_int);
+				THREADED_NEXT;
+			THREADED_OP(OP_OR)
+				DOPC->_float = FLOAT_IS_TRUE_FOR_INT(DOPA->_int) || FLOAT_IS_TRUE_FOR_INT(DOPB->_int);
+				THREADED_NEXT;
+			THREADED_OP(OP_NOT_F)
+				DOPC->_float = !FLOAT_IS_TRUE_FOR_INT(DOPA->_int);
+				THREADED_NEXT;
+			THREADED_OP(OP_NOT_V)
+				DOPC->_float = !DOPA->vector[0] && !DOPA->vector[1] && !DOPA->vector[2];
+				THREADED_NEXT;
+			THREADED_OP(OP_NOT_S)
+				DOPC->_float = !DOPA->string || !*PRVM_GetString(prog, DOPA->string);
+				THREADED_NEXT;
+			THREADED_OP(OP_NOT_FNC)
+				DOPC->_float = !DOPA->function;
+				THREADED_NEXT;
+			THREADED_OP(OP_NOT_ENT)
+				DOPC->_float = (DOPA->edict == 0);
+				THREADED_NEXT;
+			THREADED_OP(OP_EQ_F)
+				DOPC->_float = DOPA->_float == DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_EQ_V)
+				DOPC->_float = (DOPA->vector[0] == DOPB->vector[0]) && (DOPA->vector[1] == DOPB->vector[1]) && (DOPA->vector[2] == DOPB->vector[2]);
+				THREADED_NEXT;
+			THREADED_OP(OP_EQ_S)
+				DOPC->_float = !strcmp(PRVM_GetString(prog, DOPA->string),PRVM_GetString(prog, DOPB->string));
+				THREADED_NEXT;
+			THREADED_OP(OP_EQ_E)
+				DOPC->_float = DOPA->_int == DOPB->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_EQ_FNC)
+				DOPC->_float = DOPA->function == DOPB->function;
+				THREADED_NEXT;
+			THREADED_OP(OP_NE_F)
+				DOPC->_float = DOPA->_float != DOPB->_float;
+				THREADED_NEXT;
+			THREADED_OP(OP_NE_V)
+				DOPC->_float = (DOPA->vector[0] != DOPB->vector[0]) || (DOPA->vector[1] != DOPB->vector[1]) || (DOPA->vector[2] != DOPB->vector[2]);
+				THREADED_NEXT;
+			THREADED_OP(OP_NE_S)
+				DOPC->_float = strcmp(PRVM_GetString(prog, DOPA->string),PRVM_GetString(prog, DOPB->string));
+				THREADED_NEXT;
+			THREADED_OP(OP_NE_E)
+				DOPC->_float = DOPA->_int != DOPB->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_NE_FNC)
+				DOPC->_float = DOPA->function != DOPB->function;
+				THREADED_NEXT;
+
+		//==================
+			THREADED_OP(OP_STORE_F)
+			THREADED_OP(OP_STORE_ENT)
+			THREADED_OP(OP_STORE_FLD)		// integers
+			THREADED_OP(OP_STORE_S)
+			THREADED_OP(OP_STORE_FNC)		// pointers
+				DOPB->_int = DOPA->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_STORE_V)
+				DOPB->ivector[0] = DOPA->ivector[0];
+				DOPB->ivector[1] = DOPA->ivector[1];
+				DOPB->ivector[2] = DOPA->ivector[2];
+				THREADED_NEXT;
+
+			THREADED_OP(OP_STOREP_F)
+			THREADED_OP(OP_STOREP_ENT)
+			THREADED_OP(OP_STOREP_FLD)		// integers
+			THREADED_OP(OP_STOREP_S)
+			THREADED_OP(OP_STOREP_FNC)		// pointers
+				if ((prvm_uint_t)DOPB->_int - cached_entityfields >= cached_entityfieldsarea_entityfields)
+				{
+					if ((prvm_uint_t)DOPB->_int >= cached_entityfieldsarea)
+					{
+						PreError();
+						prog->error_cmd("%s attempted to write to an out of bounds edict (%i)", prog->name, (int)DOPB->_int);
+						goto cleanup;
+					}
+					if ((prvm_uint_t)DOPB->_int < cached_entityfields && !cached_allowworldwrites)
+					{
+						prog->xstatement = dst - cached_decodedstatements;
+						VM_Warning(prog, "assignment to world.%s (field %i) in %s\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, DOPB->_int)->s_name), (int)DOPB->_int, prog->name);
+					}
+				}
+				ptr = (prvm_eval_t *)(cached_edictsfields + DOPB->_int);
+				ptr->_int = DOPA->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_STOREP_V)
+				if ((prvm_uint_t)DOPB->_int - cached_entityfields > (prvm_uint_t)cached_entityfieldsarea_entityfields_3)
+				{
+					if ((prvm_uint_t)DOPB->_int > cached_entityfieldsarea_3)
+					{
+						PreError();
+						prog->error_cmd("%s attempted to write to an out of bounds edict (%i)", prog->name, (int)DOPB->_int);
+						goto cleanup;
+					}
+					if ((prvm_uint_t)DOPB->_int < cached_entityfields && !cached_allowworldwrites)
+					{
+						prog->xstatement = dst - cached_decodedstatements;
+						VM_Warning(prog, "assignment to world.%s (field %i) in %s\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, DOPB->_int)->s_name), (int)DOPB->_int, prog->name);
+					}
+				}
+				ptr = (prvm_eval_t *)(cached_edictsfields + DOPB->_int);
+				ptr->ivector[0] = DOPA->ivector[0];
+				ptr->ivector[1] = DOPA->ivector[1];
+				ptr->ivector[2] = DOPA->ivector[2];
+				THREADED_NEXT;
+
+			THREADED_OP(OP_ADDRESS)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to address an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int >= cached_entityfields)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to address an invalid field (%i) in an edict", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				if (cached_fieldindexflags[DOPB->_int])
+					PRVM_ED_FieldIndexTouch(prog, DOPA->edict, DOPB->_int);
+				DOPC->_int = DOPA->edict * cached_entityfields + DOPB->_int;
+				THREADED_NEXT;
+
+			THREADED_OP(OP_LOAD_F)
+			THREADED_OP(OP_LOAD_FLD)
+			THREADED_OP(OP_LOAD_ENT)
+			THREADED_OP(OP_LOAD_S)
+			THREADED_OP(OP_LOAD_FNC)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to read an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int >= cached_entityfields)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to read an invalid field in an edict (%i)", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				ed = PRVM_PROG_TO_EDICT(DOPA->edict);
+				DOPC->_int = ((prvm_eval_t *)(ed->fields.ip + DOPB->_int))->_int;
+				THREADED_NEXT;
+
+			THREADED_OP(OP_LOAD_V)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to read an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int > cached_entityfields_3)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to read an invalid field in an edict (%i)", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				ed = PRVM_PROG_TO_EDICT(DOPA->edict);
+				ptr = (prvm_eval_t *)(ed->fields.ip + DOPB->_int);
+				DOPC->ivector[0] = ptr->ivector[0];
+				DOPC->ivector[1] = ptr->ivector[1];
+				DOPC->ivector[2] = ptr->ivector[2];
+				THREADED_NEXT;
+
+		//==================
+
+			THREADED_OP(OP_IFNOT)
+				if(!FLOAT_IS_TRUE_FOR_INT(DOPA->_int))
+				{
+					prog->xfunction->profile += (dst - startdst);
+					dst = cached_decodedstatements + dst->jumpabsolute - 1;	// offset the dst++
+					startdst = dst;
+					// no bounds check needed, it is done when loading progs
+					if (++jumpcount == 10000000 && prvm_runawaycheck)
+					{
+						prog->xstatement = dst - cached_decodedstatements;
+						PRVM_Profile(prog, 1<<30, 1000000, 0);
+						prog->error_cmd("%s runaway loop counter hit limit of %d jumps\ntip: read above for list of most-executed functions", prog->name, jumpcount);
+					}
+				}
+				THREADED_NEXT;
+
+			THREADED_OP(OP_IF)
+				if(FLOAT_IS_TRUE_FOR_INT(DOPA->_int))
+				{
+					prog->xfunction->profile += (dst - startdst);
+					dst = cached_decodedstatements + dst->jumpabsolute - 1;	// offset the dst++
+					startdst = dst;
+					// no bounds check needed, it is done when loading progs
+					if (++jumpcount == 10000000 && prvm_runawaycheck)
+					{
+						prog->xstatement = dst - cached_decodedstatements;
+						PRVM_Profile(prog, 1<<30, 0.01, 0);
+						prog->error_cmd("%s runaway loop counter hit limit of %d jumps\ntip: read above for list of most-executed functions", prog->name, jumpcount);
+					}
+				}
+				THREADED_NEXT;
+
+			THREADED_OP(OP_GOTO)
+				prog->xfunction->profile += (dst - startdst);
+				dst = cached_decodedstatements + dst->jumpabsolute - 1;	// offset the dst++
+				startdst = dst;
+				// no bounds check needed, it is done when loading progs
+				if (++jumpcount == 10000000 && prvm_runawaycheck)
+				{
+					prog->xstatement = dst - cached_decodedstatements;
+					PRVM_Profile(prog, 1<<30, 0.01, 0);
+					prog->error_cmd("%s runaway loop counter hit limit of %d jumps\ntip: read above for list of most-executed functions", prog->name, jumpcount);
+				}
+				THREADED_NEXT;
+
+			THREADED_OP(OP_CALL0)
+			THREADED_OP(OP_CALL1)
+			THREADED_OP(OP_CALL2)
+			THREADED_OP(OP_CALL3)
+			THREADED_OP(OP_CALL4)
+			THREADED_OP(OP_CALL5)
+			THREADED_OP(OP_CALL6)
+			THREADED_OP(OP_CALL7)
+			THREADED_OP(OP_CALL8)
+				prog->xfunction->profile += (dst - startdst);
+				startdst = dst;
+				prog->xstatement = dst - cached_decodedstatements;
+				prog->argc = dst->op - OP_CALL0;
+				if (!DOPA->function)
+					prog->error_cmd("NULL function in %s", prog->name);
+
+				if(!DOPA->function || DOPA->function < 0 || DOPA->function >= prog->numfunctions)
+				{
+					PreError();
+					prog->error_cmd("%s CALL outside the program", prog->name);
+					goto cleanup;
+				}
+
+				newf = &prog->functions[DOPA->function];
+				newf->callcount++;
+
+				if (newf->first_statement < 0)
+				{
+					// negative first_statement values are built in functions
+					int builtinnumber = -newf->first_statement;
+					prog->xfunction->builtinsprofile++;
+					if (builtinnumber < prog->numbuiltins && prog->builtins[builtinnumber])
+					{
+						prog->builtins[builtinnumber](prog);
+						// builtins may cause ED_Alloc() to be called, update cached variables
+						cached_edictsfields = prog->edictsfields;
+						cached_entityfields = prog->entityfields;
+						cached_entityfields_3 = prog->entityfields - 3;
+						cached_entityfieldsarea = prog->entityfieldsarea;
+						cached_entityfieldsarea_entityfields = prog->entityfieldsarea - prog->entityfields;
+						cached_entityfieldsarea_3 = prog->entityfieldsarea - 3;
+						cached_entityfieldsarea_entityfields_3 = prog->entityfieldsarea - prog->entityfields - 3;
+						cached_max_edicts = prog->max_edicts;
+						// if prog->trace changed we need to change interpreter path
+						if (prog->trace != cachedpr_trace)
+						{
+							st = cached_statements + (dst - cached_decodedstatements);
+							startst = cached_statements + (startdst - cached_decodedstatements);
+							goto chooseexecprogram;
+						}
+					}
+					else
+						prog->error_cmd("No such builtin #%i in %s; most likely cause: outdated engine build. Try updating!", builtinnumber, prog->name);
+				}
+				else
+					dst = cached_decodedstatements + PRVM_EnterFunction(prog, newf);
+				startdst = dst;
+				THREADED_NEXT;
+
+			THREADED_OP(OP_DONE)
+			THREADED_OP(OP_RETURN)
+				prog->xfunction->profile += (dst - startdst);
+				prog->xstatement = dst - cached_decodedstatements;
+
+				prog->globals.ip[OFS_RETURN  ] = DOPA->ivector[0];
+				prog->globals.ip[OFS_RETURN+1] = DOPA->ivector[1];
+				prog->globals.ip[OFS_RETURN+2] = DOPA->ivector[2];
+
+				dst = cached_decodedstatements + PRVM_LeaveFunction(prog);
+				startdst = dst;
+				if (prog->depth <= exitdepth)
+					goto cleanup; // all done
+				THREADED_NEXT;
+
+			THREADED_OP(OP_STATE)
+				if(cached_flag & PRVM_OP_STATE)
+				{
+					ed = PRVM_PROG_TO_EDICT(PRVM_gameglobaledict(self));
+					PRVM_gameedictfloat(ed,nextthink) = PRVM_gameglobalfloat(time) + 0.1;
+					PRVM_gameedictfloat(ed,frame) = DOPA->_float;
+					PRVM_gameedictfunction(ed,think) = DOPB->function;
+				}
+				else
+				{
+					PreError();
+					prog->error_cmd("OP_STATE not supported by %s", prog->name);
+				}
+				THREADED_NEXT;
+
+		//==================
+		// superinstructions, see PRVM_DecodeStatements
+		// each does the work of two statements, errors in the second one are
+		// reported after dst is advanced to it
+
+			THREADED_OP(OP_FUSED_EQ_F_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float == DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_NE_F_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float != DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_LE_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float <= DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_GE_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float >= DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_LT_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float < DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_GT_IFNOT)
+				DOPC->_float = tempfloat = DOPA->_float > DOPB->_float;
+				dst++;
+				if (!tempfloat)
+				{
+					FusedJump();
+				}
+				THREADED_NEXT;
+
+			THREADED_OP(OP_FUSED_ADDRESS_STOREP)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to address an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int >= cached_entityfields)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to address an invalid field (%i) in an edict", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				if (cached_fieldindexflags[DOPB->_int])
+					PRVM_ED_FieldIndexTouch(prog, DOPA->edict, DOPB->_int);
+				// the checks above keep the address inside the entity fields
+				address = DOPA->edict * cached_entityfields + DOPB->_int;
+				DOPC->_int = address;
+				dst++;
+				if ((prvm_uint_t)address < cached_entityfields && !cached_allowworldwrites)
+				{
+					prog->xstatement = dst - cached_decodedstatements;
+					VM_Warning(prog, "assignment to world.%s (field %i) in %s\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, address)->s_name), (int)address, prog->name);
+				}
+				ptr = (prvm_eval_t *)(cached_edictsfields + address);
+				ptr->_int = DOPA->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_ADDRESS_STOREP_V)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to address an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int >= cached_entityfields)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to address an invalid field (%i) in an edict", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				if (cached_fieldindexflags[DOPB->_int])
+					PRVM_ED_FieldIndexTouch(prog, DOPA->edict, DOPB->_int);
+				address = DOPA->edict * cached_entityfields + DOPB->_int;
+				DOPC->_int = address;
+				dst++;
+				if ((prvm_uint_t)address > cached_entityfieldsarea_3)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to write to an out of bounds edict (%i)", prog->name, (int)address);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)address < cached_entityfields && !cached_allowworldwrites)
+				{
+					prog->xstatement = dst - cached_decodedstatements;
+					VM_Warning(prog, "assignment to world.%s (field %i) in %s\n", PRVM_GetString(prog, PRVM_ED_FieldAtOfs(prog, address)->s_name), (int)address, prog->name);
+				}
+				ptr = (prvm_eval_t *)(cached_edictsfields + address);
+				ptr->ivector[0] = DOPA->ivector[0];
+				ptr->ivector[1] = DOPA->ivector[1];
+				ptr->ivector[2] = DOPA->ivector[2];
+				THREADED_NEXT;
+
+			THREADED_OP(OP_FUSED_LOAD_F_ADD_F)
+			THREADED_OP(OP_FUSED_LOAD_F_SUB_F)
+			THREADED_OP(OP_FUSED_LOAD_F_MUL_F)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to read an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int >= cached_entityfields)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to read an invalid field in an edict (%i)", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				ed = PRVM_PROG_TO_EDICT(DOPA->edict);
+				DOPC->_int = ((prvm_eval_t *)(ed->fields.ip + DOPB->_int))->_int;
+				dst++;
+				switch (dst[-1].op)
+				{
+				case OP_FUSED_LOAD_F_ADD_F:
+					DOPC->_float = DOPA->_float + DOPB->_float;
+					break;
+				case OP_FUSED_LOAD_F_SUB_F:
+					DOPC->_float = DOPA->_float - DOPB->_float;
+					break;
+				default:
+					DOPC->_float = DOPA->_float * DOPB->_float;
+					break;
+				}
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_LOAD_V_ADD_V)
+			THREADED_OP(OP_FUSED_LOAD_V_SUB_V)
+				if ((prvm_uint_t)DOPA->edict >= cached_max_edicts)
+				{
+					PreError();
+					prog->error_cmd("%s Progs attempted to read an out of bounds edict number", prog->name);
+					goto cleanup;
+				}
+				if ((prvm_uint_t)DOPB->_int > cached_entityfields_3)
+				{
+					PreError();
+					prog->error_cmd("%s attempted to read an invalid field in an edict (%i)", prog->name, (int)DOPB->_int);
+					goto cleanup;
+				}
+				ed = PRVM_PROG_TO_EDICT(DOPA->edict);
+				ptr = (prvm_eval_t *)(ed->fields.ip + DOPB->_int);
+				DOPC->ivector[0] = ptr->ivector[0];
+				DOPC->ivector[1] = ptr->ivector[1];
+				DOPC->ivector[2] = ptr->ivector[2];
+				dst++;
+				if (dst[-1].op == OP_FUSED_LOAD_V_ADD_V)
+				{
+					DOPC->vector[0] = DOPA->vector[0] + DOPB->vector[0];
+					DOPC->vector[1] = DOPA->vector[1] + DOPB->vector[1];
+					DOPC->vector[2] = DOPA->vector[2] + DOPB->vector[2];
+				}
+				else
+				{
+					DOPC->vector[0] = DOPA->vector[0] - DOPB->vector[0];
+					DOPC->vector[1] = DOPA->vector[1] - DOPB->vector[1];
+					DOPC->vector[2] = DOPA->vector[2] - DOPB->vector[2];
+				}
+				THREADED_NEXT;
+
+			THREADED_OP(OP_FUSED_STORE_STORE)
+				DOPB->_int = DOPA->_int;
+				dst++;
+				DOPB->_int = DOPA->_int;
+				THREADED_NEXT;
+			THREADED_OP(OP_FUSED_STORE_V_STORE_V)
+				DOPB->ivector[0] = DOPA->ivector[0];
+				DOPB->ivector[1] = DOPA->ivector[1];
+				DOPB->ivector[2] = DOPA->ivector[2];
+				dst++;
+				DOPB->ivector[0] = DOPA->ivector[0];
+				DOPB->ivector[1] = DOPA->ivector[1];
+				DOPB->ivector[2] = DOPA->ivector[2];
+				THREADED_NEXT;
+
+			THREADED_BADOP
+				PreError();
+				prog->error_cmd("Bad opcode %i in %s", prog->statements[dst - cached_decodedstatements].op, prog->name);
+				goto cleanup;
+
+#ifndef PRVMTHREADEDGOTO
+				}
+			}
+#endif
+		}
+
+#undef PreError
+#undef FusedJump
+#undef PRVMTHREADEDGOTO
+#undef THREADED_OP
+#undef THREADED_BADOP
+#undef THREADED_NEXT
@@ -65,6 +65,34 @@ typedef struct server_static_s
 
 typedef enum server_state_e {ss_loading, ss_active} server_state_t;
 
+/// state of one entity culling pass for one client (see SV_MarkWriteEntityStateToClient)
+typedef struct sv_entitycull_s
+{
+	int clientnumber;
+	int cliententitynumber;
+	vec3_t eyes[MAX_CLIENTNETWORKEYES];
+	int numeyes;
+	int pvsbytes;
+	unsigned char pvs[MAX_MAP_LEAFS/8];
+	/// an entity is considered/visible in this pass if its slot equals mark
+	int mark;
+	int *considered;
+	int *sent;
+	/// bit per sendentities index, entities SV_MarkWriteEntityStateToClient gets called for
+	unsigned int candidatebits[(MAX_EDICTS + 31) / 32];
+	/// scratch for SV_CanSeeBox, NULL uses a shared static array (main thread only)
+	struct prvm_edict_s **touchedicts;
+	/// random generator for SV_CanSeeBox samples, 0 uses rand() (main thread only)
+	unsigned int randomseed;
+	/// if set, entities seen by traces are flagged here instead of updating visibletime immediately
+	unsigned char *refreshbits;
+	int stats_culled_pvs;
+	int stats_culled_trace;
+	int stats_visibleentities;
+	int stats_totalentities;
+}
+sv_entitycull_t;
+
 #define MAX_CONNECTFLOODADDRESSES 16
 #define MAX_GETSTATUSFLOODADDRESSES 128
 typedef struct server_floodaddress_s
@@ -74,6 +102,29 @@ typedef struct server_floodaddress_s
 }
 server_floodaddress_t;
 
+/// engine copy of the edict fields the per frame entity walks read, one
+/// packed array per field so a walk over every entity touches a few dense
+/// arrays instead of each edict's field block.  refreshed by
+/// SV_EdictHot_Sync once the tick's QC has run and only valid until QC runs
+/// again (indexed by entity number)
+typedef struct sv_edicthot_s
+{
+	int numedicts; // prog->num_edicts at the last sync
+	int toplevelcalls; // prog->toplevelcalls at the last sync
+	unsigned char active[MAX_EDICTS]; // not free
+	vec3_t origin[MAX_EDICTS];
+	vec3_t mins[MAX_EDICTS];
+	vec3_t maxs[MAX_EDICTS];
+	vec3_t absmin[MAX_EDICTS];
+	vec3_t absmax[MAX_EDICTS];
+	float solid[MAX_EDICTS];
+	float movetype[MAX_EDICTS];
+	float flags[MAX_EDICTS];
+	float modelindex[MAX_EDICTS];
+	float effects[MAX_EDICTS];
+}
+sv_edicthot_t;
+
 typedef struct server_s
 {
 	/// false if only a net client
@@ -145,17 +196,11 @@ typedef struct server_s
 	qboolean particleeffectnamesloaded;
 	char particleeffectname[SV_MAX_PARTICLEEFFECTNAME][MAX_QPATH];
 
-	int writeentitiestoclient_stats_culled_pvs;
-	int writeentitiestoclient_stats_culled_trace;
-	int writeentitiestoclient_stats_visibleentities;
-	int writeentitiestoclient_stats_totalentities;
 	int writeentitiestoclient_cliententitynumber;
 	int writeentitiestoclient_clientnumber;
 	sizebuf_t *writeentitiestoclient_msg;
-	vec3_t writeentitiestoclient_eyes[MAX_CLIENTNETWORKEYES];
-	int writeentitiestoclient_numeyes;
-	int writeentitiestoclient_pvsbytes;
-	unsigned char writeentitiestoclient_pvs[MAX_MAP_LEAFS/8];
+	/// culling pass used when the client was not culled on the worker threads
+	sv_entitycull_t writeentitiestoclient_cull;
 	const entity_state_t *writeentitiestoclient_sendstates[MAX_EDICTS];
 	unsigned short writeentitiestoclient_csqcsendstates[MAX_EDICTS];
 
@@ -163,10 +208,32 @@ typedef struct server_s
 	entity_state_t sendentities[MAX_EDICTS];
 	entity_state_t *sendentitiesindex[MAX_EDICTS];
 
+	/// culling data for sendentities, built once per tick by
+	/// SV_PrepareEntitiesForSending and indexed like sendentities so the
+	/// per-client visibility pass can scan it linearly
+	vec3_t sendentitiescullmins[MAX_EDICTS];
+	vec3_t sendentitiescullmaxs[MAX_EDICTS];
+	/// bit per sendentities index: considered for every client no matter what its PVS is
+	unsigned int sendentitiesalwaysbits[(MAX_EDICTS + 31) / 32];
+	/// bit per sendentities index: only considered if one of its clusters is in the client's PVS
+	unsigned int sendentitiesclusteredbits[(MAX_EDICTS + 31) / 32];
+	int sendentitiesnumclustered;
+	/// sendentities indices touching each pvs cluster, entities of cluster c
+	/// are sendentitiesclusterentities[sendentitiesclusterfirst[c] .. sendentitiesclusterfirst[c+1]-1]
+	int sendentitiesnumclusters;
+	int sendentitiesclusterfirst[MAX_MAP_LEAFS + 1];
+	unsigned short sendentitiesclusterentities[MAX_EDICTS * MAX_ENTITYCLUSTERS];
+
 	int sententitiesmark;
 	int sententities[MAX_EDICTS];
 	int sententitiesconsideration[MAX_EDICTS];
 
+	/// set by SV_PrepareEntitiesForSending if culling needs QC (customizeentityforclient or camera_transform) and so can't be threaded
+	qboolean sendentitiesneedqc;
+
+	/// hot edict fields for SV_PrepareEntitiesForSending and SV_CleanupEnts
+	sv_edicthot_t edicthot;
+
 	/// legacy support for self.Version based csqc entity networking
 	unsigned char csqcentityversion[MAX_EDICTS]; // legacy
 } server_t;
@@ -252,6 +319,15 @@ typedef struct client_s
 	/// visibility state
 	float visibletime[MAX_EDICTS];
 
+	/// result of culling on the worker threads this frame (see SV_CullEntitiesForClients)
+	qboolean entitiesculled;
+	unsigned char culledvisiblebits[MAX_EDICTS/8];
+	unsigned char culledrefreshbits[MAX_EDICTS/8];
+	int culledstats_pvs;
+	int culledstats_trace;
+	int culledstats_visible;
+	int culledstats_total;
+
 	// scope is whether an entity is currently being networked to this client
 	// sendflags is what properties have changed on the entity since the last
 	// update that was sent
@@ -90,9 +90,15 @@
 "dp_attribute vec4 Attrib_Position;  // vertex\n",
 "dp_attribute vec4 Attrib_Color;     // color\n",
 "dp_attribute vec4 Attrib_TexCoord0; // material texcoords\n",
+"#ifdef MODE_PARTICLE\n",
+"dp_attribute vec4 Attrib_TexCoord1; // instance origin and kind\n",
+"dp_attribute vec4 Attrib_TexCoord2; // instance axes or beam end and width\n",
+"dp_attribute vec4 Attrib_TexCoord3; // instance up axis\n",
+"#else\n",
 "dp_attribute vec3 Attrib_TexCoord1; // svector\n",
 "dp_attribute vec3 Attrib_TexCoord2; // tvector\n",
 "dp_attribute vec3 Attrib_TexCoord3; // normal\n",
+"#endif\n",
 "dp_attribute vec4 Attrib_TexCoord4; // lightmap texcoords\n",
 "#ifdef USESKELETAL\n",
 "//uniform mat4 Skeletal_Transform[128];\n",
@@ -416,6 +422,63 @@
 "\n",
 "\n",
 "\n",
+"#ifdef MODE_PARTICLE\n",
+"// one quad per instance, Attrib_Position holds the corner in -1 to 1 and\n",
+"// everything else comes from the per instance arrays:\n",
+"// Attrib_Color = color, Attrib_TexCoord0 = texcoord rect (s1, t1, s2, t2)\n",
+"// Attrib_TexCoord1 = origin, w = kind (0 billboard, 1 oriented, 2 beam, 3 beam with texcoords swapped)\n",
+"// billboard: Attrib_TexCoord2 = right and up as ViewLeft/ViewUp coefficients\n",
+"// oriented: Attrib_TexCoord2 = right axis, Attrib_TexCoord3 = up axis\n",
+"// beam: Attrib_TexCoord2 = end point, w = width\n",
+"dp_varying mediump vec2 TexCoord1;\n",
+"#ifdef VERTEX_SHADER\n",
+"uniform highp vec3 EyePosition;\n",
+"uniform highp vec3 ViewLeft;\n",
+"uniform highp vec3 ViewUp;\n",
+"void main(void)\n",
+"{\n",
+"	vec2 corner = Attrib_Position.xy;\n",
+"	vec2 lerp = corner * 0.5 + vec2(0.5, 0.5);\n",
+"	vec3 org = Attrib_TexCoord1.xyz;\n",
+"	float kind = Attrib_TexCoord1.w;\n",
+"	vec3 position;\n",
+"	if (kind < 0.5)\n",
+"	{\n",
+"		vec3 right = ViewLeft * Attrib_TexCoord2.x + ViewUp * Attrib_TexCoord2.y;\n",
+"		vec3 up = ViewLeft * Attrib_TexCoord2.z + ViewUp * Attrib_TexCoord2.w;\n",
+"		position = org + right * corner.x + up * corner.y;\n",
+"	}\n",
+"	else if (kind < 1.5)\n",
+"		position = org + Attrib_TexCoord2.xyz * corner.x + Attrib_TexCoord3.xyz * corner.y;\n",
+"	else\n",
+"	{\n",
+"		vec3 end = mix(org, Attrib_TexCoord2.xyz, lerp.x);\n",
+"		vec3 right = normalize(cross(Attrib_TexCoord2.xyz - org, EyePosition - end));\n",
+"		position = end - right * (Attrib_TexCoord2.w * corner.y);\n",
+"		if (kind > 2.5)\n",
+"			lerp = lerp.yx;\n",
+"	}\n",
+"	TexCoord1 = mix(Attrib_TexCoord0.xy, Attrib_TexCoord0.zw, lerp);\n",
+"	VertexColor = Attrib_Color;\n",
+"	gl_Position = ModelViewProjectionMatrix * vec4(position, 1.0);\n",
+"#ifdef USETRIPPY\n",
+"	gl_Position = TrippyVertex(gl_Position);\n",
+"#endif\n",
+"}\n",
+"#endif\n",
+"\n",
+"#ifdef FRAGMENT_SHADER\n",
+"uniform sampler2D Texture_First;\n",
+"void main(void)\n",
+"{\n",
+"	dp_FragColor = VertexColor * dp_texture2D(Texture_First, TexCoord1);\n",
+"}\n",
+"#endif\n",
+"#else // !MODE_PARTICLE\n",
+"\n",
+"\n",
+"\n",
+"\n",
 "#ifdef MODE_BLOOMBLUR\n",
 "dp_varying mediump vec2 TexCoord;\n",
 "#ifdef VERTEX_SHADER\n",
@@ -1694,6 +1757,7 @@
 "#endif // !MODE_WATER\n",
 "#endif // !MODE_REFRACTION\n",
 "#endif // !MODE_BLOOMBLUR\n",
+"#endif // !MODE_PARTICLE\n",
 "#endif // !MODE_GENERIC\n",
 "#endif // !MODE_POSTPROCESS\n",
 "#endif // !MODE_DEPTH_OR_SHADOW\n",
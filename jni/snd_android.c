@@ -22,10 +22,19 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <math.h>
 
 #include "snd_main.h"
+#include "thread.h"
 
 
-static unsigned int audiopos = 0;
+static volatile unsigned int audiopos = 0;
 static unsigned int buffersize;
+
+// the mixer thread keeps the ring buffer filled ahead of the java audio
+// callback so that a slow render frame no longer starves the output
+static void *snd_mixer_mutex = NULL;
+static void *snd_mixer_thread = NULL;
+static volatile qboolean snd_mixer_quit = false;
+
+#define SND_MIXER_SLEEP 2000	// microseconds between mixer passes
 __attribute__((weak)) __dso_handle=0;
 
 extern void jni_initAudio(void *buffer, int size);
@@ -39,6 +48,62 @@ void QGVR_GetAudio()
     audiopos+=2048;
 }
 
+/*
+====================
+SndSys_MixerThread
+
+Mixes into "snd_renderbuffer" ahead of the position the java side has consumed,
+so S_PaintAndSubmit does not have to mix on the main thread
+====================
+*/
+static int SndSys_MixerThread(void *data)
+{
+	unsigned int soundtime, paintedtime, endtime, maxtime, usedframes;
+	unsigned int startoffset, nbframes;
+
+	while (!snd_mixer_quit)
+	{
+		// the main thread decides when threaded mixing is allowed (it is not
+		// during timedemo or video capture, which mix in non-realtime)
+		if (snd_renderbuffer != NULL && snd_usethreadedmixing && snd_blocked <= 0)
+		{
+			SndSys_LockRenderBuffer();
+
+			soundtime = audiopos;
+			if (snd_renderbuffer->startframe < soundtime)
+				snd_renderbuffer->startframe = soundtime;
+			paintedtime = snd_renderbuffer->endframe;
+			if (paintedtime < soundtime)
+				paintedtime = soundtime;
+
+			endtime = soundtime + (unsigned int)(_snd_mixahead.value * (float)snd_renderbuffer->format.speed);
+			usedframes = snd_renderbuffer->endframe - snd_renderbuffer->startframe;
+			maxtime = paintedtime + snd_renderbuffer->maxframes - usedframes;
+			endtime = min(endtime, maxtime);
+
+			while (paintedtime < endtime)
+			{
+				// limit to the end of the ring buffer (in case of wrapping)
+				startoffset = paintedtime % snd_renderbuffer->maxframes;
+				nbframes = min(endtime - paintedtime, snd_renderbuffer->maxframes - startoffset);
+
+				S_MixToBuffer(&snd_renderbuffer->ring[startoffset * snd_renderbuffer->format.width * snd_renderbuffer->format.channels], nbframes);
+
+				paintedtime += nbframes;
+				snd_renderbuffer->endframe = paintedtime;
+			}
+
+			cls.soundstats.latency_milliseconds = (snd_renderbuffer->endframe - snd_renderbuffer->startframe) * 1000 / snd_renderbuffer->format.speed;
+
+			SndSys_UnlockRenderBuffer();
+		}
+
+		Sys_Sleep(SND_MIXER_SLEEP);
+	}
+
+	return 0;
+}
+
 /*
 ====================
 SndSys_Init
@@ -90,8 +155,6 @@ qboolean SndSys_Init (const snd_format_t* requested, snd_format_t* suggested)
 		return false;
 	}
 
-	snd_threaded = false; //TODO!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-
 	snd_renderbuffer = Snd_CreateRingBuffer(requested, 16384, 0);
 	if (snd_channellayout.integer == SND_CHANNELLAYOUT_AUTO)
 		Cvar_SetValueQuick (&snd_channellayout, SND_CHANNELLAYOUT_STANDARD);
@@ -100,6 +163,20 @@ qboolean SndSys_Init (const snd_format_t* requested, snd_format_t* suggested)
 	buffersize=16384*2*2;
 	jni_initAudio(snd_renderbuffer->ring, buffersize);
 
+	// start the mixer thread, if that fails the main thread keeps mixing
+	snd_threaded = false;
+	if (Thread_HasThreads())
+	{
+		snd_mixer_quit = false;
+		snd_mixer_mutex = Thread_CreateMutex();
+		if (snd_mixer_mutex)
+			snd_mixer_thread = Thread_CreateThread(SndSys_MixerThread, NULL);
+		if (snd_mixer_thread)
+			snd_threaded = true;
+		else
+			Con_Print("SndSys_Init: could not start the mixer thread, mixing on the main thread\n");
+	}
+
 	return true;
 }
 
@@ -113,6 +190,19 @@ Stop the sound card, delete "snd_renderbuffer" and free its other resources
 */
 void SndSys_Shutdown(void)
 {
+	if (snd_mixer_thread)
+	{
+		snd_mixer_quit = true;
+		Thread_WaitThread(snd_mixer_thread, 0);
+		snd_mixer_thread = NULL;
+	}
+	if (snd_mixer_mutex)
+	{
+		Thread_DestroyMutex(snd_mixer_mutex);
+		snd_mixer_mutex = NULL;
+	}
+	snd_threaded = false;
+
 	if (snd_renderbuffer != NULL)
 	{
 		Mem_Free(snd_renderbuffer->ring);
@@ -157,6 +247,8 @@ Get the exclusive lock on "snd_renderbuffer"
 */
 qboolean SndSys_LockRenderBuffer (void)
 {
+	if (snd_mixer_mutex)
+		Thread_LockMutex(snd_mixer_mutex);
 	return true;
 }
 
@@ -170,6 +262,8 @@ Release the exclusive lock on "snd_renderbuffer"
 */
 void SndSys_UnlockRenderBuffer (void)
 {
+	if (snd_mixer_mutex)
+		Thread_UnlockMutex(snd_mixer_mutex);
 }
 
 /*
@@ -189,6 +189,7 @@ cvar_t snd_mutewhenidle = {CVAR_SAVE, "snd_mutewhenidle", "1", "whether to disab
 cvar_t snd_maxchannelvolume = {CVAR_SAVE, "snd_maxchannelvolume", "10", "maximum volume of a single sound"};
 cvar_t snd_softclip = {CVAR_SAVE, "snd_softclip", "0", "Use soft-clipping. Soft-clipping can make the sound more smooth if very high volume levels are used. Enable this option if the dynamic range of the loudspeakers is very low. WARNING: This feature creates distortion and should be considered a last resort."};
 //cvar_t snd_softclip = {CVAR_SAVE, "snd_softclip", "0", "Use soft-clipping (when set to 2, use it even if output is floating point). Soft-clipping can make the sound more smooth if very high volume levels are used. Enable this option if the dynamic range of the loudspeakers is very low. WARNING: This feature creates distortion and should be considered a last resort."};
+cvar_t snd_mixsimd = {0, "snd_mixsimd", "1", "use the NEON/SSE2 mixing kernels when the engine was built with them, 0 uses the scalar reference kernels"};
 cvar_t snd_entchannel0volume = {CVAR_SAVE, "snd_entchannel0volume", "1", "volume multiplier of the auto-allocate entity channel of regular entities (DEPRECATED)"};
 cvar_t snd_entchannel1volume = {CVAR_SAVE, "snd_entchannel1volume", "1", "volume multiplier of the 1st entity channel of regular entities (DEPRECATED)"};
 cvar_t snd_entchannel2volume = {CVAR_SAVE, "snd_entchannel2volume", "1", "volume multiplier of the 2nd entity channel of regular entities (DEPRECATED)"};
@@ -862,6 +863,7 @@ void S_Init(void)
 	Cvar_RegisterVariable(&snd_mutewhenidle);
 	Cvar_RegisterVariable(&snd_maxchannelvolume);
 	Cvar_RegisterVariable(&snd_softclip);
+	Cvar_RegisterVariable(&snd_mixsimd);
 
 	Cvar_RegisterVariable(&snd_startloopingsounds);
 	Cvar_RegisterVariable(&snd_startnonloopingsounds);
@@ -892,6 +894,7 @@ void S_Init(void)
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f, "print sound system information (such as channels and speed)");
 	Cmd_AddCommand("snd_restart", S_Restart_f, "restart sound system");
 	Cmd_AddCommand("snd_unloadallsounds", S_UnloadAllSounds_f, "unload all sound files");
+	Cmd_AddCommand("snd_mixbench", S_MixBench_f, "compare the vector mixing kernels against the scalar ones with 64 channels and time both (optional argument: iterations)");
 
 	Cvar_RegisterVariable(&nosound);
 	Cvar_RegisterVariable(&snd_precache);
@@ -914,6 +917,7 @@ void S_Init(void)
 	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;	// no statics
 	memset(channels, 0, MAX_CHANNELS * sizeof(channel_t));
 
+	OGG_Init ();
 	OGG_OpenLibrary ();
 	ModPlug_OpenLibrary ();
 }
@@ -930,6 +934,7 @@ void S_Terminate (void)
 {
 	S_Shutdown ();
 	ModPlug_CloseLibrary ();
+	OGG_Shutdown ();
 	OGG_CloseLibrary ();
 
 	// Free all SFXs
@@ -1033,6 +1038,9 @@ void S_FreeSfx (sfx_t *sfx, qboolean force)
 	if (!force && (sfx->flags & (SFXFLAG_LEVELSOUND | SFXFLAG_MENUSOUND)))
 		return;
 
+	// a worker thread may still be decoding into it
+	OGG_EndDeferredDecode ();
+
 	if (developer_loading.integer)
 		Con_Printf ("unloading sound %s\n", sfx->name);
 
@@ -1073,6 +1081,30 @@ void S_FreeSfx (sfx_t *sfx, qboolean force)
 }
 
 
+/*
+==================
+S_BeginPrecaching
+
+Sounds precached until S_EndPrecaching may finish decoding on worker threads
+(S_EndPrecaching waits for them), so a batch of them loads in parallel
+==================
+*/
+void S_BeginPrecaching (void)
+{
+	OGG_BeginDeferredDecode ();
+}
+
+/*
+==================
+S_EndPrecaching
+==================
+*/
+void S_EndPrecaching (void)
+{
+	OGG_EndDeferredDecode ();
+}
+
+
 /*
 ==================
 S_ClearUsed
@@ -150,6 +150,7 @@ extern qboolean simsound;
 // ====================================================================
 
 void S_MixToBuffer(void *stream, unsigned int frames);
+void S_MixBench_f(void);
 
 qboolean S_LoadSound (sfx_t *sfx, qboolean complain);
 
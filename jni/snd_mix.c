@@ -48,87 +48,190 @@ static void S_CaptureAVISound(const portable_sampleframe_t *paintbuffer, size_t
 }
 
 extern cvar_t snd_softclip;
+extern cvar_t snd_mixsimd;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SND_MIX_NEON
+#define SND_MIX_SIMD
+typedef float32x4_t snd_vec4_t;
+typedef float32x2_t snd_vec2_t;
+#define SND_VEC4_LOAD(p) vld1q_f32(p)
+#define SND_VEC4_STORE(p, v) vst1q_f32(p, v)
+#define SND_VEC4_SPLAT(f) vdupq_n_f32(f)
+#define SND_VEC4_MUL(a, b) vmulq_f32(a, b)
+#define SND_VEC4_MADD(a, b, c) vaddq_f32(a, vmulq_f32(b, c))
+#define SND_VEC4_ABS(a) vabsq_f32(a)
+#define SND_VEC4_MAX(a, b) vmaxq_f32(a, b)
+#define SND_VEC4_COMBINE(lo, hi) vcombine_f32(lo, hi)
+#define SND_VEC2_LOAD(p) vld1_f32(p)
+#define SND_VEC2_SPLAT(f) vdup_n_f32(f)
+#elif defined(SSE2_PRESENT)
+#include <emmintrin.h>
+#define SND_MIX_SSE
+#define SND_MIX_SIMD
+typedef __m128 snd_vec4_t;
+typedef __m128 snd_vec2_t; // only the low two lanes are used
+#define SND_VEC4_LOAD(p) _mm_loadu_ps(p)
+#define SND_VEC4_STORE(p, v) _mm_storeu_ps(p, v)
+#define SND_VEC4_SPLAT(f) _mm_set1_ps(f)
+#define SND_VEC4_MUL(a, b) _mm_mul_ps(a, b)
+#define SND_VEC4_MADD(a, b, c) _mm_add_ps(a, _mm_mul_ps(b, c))
+#define SND_VEC4_ABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define SND_VEC4_MAX(a, b) _mm_max_ps(a, b)
+#define SND_VEC4_COMBINE(lo, hi) _mm_movelh_ps(lo, hi)
+#define SND_VEC2_LOAD(p) _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(p))
+#define SND_VEC2_SPLAT(f) _mm_set1_ps(f)
+#endif
 
-static void S_SoftClipPaintBuffer(portable_sampleframe_t *painted_ptr, int nbframes, int width, int channels)
-{
-	int i;
+/*
+===============================================================================
 
-	if((snd_softclip.integer == 1 && width <= 2) || snd_softclip.integer > 1)
-	{
-		portable_sampleframe_t *p = painted_ptr;
+MIXING KERNELS
 
-#if 0
-/* Soft clipping, the sound of a dream, thanks to Jon Wattes
-   post to Musicdsp.org */
-#define SOFTCLIP(x) (x) = sin(bound(-M_PI/2, (x), M_PI/2)) * 0.25
-#endif
+Every kernel has a scalar reference version. When the build targets NEON or
+SSE2 there is also a vector version that gives the same output, snd_mixbench
+compares the two.
 
-		// let's do a simple limiter instead, seems to sound better
-		static float maxvol = 0;
-		maxvol = max(1.0f, maxvol * (1.0f - nbframes / (0.4f * snd_renderbuffer->format.speed)));
-#define SOFTCLIP(x) if(fabs(x)>maxvol) maxvol=fabs(x); (x) /= maxvol;
+===============================================================================
+*/
 
-		if (channels == 8)  // 7.1 surround
+typedef struct snd_mixkernels_s
+{
+	const char *name;
+	// resample one mono or stereo source and add it to the paint buffer
+	void (*paintmono)(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround);
+	void (*paintstereo)(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround);
+	// limit the paint buffer to -1..1, maxvol is the limiter state
+	void (*softclip)(portable_sampleframe_t *painted_ptr, int nbframes, int channels, float *maxvol);
+	// convert the paint buffer to the output sample format
+	void (*convert)(const portable_sampleframe_t *painted_ptr, void *rb_ptr, int nbframes, int width, int channels);
+} snd_mixkernels_t;
+
+static void S_PaintMono_Scalar(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround)
+{
+	int i;
+	float lerp[2];
+	float sample;
+
+#if SND_LISTENERS != 8
+#error the following code only supports up to 8 channels, update it
+#endif
+	if (surround)
+	{
+		// surround mixing
+		for (i = 0;i < count;i++, paint++)
 		{
-			for (i = 0;i < nbframes;i++, p++)
-			{
-				SOFTCLIP(p->sample[0]);
-				SOFTCLIP(p->sample[1]);
-				SOFTCLIP(p->sample[2]);
-				SOFTCLIP(p->sample[3]);
-				SOFTCLIP(p->sample[4]);
-				SOFTCLIP(p->sample[5]);
-				SOFTCLIP(p->sample[6]);
-				SOFTCLIP(p->sample[7]);
-			}
+			lerp[1] = indexfrac * (1.0f / 65536.0f);
+			lerp[0] = 1.0f - lerp[1];
+			sample = fetchsampleframe[0] * lerp[0] + fetchsampleframe[1] * lerp[1];
+			paint->sample[0] += sample * vol[0];
+			paint->sample[1] += sample * vol[1];
+			paint->sample[2] += sample * vol[2];
+			paint->sample[3] += sample * vol[3];
+			paint->sample[4] += sample * vol[4];
+			paint->sample[5] += sample * vol[5];
+			paint->sample[6] += sample * vol[6];
+			paint->sample[7] += sample * vol[7];
+			indexfrac += indexfracstep;
+			fetchsampleframe += (indexfrac >> 16);
+			indexfrac &= 0xFFFF;
 		}
-		else if (channels == 6)  // 5.1 surround
+	}
+	else
+	{
+		// stereo mixing
+		for (i = 0;i < count;i++, paint++)
 		{
-			for (i = 0; i < nbframes; i++, p++)
-			{
-				SOFTCLIP(p->sample[0]);
-				SOFTCLIP(p->sample[1]);
-				SOFTCLIP(p->sample[2]);
-				SOFTCLIP(p->sample[3]);
-				SOFTCLIP(p->sample[4]);
-				SOFTCLIP(p->sample[5]);
-			}
+			lerp[1] = indexfrac * (1.0f / 65536.0f);
+			lerp[0] = 1.0f - lerp[1];
+			sample = fetchsampleframe[0] * lerp[0] + fetchsampleframe[1] * lerp[1];
+			paint->sample[0] += sample * vol[0];
+			paint->sample[1] += sample * vol[1];
+			indexfrac += indexfracstep;
+			fetchsampleframe += (indexfrac >> 16);
+			indexfrac &= 0xFFFF;
 		}
-		else if (channels == 4)  // 4.0 surround
+	}
+}
+
+static void S_PaintStereo_Scalar(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround)
+{
+	int i;
+	float lerp[2];
+	float sample[3];
+
+#if SND_LISTENERS != 8
+#error the following code only supports up to 8 channels, update it
+#endif
+	if (surround)
+	{
+		// surround mixing
+		for (i = 0;i < count;i++, paint++)
 		{
-			for (i = 0; i < nbframes; i++, p++)
-			{
-				SOFTCLIP(p->sample[0]);
-				SOFTCLIP(p->sample[1]);
-				SOFTCLIP(p->sample[2]);
-				SOFTCLIP(p->sample[3]);
-			}
+			lerp[1] = indexfrac * (1.0f / 65536.0f);
+			lerp[0] = 1.0f - lerp[1];
+			sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[2] * lerp[1];
+			sample[1] = fetchsampleframe[1] * lerp[0] + fetchsampleframe[3] * lerp[1];
+			sample[2] = (sample[0] + sample[1]) * 0.5f;
+			paint->sample[0] += sample[0] * vol[0];
+			paint->sample[1] += sample[1] * vol[1];
+			paint->sample[2] += sample[0] * vol[2];
+			paint->sample[3] += sample[1] * vol[3];
+			paint->sample[4] += sample[2] * vol[4];
+			paint->sample[5] += sample[2] * vol[5];
+			paint->sample[6] += sample[0] * vol[6];
+			paint->sample[7] += sample[1] * vol[7];
+			indexfrac += indexfracstep;
+			fetchsampleframe += 2 * (indexfrac >> 16);
+			indexfrac &= 0xFFFF;
 		}
-		else if (channels == 2)  // 2.0 stereo
+	}
+	else
+	{
+		// stereo mixing
+		for (i = 0;i < count;i++, paint++)
 		{
-			for (i = 0; i < nbframes; i++, p++)
-			{
-				SOFTCLIP(p->sample[0]);
-				SOFTCLIP(p->sample[1]);
-			}
+			lerp[1] = indexfrac * (1.0f / 65536.0f);
+			lerp[0] = 1.0f - lerp[1];
+			sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[2] * lerp[1];
+			sample[1] = fetchsampleframe[1] * lerp[0] + fetchsampleframe[3] * lerp[1];
+			paint->sample[0] += sample[0] * vol[0];
+			paint->sample[1] += sample[1] * vol[1];
+			indexfrac += indexfracstep;
+			fetchsampleframe += 2 * (indexfrac >> 16);
+			indexfrac &= 0xFFFF;
 		}
-		else if (channels == 1)  // 1.0 mono
+	}
+}
+
+static void S_SoftClip_Scalar(portable_sampleframe_t *painted_ptr, int nbframes, int channels, float *maxvol)
+{
+	int i, k;
+	float m, scale;
+
+	// the limiter follows the loudest sample of each frame, so all speakers
+	// of a frame are scaled by the same amount
+	for (i = 0;i < nbframes;i++, painted_ptr++)
+	{
+		m = *maxvol;
+		for (k = 0;k < channels;k++)
+			m = max(m, fabs(painted_ptr->sample[k]));
+		*maxvol = m;
+		if (m != 1.0f)
 		{
-			for (i = 0; i < nbframes; i++, p++)
-			{
-				SOFTCLIP(p->sample[0]);
-			}
+			scale = 1.0f / m;
+			for (k = 0;k < channels;k++)
+				painted_ptr->sample[k] *= scale;
 		}
-#undef SOFTCLIP
 	}
 }
 
-static void S_ConvertPaintBuffer(portable_sampleframe_t *painted_ptr, void *rb_ptr, int nbframes, int width, int channels)
+static void S_ConvertPaintBuffer_Scalar(const portable_sampleframe_t *painted_ptr, void *rb_ptr, int nbframes, int width, int channels)
 {
 	int i, val;
 
 	// FIXME: add 24bit and 32bit float formats
-	// FIXME: optimize with SSE intrinsics?
 	if (width == 2)  // 16bit
 	{
 		short *snd_out = (short*)rb_ptr;
@@ -183,10 +286,6 @@ static void S_ConvertPaintBuffer(portable_sampleframe_t *painted_ptr, void *rb_p
 				val = (int)((painted_ptr->sample[0] + painted_ptr->sample[1]) * 16384.0f);*snd_out++ = bound(-32768, val, 32767);
 			}
 		}
-
-		// noise is really really annoying
-		if (cls.timedemo)
-			memset(rb_ptr, 0, nbframes * channels * width);
 	}
 	else  // 8bit
 	{
@@ -242,13 +341,247 @@ static void S_ConvertPaintBuffer(portable_sampleframe_t *painted_ptr, void *rb_p
 				val = (int)((painted_ptr->sample[0] + painted_ptr->sample[1]) * 64.0f) + 128; *snd_out++ = bound(0, val, 255);
 			}
 		}
+	}
+}
+
+static const snd_mixkernels_t snd_mixkernels_scalar =
+{
+	"scalar",
+	S_PaintMono_Scalar,
+	S_PaintStereo_Scalar,
+	S_SoftClip_Scalar,
+	S_ConvertPaintBuffer_Scalar
+};
+
+#ifdef SND_MIX_SIMD
+// the resampling stays scalar (each frame has its own fetch position), the
+// speaker volumes of a frame are applied as one vector; two speakers are too
+// narrow for that to pay off, so stereo output uses the scalar loop
+static void S_PaintMono_SIMD(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround)
+{
+	int i;
+	float lerp[2];
+	float sample;
+	snd_vec4_t vol0, vol1, s;
+
+	if (!surround)
+	{
+		S_PaintMono_Scalar(paint, count, fetchsampleframe, indexfrac, indexfracstep, vol, surround);
+		return;
+	}
+
+	vol0 = SND_VEC4_LOAD(vol);
+	vol1 = SND_VEC4_LOAD(vol + 4);
+	for (i = 0;i < count;i++, paint++)
+	{
+		lerp[1] = indexfrac * (1.0f / 65536.0f);
+		lerp[0] = 1.0f - lerp[1];
+		sample = fetchsampleframe[0] * lerp[0] + fetchsampleframe[1] * lerp[1];
+		s = SND_VEC4_SPLAT(sample);
+		SND_VEC4_STORE(paint->sample, SND_VEC4_MADD(SND_VEC4_LOAD(paint->sample), s, vol0));
+		SND_VEC4_STORE(paint->sample + 4, SND_VEC4_MADD(SND_VEC4_LOAD(paint->sample + 4), s, vol1));
+		indexfrac += indexfracstep;
+		fetchsampleframe += (indexfrac >> 16);
+		indexfrac &= 0xFFFF;
+	}
+}
+
+static void S_PaintStereo_SIMD(portable_sampleframe_t *paint, int count, const float *fetchsampleframe, int indexfrac, int indexfracstep, const float *vol, qboolean surround)
+{
+	int i;
+	float lerp[2];
+	float sample[3];
+	snd_vec4_t vol0, vol1;
+	snd_vec2_t lr;
+
+	if (!surround)
+	{
+		S_PaintStereo_Scalar(paint, count, fetchsampleframe, indexfrac, indexfracstep, vol, surround);
+		return;
+	}
+
+	// speaker order is L R, L R, C C, L R (see S_PaintStereo_Scalar)
+	vol0 = SND_VEC4_LOAD(vol);
+	vol1 = SND_VEC4_LOAD(vol + 4);
+	for (i = 0;i < count;i++, paint++)
+	{
+		lerp[1] = indexfrac * (1.0f / 65536.0f);
+		lerp[0] = 1.0f - lerp[1];
+		sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[2] * lerp[1];
+		sample[1] = fetchsampleframe[1] * lerp[0] + fetchsampleframe[3] * lerp[1];
+		sample[2] = (sample[0] + sample[1]) * 0.5f;
+		lr = SND_VEC2_LOAD(sample);
+		SND_VEC4_STORE(paint->sample, SND_VEC4_MADD(SND_VEC4_LOAD(paint->sample), SND_VEC4_COMBINE(lr, lr), vol0));
+		SND_VEC4_STORE(paint->sample + 4, SND_VEC4_MADD(SND_VEC4_LOAD(paint->sample + 4), SND_VEC4_COMBINE(SND_VEC2_SPLAT(sample[2]), lr), vol1));
+		indexfrac += indexfracstep;
+		fetchsampleframe += 2 * (indexfrac >> 16);
+		indexfrac &= 0xFFFF;
+	}
+}
+
+static void S_SoftClip_SIMD(portable_sampleframe_t *painted_ptr, int nbframes, int channels, float *maxvol)
+{
+	int i;
+	float m;
+	float absmax[4];
+	snd_vec4_t a, scale;
+
+	// 5.1 would pull the two unused speakers into the maximum, and
+	// stereo/mono frames are too narrow to gain anything
+	if (channels != 8 && channels != 4)
+	{
+		S_SoftClip_Scalar(painted_ptr, nbframes, channels, maxvol);
+		return;
+	}
+
+	for (i = 0;i < nbframes;i++, painted_ptr++)
+	{
+		a = SND_VEC4_ABS(SND_VEC4_LOAD(painted_ptr->sample));
+		if (channels == 8)
+			a = SND_VEC4_MAX(a, SND_VEC4_ABS(SND_VEC4_LOAD(painted_ptr->sample + 4)));
+		SND_VEC4_STORE(absmax, a);
+		m = max(max(*maxvol, absmax[0]), max(max(absmax[1], absmax[2]), absmax[3]));
+		*maxvol = m;
+		if (m != 1.0f)
+		{
+			scale = SND_VEC4_SPLAT(1.0f / m);
+			SND_VEC4_STORE(painted_ptr->sample, SND_VEC4_MUL(SND_VEC4_LOAD(painted_ptr->sample), scale));
+			if (channels == 8)
+				SND_VEC4_STORE(painted_ptr->sample + 4, SND_VEC4_MUL(SND_VEC4_LOAD(painted_ptr->sample + 4), scale));
+		}
+	}
+}
+
+// truncate 4 samples to int and saturate them the same way bound() does
+#ifdef SND_MIX_NEON
+static void S_Convert4To16(snd_vec4_t v, short *out)
+{
+	vst1_s16(out, vqmovn_s32(vcvtq_s32_f32(v)));
+}
+
+static void S_Convert4To8(snd_vec4_t v, unsigned char *out)
+{
+	int16x4_t s = vqmovn_s32(vaddq_s32(vcvtq_s32_f32(v), vdupq_n_s32(128)));
+	unsigned char b[8];
+
+	vst1_u8(b, vqmovun_s16(vcombine_s16(s, s)));
+	memcpy(out, b, 4);
+}
+#else
+static void S_Convert4To16(snd_vec4_t v, short *out)
+{
+	__m128i i = _mm_cvttps_epi32(v);
+
+	_mm_storel_epi64((__m128i *)out, _mm_packs_epi32(i, i));
+}
+
+static void S_Convert4To8(snd_vec4_t v, unsigned char *out)
+{
+	__m128i i = _mm_add_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(128));
+	int b;
+
+	i = _mm_packs_epi32(i, i);
+	b = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+	memcpy(out, &b, 4);
+}
+#endif
+
+static void S_ConvertPaintBuffer_SIMD(const portable_sampleframe_t *painted_ptr, void *rb_ptr, int nbframes, int width, int channels)
+{
+	int i;
+	snd_vec4_t scale, v;
+
+	if (channels != 8 && channels != 4 && channels != 2)
+	{
+		S_ConvertPaintBuffer_Scalar(painted_ptr, rb_ptr, nbframes, width, channels);
+		return;
+	}
+
+	scale = SND_VEC4_SPLAT(width == 2 ? 32768.0f : 128.0f);
+	if (channels == 2)
+	{
+		// two stereo frames per vector, an odd last frame goes the scalar way
+		for (i = 0;i + 1 < nbframes;i += 2, painted_ptr += 2)
+		{
+			v = SND_VEC4_MUL(SND_VEC4_COMBINE(SND_VEC2_LOAD(painted_ptr[0].sample), SND_VEC2_LOAD(painted_ptr[1].sample)), scale);
+			if (width == 2)
+				S_Convert4To16(v, (short *)rb_ptr + i * 2);
+			else
+				S_Convert4To8(v, (unsigned char *)rb_ptr + i * 2);
+		}
+		if (i < nbframes)
+			S_ConvertPaintBuffer_Scalar(painted_ptr, (unsigned char *)rb_ptr + i * 2 * width, 1, width, channels);
+		return;
+	}
+
+	for (i = 0;i < nbframes;i++, painted_ptr++)
+	{
+		v = SND_VEC4_MUL(SND_VEC4_LOAD(painted_ptr->sample), scale);
+		if (width == 2)
+			S_Convert4To16(v, (short *)rb_ptr + i * channels);
+		else
+			S_Convert4To8(v, (unsigned char *)rb_ptr + i * channels);
+		if (channels == 8)
+		{
+			v = SND_VEC4_MUL(SND_VEC4_LOAD(painted_ptr->sample + 4), scale);
+			if (width == 2)
+				S_Convert4To16(v, (short *)rb_ptr + i * channels + 4);
+			else
+				S_Convert4To8(v, (unsigned char *)rb_ptr + i * channels + 4);
+		}
+	}
+}
+
+static const snd_mixkernels_t snd_mixkernels_simd =
+{
+#ifdef SND_MIX_NEON
+	"neon",
+#else
+	"sse2",
+#endif
+	S_PaintMono_SIMD,
+	S_PaintStereo_SIMD,
+	S_SoftClip_SIMD,
+	S_ConvertPaintBuffer_SIMD
+};
+#endif
+
+static const snd_mixkernels_t *S_MixKernels(qboolean vector)
+{
+#ifdef SND_MIX_SIMD
+	if (vector)
+		return &snd_mixkernels_simd;
+#endif
+	return &snd_mixkernels_scalar;
+}
 
-		// noise is really really annoying
-		if (cls.timedemo)
-			memset(rb_ptr, 128, nbframes * channels);
+static float snd_softclip_maxvol = 0;
+
+static void S_SoftClipPaintBuffer(const snd_mixkernels_t *kernels, portable_sampleframe_t *painted_ptr, int nbframes, int width, int channels)
+{
+	if((snd_softclip.integer == 1 && width <= 2) || snd_softclip.integer > 1)
+	{
+#if 0
+/* Soft clipping, the sound of a dream, thanks to Jon Wattes
+   post to Musicdsp.org */
+#define SOFTCLIP(x) (x) = sin(bound(-M_PI/2, (x), M_PI/2)) * 0.25
+#endif
+
+		// let's do a simple limiter instead, seems to sound better
+		snd_softclip_maxvol = max(1.0f, snd_softclip_maxvol * (1.0f - nbframes / (0.4f * snd_renderbuffer->format.speed)));
+		kernels->softclip(painted_ptr, nbframes, channels, &snd_softclip_maxvol);
 	}
 }
 
+static void S_ConvertPaintBuffer(const snd_mixkernels_t *kernels, const portable_sampleframe_t *painted_ptr, void *rb_ptr, int nbframes, int width, int channels)
+{
+	kernels->convert(painted_ptr, rb_ptr, nbframes, width, channels);
+
+	// noise is really really annoying
+	if (cls.timedemo)
+		memset(rb_ptr, width == 1 ? 128 : 0, nbframes * channels * width);
+}
+
 
 /*
 ===============================================================================
@@ -282,13 +615,12 @@ void S_MixToBuffer(void *stream, unsigned int bufferframes)
 	float fetchsampleframes[S_FETCHBUFFERSIZE*2];
 	const float *fetchsampleframe;
 	float vol[SND_LISTENERS];
-	float lerp[2];
-	float sample[3];
 	double posd;
 	double speedd;
 	float maxvol;
 	qboolean looping;
 	qboolean silent;
+	const snd_mixkernels_t *kernels = S_MixKernels(snd_mixsimd.integer != 0);
 
 	// mix as many times as needed to fill the requested buffer
 	while (bufferframes)
@@ -425,91 +757,14 @@ void S_MixToBuffer(void *stream, unsigned int bufferframes)
 					if (sfx->format.channels == 2)
 					{
 						// music is stereo
-#if SND_LISTENERS != 8
-#error the following code only supports up to 8 channels, update it
-#endif
-						if (snd_speakerlayout.channels > 2)
-						{
-							// surround mixing
-							for (i = 0;i < count;i++, paint++)
-							{
-								lerp[1] = indexfrac * (1.0f / 65536.0f);
-								lerp[0] = 1.0f - lerp[1];
-								sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[2] * lerp[1];
-								sample[1] = fetchsampleframe[1] * lerp[0] + fetchsampleframe[3] * lerp[1];
-								sample[2] = (sample[0] + sample[1]) * 0.5f;
-								paint->sample[0] += sample[0] * vol[0];
-								paint->sample[1] += sample[1] * vol[1];
-								paint->sample[2] += sample[0] * vol[2];
-								paint->sample[3] += sample[1] * vol[3];
-								paint->sample[4] += sample[2] * vol[4];
-								paint->sample[5] += sample[2] * vol[5];
-								paint->sample[6] += sample[0] * vol[6];
-								paint->sample[7] += sample[1] * vol[7];
-								indexfrac += indexfracstep;
-								fetchsampleframe += 2 * (indexfrac >> 16);
-								indexfrac &= 0xFFFF;
-							}
-						}
-						else
-						{
-							// stereo mixing
-							for (i = 0;i < count;i++, paint++)
-							{
-								lerp[1] = indexfrac * (1.0f / 65536.0f);
-								lerp[0] = 1.0f - lerp[1];
-								sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[2] * lerp[1];
-								sample[1] = fetchsampleframe[1] * lerp[0] + fetchsampleframe[3] * lerp[1];
-								paint->sample[0] += sample[0] * vol[0];
-								paint->sample[1] += sample[1] * vol[1];
-								indexfrac += indexfracstep;
-								fetchsampleframe += 2 * (indexfrac >> 16);
-								indexfrac &= 0xFFFF;
-							}
-						}
+						kernels->paintstereo(paint, count, fetchsampleframe, indexfrac, indexfracstep, vol, snd_speakerlayout.channels > 2);
+						paint += count;
 					}
 					else if (sfx->format.channels == 1)
 					{
 						// most sounds are mono
-#if SND_LISTENERS != 8
-#error the following code only supports up to 8 channels, update it
-#endif
-						if (snd_speakerlayout.channels > 2)
-						{
-							// surround mixing
-							for (i = 0;i < count;i++, paint++)
-							{
-								lerp[1] = indexfrac * (1.0f / 65536.0f);
-								lerp[0] = 1.0f - lerp[1];
-								sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[1] * lerp[1];
-								paint->sample[0] += sample[0] * vol[0];
-								paint->sample[1] += sample[0] * vol[1];
-								paint->sample[2] += sample[0] * vol[2];
-								paint->sample[3] += sample[0] * vol[3];
-								paint->sample[4] += sample[0] * vol[4];
-								paint->sample[5] += sample[0] * vol[5];
-								paint->sample[6] += sample[0] * vol[6];
-								paint->sample[7] += sample[0] * vol[7];
-								indexfrac += indexfracstep;
-								fetchsampleframe += (indexfrac >> 16);
-								indexfrac &= 0xFFFF;
-							}
-						}
-						else
-						{
-							// stereo mixing
-							for (i = 0;i < count;i++, paint++)
-							{
-								lerp[1] = indexfrac * (1.0f / 65536.0f);
-								lerp[0] = 1.0f - lerp[1];
-								sample[0] = fetchsampleframe[0] * lerp[0] + fetchsampleframe[1] * lerp[1];
-								paint->sample[0] += sample[0] * vol[0];
-								paint->sample[1] += sample[0] * vol[1];
-								indexfrac += indexfracstep;
-								fetchsampleframe += (indexfrac >> 16);
-								indexfrac &= 0xFFFF;
-							}
-						}
+						kernels->paintmono(paint, count, fetchsampleframe, indexfrac, indexfracstep, vol, snd_speakerlayout.channels > 2);
+						paint += count;
 					}
 				}
 			}
@@ -518,15 +773,149 @@ void S_MixToBuffer(void *stream, unsigned int bufferframes)
 				S_StopChannel(ch - channels, false, false);
 		}
 
-		S_SoftClipPaintBuffer(paintbuffer, totalmixframes, snd_renderbuffer->format.width, snd_renderbuffer->format.channels);
+		S_SoftClipPaintBuffer(kernels, paintbuffer, totalmixframes, snd_renderbuffer->format.width, snd_renderbuffer->format.channels);
 
 		if (!snd_usethreadedmixing)
 			S_CaptureAVISound(paintbuffer, totalmixframes);
 
-		S_ConvertPaintBuffer(paintbuffer, outbytes, totalmixframes, snd_renderbuffer->format.width, snd_renderbuffer->format.channels);
+		S_ConvertPaintBuffer(kernels, paintbuffer, outbytes, totalmixframes, snd_renderbuffer->format.width, snd_renderbuffer->format.channels);
 
 		// advance the output pointer
 		outbytes += totalmixframes * snd_renderbuffer->format.width * snd_renderbuffer->format.channels;
 		bufferframes -= totalmixframes;
 	}
 }
+
+/*
+===============================================================================
+
+MIXING BENCHMARK
+
+===============================================================================
+*/
+
+#define SND_MIXBENCH_CHANNELS 64
+#define SND_MIXBENCH_FRAMES 1024
+#define SND_MIXBENCH_SOURCEFRAMES (SND_MIXBENCH_FRAMES * 2 + 16)
+
+static void S_MixBench_Paint(const snd_mixkernels_t *kernels, portable_sampleframe_t *paint, const float *source, float vol[SND_MIXBENCH_CHANNELS][SND_LISTENERS], qboolean surround)
+{
+	int c, indexfrac, indexfracstep;
+
+	memset(paint, 0, SND_MIXBENCH_FRAMES * sizeof(*paint));
+	for (c = 0;c < SND_MIXBENCH_CHANNELS;c++)
+	{
+		// half to one and a half times the output rate, odd channels are stereo
+		indexfracstep = 32768 + (c % 5) * 16384;
+		indexfrac = (c * 4099) & 0xFFFF;
+		if (c & 1)
+			kernels->paintstereo(paint, SND_MIXBENCH_FRAMES, source + (c % 7) * 2, indexfrac, indexfracstep, vol[c], surround);
+		else
+			kernels->paintmono(paint, SND_MIXBENCH_FRAMES, source + (c % 7), indexfrac, indexfracstep, vol[c], surround);
+	}
+}
+
+static float S_MixBench_Difference(const portable_sampleframe_t *a, const portable_sampleframe_t *b, int channels)
+{
+	int i, k;
+	float diff = 0;
+
+	for (i = 0;i < SND_MIXBENCH_FRAMES;i++)
+		for (k = 0;k < channels;k++)
+			diff = max(diff, fabs(a[i].sample[k] - b[i].sample[k]));
+	return diff;
+}
+
+/*
+====================
+S_MixBench_f
+
+Runs SND_MIXBENCH_CHANNELS synthetic channels through the scalar reference
+kernels and the vector kernels. It prints the time each took and how far the
+vector output is from the reference.
+====================
+*/
+void S_MixBench_f(void)
+{
+	static const int layouts[2] = {2, 8};
+	const snd_mixkernels_t *kernels[2];
+	float vol[SND_MIXBENCH_CHANNELS][SND_LISTENERS];
+	float *source;
+	portable_sampleframe_t *paint[2], *reference;
+	unsigned char *out[2];
+	float maxvol[2];
+	double t0, t[2];
+	int i, k, impl, layout, channels, width, iterations;
+	size_t outsize;
+
+	iterations = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 200;
+	iterations = max(iterations, 1);
+
+	kernels[0] = S_MixKernels(false);
+	kernels[1] = S_MixKernels(true);
+	if (kernels[1] == kernels[0])
+		Con_Print("snd_mixbench: no vector kernels in this build, timing the scalar kernels twice\n");
+
+	source = (float *)Mem_Alloc(tempmempool, SND_MIXBENCH_SOURCEFRAMES * 2 * sizeof(float));
+	for (i = 0;i < SND_MIXBENCH_SOURCEFRAMES * 2;i++)
+		source[i] = sin(i * 0.05) * 0.5 + sin(i * 0.37) * 0.25;
+	for (i = 0;i < SND_MIXBENCH_CHANNELS;i++)
+		for (k = 0;k < SND_LISTENERS;k++)
+			vol[i][k] = ((i * 7 + k * 3) % 11) * 0.02f;
+	paint[0] = (portable_sampleframe_t *)Mem_Alloc(tempmempool, SND_MIXBENCH_FRAMES * sizeof(portable_sampleframe_t));
+	paint[1] = (portable_sampleframe_t *)Mem_Alloc(tempmempool, SND_MIXBENCH_FRAMES * sizeof(portable_sampleframe_t));
+	reference = (portable_sampleframe_t *)Mem_Alloc(tempmempool, SND_MIXBENCH_FRAMES * sizeof(portable_sampleframe_t));
+	outsize = SND_MIXBENCH_FRAMES * SND_LISTENERS * 2;
+	out[0] = (unsigned char *)Mem_Alloc(tempmempool, outsize);
+	out[1] = (unsigned char *)Mem_Alloc(tempmempool, outsize);
+
+	Con_Printf("snd_mixbench: %i channels, %i frames, %i iterations, %s vs %s (times per iteration)\n", SND_MIXBENCH_CHANNELS, SND_MIXBENCH_FRAMES, iterations, kernels[0]->name, kernels[1]->name);
+	for (layout = 0;layout < 2;layout++)
+	{
+		channels = layouts[layout];
+
+		for (impl = 0;impl < 2;impl++)
+		{
+			t0 = Sys_DirtyTime();
+			for (i = 0;i < iterations;i++)
+				S_MixBench_Paint(kernels[impl], paint[impl], source, vol, channels > 2);
+			t[impl] = (Sys_DirtyTime() - t0) / iterations;
+		}
+		Con_Printf("%i speakers: paint %.1fus / %.1fus, max difference %g\n", channels, t[0] * 1000000.0, t[1] * 1000000.0, S_MixBench_Difference(paint[0], paint[1], channels));
+
+		// 64 channels add up well above 1, so the limiter has work to do
+		memcpy(reference, paint[0], SND_MIXBENCH_FRAMES * sizeof(portable_sampleframe_t));
+		for (impl = 0;impl < 2;impl++)
+		{
+			t0 = Sys_DirtyTime();
+			for (i = 0;i < iterations;i++)
+			{
+				memcpy(paint[impl], reference, SND_MIXBENCH_FRAMES * sizeof(portable_sampleframe_t));
+				maxvol[impl] = 1.0f;
+				kernels[impl]->softclip(paint[impl], SND_MIXBENCH_FRAMES, channels, &maxvol[impl]);
+			}
+			t[impl] = (Sys_DirtyTime() - t0) / iterations;
+		}
+		Con_Printf("%i speakers: softclip %.1fus / %.1fus, max difference %g\n", channels, t[0] * 1000000.0, t[1] * 1000000.0, S_MixBench_Difference(paint[0], paint[1], channels));
+
+		// convert the same clipped input with both, the integer output must match exactly
+		for (width = 2;width >= 1;width--)
+		{
+			for (impl = 0;impl < 2;impl++)
+			{
+				t0 = Sys_DirtyTime();
+				for (i = 0;i < iterations;i++)
+					kernels[impl]->convert(paint[0], out[impl], SND_MIXBENCH_FRAMES, width, channels);
+				t[impl] = (Sys_DirtyTime() - t0) / iterations;
+			}
+			Con_Printf("%i speakers: convert %i bit %.1fus / %.1fus, %s\n", channels, width * 8, t[0] * 1000000.0, t[1] * 1000000.0, memcmp(out[0], out[1], SND_MIXBENCH_FRAMES * channels * width) ? "MISMATCH" : "identical");
+		}
+	}
+
+	Mem_Free(out[1]);
+	Mem_Free(out[0]);
+	Mem_Free(reference);
+	Mem_Free(paint[1]);
+	Mem_Free(paint[0]);
+	Mem_Free(source);
+}
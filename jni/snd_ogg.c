@@ -26,6 +26,9 @@
 #include "snd_main.h"
 #include "snd_ogg.h"
 #include "snd_wav.h"
+#include "thread.h"
+#include "taskqueue.h"
+#include "mdfour.h"
 
 #ifdef LINK_TO_LIBVORBIS
 #define OV_EXCLUDE_STATIC_CALLBACKS
@@ -402,19 +405,296 @@ typedef struct
 } ogg_stream_persfx_t;
 
 // Per-channel data structure
-typedef struct
+typedef struct ogg_stream_perchannel_s
 {
+	struct ogg_stream_perchannel_s *next;	// in ogg_streams
 	OggVorbis_File	vf;
 	ov_decode_t		ov_decode;
 	int				bs;
-	int				buffer_firstframe;
-	int				buffer_numframes;
-	unsigned char	buffer[STREAM_BUFFERSIZE*4];
+	sfx_t			*sfx;
+	channel_t		*ch;
+	qboolean		threaded;		// filled by the decoder thread instead of the mixer
+	qboolean		dead;			// channel stopped, the decoder thread frees it
+	qboolean		eof;			// nothing more to decode until the next seek
+	int				seekframe;		// requested restart position, -1 if none
+	int				decodeframe;	// sfx frame the decoder will produce next
+
+	// decoded 16bit frames, head and tail count frames and only move forward
+	unsigned int	head;
+	unsigned int	tail;
+	int				headframe;		// sfx frame at head
+	qboolean		haswrap;		// the sound looped back to wraploopstart at wrappos
+	unsigned int	wrappos;
+	int				wraploopstart;
+	unsigned int	ringframes;
+	short			*ring;
 } ogg_stream_perchannel_t;
 
+#define OGG_DECODECHUNK 4096	// sample frames decoded per step
+#define OGG_DECODER_SLEEP 2000	// microseconds the decoder thread idles when all streams are full
+
+cvar_t snd_ogg_decodeahead = {CVAR_SAVE, "snd_ogg_decodeahead", "1", "decode streamed Ogg Vorbis sounds (music) ahead of time on a background thread, so the mixer only has to copy samples"};
+cvar_t snd_ogg_readahead = {CVAR_SAVE, "snd_ogg_readahead", "0.5", "seconds of decoded audio kept ready for each streamed Ogg Vorbis sound"};
+
+static ogg_stream_perchannel_t *ogg_streams = NULL;	// streams filled by the decoder thread
+static ogg_stream_perchannel_t *ogg_decoding = NULL;	// stream the decoder thread is working on
+static void *ogg_decoder_mutex = NULL;
+static void *ogg_decoder_thread = NULL;
+static volatile qboolean ogg_decoder_quit = false;
+
+static struct
+{
+	unsigned int decodes;
+	unsigned int decodedframes;
+	unsigned int underflows;
+	double decodetime;
+	double maxdecodetime;
+} ogg_stats;
 
 static const ov_callbacks callbacks = {ovcb_read, ovcb_seek, ovcb_close, ovcb_tell};
 
+static void OGG_LockStreams(void)
+{
+	if (ogg_decoder_mutex)
+		Thread_LockMutex(ogg_decoder_mutex);
+}
+
+static void OGG_UnlockStreams(void)
+{
+	if (ogg_decoder_mutex)
+		Thread_UnlockMutex(ogg_decoder_mutex);
+}
+
+static int OGG_Stream_LoopStart(const ogg_stream_perchannel_t *per_ch)
+{
+	// same rule as S_MixToBuffer
+	if (per_ch->sfx->loopstart < per_ch->sfx->total_length)
+		return per_ch->sfx->loopstart;
+	return (per_ch->ch->flags & CHANNELFLAG_FORCELOOP) ? 0 : (int)per_ch->sfx->total_length;
+}
+
+/*
+====================
+OGG_Stream_Decode
+
+Decodes the next chunk of a stream into its ring, handling pending seeks and
+loops. Returns false if nothing could be decoded (ring full, end of the sound,
+decoder error). Only one thread may decode a given stream at a time, but the
+mixer may read from it meanwhile.
+====================
+*/
+static qboolean OGG_Stream_Decode(ogg_stream_perchannel_t *per_ch)
+{
+	sfx_t *sfx = per_ch->sfx;
+	int f = sfx->format.channels; // shorts per frame in the ring
+	int seekframe, loopstart, wanted, done, ret, offset, n;
+	unsigned int writepos, space;
+	qboolean haswrap, eof;
+	double starttime, decodetime;
+
+	OGG_LockStreams();
+	seekframe = per_ch->seekframe;
+	if (seekframe >= 0)
+	{
+		// restart the ring at the requested position
+		per_ch->seekframe = -1;
+		per_ch->head = per_ch->tail = 0;
+		per_ch->headframe = seekframe;
+		per_ch->haswrap = false;
+		per_ch->eof = false;
+		per_ch->decodeframe = seekframe;
+	}
+	writepos = per_ch->tail;
+	space = per_ch->ringframes - (per_ch->tail - per_ch->head);
+	haswrap = per_ch->haswrap;
+	eof = per_ch->eof;
+	OGG_UnlockStreams();
+
+	if (eof)
+		return false;
+
+	if (seekframe >= 0 && qov_pcm_seek(&per_ch->vf, (ogg_int64_t)seekframe) != 0)
+	{
+		// LordHavoc: we can't Con_Printf here, not thread safe...
+		OGG_LockStreams();
+		per_ch->eof = true;
+		OGG_UnlockStreams();
+		return false;
+	}
+
+	if (per_ch->decodeframe >= (int)sfx->total_length)
+	{
+		loopstart = OGG_Stream_LoopStart(per_ch);
+		// wait until the previous loop has been played before starting another
+		if (haswrap)
+			return false;
+		if (loopstart >= (int)sfx->total_length || qov_pcm_seek(&per_ch->vf, (ogg_int64_t)loopstart) != 0)
+		{
+			OGG_LockStreams();
+			per_ch->eof = true;
+			OGG_UnlockStreams();
+			return false;
+		}
+		OGG_LockStreams();
+		per_ch->haswrap = true;
+		per_ch->wrappos = writepos;
+		per_ch->wraploopstart = loopstart;
+		OGG_UnlockStreams();
+		per_ch->decodeframe = loopstart;
+	}
+
+	wanted = min((int)space, OGG_DECODECHUNK);
+	wanted = min(wanted, (int)sfx->total_length - per_ch->decodeframe);
+	if (wanted <= 0)
+		return false;
+
+	// the frames beyond tail belong to the decoder, the mixer never reads them
+	starttime = Sys_DirtyTime();
+	done = 0;
+	while (done < wanted)
+	{
+		offset = (writepos + done) % per_ch->ringframes;
+		n = min(wanted - done, (int)per_ch->ringframes - offset);
+		ret = qov_read(&per_ch->vf, (char *)(per_ch->ring + offset * f), n * f * 2, mem_bigendian, 2, 1, &per_ch->bs);
+		if (ret <= 0)
+			break;
+		done += ret / (f * 2);
+	}
+	decodetime = Sys_DirtyTime() - starttime;
+
+	OGG_LockStreams();
+	per_ch->tail += done;
+	per_ch->decodeframe += done;
+	// a truncated or damaged file, play silence for the rest
+	if (done < wanted)
+		per_ch->eof = true;
+	ogg_stats.decodes++;
+	ogg_stats.decodedframes += done;
+	ogg_stats.decodetime += decodetime;
+	ogg_stats.maxdecodetime = max(ogg_stats.maxdecodetime, decodetime);
+	OGG_UnlockStreams();
+
+	return done > 0;
+}
+
+/*
+====================
+OGG_Stream_Read
+
+Converts frames from the ring of a stream for the mixer, and drops the frames
+before them. Returns how many of the requested frames were decoded already, or
+-1 if firstsampleframe is not in the ring at all.
+====================
+*/
+static int OGG_Stream_Read(ogg_stream_perchannel_t *per_ch, int firstsampleframe, int numsampleframes, float *outsamplesfloat)
+{
+	int f = per_ch->sfx->format.channels;
+	unsigned int pos, end;
+	int available, offset, i, n;
+	const short *buf;
+
+	OGG_LockStreams();
+	// find the request in the ring, the mixer never asks for frames across
+	// the end of the sound so it is on one side of the loop
+	if (per_ch->seekframe >= 0)
+		available = -1;
+	else if (firstsampleframe >= per_ch->headframe && (!per_ch->haswrap || firstsampleframe - per_ch->headframe < (int)(per_ch->wrappos - per_ch->head)))
+	{
+		pos = per_ch->head + (firstsampleframe - per_ch->headframe);
+		end = per_ch->haswrap ? per_ch->wrappos : per_ch->tail;
+		available = pos <= end ? min(numsampleframes, (int)(end - pos)) : -1;
+	}
+	else if (per_ch->haswrap && firstsampleframe >= per_ch->wraploopstart)
+	{
+		pos = per_ch->wrappos + (firstsampleframe - per_ch->wraploopstart);
+		end = per_ch->tail;
+		available = pos <= end ? min(numsampleframes, (int)(end - pos)) : -1;
+	}
+	else
+		available = -1;
+	if (available >= 0)
+	{
+		per_ch->head = pos;
+		per_ch->headframe = firstsampleframe;
+		if (per_ch->haswrap && pos >= per_ch->wrappos)
+			per_ch->haswrap = false;
+	}
+	OGG_UnlockStreams();
+
+	// convert the sample format for the caller, the decoder does not touch
+	// frames between head and tail
+	for (i = 0;i < available;i += n)
+	{
+		offset = (pos + i) % per_ch->ringframes;
+		n = min(available - i, (int)per_ch->ringframes - offset);
+		buf = per_ch->ring + offset * f;
+		for (offset = 0;offset < n * f;offset++)
+			*outsamplesfloat++ = buf[offset] * (1.0f / 32768.0f);
+	}
+	return available;
+}
+
+static void OGG_Stream_Free(ogg_stream_perchannel_t *per_ch)
+{
+	// release the vorbis decompressor
+	qov_clear(&per_ch->vf);
+	Mem_Free(per_ch);
+}
+
+/*
+====================
+OGG_DecoderThread
+
+Keeps the rings of all threaded streams filled, emptiest first
+====================
+*/
+static int OGG_DecoderThread(void *data)
+{
+	ogg_stream_perchannel_t *per_ch, **link, *best;
+	float fill, bestfill;
+
+	while (!ogg_decoder_quit)
+	{
+		OGG_LockStreams();
+		best = NULL;
+		bestfill = 1;
+		for (link = &ogg_streams;(per_ch = *link) != NULL;)
+		{
+			if (per_ch->dead)
+			{
+				*link = per_ch->next;
+				OGG_Stream_Free(per_ch);
+				continue;
+			}
+			link = &per_ch->next;
+			if (per_ch->seekframe >= 0)
+				fill = 0;
+			else if (per_ch->eof || per_ch->ringframes - (per_ch->tail - per_ch->head) < OGG_DECODECHUNK)
+				continue;
+			// a loop waiting for the mixer to pass its last wrap can't decode yet
+			else if (per_ch->haswrap && per_ch->decodeframe >= (int)per_ch->sfx->total_length)
+				continue;
+			else
+				fill = (float)(per_ch->tail - per_ch->head) / per_ch->ringframes;
+			if (bestfill > fill)
+			{
+				bestfill = fill;
+				best = per_ch;
+			}
+		}
+		ogg_decoding = best;
+		OGG_UnlockStreams();
+
+		if (best == NULL || !OGG_Stream_Decode(best))
+			Sys_Sleep(OGG_DECODER_SLEEP);
+
+		OGG_LockStreams();
+		ogg_decoding = NULL;
+		OGG_UnlockStreams();
+	}
+	return 0;
+}
+
 /*
 ====================
 OGG_GetSamplesFloat
@@ -424,16 +704,16 @@ static void OGG_GetSamplesFloat (channel_t *ch, sfx_t *sfx, int firstsampleframe
 {
 	ogg_stream_perchannel_t *per_ch = (ogg_stream_perchannel_t *)ch->fetcher_data;
 	ogg_stream_persfx_t *per_sfx = (ogg_stream_persfx_t *)sfx->fetcher_data;
-	int f = sfx->format.width * sfx->format.channels; // bytes per frame in the buffer
-	short *buf;
-	int i, len;
-	int newlength, done, ret;
+	int f = sfx->format.channels;
+	unsigned int ringframes;
+	int done;
 
 	// if this channel does not yet have a channel fetcher, make one
 	if (per_ch == NULL)
 	{
 		// allocate a struct to keep track of our file position and buffer
-		per_ch = (ogg_stream_perchannel_t *)Mem_Alloc(snd_mempool, sizeof(*per_ch));
+		ringframes = (unsigned int)max(STREAM_BUFFERSIZE, snd_ogg_readahead.value * sfx->format.speed);
+		per_ch = (ogg_stream_perchannel_t *)Mem_Alloc(snd_mempool, sizeof(*per_ch) + ringframes * f * sizeof(short));
 		// begin decoding the file
 		per_ch->ov_decode.buffer = per_sfx->file;
 		per_ch->ov_decode.ind = 0;
@@ -445,66 +725,58 @@ static void OGG_GetSamplesFloat (channel_t *ch, sfx_t *sfx, int firstsampleframe
 			return;
 		}
 		per_ch->bs = 0;
-		per_ch->buffer_firstframe = 0;
-		per_ch->buffer_numframes = 0;
+		per_ch->sfx = sfx;
+		per_ch->ch = ch;
+		per_ch->ringframes = ringframes;
+		per_ch->ring = (short *)(per_ch + 1);
+		per_ch->seekframe = firstsampleframe;
+		// the first fetch is decoded right here so the sound starts without a
+		// gap, after that the decoder thread (if any) keeps ahead of the mixer
+		while (OGG_Stream_Decode(per_ch) && (int)(per_ch->tail - per_ch->head) < numsampleframes)
+			;
+		OGG_LockStreams();
+		if (ogg_decoder_thread && snd_ogg_decodeahead.integer)
+		{
+			per_ch->threaded = true;
+			per_ch->next = ogg_streams;
+			ogg_streams = per_ch;
+		}
+		OGG_UnlockStreams();
 		// attach the struct to our channel
 		ch->fetcher_data = (void *)per_ch;
 	}
 
 	// if the request is too large for our buffer, loop...
-	while (numsampleframes * f > (int)sizeof(per_ch->buffer))
+	while (numsampleframes > (int)per_ch->ringframes / 2)
 	{
-		done = sizeof(per_ch->buffer) / f;
+		done = per_ch->ringframes / 2;
 		OGG_GetSamplesFloat(ch, sfx, firstsampleframe, done, outsamplesfloat);
 		firstsampleframe += done;
 		numsampleframes -= done;
-		outsamplesfloat += done * sfx->format.channels;
+		outsamplesfloat += done * f;
 	}
 
-	// seek if the request is before the current buffer (loop back)
-	// seek if the request starts beyond the current buffer by at least one frame (channel was zero volume for a while)
-	// do not seek if the request overlaps the buffer end at all (expected behavior)
-	if (per_ch->buffer_firstframe > firstsampleframe || per_ch->buffer_firstframe + per_ch->buffer_numframes < firstsampleframe)
+	done = OGG_Stream_Read(per_ch, firstsampleframe, numsampleframes, outsamplesfloat);
+	if (!per_ch->threaded)
 	{
-		// we expect to decode forward from here so this will be our new buffer start
-		per_ch->buffer_firstframe = firstsampleframe;
-		per_ch->buffer_numframes = 0;
-		ret = qov_pcm_seek(&per_ch->vf, (ogg_int64_t)firstsampleframe);
-		if (ret != 0)
-		{
-			// LordHavoc: we can't Con_Printf here, not thread safe...
-			//Con_Printf("OGG_FetchSound: qov_pcm_seek(..., %d) returned %d\n", firstsampleframe, ret);
-			return;
-		}
+		// no decoder thread, decode on demand
+		if (done < 0)
+			per_ch->seekframe = firstsampleframe;
+		while (done < numsampleframes && OGG_Stream_Decode(per_ch))
+			done = OGG_Stream_Read(per_ch, firstsampleframe, numsampleframes, outsamplesfloat);
+	}
+	else if (done < numsampleframes)
+	{
+		// the decoder thread is behind, or the channel skipped ahead while it
+		// was silent; the missing frames stay silent (the mixer zeroed them)
+		// and if the position is not in the ring at all the decoder restarts
+		// there
+		OGG_LockStreams();
+		if (done < 0 && per_ch->seekframe < 0)
+			per_ch->seekframe = firstsampleframe;
+		ogg_stats.underflows++;
+		OGG_UnlockStreams();
 	}
-
-	// decompress the file as needed
-	if (firstsampleframe + numsampleframes > per_ch->buffer_firstframe + per_ch->buffer_numframes)
-	{
-		// first slide the buffer back, discarding any data preceding the range we care about
-		int offset = firstsampleframe - per_ch->buffer_firstframe;
-		int keeplength = per_ch->buffer_numframes - offset;
-		if (keeplength > 0)
-			memmove(per_ch->buffer, per_ch->buffer + offset * sfx->format.width * sfx->format.channels, keeplength * sfx->format.width * sfx->format.channels);
-		per_ch->buffer_firstframe = firstsampleframe;
-		per_ch->buffer_numframes -= offset;
-		// decompress as much as we can fit in the buffer
-		newlength = sizeof(per_ch->buffer) - per_ch->buffer_numframes * f;
-		done = 0;
-		while (newlength > done && (ret = qov_read(&per_ch->vf, (char *)per_ch->buffer + per_ch->buffer_numframes * f + done, (int)(newlength - done), mem_bigendian, 2, 1, &per_ch->bs)) > 0)
-			done += ret;
-		// clear the missing space if any
-		if (done < newlength)
-			memset(per_ch->buffer + done, 0, newlength - done);
-		// we now have more data in the buffer
-		per_ch->buffer_numframes += done / f;
-	}
-
-	// convert the sample format for the caller
-	buf = (short *)((char *)per_ch->buffer + (firstsampleframe - per_ch->buffer_firstframe) * f);
-	len = numsampleframes * sfx->format.channels;
-	for (i = 0;i < len;i++)
-		outsamplesfloat[i] = buf[i] * (1.0f / 32768.0f);
 }
 
 
@@ -518,9 +790,13 @@ static void OGG_StopChannel(channel_t *ch)
 	ogg_stream_perchannel_t *per_ch = (ogg_stream_perchannel_t *)ch->fetcher_data;
 	if (per_ch != NULL)
 	{
-		// release the vorbis decompressor
-		qov_clear(&per_ch->vf);
-		Mem_Free(per_ch);
+		// the decoder thread may be working on it, let it free the stream
+		OGG_LockStreams();
+		if (per_ch->threaded)
+			per_ch->dead = true;
+		OGG_UnlockStreams();
+		if (!per_ch->threaded)
+			OGG_Stream_Free(per_ch);
 	}
 }
 
@@ -533,6 +809,18 @@ OGG_FreeSfx
 static void OGG_FreeSfx(sfx_t *sfx)
 {
 	ogg_stream_persfx_t *per_sfx = (ogg_stream_persfx_t *)sfx->fetcher_data;
+
+	// the channels are stopped already, but the decoder thread may still be
+	// reading the file for one of them
+	OGG_LockStreams();
+	while (ogg_decoding != NULL && ogg_decoding->sfx == sfx)
+	{
+		OGG_UnlockStreams();
+		Sys_Sleep(100);
+		OGG_LockStreams();
+	}
+	OGG_UnlockStreams();
+
 	// free the complete file we were keeping around
 	Mem_Free(per_sfx->file);
 	// free the file information structure
@@ -542,6 +830,281 @@ static void OGG_FreeSfx(sfx_t *sfx)
 
 static const snd_fetcher_t ogg_fetcher = {OGG_GetSamplesFloat, OGG_StopChannel, OGG_FreeSfx};
 
+cvar_t snd_pcmcache_load = {CVAR_SAVE, "snd_pcmcache_load", "1", "load decoded Ogg Vorbis sounds from pcmcache/filename.pcm when it was made from the same file, instead of decoding them again"};
+cvar_t snd_pcmcache_save = {CVAR_SAVE, "snd_pcmcache_save", "1", "save decoded Ogg Vorbis sounds to pcmcache/filename.pcm so that later level loads can skip decoding them"};
+
+#define OGG_PCMCACHE_IDENT "DPOGGPCM"
+#define OGG_PCMCACHE_VERSION 1
+
+// header of pcmcache/*.pcm files, they are only read back on the machine
+// that wrote them so everything is in native byte order
+typedef struct ogg_pcmcache_header_s
+{
+	char			ident[8];
+	int				version;
+	int				bigendian;
+	int				sourcesize;
+	unsigned char	sourcemd4[16];
+	int				speed;
+	int				channels;
+	int				datasize;
+} ogg_pcmcache_header_t;
+
+// a cached (not streamed) sound being decoded, possibly on a worker thread
+typedef struct ogg_decodejob_s
+{
+	struct ogg_decodejob_s *next;
+	taskqueue_task_t task;
+	char			filename[MAX_QPATH + 16];
+	sfx_t			*sfx;
+	unsigned char	*file;
+	size_t			filesize;
+	unsigned char	sourcemd4[16];
+	char			*pcm;
+	size_t			pcmsize;
+	size_t			decodedsize;
+} ogg_decodejob_t;
+
+static ogg_decodejob_t *ogg_decodejobs = NULL;
+static qboolean ogg_deferdecode = false;
+
+/*
+====================
+OGG_LoadPCMCache
+
+Returns the decoded samples of a cached sound from its pcmcache file, or NULL
+if there is none made from this exact .ogg file
+====================
+*/
+static char *OGG_LoadPCMCache(const char *filename, const sfx_t *sfx, const unsigned char *sourcemd4, size_t sourcesize, size_t pcmsize)
+{
+	ogg_pcmcache_header_t header;
+	qfile_t *file;
+	char *pcm;
+	char vabuf[1024];
+
+	if (!snd_pcmcache_load.integer)
+		return NULL;
+
+	file = FS_OpenVirtualFile(va(vabuf, sizeof(vabuf), "pcmcache/%s.pcm", filename), true);
+	if (file == NULL)
+		return NULL;
+
+	if (FS_Read(file, &header, sizeof(header)) != sizeof(header)
+	 || memcmp(header.ident, OGG_PCMCACHE_IDENT, sizeof(header.ident))
+	 || header.version != OGG_PCMCACHE_VERSION
+	 || header.bigendian != mem_bigendian
+	 || header.sourcesize != (int)sourcesize
+	 || memcmp(header.sourcemd4, sourcemd4, sizeof(header.sourcemd4))
+	 || header.speed != (int)sfx->format.speed
+	 || header.channels != (int)sfx->format.channels
+	 || header.datasize != (int)pcmsize)
+	{
+		FS_Close(file);
+		return NULL;
+	}
+
+	pcm = (char *)Mem_Alloc(snd_mempool, pcmsize);
+	if (FS_Read(file, pcm, pcmsize) != (fs_offset_t)pcmsize)
+	{
+		Mem_Free(pcm);
+		pcm = NULL;
+	}
+	FS_Close(file);
+
+	if (pcm && developer_loading.integer >= 2)
+		Con_Printf("Ogg sound file \"%s\" loaded from the PCM cache\n", filename);
+	return pcm;
+}
+
+/*
+====================
+OGG_SavePCMCache
+====================
+*/
+static void OGG_SavePCMCache(const ogg_decodejob_t *job)
+{
+	ogg_pcmcache_header_t header;
+	const void *data[2];
+	fs_offset_t len[2];
+	char vabuf[1024];
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.ident, OGG_PCMCACHE_IDENT, sizeof(header.ident));
+	header.version = OGG_PCMCACHE_VERSION;
+	header.bigendian = mem_bigendian;
+	header.sourcesize = (int)job->filesize;
+	memcpy(header.sourcemd4, job->sourcemd4, sizeof(header.sourcemd4));
+	header.speed = job->sfx->format.speed;
+	header.channels = job->sfx->format.channels;
+	header.datasize = (int)job->pcmsize;
+
+	data[0] = &header;
+	len[0] = sizeof(header);
+	data[1] = job->pcm;
+	len[1] = job->pcmsize;
+	FS_WriteFileInBlocks(va(vabuf, sizeof(vabuf), "pcmcache/%s.pcm", job->filename), data, len, 2);
+}
+
+/*
+====================
+OGG_DecodeJob
+
+Decodes a whole cached sound, this only touches the job so it can run on any thread
+====================
+*/
+static void OGG_DecodeJob(ogg_decodejob_t *job)
+{
+	ov_decode_t ov_decode;
+	OggVorbis_File vf;
+	long ret;
+	int bs;
+
+	ov_decode.buffer = job->file;
+	ov_decode.ind = 0;
+	ov_decode.buffsize = job->filesize;
+	// this never fails - it succeeded earlier on the same data
+	if (qov_open_callbacks(&ov_decode, &vf, NULL, 0, callbacks) < 0)
+		return;
+	bs = 0;
+	while (job->decodedsize < job->pcmsize && (ret = qov_read(&vf, job->pcm + job->decodedsize, (int)(job->pcmsize - job->decodedsize), mem_bigendian, 2, 1, &bs)) > 0)
+		job->decodedsize += ret;
+	qov_clear(&vf);
+}
+
+static void OGG_DecodeJob_Task(taskqueue_task_t *task)
+{
+	OGG_DecodeJob((ogg_decodejob_t *)task->p[0]);
+}
+
+static void OGG_FinishDecodeJob(ogg_decodejob_t *job)
+{
+	// a truncated file would be decoded again next time rather than cached
+	if (snd_pcmcache_save.integer && job->decodedsize == job->pcmsize)
+		OGG_SavePCMCache(job);
+	Mem_Free(job->file);
+	Mem_Free(job);
+}
+
+/*
+====================
+OGG_BeginDeferredDecode
+
+Until the matching OGG_EndDeferredDecode, cached sounds are decoded on the
+task queue while the next files are being loaded. Their samples read as
+silence until then.
+====================
+*/
+void OGG_BeginDeferredDecode(void)
+{
+	ogg_deferdecode = true;
+}
+
+/*
+====================
+OGG_EndDeferredDecode
+
+Waits for the pending decodes and writes their cache files. Also used to
+clean up after a batch that was left by a Host_Error, and before sounds are
+freed, so it always drains.
+====================
+*/
+void OGG_EndDeferredDecode(void)
+{
+	ogg_decodejob_t *job;
+
+	ogg_deferdecode = false;
+	while (ogg_decodejobs)
+	{
+		job = ogg_decodejobs;
+		ogg_decodejobs = job->next;
+		TaskQueue_WaitForTaskDone(&job->task);
+		OGG_FinishDecodeJob(job);
+	}
+}
+
+/*
+====================
+OGG_Stats_f
+====================
+*/
+static void OGG_Stats_f(void)
+{
+	ogg_stream_perchannel_t *per_ch;
+	int streams = 0;
+
+	OGG_LockStreams();
+	for (per_ch = ogg_streams;per_ch;per_ch = per_ch->next)
+		if (!per_ch->dead)
+			streams++;
+	Con_Printf("Ogg Vorbis decoder: %s, %i threaded streams\n", ogg_decoder_thread ? (snd_ogg_decodeahead.integer ? "background thread" : "background thread (disabled)") : "on demand in the mixer", streams);
+	Con_Printf("%u decodes, %u frames, %.1fms total, %.2fms average, %.2fms worst\n", ogg_stats.decodes, ogg_stats.decodedframes, ogg_stats.decodetime * 1000.0, ogg_stats.decodes ? ogg_stats.decodetime * 1000.0 / ogg_stats.decodes : 0.0, ogg_stats.maxdecodetime * 1000.0);
+	Con_Printf("%u buffer underflows\n", ogg_stats.underflows);
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+		memset(&ogg_stats, 0, sizeof(ogg_stats));
+	OGG_UnlockStreams();
+}
+
+/*
+====================
+OGG_Init
+
+Starts the decoder thread for streamed sounds
+====================
+*/
+void OGG_Init(void)
+{
+	Cvar_RegisterVariable(&snd_ogg_decodeahead);
+	Cvar_RegisterVariable(&snd_ogg_readahead);
+	Cvar_RegisterVariable(&snd_pcmcache_load);
+	Cvar_RegisterVariable(&snd_pcmcache_save);
+	Cmd_AddCommand("snd_oggstats", OGG_Stats_f, "print Ogg Vorbis stream decoding times and buffer underflows (\"snd_oggstats reset\" clears them afterwards)");
+
+	if (Thread_HasThreads())
+	{
+		ogg_decoder_mutex = Thread_CreateMutex();
+		ogg_decoder_quit = false;
+		if (ogg_decoder_mutex)
+			ogg_decoder_thread = Thread_CreateThread(OGG_DecoderThread, NULL);
+		if (!ogg_decoder_thread)
+			Con_Print("OGG_Init: could not start the decoder thread, streamed sounds will be decoded by the mixer\n");
+	}
+}
+
+/*
+====================
+OGG_Shutdown
+
+Stops the decoder thread, the streams it was filling are freed now if their
+channel is stopped already, or by OGG_StopChannel later
+====================
+*/
+void OGG_Shutdown(void)
+{
+	ogg_stream_perchannel_t *per_ch;
+
+	OGG_EndDeferredDecode();
+	if (ogg_decoder_thread)
+	{
+		ogg_decoder_quit = true;
+		Thread_WaitThread(ogg_decoder_thread, 0);
+		ogg_decoder_thread = NULL;
+	}
+	while (ogg_streams)
+	{
+		per_ch = ogg_streams;
+		ogg_streams = per_ch->next;
+		per_ch->threaded = false;
+		if (per_ch->dead)
+			OGG_Stream_Free(per_ch);
+	}
+	if (ogg_decoder_mutex)
+	{
+		Thread_DestroyMutex(ogg_decoder_mutex);
+		ogg_decoder_mutex = NULL;
+	}
+}
+
 static void OGG_DecodeTags(vorbis_comment *vc, unsigned int *start, unsigned int *length, unsigned int numsamples, double *peak, double *gaindb)
 {
 	const char *startcomment = NULL, *lengthcomment = NULL, *endcomment = NULL, *thiscomment = NULL;
@@ -655,7 +1218,7 @@ qboolean OGG_LoadVorbisFile(const char *filename, sfx_t *sfx)
 
 	sfx->total_length = qov_pcm_total(&vf, -1);
 
-	if (snd_streaming.integer && (snd_streaming.integer >= 2 || sfx->total_length > max(sizeof(ogg_stream_perchannel_t), snd_streaming_length.value * sfx->format.speed)))
+	if (snd_streaming.integer && (snd_streaming.integer >= 2 || sfx->total_length > max(STREAM_BUFFERSIZE, snd_streaming_length.value * sfx->format.speed)))
 	{
 		// large sounds use the OGG fetcher to decode the file on demand (but the entire file is held in memory)
 		ogg_stream_persfx_t* per_sfx;
@@ -676,27 +1239,51 @@ qboolean OGG_LoadVorbisFile(const char *filename, sfx_t *sfx)
 	else
 	{
 		// small sounds are entirely loaded and use the PCM fetcher
-		char *buff;
-		ogg_int64_t len;
-		ogg_int64_t done;
-		int bs;
-		long ret;
+		ogg_decodejob_t *job;
+		size_t len;
+		unsigned char sourcemd4[16];
 		if (developer_loading.integer >= 2)
 			Con_Printf ("Ogg sound file \"%s\" will be cached\n", filename);
 		len = sfx->total_length * sfx->format.channels * sfx->format.width;
 		sfx->flags &= ~SFXFLAG_STREAMED;
 		sfx->memsize += len;
 		sfx->fetcher = &wav_fetcher;
-		sfx->fetcher_data = Mem_Alloc(snd_mempool, (size_t)len);
-		buff = (char *)sfx->fetcher_data;
-		done = 0;
-		bs = 0;
-		while ((ret = qov_read(&vf, &buff[done], (int)(len - done), mem_bigendian, 2, 1, &bs)) > 0)
-			done += ret;
 		vc = qov_comment(&vf, -1);
 		OGG_DecodeTags(vc, &sfx->loopstart, &sfx->total_length, sfx->total_length, &peak, &gaindb);
 		qov_clear(&vf);
-		Mem_Free(data);
+
+		// the decoded samples are cached on disk by the identity of the .ogg file
+		memset(sourcemd4, 0, sizeof(sourcemd4));
+		if (snd_pcmcache_load.integer || snd_pcmcache_save.integer)
+			mdfour(sourcemd4, data, (int)filesize);
+		sfx->fetcher_data = OGG_LoadPCMCache(filename, sfx, sourcemd4, (size_t)filesize, len);
+		if (sfx->fetcher_data != NULL)
+			Mem_Free(data);
+		else
+		{
+			job = (ogg_decodejob_t *)Mem_Alloc(snd_mempool, sizeof(*job));
+			strlcpy(job->filename, filename, sizeof(job->filename));
+			job->sfx = sfx;
+			job->file = data;
+			job->filesize = filesize;
+			memcpy(job->sourcemd4, sourcemd4, sizeof(job->sourcemd4));
+			job->pcm = (char *)Mem_Alloc(snd_mempool, len);
+			job->pcmsize = len;
+			sfx->fetcher_data = job->pcm;
+			if (ogg_deferdecode)
+			{
+				// decode on a worker thread while the caller loads more sounds
+				job->next = ogg_decodejobs;
+				ogg_decodejobs = job;
+				TaskQueue_Setup(&job->task, OGG_DecodeJob_Task, 0, 0, job, NULL);
+				TaskQueue_Enqueue(1, &job->task);
+			}
+			else
+			{
+				OGG_DecodeJob(job);
+				OGG_FinishDecodeJob(job);
+			}
+		}
 	}
 
 	if(peak)
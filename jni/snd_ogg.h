@@ -28,6 +28,10 @@
 qboolean OGG_OpenLibrary (void);
 void OGG_CloseLibrary (void);
 qboolean OGG_LoadVorbisFile (const char *filename, sfx_t *sfx);
+void OGG_Init (void);
+void OGG_Shutdown (void);
+void OGG_BeginDeferredDecode (void);
+void OGG_EndDeferredDecode (void);
 
 
 #endif
@@ -69,6 +69,8 @@ void S_Update(const matrix4x4_t *listenermatrix);
 void S_ExtraUpdate (void);
 
 sfx_t *S_PrecacheSound (const char *sample, qboolean complain, qboolean levelsound);
+void S_BeginPrecaching (void);
+void S_EndPrecaching (void);
 float S_SoundLength(const char *name);
 void S_ClearUsed (void);
 void S_PurgeUnused (void);
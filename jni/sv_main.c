@@ -21,15 +21,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "sv_demo.h"
+#include "sv_save.h"
 #include "libcurl.h"
 #include "csprogs.h"
 #include "thread.h"
+#include "taskqueue.h"
 
 static void SV_SaveEntFile_f(void);
 static void SV_StartDownload_f(void);
 static void SV_Download_f(void);
 static void SV_VM_Setup(void);
+static void SV_EdictHot_Benchmark_f(void);
 extern cvar_t net_connecttimeout;
+extern cvar_t mod_collision_bih;
+extern cvar_t mod_q3bsp_tracelineofsight_brushes;
 
 cvar_t sv_worldmessage = {CVAR_READONLY, "sv_worldmessage", "", "title of current level"};
 cvar_t sv_worldname = {CVAR_READONLY, "sv_worldname", "", "name of current worldmodel"};
@@ -77,6 +82,7 @@ cvar_t sv_clmovement_inputtimeout = {0, "sv_clmovement_inputtimeout", "0.2", "wh
 cvar_t sv_cullentities_nevercullbmodels = {0, "sv_cullentities_nevercullbmodels", "0", "if enabled the clients are always notified of moving doors and lifts and other submodels of world (warning: eats a lot of network bandwidth on some levels!)"};
 cvar_t sv_cullentities_pvs = {0, "sv_cullentities_pvs", "1", "fast but loose culling of hidden entities"};
 cvar_t sv_cullentities_stats = {0, "sv_cullentities_stats", "0", "displays stats on network entities culled by various methods for each client"};
+cvar_t sv_cullentities_threaded = {0, "sv_cullentities_threaded", "1", "cull network entities for all clients in parallel on the taskqueue worker threads (not used when the mod has customizeentityforclient or camera_transform entities, or with sv_cullentities_trace_entityocclusion, or on q3bsp maps with mod_collision_bih 0)"};
 cvar_t sv_cullentities_trace = {0, "sv_cullentities_trace", "0", "somewhat slow but very tight culling of hidden entities, minimizes network traffic and makes wallhack cheats useless"};
 cvar_t sv_cullentities_trace_delay = {0, "sv_cullentities_trace_delay", "1", "number of seconds until the entity gets actually culled"};
 cvar_t sv_cullentities_trace_delay_players = {0, "sv_cullentities_trace_delay_players", "0.2", "number of seconds until the entity gets actually culled if it is a player entity"};
@@ -443,6 +449,7 @@ void SV_Init (void)
 
 	Cmd_AddCommand("sv_saveentfile", SV_SaveEntFile_f, "save map entities to .ent file (to allow external editing)");
 	Cmd_AddCommand("sv_areastats", SV_AreaStats_f, "prints statistics on entity culling during collision traces");
+	Cmd_AddCommand("sv_edicthot_benchmark", SV_EdictHot_Benchmark_f, "times walking the hot fields of every edict through the field blocks and through the packed copy the entity sending uses; usage: sv_edicthot_benchmark [count]");
 	Cmd_AddCommand_WithClientCommand("sv_startdownload", NULL, SV_StartDownload_f, "begins sending a file to the client (network protocol use only)");
 	Cmd_AddCommand_WithClientCommand("download", NULL, SV_Download_f, "downloads a specified file from the server");
 
@@ -486,6 +493,7 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_cullentities_nevercullbmodels);
 	Cvar_RegisterVariable (&sv_cullentities_pvs);
 	Cvar_RegisterVariable (&sv_cullentities_stats);
+	Cvar_RegisterVariable (&sv_cullentities_threaded);
 	Cvar_RegisterVariable (&sv_cullentities_trace);
 	Cvar_RegisterVariable (&sv_cullentities_trace_delay);
 	Cvar_RegisterVariable (&sv_cullentities_trace_delay_players);
@@ -604,6 +612,8 @@ void SV_Init (void)
 
 	Cvar_RegisterVariable (&halflifebsp);
 
+	SV_Save_Init();
+
 	sv_mempool = Mem_AllocPool("server", 0, NULL);
 }
 
@@ -1174,17 +1184,17 @@ static qboolean SV_PrepareEntityForSending (prvm_edict_t *ent, entity_state_t *c
 
 	// this 2 billion unit check is actually to detect NAN origins
 	// (we really don't want to send those)
-	if (!(VectorLength2(PRVM_serveredictvector(ent, origin)) < 2000000000.0*2000000000.0))
+	if (!(VectorLength2(sv.edicthot.origin[enumber]) < 2000000000.0*2000000000.0))
 		return false;
 
 	// EF_NODRAW prevents sending for any reason except for your own
 	// client, so we must keep all clients in this superset
-	effects = (unsigned)PRVM_serveredictfloat(ent, effects);
+	effects = (unsigned)sv.edicthot.effects[enumber];
 
 	// we can omit invisible entities with no effects that are not clients
 	// LordHavoc: this could kill tags attached to an invisible entity, I
 	// just hope we never have to support that case
-	i = (int)PRVM_serveredictfloat(ent, modelindex);
+	i = (int)sv.edicthot.modelindex[enumber];
 	modelindex = (i >= 1 && i < MAX_MODELS && PRVM_serveredictstring(ent, model) && *PRVM_GetString(prog, PRVM_serveredictstring(ent, model)) && sv.models[i]) ? i : 0;
 
 	flags = 0;
@@ -1263,7 +1273,7 @@ static qboolean SV_PrepareEntityForSending (prvm_edict_t *ent, entity_state_t *c
 	*cs = defaultstate;
 	cs->active = ACTIVE_NETWORK;
 	cs->number = enumber;
-	VectorCopy(PRVM_serveredictvector(ent, origin), cs->origin);
+	VectorCopy(sv.edicthot.origin[enumber], cs->origin);
 	VectorCopy(PRVM_serveredictvector(ent, angles), cs->angles);
 	cs->flags = flags;
 	cs->effects = effects;
@@ -1338,7 +1348,7 @@ static qboolean SV_PrepareEntityForSending (prvm_edict_t *ent, entity_state_t *c
 	if (f)
 		cs->effects |= ((unsigned int)f & 0xff) << 24;
 
-	if (PRVM_serveredictfloat(ent, movetype) == MOVETYPE_STEP)
+	if (sv.edicthot.movetype[enumber] == MOVETYPE_STEP)
 		cs->flags |= RENDER_STEP;
 	if (cs->number != sv.writeentitiestoclient_cliententitynumber && (cs->effects & EF_LOWPRECISION) && cs->origin[0] >= -32768 && cs->origin[1] >= -32768 && cs->origin[2] >= -32768 && cs->origin[0] <= 32767 && cs->origin[1] <= 32767 && cs->origin[2] <= 32767)
 		cs->flags |= RENDER_LOWPRECISION;
@@ -1401,8 +1411,8 @@ static qboolean SV_PrepareEntityForSending (prvm_edict_t *ent, entity_state_t *c
 	else
 	{
 		// if there is no model (or it could not be loaded), use the physics box
-		VectorAdd(cs->origin, PRVM_serveredictvector(ent, mins), cullmins);
-		VectorAdd(cs->origin, PRVM_serveredictvector(ent, maxs), cullmaxs);
+		VectorAdd(cs->origin, sv.edicthot.mins[enumber], cullmins);
+		VectorAdd(cs->origin, sv.edicthot.maxs[enumber], cullmaxs);
 	}
 	if (specialvisibilityradius)
 	{
@@ -1460,6 +1470,198 @@ static qboolean SV_PrepareEntityForSending (prvm_edict_t *ent, entity_state_t *c
 	return true;
 }
 
+/*
+=======================
+SV_LinkSendEntityClusters
+
+Sorts the prepared entities into the ones every client has to look at and
+the ones that can only be visible through their cached pvs clusters, and
+builds the cluster -> entities table for the latter, so the per-client pass
+only visits entities in clusters the client can see.
+=======================
+*/
+static void SV_LinkSendEntityClusters(void)
+{
+	prvm_prog_t *prog = SVVM_prog;
+	int i, j, c, numclusters, total;
+	int *first = sv.sendentitiesclusterfirst;
+	entity_state_t *s;
+	prvm_edict_t *ed;
+	dp_model_t *model;
+	qboolean nevercullbmodels = sv_cullentities_nevercullbmodels.integer && sv.protocol != PROTOCOL_QUAKE && sv.protocol != PROTOCOL_QUAKEDP && sv.protocol != PROTOCOL_NEHAHRAMOVIE;
+
+	numclusters = 0;
+	if (sv.worldmodel && sv.worldmodel->brush.FindBoxClusters)
+		numclusters = bound(0, sv.worldmodel->brush.num_pvsclusters, MAX_MAP_LEAFS);
+	sv.sendentitiesnumclusters = numclusters;
+	sv.sendentitiesnumclustered = 0;
+	memset(sv.sendentitiesalwaysbits, 0, ((sv.numsendentities + 31) >> 5) * sizeof(unsigned int));
+	memset(sv.sendentitiesclusteredbits, 0, ((sv.numsendentities + 31) >> 5) * sizeof(unsigned int));
+	memset(first, 0, (numclusters + 1) * sizeof(int));
+
+	// classify and count entities per cluster
+	for (i = 0, s = sv.sendentities;i < sv.numsendentities;i++, s++)
+	{
+		// these are rejected for everyone except their own client (handled
+		// per client) or when a tagged child checks them
+		if (!s->customizeentityforclient && ((s->effects & EF_NODRAW) || (!s->modelindex && s->specialvisibilityradius == 0)))
+			continue;
+		ed = PRVM_EDICT_NUM(s->number);
+		// same conditions as the pvs check in SV_MarkWriteEntityStateToClient
+		if (s->customizeentityforclient || s->viewmodelforclient || s->tagentity || (s->effects & EF_NODEPTHTEST)
+		 || (nevercullbmodels && (model = SV_GetModelByIndex(s->modelindex)) != NULL && model->name[0] == '*')
+		 || ed->priv.server->pvs_numclusters < 0 || !numclusters)
+		{
+			sv.sendentitiesalwaysbits[i >> 5] |= 1u << (i & 31);
+			continue;
+		}
+		sv.sendentitiesclusteredbits[i >> 5] |= 1u << (i & 31);
+		sv.sendentitiesnumclustered++;
+		for (j = 0;j < ed->priv.server->pvs_numclusters;j++)
+		{
+			c = ed->priv.server->pvs_clusterlist[j];
+			if (c >= 0 && c < numclusters)
+				first[c + 1]++;
+		}
+	}
+
+	// turn the counts into offsets, then fill in the entities
+	for (c = 0, total = 0;c < numclusters;c++)
+	{
+		j = first[c + 1];
+		first[c + 1] = total;
+		total += j;
+	}
+	for (i = 0;i < sv.numsendentities;i++)
+	{
+		if (!(sv.sendentitiesclusteredbits[i >> 5] & (1u << (i & 31))))
+			continue;
+		ed = PRVM_EDICT_NUM(sv.sendentities[i].number);
+		for (j = 0;j < ed->priv.server->pvs_numclusters;j++)
+		{
+			c = ed->priv.server->pvs_clusterlist[j];
+			if (c >= 0 && c < numclusters)
+				sv.sendentitiesclusterentities[first[c + 1]++] = (unsigned short)i;
+		}
+	}
+	// first[c + 1] is now the end of cluster c, which is where c + 1 starts
+}
+
+/*
+=============
+SV_EdictHot_SyncEdict
+
+copies the hot fields of one edict into sv.edicthot
+=============
+*/
+static void SV_EdictHot_SyncEdict(prvm_prog_t *prog, int e)
+{
+	sv_edicthot_t *hot = &sv.edicthot;
+	prvm_edict_t *ent = PRVM_EDICT_NUM(e);
+	hot->active[e] = !ent->priv.server->free;
+	VectorCopy(PRVM_serveredictvector(ent, origin), hot->origin[e]);
+	VectorCopy(PRVM_serveredictvector(ent, mins), hot->mins[e]);
+	VectorCopy(PRVM_serveredictvector(ent, maxs), hot->maxs[e]);
+	VectorCopy(PRVM_serveredictvector(ent, absmin), hot->absmin[e]);
+	VectorCopy(PRVM_serveredictvector(ent, absmax), hot->absmax[e]);
+	hot->solid[e] = PRVM_serveredictfloat(ent, solid);
+	hot->movetype[e] = PRVM_serveredictfloat(ent, movetype);
+	hot->flags[e] = PRVM_serveredictfloat(ent, flags);
+	hot->modelindex[e] = PRVM_serveredictfloat(ent, modelindex);
+	hot->effects[e] = PRVM_serveredictfloat(ent, effects);
+}
+
+/*
+=============
+SV_EdictHot_Sync
+
+copies the hot fields of every edict into sv.edicthot, in one sequential
+pass over the field blocks.  call it once the QC of the tick has run, it
+stays valid until QC runs again (prog->toplevelcalls changes)
+=============
+*/
+static void SV_EdictHot_Sync(void)
+{
+	prvm_prog_t *prog = SVVM_prog;
+	int e;
+	for (e = 0;e < prog->num_edicts;e++)
+		SV_EdictHot_SyncEdict(prog, e);
+	sv.edicthot.numedicts = prog->num_edicts;
+	sv.edicthot.toplevelcalls = prog->toplevelcalls;
+}
+
+static qboolean SV_EdictHot_IsCurrent(void)
+{
+	prvm_prog_t *prog = SVVM_prog;
+	return sv.edicthot.toplevelcalls == prog->toplevelcalls && sv.edicthot.numedicts == prog->num_edicts;
+}
+
+/*
+=============
+SV_EdictHot_Benchmark_f
+
+times a walk over the hot fields of every edict through the field blocks
+and through sv.edicthot, and the sync that fills the latter
+=============
+*/
+static void SV_EdictHot_Benchmark_f(void)
+{
+	prvm_prog_t *prog = SVVM_prog;
+	sv_edicthot_t *hot = &sv.edicthot;
+	prvm_edict_t *ent;
+	int e, i, count, numactive;
+	double t, times[3], sum[2];
+
+	if (!sv.active)
+	{
+		Con_Print("sv_edicthot_benchmark: no server running\n");
+		return;
+	}
+	count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+	count = max(count, 1);
+
+	// the sums keep the compiler from dropping the walks
+	sum[0] = sum[1] = 0;
+	numactive = 0;
+	t = Sys_DirtyTime();
+	for (i = 0;i < count;i++)
+	{
+		for (e = 1, ent = PRVM_NEXT_EDICT(prog->edicts);e < prog->num_edicts;e++, ent = PRVM_NEXT_EDICT(ent))
+		{
+			if (ent->priv.server->free)
+				continue;
+			sum[0] += PRVM_serveredictvector(ent, origin)[0] + PRVM_serveredictvector(ent, mins)[1] + PRVM_serveredictvector(ent, maxs)[2]
+				+ PRVM_serveredictvector(ent, absmin)[0] + PRVM_serveredictvector(ent, absmax)[1]
+				+ PRVM_serveredictfloat(ent, solid) + PRVM_serveredictfloat(ent, movetype) + PRVM_serveredictfloat(ent, flags)
+				+ PRVM_serveredictfloat(ent, modelindex) + PRVM_serveredictfloat(ent, effects);
+			numactive++;
+		}
+	}
+	times[0] = Sys_DirtyTime() - t;
+
+	t = Sys_DirtyTime();
+	for (i = 0;i < count;i++)
+		SV_EdictHot_Sync();
+	times[1] = Sys_DirtyTime() - t;
+
+	t = Sys_DirtyTime();
+	for (i = 0;i < count;i++)
+	{
+		for (e = 1;e < hot->numedicts;e++)
+		{
+			if (!hot->active[e])
+				continue;
+			sum[1] += hot->origin[e][0] + hot->mins[e][1] + hot->maxs[e][2]
+				+ hot->absmin[e][0] + hot->absmax[e][1]
+				+ hot->solid[e] + hot->movetype[e] + hot->flags[e]
+				+ hot->modelindex[e] + hot->effects[e];
+		}
+	}
+	times[2] = Sys_DirtyTime() - t;
+
+	Con_Printf("%i edicts (%i in use) x%i: field blocks %.3fus/walk, sync %.3fus, mirror %.3fus/walk (%.2fx)%s\n", prog->num_edicts, numactive / count, count, times[0] * 1000000.0 / count, times[1] * 1000000.0 / count, times[2] * 1000000.0 / count, times[2] > 0 ? times[0] / times[2] : 0, sum[0] == sum[1] ? "" : " MISMATCH");
+}
+
 static void SV_PrepareEntitiesForSending(void)
 {
 	prvm_prog_t *prog = SVVM_prog;
@@ -1468,20 +1670,43 @@ static void SV_PrepareEntitiesForSending(void)
 	// send all entities that touch the pvs
 	sv.numsendentities = 0;
 	sv.sendentitiesindex[0] = NULL;
+	sv.sendentitiesneedqc = false;
 	memset(sv.sendentitiesindex, 0, prog->num_edicts * sizeof(*sv.sendentitiesindex));
+	// the QC of this tick is done, take the hot fields in one pass
+	SV_EdictHot_Sync();
 	for (e = 1, ent = PRVM_NEXT_EDICT(prog->edicts);e < prog->num_edicts;e++, ent = PRVM_NEXT_EDICT(ent))
 	{
-		if (!ent->priv.server->free && SV_PrepareEntityForSending(ent, sv.sendentities + sv.numsendentities, e))
+		if (!sv.edicthot.active[e])
+			continue;
+#if MAX_LEVELNETWORKEYES > 0
+		if (PRVM_serveredictfunction(ent, camera_transform))
+			sv.sendentitiesneedqc = true;
+#endif
+		if (SV_PrepareEntityForSending(ent, sv.sendentities + sv.numsendentities, e))
 		{
+			if (sv.sendentities[sv.numsendentities].customizeentityforclient)
+				sv.sendentitiesneedqc = true;
 			sv.sendentitiesindex[e] = sv.sendentities + sv.numsendentities;
+			VectorCopy(ent->priv.server->cullmins, sv.sendentitiescullmins[sv.numsendentities]);
+			VectorCopy(ent->priv.server->cullmaxs, sv.sendentitiescullmaxs[sv.numsendentities]);
 			sv.numsendentities++;
 		}
 	}
+	SV_LinkSendEntityClusters();
 }
 
 #define MAX_LINEOFSIGHTTRACES 64
 
-qboolean SV_CanSeeBox(int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmins, vec3_t entboxmaxs)
+// returns a number in [0, 1) from the pass's own generator, or rand() on the main thread
+static double SV_CullRandom(sv_entitycull_t *cull)
+{
+	if (!cull || !cull->randomseed)
+		return lhrandom(0, 1);
+	cull->randomseed = cull->randomseed * 1103515245u + 12345u;
+	return ((cull->randomseed >> 8) & 0xFFFF) * (1.0 / 65536.0);
+}
+
+static qboolean SV_CanSeeBoxForCull(sv_entitycull_t *cull, int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmins, vec3_t entboxmaxs)
 {
 	prvm_prog_t *prog = SVVM_prog;
 	float pitchsign;
@@ -1495,7 +1720,8 @@ qboolean SV_CanSeeBox(int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmin
 	matrix4x4_t matrix, imatrix;
 	dp_model_t *model;
 	prvm_edict_t *touch;
-	static prvm_edict_t *touchedicts[MAX_EDICTS];
+	static prvm_edict_t *sharedtouchedicts[MAX_EDICTS];
+	prvm_edict_t **touchedicts = cull && cull->touchedicts ? cull->touchedicts : sharedtouchedicts;
 	vec3_t boxmins, boxmaxs;
 	vec3_t clipboxmins, clipboxmaxs;
 	vec3_t endpoints[MAX_LINEOFSIGHTTRACES];
@@ -1512,7 +1738,11 @@ qboolean SV_CanSeeBox(int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmin
 
 	VectorMAM(0.5f, boxmins, 0.5f, boxmaxs, endpoints[0]);
 	for (traceindex = 1;traceindex < numtraces;traceindex++)
-		VectorSet(endpoints[traceindex], lhrandom(boxmins[0], boxmaxs[0]), lhrandom(boxmins[1], boxmaxs[1]), lhrandom(boxmins[2], boxmaxs[2]));
+	{
+		endpoints[traceindex][0] = boxmins[0] + SV_CullRandom(cull) * (boxmaxs[0] - boxmins[0]);
+		endpoints[traceindex][1] = boxmins[1] + SV_CullRandom(cull) * (boxmaxs[1] - boxmins[1]);
+		endpoints[traceindex][2] = boxmins[2] + SV_CullRandom(cull) * (boxmaxs[2] - boxmins[2]);
+	}
 
 	// calculate sweep box for the entire swarm of traces
 	VectorCopy(eye, clipboxmins);
@@ -1597,34 +1827,43 @@ qboolean SV_CanSeeBox(int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmin
 	return false;
 }
 
-static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
+qboolean SV_CanSeeBox(int numtraces, vec_t enlarge, vec3_t eye, vec3_t entboxmins, vec3_t entboxmaxs)
+{
+	return SV_CanSeeBoxForCull(NULL, numtraces, enlarge, eye, entboxmins, entboxmaxs);
+}
+
+static void SV_MarkWriteEntityStateToClient(sv_entitycull_t *cull, entity_state_t *s)
 {
 	prvm_prog_t *prog = SVVM_prog;
 	int isbmodel;
 	dp_model_t *model;
 	prvm_edict_t *ed;
-	if (sv.sententitiesconsideration[s->number] == sv.sententitiesmark)
+	if (cull->considered[s->number] == cull->mark)
 		return;
-	sv.sententitiesconsideration[s->number] = sv.sententitiesmark;
-	sv.writeentitiestoclient_stats_totalentities++;
+	cull->considered[s->number] = cull->mark;
+	cull->stats_totalentities++;
 
 	if (s->customizeentityforclient)
 	{
 		PRVM_serverglobalfloat(time) = sv.time;
 		PRVM_serverglobaledict(self) = s->number;
-		PRVM_serverglobaledict(other) = sv.writeentitiestoclient_cliententitynumber;
+		PRVM_serverglobaledict(other) = cull->cliententitynumber;
 		prog->ExecuteProgram(prog, s->customizeentityforclient, "customizeentityforclient: NULL function");
+		// the QC may have changed the entity
+		SV_EdictHot_SyncEdict(prog, s->number);
 		if(!PRVM_G_FLOAT(OFS_RETURN) || !SV_PrepareEntityForSending(PRVM_EDICT_NUM(s->number), s, s->number))
 			return;
+		VectorCopy(PRVM_EDICT_NUM(s->number)->priv.server->cullmins, sv.sendentitiescullmins[s - sv.sendentities]);
+		VectorCopy(PRVM_EDICT_NUM(s->number)->priv.server->cullmaxs, sv.sendentitiescullmaxs[s - sv.sendentities]);
 	}
 
 	// never reject player
-	if (s->number != sv.writeentitiestoclient_cliententitynumber)
+	if (s->number != cull->cliententitynumber)
 	{
 		// check various rejection conditions
-		if (s->nodrawtoclient == sv.writeentitiestoclient_cliententitynumber)
+		if (s->nodrawtoclient == cull->cliententitynumber)
 			return;
-		if (s->drawonlytoclient && s->drawonlytoclient != sv.writeentitiestoclient_cliententitynumber)
+		if (s->drawonlytoclient && s->drawonlytoclient != cull->cliententitynumber)
 			return;
 		if (s->effects & EF_NODRAW)
 			return;
@@ -1636,7 +1875,7 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 		// viewmodels don't have visibility checking
 		if (s->viewmodelforclient)
 		{
-			if (s->viewmodelforclient != sv.writeentitiestoclient_cliententitynumber)
+			if (s->viewmodelforclient != cull->cliententitynumber)
 				return;
 		}
 		else if (s->tagentity)
@@ -1644,8 +1883,8 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 			// tag attached entities simply check their parent
 			if (!sv.sendentitiesindex[s->tagentity])
 				return;
-			SV_MarkWriteEntityStateToClient(sv.sendentitiesindex[s->tagentity]);
-			if (sv.sententities[s->tagentity] != sv.sententitiesmark)
+			SV_MarkWriteEntityStateToClient(cull, sv.sendentitiesindex[s->tagentity]);
+			if (cull->sent[s->tagentity] != cull->mark)
 				return;
 		}
 		// always send world submodels in newer protocols because they don't
@@ -1657,14 +1896,14 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 			ed = PRVM_EDICT_NUM(s->number);
 
 			// if not touching a visible leaf
-			if (sv_cullentities_pvs.integer && !r_novis.integer && !r_trippy.integer && sv.writeentitiestoclient_pvsbytes)
+			if (sv_cullentities_pvs.integer && !r_novis.integer && !r_trippy.integer && cull->pvsbytes)
 			{
 				if (ed->priv.server->pvs_numclusters < 0)
 				{
 					// entity too big for clusters list
-					if (sv.worldmodel && sv.worldmodel->brush.BoxTouchingPVS && !sv.worldmodel->brush.BoxTouchingPVS(sv.worldmodel, sv.writeentitiestoclient_pvs, ed->priv.server->cullmins, ed->priv.server->cullmaxs))
+					if (sv.worldmodel && sv.worldmodel->brush.BoxTouchingPVS && !sv.worldmodel->brush.BoxTouchingPVS(sv.worldmodel, cull->pvs, sv.sendentitiescullmins[s - sv.sendentities], sv.sendentitiescullmaxs[s - sv.sendentities]))
 					{
-						sv.writeentitiestoclient_stats_culled_pvs++;
+						cull->stats_culled_pvs++;
 						return;
 					}
 				}
@@ -1673,11 +1912,11 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 					int i;
 					// check cached clusters list
 					for (i = 0;i < ed->priv.server->pvs_numclusters;i++)
-						if (CHECKPVSBIT(sv.writeentitiestoclient_pvs, ed->priv.server->pvs_clusterlist[i]))
+						if (CHECKPVSBIT(cull->pvs, ed->priv.server->pvs_clusterlist[i]))
 							break;
 					if (i == ed->priv.server->pvs_numclusters)
 					{
-						sv.writeentitiestoclient_stats_culled_pvs++;
+						cull->stats_culled_pvs++;
 						return;
 					}
 				}
@@ -1698,19 +1937,26 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 				if(samples > 0)
 				{
 					int eyeindex;
-					for (eyeindex = 0;eyeindex < sv.writeentitiestoclient_numeyes;eyeindex++)
-						if(SV_CanSeeBox(samples, enlarge, sv.writeentitiestoclient_eyes[eyeindex], ed->priv.server->cullmins, ed->priv.server->cullmaxs))
+					for (eyeindex = 0;eyeindex < cull->numeyes;eyeindex++)
+						if(SV_CanSeeBoxForCull(cull, samples, enlarge, cull->eyes[eyeindex], sv.sendentitiescullmins[s - sv.sendentities], sv.sendentitiescullmaxs[s - sv.sendentities]))
 							break;
-					if(eyeindex < sv.writeentitiestoclient_numeyes)
-						svs.clients[sv.writeentitiestoclient_clientnumber].visibletime[s->number] =
-							realtime + (
-								s->number <= svs.maxclients
-									? sv_cullentities_trace_delay_players.value
-									: sv_cullentities_trace_delay.value
-							);
-					else if (realtime > svs.clients[sv.writeentitiestoclient_clientnumber].visibletime[s->number])
+					if(eyeindex < cull->numeyes)
 					{
-						sv.writeentitiestoclient_stats_culled_trace++;
+						// worker threads leave visibletime alone, it is
+						// updated when the client's frame is written
+						if (cull->refreshbits)
+							SETPVSBIT(cull->refreshbits, s->number);
+						else
+							svs.clients[cull->clientnumber].visibletime[s->number] =
+								realtime + (
+									s->number <= svs.maxclients
+										? sv_cullentities_trace_delay_players.value
+										: sv_cullentities_trace_delay.value
+								);
+					}
+					else if (realtime > svs.clients[cull->clientnumber].visibletime[s->number])
+					{
+						cull->stats_culled_trace++;
 						return;
 					}
 				}
@@ -1721,13 +1967,13 @@ static void SV_MarkWriteEntityStateToClient(entity_state_t *s)
 	// this just marks it for sending
 	// FIXME: it would be more efficient to send here, but the entity
 	// compressor isn't that flexible
-	sv.writeentitiestoclient_stats_visibleentities++;
-	sv.sententities[s->number] = sv.sententitiesmark;
+	cull->stats_visibleentities++;
+	cull->sent[s->number] = cull->mark;
 }
 
 #if MAX_LEVELNETWORKEYES > 0
 #define MAX_EYE_RECURSION 1 // increase if recursion gets supported by portals
-static void SV_AddCameraEyes(void)
+static void SV_AddCameraEyes(sv_entitycull_t *cull)
 {
 	prvm_prog_t *prog = SVVM_prog;
 	int e, i, j, k;
@@ -1738,7 +1984,7 @@ static void SV_AddCameraEyes(void)
 	int n_cameras = 0;
 	vec3_t mi, ma;
 
-	for(i = 0; i < sv.writeentitiestoclient_numeyes; ++i)
+	for(i = 0; i < cull->numeyes; ++i)
 		eye_levels[i] = 0;
 
 	// check line of sight to portal entities and add them to PVS
@@ -1750,12 +1996,12 @@ static void SV_AddCameraEyes(void)
 			{
 				PRVM_serverglobalfloat(time) = sv.time;
 				PRVM_serverglobaledict(self) = e;
-				PRVM_serverglobaledict(other) = sv.writeentitiestoclient_cliententitynumber;
-				VectorCopy(sv.writeentitiestoclient_eyes[0], PRVM_serverglobalvector(trace_endpos));
-				VectorCopy(sv.writeentitiestoclient_eyes[0], PRVM_G_VECTOR(OFS_PARM0));
+				PRVM_serverglobaledict(other) = cull->cliententitynumber;
+				VectorCopy(cull->eyes[0], PRVM_serverglobalvector(trace_endpos));
+				VectorCopy(cull->eyes[0], PRVM_G_VECTOR(OFS_PARM0));
 				VectorClear(PRVM_G_VECTOR(OFS_PARM1));
 				prog->ExecuteProgram(prog, PRVM_serveredictfunction(ed, camera_transform), "QC function e.camera_transform is missing");
-				if(!VectorCompare(PRVM_serverglobalvector(trace_endpos), sv.writeentitiestoclient_eyes[0]))
+				if(!VectorCompare(PRVM_serverglobalvector(trace_endpos), cull->eyes[0]))
 				{
 					VectorCopy(PRVM_serverglobalvector(trace_endpos), camera_origins[n_cameras]);
 					cameras[n_cameras] = e;
@@ -1772,22 +2018,22 @@ static void SV_AddCameraEyes(void)
 
 	// i is loop counter, is reset to 0 when an eye got added
 	// j is camera index to check
-	for(i = 0, j = 0; sv.writeentitiestoclient_numeyes < MAX_CLIENTNETWORKEYES && i < n_cameras; ++i, ++j, j %= n_cameras)
+	for(i = 0, j = 0; cull->numeyes < MAX_CLIENTNETWORKEYES && i < n_cameras; ++i, ++j, j %= n_cameras)
 	{
 		if(!cameras[j])
 			continue;
 		ed = PRVM_EDICT_NUM(cameras[j]);
 		VectorAdd(PRVM_serveredictvector(ed, origin), PRVM_serveredictvector(ed, mins), mi);
 		VectorAdd(PRVM_serveredictvector(ed, origin), PRVM_serveredictvector(ed, maxs), ma);
-		for(k = 0; k < sv.writeentitiestoclient_numeyes; ++k)
+		for(k = 0; k < cull->numeyes; ++k)
 		if(eye_levels[k] <= MAX_EYE_RECURSION)
 		{
-			if(SV_CanSeeBox(sv_cullentities_trace_samples.integer, sv_cullentities_trace_enlarge.value, sv.writeentitiestoclient_eyes[k], mi, ma))
+			if(SV_CanSeeBoxForCull(cull, sv_cullentities_trace_samples.integer, sv_cullentities_trace_enlarge.value, cull->eyes[k], mi, ma))
 			{
-				eye_levels[sv.writeentitiestoclient_numeyes] = eye_levels[k] + 1;
-				VectorCopy(camera_origins[j], sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes]);
-				// Con_Printf("added eye %d: %f %f %f because we can see %f %f %f .. %f %f %f from eye %d\n", j, sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes][0], sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes][1], sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes][2], mi[0], mi[1], mi[2], ma[0], ma[1], ma[2], k);
-				sv.writeentitiestoclient_numeyes++;
+				eye_levels[cull->numeyes] = eye_levels[k] + 1;
+				VectorCopy(camera_origins[j], cull->eyes[cull->numeyes]);
+				// Con_Printf("added eye %d: %f %f %f because we can see %f %f %f .. %f %f %f from eye %d\n", j, cull->eyes[cull->numeyes][0], cull->eyes[cull->numeyes][1], cull->eyes[cull->numeyes][2], mi[0], mi[1], mi[2], ma[0], ma[1], ma[2], k);
+				cull->numeyes++;
 				cameras[j] = 0;
 				i = 0;
 				break;
@@ -1796,80 +2042,310 @@ static void SV_AddCameraEyes(void)
 	}
 }
 #else
-void SV_AddCameraEyes(void)
+static void SV_AddCameraEyes(sv_entitycull_t *cull)
 {
 }
 #endif
 
-static void SV_WriteEntitiesToClient(client_t *client, prvm_edict_t *clent, sizebuf_t *msg, int maxsize)
+// picks the sendentities worth running SV_MarkWriteEntityStateToClient on
+// for this client: the ones every client looks at, plus the ones linked to a
+// pvs cluster the client can see (the others would fail the pvs check anyway)
+static void SV_GatherEntitiesForClient(sv_entitycull_t *cull)
+{
+	int i, c, b, e, end, numwords, numgathered;
+	unsigned int bit;
+	const unsigned short *list;
+
+	numwords = (sv.numsendentities + 31) >> 5;
+	if (!sv_cullentities_pvs.integer || r_novis.integer || r_trippy.integer || !cull->pvsbytes)
+	{
+		for (i = 0;i < numwords;i++)
+			cull->candidatebits[i] = sv.sendentitiesalwaysbits[i] | sv.sendentitiesclusteredbits[i];
+	}
+	else
+	{
+		memcpy(cull->candidatebits, sv.sendentitiesalwaysbits, numwords * sizeof(unsigned int));
+		numgathered = 0;
+		end = min(cull->pvsbytes, (sv.sendentitiesnumclusters + 7) >> 3);
+		for (b = 0;b < end;b++)
+		{
+			if (!cull->pvs[b])
+				continue;
+			for (c = b << 3;c < (b << 3) + 8 && c < sv.sendentitiesnumclusters;c++)
+			{
+				if (!CHECKPVSBIT(cull->pvs, c))
+					continue;
+				list = sv.sendentitiesclusterentities + sv.sendentitiesclusterfirst[c];
+				for (i = sv.sendentitiesclusterfirst[c + 1] - sv.sendentitiesclusterfirst[c];i > 0;i--, list++)
+				{
+					e = *list;
+					bit = 1u << (e & 31);
+					if (!(cull->candidatebits[e >> 5] & bit))
+					{
+						cull->candidatebits[e >> 5] |= bit;
+						numgathered++;
+					}
+				}
+			}
+		}
+		// entities skipped here count as culled by pvs in the stats
+		cull->stats_culled_pvs += sv.sendentitiesnumclustered - numgathered;
+		cull->stats_totalentities += sv.sendentitiesnumclustered - numgathered;
+	}
+
+	// never reject player
+	if (cull->cliententitynumber > 0 && cull->cliententitynumber < MAX_EDICTS && sv.sendentitiesindex[cull->cliententitynumber])
+	{
+		e = sv.sendentitiesindex[cull->cliententitynumber] - sv.sendentities;
+		bit = 1u << (e & 31);
+		if (!(cull->candidatebits[e >> 5] & bit) && (sv.sendentitiesclusteredbits[e >> 5] & bit))
+		{
+			cull->stats_culled_pvs--;
+			cull->stats_totalentities--;
+		}
+		cull->candidatebits[e >> 5] |= bit;
+	}
+}
+
+// finds the eyes and PVS of the client and marks every visible entity in
+// cull->sent (the caller sets up the considered/sent arrays and mark)
+static void SV_CullEntitiesForClient(sv_entitycull_t *cull, client_t *client)
 {
 	prvm_prog_t *prog = SVVM_prog;
-	qboolean need_empty = false;
-	int i, numsendstates, numcsqcsendstates;
-	entity_state_t *s;
+	int i, j;
+	unsigned int bits;
 	prvm_edict_t *camera;
-	qboolean success;
+	prvm_edict_t *clent = client->edict;
 	vec3_t eye;
 
-	// if there isn't enough space to accomplish anything, skip it
-	if (msg->cursize + 25 > maxsize)
-		return;
-
-	sv.writeentitiestoclient_msg = msg;
-	sv.writeentitiestoclient_clientnumber = client - svs.clients;
-
-	sv.writeentitiestoclient_stats_culled_pvs = 0;
-	sv.writeentitiestoclient_stats_culled_trace = 0;
-	sv.writeentitiestoclient_stats_visibleentities = 0;
-	sv.writeentitiestoclient_stats_totalentities = 0;
-	sv.writeentitiestoclient_numeyes = 0;
+	cull->clientnumber = client - svs.clients;
+	cull->stats_culled_pvs = 0;
+	cull->stats_culled_trace = 0;
+	cull->stats_visibleentities = 0;
+	cull->stats_totalentities = 0;
+	cull->numeyes = 0;
 
 	// get eye location
-	sv.writeentitiestoclient_cliententitynumber = PRVM_EDICT_TO_PROG(clent); // LordHavoc: for comparison purposes
+	cull->cliententitynumber = PRVM_EDICT_TO_PROG(clent); // LordHavoc: for comparison purposes
 	camera = PRVM_EDICT_NUM( client->clientcamera );
 	VectorAdd(PRVM_serveredictvector(camera, origin), PRVM_serveredictvector(clent, view_ofs), eye);
-	sv.writeentitiestoclient_pvsbytes = 0;
+	cull->pvsbytes = 0;
 	// get the PVS values for the eye location, later FatPVS calls will merge
 	if (sv.worldmodel && sv.worldmodel->brush.FatPVS)
-		sv.writeentitiestoclient_pvsbytes = sv.worldmodel->brush.FatPVS(sv.worldmodel, eye, 8, sv.writeentitiestoclient_pvs, sizeof(sv.writeentitiestoclient_pvs), sv.writeentitiestoclient_pvsbytes != 0);
+		cull->pvsbytes = sv.worldmodel->brush.FatPVS(sv.worldmodel, eye, 8, cull->pvs, sizeof(cull->pvs), cull->pvsbytes != 0);
 
 	// add the eye to a list for SV_CanSeeBox tests
-	VectorCopy(eye, sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes]);
-	sv.writeentitiestoclient_numeyes++;
+	VectorCopy(eye, cull->eyes[cull->numeyes]);
+	cull->numeyes++;
 
 	// calculate predicted eye origin for SV_CanSeeBox tests
 	if (sv_cullentities_trace_prediction.integer)
 	{
-		vec_t predtime = bound(0, host_client->ping, sv_cullentities_trace_prediction_time.value);
+		vec_t predtime = bound(0, client->ping, sv_cullentities_trace_prediction_time.value);
 		vec3_t predeye;
 		VectorMA(eye, predtime, PRVM_serveredictvector(camera, velocity), predeye);
-		if (SV_CanSeeBox(1, 0, eye, predeye, predeye))
+		if (SV_CanSeeBoxForCull(cull, 1, 0, eye, predeye, predeye))
 		{
-			VectorCopy(predeye, sv.writeentitiestoclient_eyes[sv.writeentitiestoclient_numeyes]);
-			sv.writeentitiestoclient_numeyes++;
+			VectorCopy(predeye, cull->eyes[cull->numeyes]);
+			cull->numeyes++;
 		}
 		//if (!sv.writeentitiestoclient_useprediction)
 		//	Con_DPrintf("Trying to walk into solid in a pingtime... not predicting for culling\n");
 	}
 
-	SV_AddCameraEyes();
+	if (sv.sendentitiesneedqc)
+		SV_AddCameraEyes(cull);
 
 	// build PVS from the new eyes
 	if (sv.worldmodel && sv.worldmodel->brush.FatPVS)
-		for(i = 1; i < sv.writeentitiestoclient_numeyes; ++i)
-			sv.writeentitiestoclient_pvsbytes = sv.worldmodel->brush.FatPVS(sv.worldmodel, sv.writeentitiestoclient_eyes[i], 8, sv.writeentitiestoclient_pvs, sizeof(sv.writeentitiestoclient_pvs), sv.writeentitiestoclient_pvsbytes != 0);
+		for(i = 1; i < cull->numeyes; ++i)
+			cull->pvsbytes = sv.worldmodel->brush.FatPVS(sv.worldmodel, cull->eyes[i], 8, cull->pvs, sizeof(cull->pvs), cull->pvsbytes != 0);
 
-	sv.sententitiesmark++;
+	cull->mark++;
 
-	for (i = 0;i < sv.numsendentities;i++)
-		SV_MarkWriteEntityStateToClient(sv.sendentities + i);
+	SV_GatherEntitiesForClient(cull);
+	for (i = 0;i < (sv.numsendentities + 31) >> 5;i++)
+	{
+		bits = cull->candidatebits[i];
+		for (j = i << 5;bits;j++, bits >>= 1)
+			if (bits & 1)
+				SV_MarkWriteEntityStateToClient(cull, sv.sendentities + j);
+	}
+}
+
+// per task scratch memory for threaded culling
+typedef struct sv_entitycullscratch_s
+{
+	sv_entitycull_t cull;
+	int considered[MAX_EDICTS];
+	int sent[MAX_EDICTS];
+	prvm_edict_t *touchedicts[MAX_EDICTS];
+}
+sv_entitycullscratch_t;
+
+#define SV_MAXCULLTASKS 16
+static sv_entitycullscratch_t *sv_entitycullscratch[SV_MAXCULLTASKS];
+static int sv_entitycullclients[MAX_SCOREBOARD];
+
+static void SV_CullEntitiesForClients_Task(taskqueue_task_t *task)
+{
+	sv_entitycullscratch_t *scratch = (sv_entitycullscratch_t *)task->p[0];
+	sv_entitycull_t *cull = &scratch->cull;
+	size_t numclients = (size_t)task->p[1];
+	size_t index;
+	int i, number;
+	client_t *client;
+
+	// clients are dealt out round robin so the tasks get similar loads
+	for (index = task->i[0];index < numclients;index += task->i[1])
+	{
+		client = svs.clients + sv_entitycullclients[index];
+		cull->randomseed = (unsigned int)(sv.time * 1000.0) * 2654435761u + (unsigned int)sv_entitycullclients[index] + 1;
+		if (!cull->randomseed)
+			cull->randomseed = 1;
+		cull->refreshbits = client->culledrefreshbits;
+		memset(client->culledrefreshbits, 0, sizeof(client->culledrefreshbits));
+		SV_CullEntitiesForClient(cull, client);
+
+		memset(client->culledvisiblebits, 0, sizeof(client->culledvisiblebits));
+		for (i = 0;i < sv.numsendentities;i++)
+		{
+			number = sv.sendentities[i].number;
+			if (cull->sent[number] == cull->mark)
+				SETPVSBIT(client->culledvisiblebits, number);
+		}
+		client->culledstats_pvs = cull->stats_culled_pvs;
+		client->culledstats_trace = cull->stats_culled_trace;
+		client->culledstats_visible = cull->stats_visibleentities;
+		client->culledstats_total = cull->stats_totalentities;
+		client->entitiesculled = true;
+	}
+}
+
+// the q3bsp trace code without BIH marks the brushes it visits in the
+// model, so the line of sight checks that use it can't run on several
+// threads at once (the world only traces brushes with
+// mod_q3bsp_tracelineofsight_brushes, submodels always do)
+static qboolean SV_CullEntities_CanThread(void)
+{
+	int i;
+	dp_model_t *model;
+	if (mod_collision_bih.integer)
+		return true;
+	for (i = 0;i < MAX_MODELS;i++)
+	{
+		model = sv.models[i];
+		if (model && model->type == mod_brushq3 && (model->brush.submodel || mod_q3bsp_tracelineofsight_brushes.integer))
+			return false;
+	}
+	return true;
+}
+
+/*
+=======================
+SV_CullEntitiesForClients
+
+Runs the entity visibility checks of every client that is about to get an
+update on the taskqueue workers; SV_WriteEntitiesToClient then only has to
+build the lists and encode them, still in client order.
+=======================
+*/
+static void SV_CullEntitiesForClients(void)
+{
+	int i, numclients, numtasks;
+	client_t *client;
+	taskqueue_task_t tasks[SV_MAXCULLTASKS];
+
+	for (i = 0, client = svs.clients;i < svs.maxclients;i++, client++)
+		client->entitiesculled = false;
+
+	if (!sv_cullentities_threaded.integer || sv.sendentitiesneedqc || sv_cullentities_trace_entityocclusion.integer || TaskQueue_NumThreads() < 2 || !SV_CullEntities_CanThread())
+		return;
+
+	// same conditions as SV_SendClientMessages and SV_SendClientDatagram
+	numclients = 0;
+	for (i = 0, client = svs.clients;i < svs.maxclients;i++, client++)
+		if (client->active && client->netconnection && !client->netconnection->message.overflowed && client->begun && realtime > client->netconnection->cleartime)
+			sv_entitycullclients[numclients++] = i;
+	if (numclients < 2)
+		return;
+
+	numtasks = min(min(numclients, TaskQueue_NumThreads()), SV_MAXCULLTASKS);
+	for (i = 0;i < numtasks;i++)
+	{
+		if (!sv_entitycullscratch[i])
+		{
+			sv_entitycullscratch[i] = (sv_entitycullscratch_t *)Z_Malloc(sizeof(*sv_entitycullscratch[i]));
+			sv_entitycullscratch[i]->cull.considered = sv_entitycullscratch[i]->considered;
+			sv_entitycullscratch[i]->cull.sent = sv_entitycullscratch[i]->sent;
+			sv_entitycullscratch[i]->cull.touchedicts = sv_entitycullscratch[i]->touchedicts;
+		}
+		TaskQueue_Setup(tasks + i, SV_CullEntitiesForClients_Task, i, numtasks, sv_entitycullscratch[i], (void *)(size_t)numclients);
+	}
+	TaskQueue_Enqueue(numtasks, tasks);
+	for (i = 0;i < numtasks;i++)
+		TaskQueue_WaitForTaskDone(tasks + i);
+}
+
+static void SV_WriteEntitiesToClient(client_t *client, prvm_edict_t *clent, sizebuf_t *msg, int maxsize)
+{
+	prvm_prog_t *prog = SVVM_prog;
+	qboolean need_empty = false;
+	int i, numsendstates, numcsqcsendstates;
+	int stats_culled_pvs, stats_culled_trace, stats_visibleentities, stats_totalentities;
+	entity_state_t *s;
+	sv_entitycull_t *cull = &sv.writeentitiestoclient_cull;
+	qboolean success;
+	qboolean visible;
+
+	// if there isn't enough space to accomplish anything, skip it
+	if (msg->cursize + 25 > maxsize)
+		return;
+
+	sv.writeentitiestoclient_msg = msg;
+	sv.writeentitiestoclient_clientnumber = client - svs.clients;
+	sv.writeentitiestoclient_cliententitynumber = PRVM_EDICT_TO_PROG(clent); // LordHavoc: for comparison purposes
+
+	if (client->entitiesculled)
+	{
+		// already culled on the worker threads, apply the visibletime updates
+		for (i = 0;i < sv.numsendentities;i++)
+		{
+			s = &sv.sendentities[i];
+			if (CHECKPVSBIT(client->culledrefreshbits, s->number))
+				client->visibletime[s->number] = realtime + (s->number <= svs.maxclients ? sv_cullentities_trace_delay_players.value : sv_cullentities_trace_delay.value);
+		}
+		stats_culled_pvs = client->culledstats_pvs;
+		stats_culled_trace = client->culledstats_trace;
+		stats_visibleentities = client->culledstats_visible;
+		stats_totalentities = client->culledstats_total;
+	}
+	else
+	{
+		cull->considered = sv.sententitiesconsideration;
+		cull->sent = sv.sententities;
+		cull->mark = sv.sententitiesmark;
+		cull->touchedicts = NULL;
+		cull->randomseed = 0;
+		cull->refreshbits = NULL;
+		SV_CullEntitiesForClient(cull, client);
+		sv.sententitiesmark = cull->mark;
+		stats_culled_pvs = cull->stats_culled_pvs;
+		stats_culled_trace = cull->stats_culled_trace;
+		stats_visibleentities = cull->stats_visibleentities;
+		stats_totalentities = cull->stats_totalentities;
+	}
 
 	numsendstates = 0;
 	numcsqcsendstates = 0;
 	for (i = 0;i < sv.numsendentities;i++)
 	{
 		s = &sv.sendentities[i];
-		if (sv.sententities[s->number] == sv.sententitiesmark)
+		if (client->entitiesculled)
+			visible = CHECKPVSBIT(client->culledvisiblebits, s->number) != 0;
+		else
+			visible = sv.sententities[s->number] == sv.sententitiesmark;
+		if (visible)
 		{
 			if(s->active == ACTIVE_NETWORK)
 			{
@@ -1888,9 +2364,10 @@ static void SV_WriteEntitiesToClient(client_t *client, prvm_edict_t *clent, size
 				Con_Printf("entity %d is in sv.sendentities and marked, but not active, please breakpoint me\n", s->number);
 		}
 	}
+	client->entitiesculled = false;
 
 	if (sv_cullentities_stats.integer)
-		Con_Printf("client \"%s\" entities: %d total, %d visible, %d culled by: %d pvs %d trace\n", client->name, sv.writeentitiestoclient_stats_totalentities, sv.writeentitiestoclient_stats_visibleentities, sv.writeentitiestoclient_stats_culled_pvs + sv.writeentitiestoclient_stats_culled_trace, sv.writeentitiestoclient_stats_culled_pvs, sv.writeentitiestoclient_stats_culled_trace);
+		Con_Printf("client \"%s\" entities: %d total, %d visible, %d culled by: %d pvs %d trace\n", client->name, stats_totalentities, stats_visibleentities, stats_culled_pvs + stats_culled_trace, stats_culled_pvs, stats_culled_trace);
 
 	if(client->entitydatabase5)
 		need_empty = EntityFrameCSQC_WriteFrame(msg, maxsize, numcsqcsendstates, sv.writeentitiestoclient_csqcsendstates, client->entitydatabase5->latestframenum + 1);
@@ -1945,6 +2422,22 @@ static void SV_CleanupEnts (void)
 	int		e;
 	prvm_edict_t	*ent;
 
+	// if no QC ran since the entities were prepared only the ones with a
+	// muzzleflash in sv.edicthot need clearing
+	if (SV_EdictHot_IsCurrent())
+	{
+		for (e = 1;e < sv.edicthot.numedicts;e++)
+		{
+			if ((int)sv.edicthot.effects[e] & EF_MUZZLEFLASH)
+			{
+				ent = PRVM_EDICT_NUM(e);
+				PRVM_serveredictfloat(ent, effects) = (int)PRVM_serveredictfloat(ent, effects) & ~EF_MUZZLEFLASH;
+				sv.edicthot.effects[e] = PRVM_serveredictfloat(ent, effects);
+			}
+		}
+		return;
+	}
+
 	ent = PRVM_NEXT_EDICT(prog->edicts);
 	for (e=1 ; e<prog->num_edicts ; e++, ent = PRVM_NEXT_EDICT(ent))
 		PRVM_serveredictfloat(ent, effects) = (int)PRVM_serveredictfloat(ent, effects) & ~EF_MUZZLEFLASH;
@@ -2550,6 +3043,9 @@ void SV_SendClientMessages(void)
 	if (sv.protocol == PROTOCOL_QUAKEWORLD)
 		Sys_Error("SV_SendClientMessages: no quakeworld support\n");
 
+	// send all the client updates with as few system calls as possible
+	NetConn_BeginBatchedWrites();
+
 	SV_FlushBroadcastMessages();
 
 // update frags, names, etc
@@ -2574,12 +3070,15 @@ void SV_SendClientMessages(void)
 			prepared = true;
 			// only prepare entities once per frame
 			SV_PrepareEntitiesForSending();
+			SV_CullEntitiesForClients();
 		}
 		SV_SendClientDatagram(host_client);
 	}
 
 // clear muzzle flashes
 	SV_CleanupEnts();
+
+	NetConn_EndBatchedWrites();
 }
 
 static void SV_StartDownload_f(void)
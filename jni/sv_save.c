@@ -0,0 +1,606 @@
+#include "quakedef.h"
+#include "progsvm.h"
+#include "taskqueue.h"
+#include "sv_save.h"
+
+/*
+Binary savegames
+
+The edict fields and globals are stored as they are in memory, the savegame
+can only be loaded with the same progs (checked by CRC and layout). Strings
+are replaced by references into a string table, and only the fields and
+globals a text savegame would contain are restored, so loading one gives the
+same result as loading the equivalent text savegame.
+
+The file starts with the same two lines as a text savegame (version and
+comment) so the load menu can list it.
+*/
+
+cvar_t sv_savegame_binary = {CVAR_SAVE, "sv_savegame_binary", "0", "write savegames in the binary format, which is faster to save and load but only works with the progs it was saved with; the file is written in the background (loading detects the format by itself)"};
+
+#define SAVEBINARY_MAGIC "DPSAVEBIN"
+#define SAVEBINARY_VERSION 1
+#define SAVEBINARY_TEXTSIZE 64 // magic and comment lines, padded with zeros
+#define SAVEBINARY_BYTEORDER 0x01020304
+// limit for the counts in the header that have no engine limit (fields,
+// globals, string buffer ints, strings and string data), far above what any
+// progs needs and low enough that the size arithmetic can't overflow
+#define SAVEBINARY_MAXCOUNT (1 << 24)
+
+typedef struct savebinary_header_s
+{
+	int byteorder;
+	int version;
+	int progscrc;
+	int entityfields;
+	int numglobals;
+	int numfielddefs;
+	int numglobaldefs;
+	int num_edicts;
+	int numlightstyles;
+	int nummodels;
+	int numsounds;
+	int numbufferints;
+	int numstrings;
+	int stringdatasize;
+	int skill;
+	float time;
+	float spawn_parms[NUM_SPAWN_PARMS];
+	char mapname[MAX_QPATH];
+}
+savebinary_header_t;
+
+typedef struct savebinary_s
+{
+	// the file contents: text lines, header, ints (lightstyles, model and
+	// sound precaches, string buffers), globals, edict free flags (padded
+	// to 4 bytes), fields, string offsets and the string data
+	unsigned char *data;
+	size_t datasize;
+	size_t maxdatasize;
+	int *stringoffsets;
+	int numstrings;
+	int maxstrings;
+	char *stringdata;
+	int stringdatasize;
+	int maxstringdatasize;
+
+	char name[MAX_QPATH];
+	qfile_t *file;
+	taskqueue_task_t task;
+	qboolean writing;
+}
+savebinary_t;
+
+static savebinary_t sv_savebinary;
+
+extern qboolean allowcheats;
+extern cvar_t sv_cheats;
+
+prvm_stringbuffer_t *BufStr_FindCreateReplace (prvm_prog_t *prog, int bufindex, int flags, char *format);
+void BufStr_Set(prvm_prog_t *prog, prvm_stringbuffer_t *stringbuffer, int strindex, const char *str);
+void BufStr_Flush(prvm_prog_t *prog);
+
+/*
+===============
+SV_SaveBinary_SavedType
+
+true if a field or global of this type is written to text savegames
+===============
+*/
+static qboolean SV_SaveBinary_SavedType(int type)
+{
+	switch (type & ~DEF_SAVEGLOBAL)
+	{
+	case ev_string:
+	case ev_float:
+	case ev_vector:
+	case ev_entity:
+	case ev_field:
+	case ev_function:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// same rules as PRVM_ED_Write
+static qboolean SV_SaveBinary_SavedField(prvm_prog_t *prog, ddef_t *d)
+{
+	const char *name = PRVM_GetString(prog, d->s_name);
+	size_t l = strlen(name);
+	if (l > 1 && name[l-2] == '_')
+		return false;
+	return SV_SaveBinary_SavedType(d->type);
+}
+
+// same rules as PRVM_ED_WriteGlobals
+static qboolean SV_SaveBinary_SavedGlobal(ddef_t *d)
+{
+	int type = d->type & ~DEF_SAVEGLOBAL;
+	if (!(d->type & DEF_SAVEGLOBAL))
+		return false;
+	return type == ev_string || type == ev_float || type == ev_entity;
+}
+
+static void *SV_SaveBinary_Append(savebinary_t *save, size_t size)
+{
+	void *p;
+	if (save->datasize + size > save->maxdatasize)
+	{
+		save->maxdatasize = max(save->maxdatasize * 2, save->datasize + size);
+		save->data = (unsigned char *)Mem_Realloc(tempmempool, save->data, save->maxdatasize);
+	}
+	p = save->data + save->datasize;
+	save->datasize += size;
+	return p;
+}
+
+// returns a reference to the string, 0 for none
+static int SV_SaveBinary_String(savebinary_t *save, const char *s)
+{
+	int l;
+	if (!s)
+		s = "";
+	l = (int)strlen(s) + 1;
+	if (save->numstrings >= save->maxstrings)
+	{
+		save->maxstrings = max(save->maxstrings * 2, 1024);
+		save->stringoffsets = (int *)Mem_Realloc(tempmempool, save->stringoffsets, save->maxstrings * sizeof(int));
+	}
+	if (save->stringdatasize + l > save->maxstringdatasize)
+	{
+		save->maxstringdatasize = max(save->maxstringdatasize * 2, save->stringdatasize + l + 65536);
+		save->stringdata = (char *)Mem_Realloc(tempmempool, save->stringdata, save->maxstringdatasize);
+	}
+	memcpy(save->stringdata + save->stringdatasize, s, l);
+	save->stringoffsets[save->numstrings++] = save->stringdatasize;
+	save->stringdatasize += l;
+	return save->numstrings;
+}
+
+static void SV_SaveBinary_Task(taskqueue_task_t *task)
+{
+	savebinary_t *save = (savebinary_t *)task->p[0];
+	FS_Write(save->file, save->data, save->datasize);
+	FS_Write(save->file, save->stringoffsets, save->numstrings * sizeof(int));
+	FS_Write(save->file, save->stringdata, save->stringdatasize);
+	FS_Close(save->file);
+}
+
+/*
+===============
+SV_Savegame_Binary_Frame
+
+Finishes a background save once it is written, or waits for it
+===============
+*/
+void SV_Savegame_Binary_Frame(qboolean wait)
+{
+	savebinary_t *save = &sv_savebinary;
+	if (!save->writing)
+		return;
+	if (wait)
+		TaskQueue_WaitForTaskDone(&save->task);
+	else if (!TaskQueue_IsDone(&save->task))
+		return;
+	save->writing = false;
+	Mem_Free(save->data);
+	if (save->stringoffsets)
+		Mem_Free(save->stringoffsets);
+	if (save->stringdata)
+		Mem_Free(save->stringdata);
+	Con_Printf("Saved game to %s.\n", save->name);
+	memset(save, 0, sizeof(*save));
+}
+
+/*
+===============
+SV_Savegame_Binary
+
+Copies the game state and writes it to name in the background
+===============
+*/
+void SV_Savegame_Binary(prvm_prog_t *prog, const char *name, const char *comment)
+{
+	savebinary_t *save = &sv_savebinary;
+	savebinary_header_t *header;
+	int i, j, k, numbuffers, *ints;
+	int numfields, numglobals, nummodels, numsounds, numbufferints;
+	size_t countoffset;
+	ddef_t **fields, **globals;
+	prvm_vec_t *v;
+	prvm_edict_t *ed;
+	prvm_stringbuffer_t *stringbuffer;
+	char *text;
+
+	// one save at a time
+	SV_Savegame_Binary_Frame(true);
+
+	Con_Printf("Saving game to %s...\n", name);
+	save->file = FS_OpenRealFile(name, "wb", false);
+	if (!save->file)
+	{
+		Con_Print("ERROR: couldn't open.\n");
+		return;
+	}
+	strlcpy(save->name, name, sizeof(save->name));
+
+	fields = (ddef_t **)Mem_Alloc(tempmempool, (prog->numfielddefs + prog->numglobaldefs) * sizeof(ddef_t *));
+	globals = fields + prog->numfielddefs;
+	numfields = 0;
+	for (i = 1;i < prog->numfielddefs;i++)
+		if ((prog->fielddefs[i].type & ~DEF_SAVEGLOBAL) == ev_string && SV_SaveBinary_SavedField(prog, prog->fielddefs + i))
+			fields[numfields++] = prog->fielddefs + i;
+	numglobals = 0;
+	for (i = 0;i < prog->numglobaldefs;i++)
+		if ((prog->globaldefs[i].type & ~DEF_SAVEGLOBAL) == ev_string && SV_SaveBinary_SavedGlobal(prog->globaldefs + i))
+			globals[numglobals++] = prog->globaldefs + i;
+
+	text = (char *)SV_SaveBinary_Append(save, SAVEBINARY_TEXTSIZE);
+	memset(text, 0, SAVEBINARY_TEXTSIZE);
+	dpsnprintf(text, SAVEBINARY_TEXTSIZE, "%s\n%s\n", SAVEBINARY_MAGIC, comment);
+
+	// the counts are filled in at the end, appending may move the buffer
+	header = (savebinary_header_t *)SV_SaveBinary_Append(save, sizeof(*header));
+	memset(header, 0, sizeof(*header));
+	header->byteorder = SAVEBINARY_BYTEORDER;
+	header->version = SAVEBINARY_VERSION;
+	header->progscrc = prog->filecrc;
+	header->entityfields = prog->entityfields;
+	header->numglobals = prog->numglobals;
+	header->numfielddefs = prog->numfielddefs;
+	header->numglobaldefs = prog->numglobaldefs;
+	header->num_edicts = prog->num_edicts;
+	header->skill = current_skill;
+	header->time = sv.time;
+	for (i = 0;i < NUM_SPAWN_PARMS;i++)
+		header->spawn_parms[i] = svs.clients[0].spawn_parms[i];
+	strlcpy(header->mapname, sv.name, sizeof(header->mapname));
+
+	ints = (int *)SV_SaveBinary_Append(save, MAX_LIGHTSTYLES * sizeof(int));
+	for (i = 0;i < MAX_LIGHTSTYLES;i++)
+		ints[i] = sv.lightstyles[i][0] ? SV_SaveBinary_String(save, sv.lightstyles[i]) : 0;
+	nummodels = 0;
+	for (i = 1;i < MAX_MODELS;i++)
+	{
+		if (!sv.model_precache[i][0])
+			continue;
+		ints = (int *)SV_SaveBinary_Append(save, 2 * sizeof(int));
+		ints[0] = i;
+		ints[1] = SV_SaveBinary_String(save, sv.model_precache[i]);
+		nummodels++;
+	}
+	numsounds = 0;
+	for (i = 1;i < MAX_SOUNDS;i++)
+	{
+		if (!sv.sound_precache[i][0])
+			continue;
+		ints = (int *)SV_SaveBinary_Append(save, 2 * sizeof(int));
+		ints[0] = i;
+		ints[1] = SV_SaveBinary_String(save, sv.sound_precache[i]);
+		numsounds++;
+	}
+
+	// string buffers: index, flags, number of strings, then index and
+	// string reference pairs
+	numbufferints = 0;
+	numbuffers = Mem_ExpandableArray_IndexRange(&prog->stringbuffersarray);
+	for (i = 0;i < numbuffers;i++)
+	{
+		stringbuffer = (prvm_stringbuffer_t *)Mem_ExpandableArray_RecordAtIndex(&prog->stringbuffersarray, i);
+		if (!stringbuffer || !(stringbuffer->flags & STRINGBUFFER_SAVED))
+			continue;
+		ints = (int *)SV_SaveBinary_Append(save, 3 * sizeof(int));
+		ints[0] = i;
+		ints[1] = stringbuffer->flags & STRINGBUFFER_QCFLAGS;
+		ints[2] = 0;
+		countoffset = save->datasize - sizeof(int);
+		numbufferints += 3;
+		for (k = 0;k < stringbuffer->num_strings;k++)
+		{
+			if (!stringbuffer->strings[k])
+				continue;
+			ints = (int *)SV_SaveBinary_Append(save, 2 * sizeof(int));
+			ints[0] = k;
+			ints[1] = SV_SaveBinary_String(save, stringbuffer->strings[k]);
+			(*(int *)(save->data + countoffset))++;
+			numbufferints += 2;
+		}
+	}
+
+	v = (prvm_vec_t *)SV_SaveBinary_Append(save, prog->numglobals * sizeof(prvm_vec_t));
+	memcpy(v, prog->globals.fp, prog->numglobals * sizeof(prvm_vec_t));
+	for (i = 0;i < numglobals;i++)
+		if (((prvm_eval_t *)(v + globals[i]->ofs))->string)
+			((prvm_eval_t *)(v + globals[i]->ofs))->_int = SV_SaveBinary_String(save, PRVM_GetString(prog, prog->globals.ip[globals[i]->ofs]));
+
+	text = (char *)SV_SaveBinary_Append(save, (prog->num_edicts + 3) & ~3);
+	memset(text, 0, (prog->num_edicts + 3) & ~3);
+	for (i = 0;i < prog->num_edicts;i++)
+		text[i] = PRVM_EDICT_NUM(i)->priv.required->free;
+
+	v = (prvm_vec_t *)SV_SaveBinary_Append(save, prog->num_edicts * prog->entityfields * sizeof(prvm_vec_t));
+	for (i = 0;i < prog->num_edicts;i++, v += prog->entityfields)
+	{
+		ed = PRVM_EDICT_NUM(i);
+		if (ed->priv.required->free)
+		{
+			memset(v, 0, prog->entityfields * sizeof(prvm_vec_t));
+			continue;
+		}
+		memcpy(v, ed->fields.fp, prog->entityfields * sizeof(prvm_vec_t));
+		for (j = 0;j < numfields;j++)
+			if (((prvm_eval_t *)(v + fields[j]->ofs))->string)
+				((prvm_eval_t *)(v + fields[j]->ofs))->_int = SV_SaveBinary_String(save, PRVM_GetString(prog, ed->fields.ip[fields[j]->ofs]));
+	}
+	Mem_Free(fields);
+
+	header = (savebinary_header_t *)(save->data + SAVEBINARY_TEXTSIZE);
+	header->numlightstyles = MAX_LIGHTSTYLES;
+	header->nummodels = nummodels;
+	header->numsounds = numsounds;
+	header->numbufferints = numbufferints;
+	header->numstrings = save->numstrings;
+	header->stringdatasize = save->stringdatasize;
+
+	save->writing = true;
+	TaskQueue_Setup(&save->task, SV_SaveBinary_Task, 0, 0, save, NULL);
+	TaskQueue_Enqueue(1, &save->task);
+}
+
+/*
+===============
+SV_Loadgame_Binary
+
+Loads a savegame written by SV_Savegame_Binary the way Host_Loadgame_f loads
+a text savegame, returns false if it could not be loaded
+===============
+*/
+qboolean SV_Loadgame_Binary(prvm_prog_t *prog, const unsigned char *data, fs_offset_t size)
+{
+	savebinary_header_t header;
+	const int *ints, *stringoffsets;
+	const char *stringdata, *freeflags;
+	const prvm_vec_t *globalsdata, *fieldsdata, *v;
+	prvm_eval_t *val;
+	prvm_edict_t *ent;
+	prvm_stringbuffer_t *stringbuffer;
+	ddef_t *d, **fields;
+	int i, j, k, n, numfields, type, entnum;
+	size_t offset;
+	unsigned long long needed;
+	char *s;
+
+	// the file may be the one still being written
+	SV_Savegame_Binary_Frame(true);
+
+	if (size < SAVEBINARY_TEXTSIZE + (fs_offset_t)sizeof(header))
+	{
+		Con_Print("Binary savegame is truncated\n");
+		return false;
+	}
+	memcpy(&header, data + SAVEBINARY_TEXTSIZE, sizeof(header));
+	if (header.byteorder != SAVEBINARY_BYTEORDER)
+	{
+		Con_Print("Binary savegame was written on a machine with a different byte order\n");
+		return false;
+	}
+	if (header.version != SAVEBINARY_VERSION)
+	{
+		Con_Printf("Binary savegame is version %i, not %i\n", header.version, SAVEBINARY_VERSION);
+		return false;
+	}
+	// bound every count before any size is computed from it
+	if (header.num_edicts < 1 || header.num_edicts > MAX_EDICTS
+	 || header.numlightstyles < 0 || header.numlightstyles > MAX_LIGHTSTYLES
+	 || header.nummodels < 0 || header.nummodels > MAX_MODELS
+	 || header.numsounds < 0 || header.numsounds > MAX_SOUNDS
+	 || header.numbufferints < 0 || header.numbufferints > SAVEBINARY_MAXCOUNT
+	 || header.numstrings < 0 || header.numstrings > SAVEBINARY_MAXCOUNT
+	 || header.stringdatasize < 0 || header.stringdatasize > SAVEBINARY_MAXCOUNT
+	 || header.entityfields < 0 || header.entityfields > SAVEBINARY_MAXCOUNT
+	 || header.numglobals < 0 || header.numglobals > SAVEBINARY_MAXCOUNT)
+	{
+		Con_Print("Binary savegame is corrupt\n");
+		return false;
+	}
+	needed = SAVEBINARY_TEXTSIZE + sizeof(header);
+	needed += ((unsigned long long)header.numlightstyles + 2 * (unsigned long long)header.nummodels + 2 * (unsigned long long)header.numsounds + (unsigned long long)header.numbufferints) * sizeof(int);
+	needed += (unsigned long long)header.numglobals * sizeof(prvm_vec_t);
+	needed += ((unsigned long long)header.num_edicts + 3) & ~3ULL;
+	needed += (unsigned long long)header.num_edicts * header.entityfields * sizeof(prvm_vec_t);
+	needed += (unsigned long long)header.numstrings * sizeof(int) + header.stringdatasize;
+	if ((unsigned long long)size < needed || (header.stringdatasize && data[needed - 1]))
+	{
+		Con_Print("Binary savegame is truncated\n");
+		return false;
+	}
+
+	// everything below fits in size, so the offsets fit in size_t
+	offset = SAVEBINARY_TEXTSIZE + sizeof(header);
+	ints = (const int *)(data + offset);
+	offset += ((size_t)header.numlightstyles + 2 * (size_t)header.nummodels + 2 * (size_t)header.numsounds + (size_t)header.numbufferints) * sizeof(int);
+	globalsdata = (const prvm_vec_t *)(data + offset);
+	offset += (size_t)header.numglobals * sizeof(prvm_vec_t);
+	freeflags = (const char *)(data + offset);
+	offset += ((size_t)header.num_edicts + 3) & ~(size_t)3;
+	fieldsdata = (const prvm_vec_t *)(data + offset);
+	offset += (size_t)header.num_edicts * header.entityfields * sizeof(prvm_vec_t);
+	stringoffsets = (const int *)(data + offset);
+	offset += (size_t)header.numstrings * sizeof(int);
+	stringdata = (const char *)(data + offset);
+#define SAVEBINARY_STRING(ref) ((ref) > 0 && (ref) <= header.numstrings ? stringdata + stringoffsets[(ref) - 1] : "")
+
+	header.mapname[sizeof(header.mapname) - 1] = 0;
+	current_skill = header.skill;
+	Cvar_SetValue ("skill", (float)current_skill);
+
+	allowcheats = sv_cheats.integer != 0;
+
+	SV_SpawnServer (header.mapname);
+	if (!sv.active)
+	{
+		Con_Print("Couldn't load map\n");
+		return false;
+	}
+	if (header.progscrc != prog->filecrc || header.entityfields != prog->entityfields || header.numglobals != prog->numglobals || header.numfielddefs != prog->numfielddefs || header.numglobaldefs != prog->numglobaldefs)
+		Host_Error("Binary savegame was made with different progs (save it as a text savegame with the old progs to convert it)");
+	for (i = 0;i < header.numstrings;i++)
+		if (stringoffsets[i] < 0 || stringoffsets[i] >= header.stringdatasize)
+			Host_Error("Binary savegame is corrupt (string %i is outside the string data)", i);
+	sv.paused = true;		// pause until all clients connect
+	sv.loadgame = true;
+
+	// unlink all entities
+	World_UnlinkAll(&sv.world);
+
+	// globals
+	for (i = 0;i < prog->numglobaldefs;i++)
+	{
+		d = prog->globaldefs + i;
+		if (!SV_SaveBinary_SavedGlobal(d))
+			continue;
+		val = (prvm_eval_t *)(prog->globals.fp + d->ofs);
+		memcpy(val, globalsdata + d->ofs, sizeof(prvm_vec_t));
+		type = d->type & ~DEF_SAVEGLOBAL;
+		if (type == ev_string && val->string)
+		{
+			const char *str = SAVEBINARY_STRING(val->_int);
+			val->string = PRVM_AllocString(prog, strlen(str) + 1, &s);
+			memcpy(s, str, strlen(str) + 1);
+		}
+		else if (type == ev_entity)
+		{
+			if ((unsigned int)val->edict >= (unsigned int)prog->limit_edicts)
+				val->edict = 0;
+			while (val->edict >= prog->max_edicts)
+				PRVM_MEM_IncreaseEdicts(prog);
+		}
+	}
+
+	// restore the autocvar globals
+	Cvar_UpdateAllAutoCvars();
+
+	// edicts, only the fields PRVM_ED_Write would have written are restored
+	fields = (ddef_t **)Mem_Alloc(tempmempool, prog->numfielddefs * sizeof(ddef_t *));
+	numfields = 0;
+	for (i = 1;i < prog->numfielddefs;i++)
+		if (SV_SaveBinary_SavedField(prog, prog->fielddefs + i))
+			fields[numfields++] = prog->fielddefs + i;
+	while (header.num_edicts > prog->max_edicts)
+		PRVM_MEM_IncreaseEdicts(prog);
+	for (entnum = 0;entnum < header.num_edicts;entnum++)
+	{
+		v = fieldsdata + (size_t)entnum * prog->entityfields;
+		ent = PRVM_EDICT_NUM(entnum);
+		memset(ent->fields.fp, 0, prog->entityfields * sizeof(prvm_vec_t));
+		PRVM_ED_FieldIndexTouch(prog, entnum, -1);
+		ent->priv.server->free = false;
+
+		n = 0;
+		if (!freeflags[entnum])
+		{
+			for (i = 0;i < numfields;i++)
+			{
+				d = fields[i];
+				type = d->type & ~DEF_SAVEGLOBAL;
+				k = type == ev_vector ? 3 : 1;
+				for (j = 0;j < k;j++)
+					if (((const prvm_eval_t *)(v + d->ofs + j))->_int)
+						break;
+				if (j == k)
+					continue;
+				n++;
+				// PRVM_ED_ParseEdict discards keys starting with _
+				if (PRVM_GetString(prog, d->s_name)[0] == '_')
+					continue;
+				val = (prvm_eval_t *)(ent->fields.fp + d->ofs);
+				memcpy(val, v + d->ofs, k * sizeof(prvm_vec_t));
+				if (type == ev_string)
+				{
+					const char *str = SAVEBINARY_STRING(val->_int);
+					val->string = PRVM_AllocString(prog, strlen(str) + 1, &s);
+					memcpy(s, str, strlen(str) + 1);
+				}
+				else if (type == ev_entity)
+				{
+					if ((unsigned int)val->edict >= (unsigned int)prog->limit_edicts)
+						val->edict = 0;
+					while (val->edict >= prog->max_edicts)
+					{
+						PRVM_MEM_IncreaseEdicts(prog);
+						ent = PRVM_EDICT_NUM(entnum);
+						val = (prvm_eval_t *)(ent->fields.fp + d->ofs);
+					}
+				}
+			}
+		}
+
+		// an edict without any saved field loads as free, like in a text savegame
+		if (!n)
+			PRVM_ED_ParseEdict(prog, "}", ent);
+		else
+			SV_LinkEdict(ent);
+	}
+	Mem_Free(fields);
+
+	prog->num_edicts = header.num_edicts;
+	sv.time = header.time;
+
+	for (i = 0;i < NUM_SPAWN_PARMS;i++)
+		svs.clients[0].spawn_parms[i] = header.spawn_parms[i];
+
+	memset(sv.lightstyles[0], 0, sizeof(sv.lightstyles));
+	memset(sv.model_precache[0], 0, sizeof(sv.model_precache));
+	memset(sv.sound_precache[0], 0, sizeof(sv.sound_precache));
+	BufStr_Flush(prog);
+
+	for (i = 0;i < header.numlightstyles;i++, ints++)
+	{
+		if (i < MAX_LIGHTSTYLES)
+			strlcpy(sv.lightstyles[i], SAVEBINARY_STRING(*ints), sizeof(sv.lightstyles[i]));
+		else if (*ints)
+			Con_Printf("unsupported lightstyle %i \"%s\"\n", i, SAVEBINARY_STRING(*ints));
+	}
+	for (i = 0;i < header.nummodels;i++, ints += 2)
+	{
+		if (ints[0] > 0 && ints[0] < MAX_MODELS)
+		{
+			strlcpy(sv.model_precache[ints[0]], SAVEBINARY_STRING(ints[1]), sizeof(sv.model_precache[ints[0]]));
+			sv.models[ints[0]] = Mod_ForName (sv.model_precache[ints[0]], true, false, sv.model_precache[ints[0]][0] == '*' ? sv.worldname : NULL);
+		}
+		else
+			Con_Printf("unsupported model %i \"%s\"\n", ints[0], SAVEBINARY_STRING(ints[1]));
+	}
+	for (i = 0;i < header.numsounds;i++, ints += 2)
+	{
+		if (ints[0] > 0 && ints[0] < MAX_SOUNDS)
+			strlcpy(sv.sound_precache[ints[0]], SAVEBINARY_STRING(ints[1]), sizeof(sv.sound_precache[ints[0]]));
+		else
+			Con_Printf("unsupported sound %i \"%s\"\n", ints[0], SAVEBINARY_STRING(ints[1]));
+	}
+	for (i = 0;i + 3 <= header.numbufferints;)
+	{
+		stringbuffer = ints[i] >= 0 ? BufStr_FindCreateReplace(prog, ints[i], STRINGBUFFER_SAVED | ints[i + 1], "string") : NULL;
+		if (!stringbuffer)
+			Con_Printf("failed to create stringbuffer %i\n", ints[i]);
+		n = ints[i + 2];
+		for (i += 3;n > 0 && i + 2 <= header.numbufferints;n--, i += 2)
+			if (stringbuffer)
+				BufStr_Set(prog, stringbuffer, ints[i], SAVEBINARY_STRING(ints[i + 1]));
+	}
+#undef SAVEBINARY_STRING
+
+	return true;
+}
+
+/*
+===============
+SV_Save_Init
+===============
+*/
+void SV_Save_Init(void)
+{
+	Cvar_RegisterVariable (&sv_savegame_binary);
+}
@@ -0,0 +1,11 @@
+#ifndef SV_SAVE_H
+#define SV_SAVE_H
+
+extern cvar_t sv_savegame_binary;
+
+void SV_Save_Init(void);
+void SV_Savegame_Binary(prvm_prog_t *prog, const char *name, const char *comment);
+void SV_Savegame_Binary_Frame(qboolean wait);
+qboolean SV_Loadgame_Binary(prvm_prog_t *prog, const unsigned char *data, fs_offset_t size);
+
+#endif
@@ -1763,6 +1763,7 @@ static void VM_SV_copyentity(prvm_prog_t *prog)
 		return;
 	}
 	memcpy(out->fields.fp, in->fields.fp, prog->entityfields * sizeof(prvm_vec_t));
+	PRVM_ED_FieldIndexTouch(prog, PRVM_NUM_FOR_EDICT(out), -1);
 	SV_LinkEdict(out);
 }
 
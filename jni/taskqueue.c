@@ -0,0 +1,219 @@
+#include "quakedef.h"
+#include "thread.h"
+#include "taskqueue.h"
+
+cvar_t taskqueue_maxthreads = {CVAR_SAVE, "taskqueue_maxthreads", "3", "how many worker threads to use for parallel engine work (0 runs all tasks on the thread that queued them)"};
+
+#define TASKQUEUE_MAXTHREADS 32
+#define TASKQUEUE_MAXQUEUED 4096
+
+typedef struct taskqueue_state_s
+{
+	void *mutex;
+	void *cond_work; // signaled when tasks are queued or threads should exit
+	void *cond_done; // broadcast when a task finishes
+	int numthreads;
+	int wantthreads;
+	void *threads[TASKQUEUE_MAXTHREADS];
+	// ring of queued tasks
+	unsigned int queue_start;
+	unsigned int queue_count;
+	taskqueue_task_t *queue[TASKQUEUE_MAXQUEUED];
+}
+taskqueue_state_t;
+
+static taskqueue_state_t taskqueue_state;
+
+static void TaskQueue_ExecuteTask(taskqueue_task_t *task)
+{
+	task->func(task);
+	if (taskqueue_state.mutex)
+	{
+		Thread_LockMutex(taskqueue_state.mutex);
+		task->done = 1;
+		Thread_CondBroadcast(taskqueue_state.cond_done);
+		Thread_UnlockMutex(taskqueue_state.mutex);
+	}
+	else
+		task->done = 1;
+}
+
+// must be called with the mutex locked, returns NULL if nothing is queued
+static taskqueue_task_t *TaskQueue_Dequeue(void)
+{
+	taskqueue_task_t *task;
+	if (!taskqueue_state.queue_count)
+		return NULL;
+	task = taskqueue_state.queue[taskqueue_state.queue_start];
+	taskqueue_state.queue_start = (taskqueue_state.queue_start + 1) % TASKQUEUE_MAXQUEUED;
+	taskqueue_state.queue_count--;
+	return task;
+}
+
+static int TaskQueue_ThreadFunc(void *d)
+{
+	int index = (int)(size_t)d;
+	taskqueue_task_t *task;
+	Thread_LockMutex(taskqueue_state.mutex);
+	for (;;)
+	{
+		if (index >= taskqueue_state.wantthreads)
+			break;
+		task = TaskQueue_Dequeue();
+		if (!task)
+		{
+			Thread_CondWait(taskqueue_state.cond_work, taskqueue_state.mutex);
+			continue;
+		}
+		Thread_UnlockMutex(taskqueue_state.mutex);
+		TaskQueue_ExecuteTask(task);
+		Thread_LockMutex(taskqueue_state.mutex);
+	}
+	Thread_UnlockMutex(taskqueue_state.mutex);
+	return 0;
+}
+
+void TaskQueue_Enqueue(int numtasks, taskqueue_task_t *tasks)
+{
+	int i;
+	if (!taskqueue_state.numthreads)
+	{
+		// no workers, just do the work now
+		for (i = 0;i < numtasks;i++)
+			TaskQueue_ExecuteTask(tasks + i);
+		return;
+	}
+	Thread_LockMutex(taskqueue_state.mutex);
+	for (i = 0;i < numtasks;i++)
+	{
+		tasks[i].done = 0;
+		if (taskqueue_state.queue_count >= TASKQUEUE_MAXQUEUED)
+		{
+			// queue is full, do this one ourselves
+			Thread_UnlockMutex(taskqueue_state.mutex);
+			TaskQueue_ExecuteTask(tasks + i);
+			Thread_LockMutex(taskqueue_state.mutex);
+			continue;
+		}
+		taskqueue_state.queue[(taskqueue_state.queue_start + taskqueue_state.queue_count) % TASKQUEUE_MAXQUEUED] = tasks + i;
+		taskqueue_state.queue_count++;
+	}
+	Thread_CondBroadcast(taskqueue_state.cond_work);
+	Thread_UnlockMutex(taskqueue_state.mutex);
+}
+
+qboolean TaskQueue_IsDone(taskqueue_task_t *task)
+{
+	int done;
+	if (!taskqueue_state.mutex)
+		return task->done != 0;
+	Thread_LockMutex(taskqueue_state.mutex);
+	done = task->done;
+	Thread_UnlockMutex(taskqueue_state.mutex);
+	return done != 0;
+}
+
+void TaskQueue_WaitForTaskDone(taskqueue_task_t *task)
+{
+	taskqueue_task_t *other;
+	if (!taskqueue_state.mutex)
+		return;
+	Thread_LockMutex(taskqueue_state.mutex);
+	while (!task->done)
+	{
+		// help out rather than sleeping while there is work queued
+		other = TaskQueue_Dequeue();
+		if (other)
+		{
+			Thread_UnlockMutex(taskqueue_state.mutex);
+			TaskQueue_ExecuteTask(other);
+			Thread_LockMutex(taskqueue_state.mutex);
+			continue;
+		}
+		Thread_CondWait(taskqueue_state.cond_done, taskqueue_state.mutex);
+	}
+	Thread_UnlockMutex(taskqueue_state.mutex);
+}
+
+void TaskQueue_Setup(taskqueue_task_t *task, void(*func)(taskqueue_task_t *), size_t i0, size_t i1, void *p0, void *p1)
+{
+	memset(task, 0, sizeof(*task));
+	task->func = func;
+	task->i[0] = i0;
+	task->i[1] = i1;
+	task->p[0] = p0;
+	task->p[1] = p1;
+}
+
+int TaskQueue_NumThreads(void)
+{
+	return taskqueue_state.numthreads + 1;
+}
+
+void TaskQueue_Frame(qboolean shutdown)
+{
+	int i, numthreads;
+	if (!taskqueue_state.mutex)
+		return;
+	numthreads = shutdown ? 0 : bound(0, taskqueue_maxthreads.integer, TASKQUEUE_MAXTHREADS);
+	if (numthreads == taskqueue_state.numthreads)
+		return;
+	Thread_LockMutex(taskqueue_state.mutex);
+	taskqueue_state.wantthreads = numthreads;
+	Thread_CondBroadcast(taskqueue_state.cond_work);
+	Thread_UnlockMutex(taskqueue_state.mutex);
+	// stop the threads we no longer want (they finish their current task first)
+	for (i = taskqueue_state.numthreads - 1;i >= numthreads;i--)
+	{
+		Thread_WaitThread(taskqueue_state.threads[i], 0);
+		taskqueue_state.threads[i] = NULL;
+	}
+	for (i = taskqueue_state.numthreads;i < numthreads;i++)
+	{
+		taskqueue_state.threads[i] = Thread_CreateThread(TaskQueue_ThreadFunc, (void *)(size_t)i);
+		if (!taskqueue_state.threads[i])
+		{
+			Con_Printf("TaskQueue_Frame: failed to create worker thread %i\n", i);
+			Thread_LockMutex(taskqueue_state.mutex);
+			taskqueue_state.wantthreads = i;
+			Thread_UnlockMutex(taskqueue_state.mutex);
+			numthreads = i;
+			break;
+		}
+	}
+	taskqueue_state.numthreads = numthreads;
+	// anything left in the queue when shrinking to zero threads is done here
+	if (!numthreads)
+	{
+		taskqueue_task_t *task;
+		Thread_LockMutex(taskqueue_state.mutex);
+		while ((task = TaskQueue_Dequeue()))
+		{
+			Thread_UnlockMutex(taskqueue_state.mutex);
+			TaskQueue_ExecuteTask(task);
+			Thread_LockMutex(taskqueue_state.mutex);
+		}
+		Thread_UnlockMutex(taskqueue_state.mutex);
+	}
+}
+
+void TaskQueue_Init(void)
+{
+	Cvar_RegisterVariable(&taskqueue_maxthreads);
+	if (!Thread_HasThreads())
+		return;
+	taskqueue_state.mutex = Thread_CreateMutex();
+	taskqueue_state.cond_work = Thread_CreateCond();
+	taskqueue_state.cond_done = Thread_CreateCond();
+}
+
+void TaskQueue_Shutdown(void)
+{
+	if (!taskqueue_state.mutex)
+		return;
+	TaskQueue_Frame(true);
+	Thread_DestroyCond(taskqueue_state.cond_done);
+	Thread_DestroyCond(taskqueue_state.cond_work);
+	Thread_DestroyMutex(taskqueue_state.mutex);
+	memset(&taskqueue_state, 0, sizeof(taskqueue_state));
+}
@@ -0,0 +1,34 @@
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include "qtypes.h"
+
+typedef struct taskqueue_task_s
+{
+	// function to call, and parameters for it to use
+	void(*func)(struct taskqueue_task_s *task);
+	void *p[2];
+	size_t i[2];
+
+	// set by the worker when func has returned, only read through TaskQueue_IsDone / TaskQueue_WaitForTaskDone
+	volatile int done;
+}
+taskqueue_task_t;
+
+// queue the tasks to be executed by the worker threads (or the calling thread if there are none)
+void TaskQueue_Enqueue(int numtasks, taskqueue_task_t *tasks);
+// returns true if the task has finished
+qboolean TaskQueue_IsDone(taskqueue_task_t *task);
+// waits for the task to finish, running queued tasks on this thread meanwhile
+void TaskQueue_WaitForTaskDone(taskqueue_task_t *task);
+// convenience function for setting up a task structure before queuing it
+void TaskQueue_Setup(taskqueue_task_t *task, void(*func)(taskqueue_task_t *), size_t i0, size_t i1, void *p0, void *p1);
+// number of threads executing tasks (including the calling thread), useful for deciding how to split work
+int TaskQueue_NumThreads(void);
+
+// called once per host frame to adjust the number of worker threads
+void TaskQueue_Frame(qboolean shutdown);
+void TaskQueue_Init(void);
+void TaskQueue_Shutdown(void);
+
+#endif
@@ -74,6 +74,7 @@ typedef struct viddef_support_s
 	qboolean ext_texture_filter_anisotropic;
 	qboolean ext_texture_srgb;
 	qboolean arb_multisample;
+	qboolean arb_instanced_arrays; // glVertexAttribDivisor and glDrawElementsInstanced (GLES3)
 }
 viddef_support_t;
 
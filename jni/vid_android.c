@@ -208,6 +208,8 @@ void GLES_Init(void)
 	vid.support.ext_texture_edge_clamp = true;
 	vid.support.ext_texture_filter_anisotropic = false; // probably don't want to use it...
 	vid.support.ext_texture_srgb = false;
+	// instancing is core in GLES3, the GLES2 headers just don't declare it
+	vid.support.arb_instanced_arrays = gl_version && strstr(gl_version, "OpenGL ES 3") != NULL;
 
 	qglGetIntegerv(GL_MAX_TEXTURE_SIZE, (GLint*)&vid.maxtexturesize_2d);
 	if (vid.support.ext_texture_filter_anisotropic)